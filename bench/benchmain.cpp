@@ -0,0 +1,470 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "srvgenerator.h"
+#include "wallssurveyparser.h"
+#include "wallsprojectparser.h"
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#if defined(__GLIBC__)
+// Count every allocation in the process by interposing malloc.  Qt's containers and strings
+// allocate with malloc rather than operator new, and libstdc++'s operator new calls malloc, so
+// this sees both, in the dewalls library as well as here.
+static std::atomic<quint64> allocationCount(0);
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void __libc_free(void* p);
+
+void* malloc(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+}
+
+void free(void* p)
+{
+    __libc_free(p);
+}
+
+} // extern "C"
+#else
+// Elsewhere malloc can't be interposed portably, so only operator new is counted, which misses
+// Qt's containers and strings.  On Mach-O this replaces operator new for the dewalls library
+// too; on Windows the DLL has its own, so only allocations made here are counted.
+static std::atomic<quint64> allocationCount(0);
+
+void* operator new(std::size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* p = std::malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+#endif
+
+using namespace dewalls;
+
+namespace {
+
+#if defined(Q_OS_LINUX)
+///
+/// \return the given field of /proc/self/status, in bytes, or -1 if it isn't there
+///
+qint64 procStatusBytes(const char* field)
+{
+    QFile status("/proc/self/status");
+    if (!status.open(QFile::ReadOnly))
+    {
+        return -1;
+    }
+    foreach (QByteArray line, status.readAll().split('\n'))
+    {
+        if (line.startsWith(field))
+        {
+            // e.g. "VmHWM:     12345 kB"
+            QByteArray kilobytes = line.mid(qstrlen(field)).trimmed();
+            kilobytes.chop(2);
+            return kilobytes.trimmed().toLongLong() * 1024;
+        }
+    }
+    return -1;
+}
+#endif
+
+///
+/// \brief restarts peakRss() from the current RSS, so that it covers a single benchmark
+/// \return false if the platform can't do that, and peakRss() is the peak of the whole process
+///
+bool resetPeakRss()
+{
+#if defined(Q_OS_LINUX)
+    QFile clearRefs("/proc/self/clear_refs");
+    return clearRefs.open(QFile::WriteOnly) && clearRefs.write("5") == 1;
+#else
+    return false;
+#endif
+}
+
+qint64 currentRss()
+{
+#if defined(Q_OS_LINUX)
+    return procStatusBytes("VmRSS:");
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return qint64(counters.WorkingSetSize);
+    }
+    return -1;
+#else
+    return -1;
+#endif
+}
+
+qint64 peakRss()
+{
+#if defined(Q_OS_LINUX)
+    return procStatusBytes("VmHWM:");
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return qint64(counters.PeakWorkingSetSize);
+    }
+    return -1;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage))
+    {
+        return -1;
+    }
+#if defined(Q_OS_MACOS)
+    return qint64(usage.ru_maxrss);
+#else
+    return qint64(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+struct Result {
+    QString name;
+    qint64 lines = 0;
+    qint64 shots = 0;
+    qint64 bytes = 0;
+    qint64 nanos = 0;
+    quint64 allocations = 0;
+    // how far RSS rose above where it was when the benchmark started, or -1 if unknown
+    qint64 rssGrowth = -1;
+};
+
+///
+/// \brief measures how far a benchmark raises RSS above where it was when it started
+///
+class RssGrowth
+{
+public:
+    RssGrowth()
+        : _perBenchmark(resetPeakRss()),
+          _start(currentRss())
+    {
+    }
+
+    qint64 get() const
+    {
+        qint64 peak = peakRss();
+        return _perBenchmark && _start >= 0 && peak >= 0 ? qMax(qint64(0), peak - _start) : -1;
+    }
+
+private:
+    bool _perBenchmark;
+    qint64 _start;
+};
+
+QList<QByteArray> splitLines(const QByteArray& data)
+{
+    QList<QByteArray> lines = data.split('\n');
+    if (!lines.isEmpty() && lines.last().isEmpty())
+    {
+        lines.removeLast();
+    }
+    for (QByteArray& line : lines)
+    {
+        if (line.endsWith('\r'))
+        {
+            line.chop(1);
+        }
+    }
+    return lines;
+}
+
+///
+/// \brief parses the given file contents the way the converter does
+///
+Result benchmarkSurvey(QString name, const QByteArray& data, int repeat, bool fastPath,
+                       WallsSurveyParser::Events events)
+{
+    RssGrowth rssGrowth;
+    Result best;
+    best.name = name;
+    for (int r = 0; r < repeat; r++)
+    {
+        Result result;
+        result.name = name;
+        result.bytes = data.size();
+
+        WallsSurveyParser parser;
+        parser.setErrorRecovery(true);
+        parser.setFastPathEnabled(fastPath);
+        parser.setEvents(events);
+        QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector) { result.shots++; });
+
+        quint64 allocationsBefore = allocationCount.load();
+        QElapsedTimer timer;
+        timer.start();
+
+        result.lines = parser.parseBuffer(data, name);
+
+        result.nanos = timer.nsecsElapsed();
+        result.allocations = allocationCount.load() - allocationsBefore;
+        if (r == 0 || result.nanos < best.nanos)
+        {
+            best = result;
+        }
+    }
+    best.rssGrowth = rssGrowth.get();
+    return best;
+}
+
+Result benchmarkProject(QString name, QString fileName, int repeat)
+{
+    QFile file(fileName);
+    qint64 bytes = file.size();
+    int lines = 0;
+    if (file.open(QFile::ReadOnly))
+    {
+        lines = splitLines(file.readAll()).size();
+    }
+
+    RssGrowth rssGrowth;
+    Result best;
+    best.name = name;
+    for (int r = 0; r < repeat; r++)
+    {
+        Result result;
+        result.name = name;
+        result.bytes = bytes;
+        result.lines = lines;
+
+        quint64 allocationsBefore = allocationCount.load();
+        QElapsedTimer timer;
+        timer.start();
+
+        WallsProjectParser parser;
+        WpjBookPtr root = parser.parseFile(fileName);
+
+        result.nanos = timer.nsecsElapsed();
+        result.allocations = allocationCount.load() - allocationsBefore;
+        if (root.isNull())
+        {
+            result.lines = 0;
+        }
+        if (r == 0 || result.nanos < best.nanos)
+        {
+            best = result;
+        }
+    }
+    best.rssGrowth = rssGrowth.get();
+    return best;
+}
+
+void printHeader(QTextStream& out)
+{
+    out << qSetFieldWidth(24) << left << "benchmark" << qSetFieldWidth(12) << right
+        << "lines" << "shots" << "MB/s" << "lines/s" << "shots/s" << "allocs/line" << "RSS +MB"
+        << qSetFieldWidth(0) << "\n";
+}
+
+void printResult(QTextStream& out, const Result& result)
+{
+    double seconds = result.nanos / 1e9;
+    out << qSetFieldWidth(24) << left << result.name << qSetFieldWidth(12) << right
+        << result.lines
+        << result.shots
+        << QString::number(result.bytes / 1e6 / seconds, 'f', 2)
+        << QString::number(result.lines / seconds, 'f', 0)
+        << QString::number(result.shots / seconds, 'f', 0)
+        << QString::number(result.lines ? double(result.allocations) / result.lines : 0.0, 'f', 1)
+        << (result.rssGrowth >= 0 ? QString::number(result.rssGrowth / 1e6, 'f', 1) : QString("n/a"))
+        << qSetFieldWidth(0) << "\n";
+    out.flush();
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("dewalls-bench");
+
+    QCommandLineParser options;
+    options.setApplicationDescription("Measures dewalls parser throughput on synthetic and real data.");
+    options.addHelpOption();
+    options.addPositionalArgument("files", "additional .SRV or .WPJ files to benchmark", "[files...]");
+
+    QCommandLineOption linesOption(QStringList() << "n" << "lines", "lines per synthetic file (default: 100000)", "N", "100000");
+    QCommandLineOption repeatOption(QStringList() << "r" << "repeat", "runs per benchmark; the fastest is reported (default: 3)", "N", "3");
+    QCommandLineOption seedOption("seed", "seed for the synthetic files (default: 1)", "N", "1");
+    QCommandLineOption filterOption(QStringList() << "f" << "filter", "only run benchmarks whose names contain this", "text");
+    options.addOption(linesOption);
+    options.addOption(repeatOption);
+    options.addOption(seedOption);
+    QCommandLineOption noFastPathOption("no-fast-path", "decode every vector line with the full grammar");
+    options.addOption(filterOption);
+    QCommandLineOption lintOption("lint", "parse .SRV files in lint mode (messages only)");
+    QCommandLineOption shotsOnlyOption("shots-only", "only build shots, without comments, LRUDs or variance overrides");
+    options.addOption(noFastPathOption);
+    options.addOption(lintOption);
+    options.addOption(shotsOnlyOption);
+    options.process(app);
+
+    int lineCount = qMax(1, options.value(linesOption).toInt());
+    int repeat = qMax(1, options.value(repeatOption).toInt());
+    quint32 seed = options.value(seedOption).toUInt();
+    QString filter = options.value(filterOption);
+    bool fastPath = !options.isSet(noFastPathOption);
+    WallsSurveyParser::Events events = WallsSurveyParser::AllEvents;
+    if (options.isSet(lintOption))
+    {
+        events = WallsSurveyParser::NoEvents;
+    }
+    else if (options.isSet(shotsOnlyOption))
+    {
+        events = WallsSurveyParser::VectorEvents;
+    }
+
+    auto synthetic = [&](SrvGeneratorOptions::Mode mode) {
+        SrvGeneratorOptions generatorOptions;
+        generatorOptions.seed = seed;
+        generatorOptions.lineCount = lineCount;
+        generatorOptions.mode = mode;
+        return generatorOptions;
+    };
+
+    QList<QPair<QString, SrvGeneratorOptions>> scenarios;
+
+    SrvGeneratorOptions ct = synthetic(SrvGeneratorOptions::Compass);
+    ct.lrudRatio = 0;
+    ct.commentRatio = 0;
+    ct.unitsRatio = 0;
+    scenarios << qMakePair(QString("srv/ct-plain"), ct);
+
+    SrvGeneratorOptions ctLruds = synthetic(SrvGeneratorOptions::Compass);
+    ctLruds.lrudRatio = 1;
+    ctLruds.backsightRatio = 0.5;
+    scenarios << qMakePair(QString("srv/ct-lruds-backsights"), ctLruds);
+
+    SrvGeneratorOptions rect = synthetic(SrvGeneratorOptions::Rect);
+    scenarios << qMakePair(QString("srv/rect"), rect);
+
+    SrvGeneratorOptions churn = synthetic(SrvGeneratorOptions::Mixed);
+    churn.unitSuffixRatio = 0.3;
+    churn.unitsRatio = 0.2;
+    scenarios << qMakePair(QString("srv/units-churn"), churn);
+
+    SrvGeneratorOptions macros = synthetic(SrvGeneratorOptions::Compass);
+    macros.macros = true;
+    macros.unitsRatio = 0.1;
+    scenarios << qMakePair(QString("srv/macros"), macros);
+
+    SrvGeneratorOptions comments = synthetic(SrvGeneratorOptions::Compass);
+    comments.commentRatio = 0.5;
+    scenarios << qMakePair(QString("srv/comments"), comments);
+
+    QTextStream out(stdout);
+    printHeader(out);
+
+    for (auto scenario : scenarios)
+    {
+        if (!scenario.first.contains(filter))
+        {
+            continue;
+        }
+        SrvGenerator generator(scenario.second);
+        QByteArray data = generator.generate();
+        printResult(out, benchmarkSurvey(scenario.first, data, repeat, fastPath, events));
+    }
+
+    QString fixture(":/test/Kaua North Maze.wpj");
+    if (QString("wpj/kaua-north-maze").contains(filter))
+    {
+        printResult(out, benchmarkProject("wpj/kaua-north-maze", fixture, repeat));
+    }
+
+    foreach (QString fileName, options.positionalArguments())
+    {
+        if (!fileName.contains(filter))
+        {
+            continue;
+        }
+        if (fileName.endsWith(".wpj", Qt::CaseInsensitive))
+        {
+            printResult(out, benchmarkProject(fileName, fileName, repeat));
+            continue;
+        }
+        QFile file(fileName);
+        if (!file.open(QFile::ReadOnly))
+        {
+            QTextStream(stderr) << "I couldn't open " << fileName << endl;
+            continue;
+        }
+        printResult(out, benchmarkSurvey(fileName, file.readAll(), repeat, fastPath, events));
+    }
+
+    return 0;
+}
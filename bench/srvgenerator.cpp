@@ -0,0 +1,244 @@
+#include "srvgenerator.h"
+
+namespace dewalls {
+
+SrvGeneratorOptions::SrvGeneratorOptions()
+    : seed(1),
+      lineCount(10000),
+      mode(Compass),
+      unitSuffixRatio(0.0),
+      lrudRatio(0.5),
+      backsightRatio(0.0),
+      commentRatio(0.05),
+      unitsRatio(0.01),
+      macros(false)
+{
+
+}
+
+SrvGenerator::SrvGenerator(SrvGeneratorOptions options)
+    : _options(options),
+      _state(0),
+      _vectorCount(0),
+      _stationCount(0),
+      _rect(false),
+      _rectStack()
+{
+
+}
+
+quint32 SrvGenerator::next()
+{
+    // xorshift32; quality is plenty for test data and it's the same on every platform
+    _state ^= _state << 13;
+    _state ^= _state >> 17;
+    _state ^= _state << 5;
+    return _state;
+}
+
+double SrvGenerator::uniform(double min, double max)
+{
+    return min + (max - min) * (next() / 4294967296.0);
+}
+
+bool SrvGenerator::chance(double probability)
+{
+    return probability > 0 && uniform(0, 1) < probability;
+}
+
+QString SrvGenerator::number(double value, int decimals)
+{
+    return QString::number(value, 'f', decimals);
+}
+
+QString SrvGenerator::length(double value)
+{
+    QString result = number(value, 2);
+    if (chance(_options.unitSuffixRatio))
+    {
+        result += chance(0.5) ? 'f' : 'm';
+    }
+    return result;
+}
+
+QString SrvGenerator::azimuth(double value)
+{
+    // any azimuth in degrees is also in range for grads
+    QString result = number(value, 1);
+    if (chance(_options.unitSuffixRatio))
+    {
+        result += chance(0.5) ? 'd' : 'g';
+    }
+    return result;
+}
+
+QString SrvGenerator::inclination(double value)
+{
+    QString result = number(value, 1);
+    if (value >= 0)
+    {
+        result.prepend('+');
+    }
+    if (chance(_options.unitSuffixRatio))
+    {
+        result += chance(0.5) ? 'd' : 'g';
+    }
+    return result;
+}
+
+QString SrvGenerator::comment()
+{
+    static const char* const words[] = {
+        "crawl", "breakdown", "mud", "flowstone", "pit", "squeeze", "lead", "dome"
+    };
+    return QString(";%1 %2").arg(words[next() % 8]).arg(next() % 1000);
+}
+
+QString SrvGenerator::vectorLine()
+{
+    _vectorCount++;
+
+    // mostly continue the traverse, sometimes branch off of an earlier station
+    int from = _stationCount == 0 || chance(0.9) ? _stationCount : int(next() % quint32(_stationCount));
+    int to = ++_stationCount;
+
+    QString line = QString("S%1 S%2 ").arg(from).arg(to);
+
+    if (_rect)
+    {
+        line += length(uniform(-15, 15)) + ' ' + length(uniform(-15, 15)) + ' ' + length(uniform(-5, 5));
+    }
+    else
+    {
+        double azm = uniform(0, 359.9);
+        double inc = uniform(-60, 60);
+        line += length(uniform(0.5, 30)) + ' ';
+        if (chance(_options.backsightRatio))
+        {
+            double bsAzm = azm < 180 ? azm + 180 : azm - 180;
+            line += azimuth(azm) + '/' + azimuth(bsAzm) + ' ' + inclination(inc) + '/' + inclination(-inc);
+        }
+        else
+        {
+            line += azimuth(azm) + ' ' + inclination(inc);
+        }
+    }
+
+    if (chance(_options.lrudRatio))
+    {
+        if (chance(0.5))
+        {
+            line += QString(" *%1 %2 %3 %4*")
+                    .arg(number(uniform(0, 5), 1), number(uniform(0, 5), 1),
+                         number(uniform(0, 3), 1), number(uniform(0, 3), 1));
+        }
+        else
+        {
+            line += QString(" <%1,%2,%3,%4>")
+                    .arg(number(uniform(0, 5), 1), number(uniform(0, 5), 1),
+                         number(uniform(0, 3), 1), number(uniform(0, 3), 1));
+        }
+    }
+
+    if (chance(_options.commentRatio / 2))
+    {
+        line += ' ' + comment();
+    }
+    return line;
+}
+
+QString SrvGenerator::unitsLine()
+{
+    if (_options.mode == SrvGeneratorOptions::Mixed && chance(0.2))
+    {
+        _rect = !_rect;
+        return _rect ? "#units rect" : "#units ct";
+    }
+    if (_options.macros && chance(0.3))
+    {
+        return chance(0.5) ? "#units $(imperial)" : "#units $(metric)";
+    }
+
+    switch (next() % 8)
+    {
+    case 0:
+        return "#units feet";
+    case 1:
+        return "#units meters";
+    case 2:
+        return QString("#units decl=%1").arg(number(uniform(-10, 10), 1));
+    case 3:
+        return chance(0.5) ? "#units a=grads" : "#units a=degrees";
+    case 4:
+        return chance(0.5) ? "#units v=grads" : "#units v=degrees";
+    case 5:
+        return QString("#units incd=%1 inca=%2").arg(number(uniform(-0.2, 0.2), 2), number(uniform(-1, 1), 1));
+    case 6:
+        if (_rectStack.size() < 5)
+        {
+            // the saved units include the vector type
+            _rectStack.push(_rect);
+            return "#units save";
+        }
+        // fall through
+    default:
+        if (!_rectStack.isEmpty())
+        {
+            _rect = _rectStack.pop();
+            return "#units restore";
+        }
+        return "#units lrud=from";
+    }
+}
+
+QStringList SrvGenerator::generateLines()
+{
+    _state = _options.seed ? _options.seed : 1;
+    _vectorCount = 0;
+    _stationCount = 0;
+    _rectStack.clear();
+    _rect = _options.mode == SrvGeneratorOptions::Rect;
+
+    QStringList lines;
+    lines << QString(";synthetic survey, seed %1").arg(_options.seed);
+    lines << "#date 2015-06-12";
+    if (_rect)
+    {
+        lines << "#units rect";
+    }
+    if (_options.macros)
+    {
+        lines << "#units $imperial=\"feet decl=1.5\" $metric=\"meters decl=0\"";
+    }
+
+    while (lines.size() < _options.lineCount)
+    {
+        double r = uniform(0, 1);
+        if (r < _options.commentRatio / 2)
+        {
+            lines << comment();
+        }
+        else if (r < _options.commentRatio / 2 + _options.unitsRatio)
+        {
+            lines << unitsLine();
+        }
+        else
+        {
+            lines << vectorLine();
+        }
+    }
+    return lines;
+}
+
+QByteArray SrvGenerator::generate()
+{
+    QByteArray result;
+    foreach (QString line, generateLines())
+    {
+        result += line.toLatin1();
+        result += "\r\n";
+    }
+    return result;
+}
+
+} // namespace dewalls
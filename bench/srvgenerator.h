@@ -0,0 +1,92 @@
+#ifndef DEWALLS_SRVGENERATOR_H
+#define DEWALLS_SRVGENERATOR_H
+
+#include <QByteArray>
+#include <QStack>
+#include <QString>
+#include <QStringList>
+
+namespace dewalls {
+
+///
+/// \brief options for generating synthetic .SRV files.  Ratios are probabilities (0 to 1) per
+/// line or per vector.
+///
+struct SrvGeneratorOptions {
+    enum Mode {
+        // compass and tape vectors
+        Compass,
+        // rectangular (east north up) vectors
+        Rect,
+        // switches between compass and rect with #units ct/rect
+        Mixed
+    };
+
+    SrvGeneratorOptions();
+
+    quint32 seed;
+    int lineCount;
+    Mode mode;
+    // fraction of measurements with explicit unit suffixes (e.g. 12.5f, 120.5g)
+    double unitSuffixRatio;
+    // fraction of vectors with LRUDs
+    double lrudRatio;
+    // fraction of compass vectors with backsights
+    double backsightRatio;
+    // fraction of lines that are comments; half of them are inline comments after vectors
+    double commentRatio;
+    // fraction of lines that are #units directives
+    double unitsRatio;
+    // define macros at the top of the file and use them in #units directives
+    bool macros;
+};
+
+///
+/// \brief generates deterministic synthetic .SRV files for benchmarks and differential tests.
+/// The same options (including the seed) always produce the same file.
+///
+class SrvGenerator
+{
+public:
+    SrvGenerator(SrvGeneratorOptions options);
+
+    ///
+    /// \return the lines of the file (without line endings)
+    ///
+    QStringList generateLines();
+    ///
+    /// \return the file contents, with CRLF line endings like Walls writes
+    ///
+    QByteArray generate();
+
+    ///
+    /// \return the number of vector lines in the last generated file
+    ///
+    inline int vectorCount() const { return _vectorCount; }
+
+private:
+    quint32 next();
+    double uniform(double min, double max);
+    bool chance(double probability);
+
+    QString number(double value, int decimals);
+    QString length(double value);
+    QString azimuth(double value);
+    QString inclination(double value);
+
+    QString vectorLine();
+    QString unitsLine();
+    QString comment();
+
+    SrvGeneratorOptions _options;
+    quint32 _state;
+    int _vectorCount;
+    int _stationCount;
+    bool _rect;
+    // whether each #units save'd set of units was rect
+    QStack<bool> _rectStack;
+};
+
+} // namespace dewalls
+
+#endif // DEWALLS_SRVGENERATOR_H
@@ -1,345 +1,396 @@
-#include <iostream>
-#include "unit.h"
-#include "unittype.h"
-#include "length.h"
-#include "angle.h"
-#include "defaultunit.h"
-#include "unitizeddouble.h"
-#include "unitizedmath.h"
-#include <string>
-#include "segment.h"
-#include <QRegExp>
-#include <QHash>
-#include <QChar>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
 #include <cmath>
-#include "lineparser.h"
-#include "varianceoverride.h"
-#include "wallsvisitor.h"
-#include "cardinaldirection.h"
 #include "wallssurveyparser.h"
+#include "wallsprojectparser.h"
+#include "compiledmodel.h"
+#include "projectpipeline.h"
 
-using namespace std;
 using namespace dewalls;
-template <typename T>
 
-void func(T t)
+typedef UnitizedDouble<Length> ULength;
+typedef UnitizedDouble<Angle> UAngle;
+
+namespace {
+
+QString number(double value, int precision)
 {
-    std::cout << t << std::endl ;
+    return std::isnan(value) ? QString() : QString::number(value, 'f', precision);
 }
 
-template<typename T, typename... Args>
-void func(T t, Args... args) // recursive variadic function
+QString meters(ULength length)
 {
-    std::cout << t <<std::endl ;
-
-    func(args...) ;
+    return length.isValid() ? number(length.get(Length::Meters), 3) : QString();
 }
 
-void quadrantTest()
+QString degrees(UAngle angle)
 {
-    using namespace CardinalDirection;
-
-    cout << quadrant(East, North, UnitizedDouble<Angle>(110.0, Angle::Degrees)) << endl;
+    return angle.isValid() ? number(angle.get(Angle::Degrees), 3) : QString();
 }
 
-void parseLine(WallsSurveyParser& parser, QString line)
+QString csvField(QString value)
 {
-    static int lineNumber = 1;
-
-    std::cout << std::endl << std::endl << line.toStdString() << std::endl;
-
-    parser.reset(Segment(line, "fakefile.txt", lineNumber++, 0));
-
-    try
+    if (value.contains(',') || value.contains('"') || value.contains('\n'))
     {
-        parser.parseLine();
+        return '"' + QString(value).replace("\"", "\"\"") + '"';
     }
-    catch (const SegmentParseExpectedException& ex)
-    {
-        cout << ex.message().toStdString() << endl;
-    }
-    catch (const SegmentParseException& ex)
+    return value;
+}
+
+///
+/// \return the full name of a station, with the #prefix and #units case it was parsed with
+///
+QString stationName(const WallsUnits& units, QString name)
+{
+    return name.isEmpty() ? name : units.processStationName(name);
+}
+
+void writeText(QTextStream& out, const QList<ParsedSurvey>& results)
+{
+    foreach (const ParsedSurvey& result, results)
     {
-        cout << ex.message().toStdString() << endl;
+        out << "; " << result.fileName << "\n";
+        foreach (const Vector& vector, result.vectors)
+        {
+            WallsUnits units = vector.units();
+            out << stationName(units, vector.from()) << "\t" << stationName(units, vector.to())
+                << "\t" << meters(vector.distance())
+                << "\t" << degrees(vector.frontAzimuth()) << "/" << degrees(vector.backAzimuth())
+                << "\t" << degrees(vector.frontInclination()) << "/" << degrees(vector.backInclination())
+                << "\n";
+        }
+        foreach (FixStation station, result.fixStations)
+        {
+            out << "#fix " << stationName(station.units(), station.name())
+                << "\t" << meters(station.east())
+                << "\t" << meters(station.north())
+                << "\t" << meters(station.rectUp())
+                << "\n";
+        }
     }
 }
 
-QString toString(QHash<QString, QString> h)
+void writeCsv(QTextStream& out, const QList<ParsedSurvey>& results)
 {
-    QString result('[');
-    foreach(QString key, h.keys())
+    out << "file,line,segment,from,to,distance_m,fs_azimuth_deg,bs_azimuth_deg,"
+           "fs_inclination_deg,bs_inclination_deg,north_m,east_m,rect_up_m,"
+           "left_m,right_m,up_m,down_m,date,comment\n";
+    foreach (const ParsedSurvey& result, results)
     {
-        if (result.length() > 1) {
-            result += ", ";
+        foreach (const Vector& vector, result.vectors)
+        {
+            WallsUnits units = vector.units();
+            QStringList fields;
+            fields << result.fileName
+                   << QString::number(vector.sourceSegment().startLine() + 1)
+                   << vector.segment().join('/')
+                   << stationName(units, vector.from())
+                   << stationName(units, vector.to())
+                   << meters(vector.distance())
+                   << degrees(vector.frontAzimuth())
+                   << degrees(vector.backAzimuth())
+                   << degrees(vector.frontInclination())
+                   << degrees(vector.backInclination())
+                   << meters(vector.north())
+                   << meters(vector.east())
+                   << meters(vector.rectUp())
+                   << meters(vector.left())
+                   << meters(vector.right())
+                   << meters(vector.up())
+                   << meters(vector.down())
+                   << vector.date().toString(Qt::ISODate)
+                   << vector.comment();
+            for (int i = 0; i < fields.size(); i++)
+            {
+                out << (i ? "," : "") << csvField(fields[i]);
+            }
+            out << "\n";
         }
-        result += QString("%1 => %2").arg(key, h[key]);
     }
-    return result + ']';
 }
 
-int main(int argc, char *argv[]) {
-    Length::init();
-    Angle::init();
-
-    if (argc < 2) {
-        cout << "Usage: dewalls <.srv file>" << endl;
-        return 0;
+bool writeModel(QString fileName, const QList<ParsedSurvey>& results)
+{
+    CompiledModelWriter writer;
+    foreach (const ParsedSurvey& result, results)
+    {
+        foreach (const Vector& vector, result.vectors)
+        {
+            writer.addVector(vector);
+        }
+        foreach (const FixStation& station, result.fixStations)
+        {
+            writer.addFixStation(station);
+        }
     }
+    return writer.write(fileName);
+}
 
-    QString filename = QString::fromLatin1(argv[1]);
+double millis(qint64 nanos)
+{
+    return nanos / 1e6;
+}
 
-    cout << "Parsing file: " << filename.toStdString() << endl;
+} // anonymous namespace
 
-    QFile file(filename);
-    file.open(QFile::ReadOnly);
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("dewalls");
+
+    QCommandLineParser options;
+    options.setApplicationDescription("Parses Walls projects and survey files and converts them to other formats.");
+    options.addHelpOption();
+    options.addPositionalArgument("files", "a .WPJ project file, or one or more .SRV files", "<file.wpj | file.srv...>");
+
+    QCommandLineOption jobsOption(QStringList() << "j" << "jobs",
+                                  "number of files to parse in parallel (default: number of cores)",
+                                  "N", QString::number(QThread::idealThreadCount()));
+    QCommandLineOption formatOption(QStringList() << "f" << "format",
+                                    "output format: text, csv or model (default: text)",
+                                    "format", "text");
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                    "output file (default: standard output; required for model)",
+                                    "file");
+    QCommandLineOption statsOption(QStringList() << "s" << "stats",
+                                   "print throughput statistics to standard error");
+    QCommandLineOption quietOption(QStringList() << "q" << "quiet",
+                                   "don't print parser errors and warnings");
+    QCommandLineOption profileOption(QStringList() << "p" << "profile",
+                                     "print per-production parser counters to standard error "
+                                     "(requires a library built with profileProductions)");
+    QCommandLineOption lintOption(QStringList() << "l" << "lint",
+                                  "only check the files for errors and warnings; writes no output");
+    QCommandLineOption igrfOption(QStringList() << "igrf",
+                                  "IGRF coefficient table (e.g. igrf14coeffs.txt) to derive declinations "
+                                  "from #date with before 2020 (the WMM2020 and WMM2025 are built in)",
+                                  "file");
+    options.addOption(jobsOption);
+    options.addOption(formatOption);
+    options.addOption(outputOption);
+    options.addOption(statsOption);
+    options.addOption(quietOption);
+    options.addOption(profileOption);
+    options.addOption(lintOption);
+    options.addOption(igrfOption);
+    options.process(app);
+
+    QTextStream err(stderr);
+
+    QStringList inputs = options.positionalArguments();
+    if (inputs.isEmpty())
+    {
+        options.showHelp(1);
+    }
 
-    WallsSurveyParser parser2;
-    PrintingWallsVisitor printingVisitor;
-    parser2.setVisitor(&printingVisitor);
+    bool jobsOk;
+    int jobCount = options.value(jobsOption).toInt(&jobsOk);
+    if (!jobsOk || jobCount < 1)
+    {
+        err << "invalid --jobs: " << options.value(jobsOption) << endl;
+        return 1;
+    }
 
-    int lineNumber = 0;
-    while (!file.atEnd())
+    QString format = options.value(formatOption).toLower();
+    if (format != "text" && format != "csv" && format != "model")
+    {
+        err << "invalid --format: " << format << endl;
+        return 1;
+    }
+    bool lint = options.isSet(lintOption);
+    if (format == "model" && !lint && !options.isSet(outputOption))
     {
-        QString line = file.readLine();
-        if (file.error() != QFile::NoError)
+        err << "--format model requires --output" << endl;
+        return 1;
+    }
+    bool quiet = options.isSet(quietOption);
+    bool profile = options.isSet(profileOption);
+    if (profile && !ProductionProfile::isCompiledIn())
+    {
+        err << "--profile requires dewalls to be built with profileProductions:true" << endl;
+        return 1;
+    }
+    GeomagneticModelSet geomagneticModels = GeomagneticModelSet::builtin();
+    if (options.isSet(igrfOption))
+    {
+        GeomagneticModelSet igrf = GeomagneticModelSet::fromIgrfFile(options.value(igrfOption));
+        if (igrf.isEmpty())
         {
-            cerr << QString("Error reading from file %1 at line %2: %3")
-                               .arg(filename)
-                               .arg(lineNumber)
-                               .arg(file.errorString()).toStdString() << endl;
+            err << "failed to read --igrf: " << options.value(igrfOption) << endl;
             return 1;
         }
+        geomagneticModels.add(igrf);
+    }
 
-        parser2.reset(Segment(line, filename, lineNumber, 0));
-
-        try
-        {
-            parser2.parseLine();
-        }
-        catch (const SegmentParseExpectedException& ex)
+    QElapsedTimer totalTimer;
+    totalTimer.start();
+
+    int fileCount = 0;
+    int lineCount = 0;
+    int shotCount = 0;
+    int fixCount = 0;
+    int errorCount = 0;
+    int warningCount = 0;
+    int failedFileCount = 0;
+    qint64 byteCount = 0;
+    qint64 readNanos = 0;
+    qint64 parseNanos = 0;
+    ProductionProfile productionProfile;
+    QList<ParsedSurvey> results;
+
+    ProjectPipeline pipeline;
+    pipeline.setParseThreadCount(jobCount);
+    pipeline.setProfileProductions(profile);
+    pipeline.setLintMode(lint);
+    pipeline.setGeomagneticModels(geomagneticModels);
+    pipeline.setReducer([&](ParsedSurvey& result) {
+        productionProfile.merge(result.profile);
+        if (result.opened) fileCount++;
+        lineCount += result.lines;
+        shotCount += result.vectors.size();
+        fixCount += result.fixStations.size();
+        byteCount += result.bytes;
+        readNanos += result.readNanos;
+        parseNanos += result.parseNanos;
+        errorCount += result.errors;
+        if (result.errors) failedFileCount++;
+        results << result;
+    });
+
+    if (inputs.size() == 1 && inputs[0].endsWith(".wpj", Qt::CaseInsensitive))
+    {
+        bool opened = pipeline.run(inputs[0]);
+        foreach (WallsMessage message, pipeline.projectMessages())
         {
-            cerr << ex.message().toStdString() << endl;
-            return 2;
+            if (!quiet) err << message.toString() << endl;
         }
-        catch (const SegmentParseException& ex)
+        if (!opened)
         {
-            cerr << ex.message().toStdString() << endl;
             return 2;
         }
-
-        lineNumber++;
+        errorCount += pipeline.projectErrorCount();
+        if (pipeline.projectErrorCount() > 0) failedFileCount++;
     }
-
-    file.close();
-
-    if (3 > 2) {
-        return 0;
+    else
+    {
+        pipeline.run(inputs);
     }
+    qint64 pipelineNanos = pipeline.wallNanos();
 
-    typedef UnitizedDouble<Length> ULength;
-    typedef UnitizedDouble<Angle> UAngle;
-
-    auto ft = Length::Feet;
-    auto m = Length::Meters;
-
-    auto deg = Angle::Degrees;
-    auto percent = Angle::PercentGrade;
-
-    cout << UAngle(45, deg).get(percent) << endl;
-
-    auto a = ULength(3, ft);
-    auto b = ULength(5, m);
-    auto c = a - b;
-    auto d = new ULength(4, m);
-    cout << -c << endl;
-    cout << a + b + b << endl;
-    cout << a * 3 << endl;
-    cout << 3 * a << endl;
-    cout << a / 3 << endl;
-    cout << 3 / a << endl;
-    cout << a.in(m) * 3 + b / 2 << endl;
-    cout << 3 / *d << endl;
-
-    Segment segment("test\r\none", "", 5, 3);
-    cout << segment.endLine() << endl;
-    cout << segment.endCol() << endl;
-
-    Segment segment2("test\r\n\none\r\n\n\r", "", 5, 3);
-    cout << segment2.endLine() << endl;
-    cout << segment2.endCol() << endl;
-
-    Segment segment3 = Segment("hello\r\nworld", "", 5, 3).mid(2, 4);
-    cout << segment3.startLine() << endl;
-    cout << segment3.startCol() << endl;
-    cout << segment3.endLine() << endl;
-    cout << segment3.endCol() << endl;
-
-    QList<Segment> segs = Segment("this is a   test", "", 5, 3).split("\\s+");
-    for (auto iter = segs.begin(); iter < segs.end(); iter++)
+    // surveys arrive in the order they finished parsing
+    std::sort(results.begin(), results.end(), [](const ParsedSurvey& a, const ParsedSurvey& b) {
+        return a.index < b.index;
+    });
+    foreach (const ParsedSurvey& result, results)
     {
-        cout << *iter << endl;
+        foreach (WallsMessage message, result.messages)
+        {
+            if (message.severity() == "warning") warningCount++;
+            if (!quiet) err << message.toString() << endl;
+        }
     }
 
-    cout << Segment("  \r this should be trimmed    \t\n  ", "", 5, 3).trimmed() << endl;
-
-    cout << Segment("hello\nweird\nworld", "", 2, 0).mid(3, 10).underlineInContext().toStdString() << endl;
-
-    QRegExp rx("he(llo\nwei)rd");
-
-    Segment segment4("hello\nweird\nworld", "", 2, 0);
-
-    indexIn(rx, segment4);
-
-    cout << cap(rx, segment4, 1).underlineInContext().toStdString() << endl;
-
-    WallsSurveyParser parser(Segment("hello weird world", "fakefile.txt", 2, 0));
+    if (errorCount > 0)
+    {
+        foreach (const ParsedSurvey& result, results)
+        {
+            if (!result.errorSummary.isEmpty()) err << result.errorSummary << endl;
+        }
+        err << errorCount << (errorCount == 1 ? " error" : " errors") << " in "
+            << failedFileCount << (failedFileCount == 1 ? " file" : " files") << endl;
+    }
 
-    try {
-        parser.expect("hello ");
-        parser.oneOf([&]() { parser.expect("test"); },
-                     [&]() { parser.expect("blah"); });
+    QElapsedTimer timer;
+    timer.start();
+    bool wrote = true;
+    if (lint)
+    {
+        // nothing was collected to write
     }
-    catch (const SegmentParseException& ex)
+    else if (format == "model")
     {
-        cout << ex.message().toStdString() << endl;
+        wrote = writeModel(options.value(outputOption), results);
     }
-
-    typedef QSharedPointer<VarianceOverride> VarianceOverridePtr;
-
-    VarianceOverridePtr v = VarianceOverridePtr(new RMSError(ULength(4, m)));
-
-    cout << v->toString().toStdString() << endl;
-
-    v.clear();
-
-    v = VarianceOverride::FLOATED_TRAVERSE;
-
-    cout << v->toString().toStdString() << endl;
-
-    quadrantTest();
-
-    parser = WallsSurveyParser(Segment("123.456 -123.456m -123i14.5", "fakefile.txt", 2, 0));
-
-    try {
-        cout << parser.length(Length::Feet) << endl;
-        parser.expect(' ');
-        cout << parser.length(Length::Feet) << endl;
-        parser.expect(' ');
-        cout << parser.length(Length::Feet) << endl;
+    else
+    {
+        QFile outFile;
+        if (options.isSet(outputOption))
+        {
+            outFile.setFileName(options.value(outputOption));
+            wrote = outFile.open(QFile::WriteOnly | QFile::Truncate | QFile::Text);
+        }
+        else
+        {
+            wrote = outFile.open(stdout, QFile::WriteOnly);
+        }
+        if (wrote)
+        {
+            QTextStream out(&outFile);
+            if (format == "csv")
+            {
+                writeCsv(out, results);
+            }
+            else
+            {
+                writeText(out, results);
+            }
+            out.flush();
+            wrote = out.status() == QTextStream::Ok;
+        }
     }
-    catch (const SegmentParseException& ex)
+    qint64 writeNanos = timer.nsecsElapsed();
+    if (!wrote)
     {
-        cout << ex.message().toStdString() << endl;
+        err << "failed to write " << (options.isSet(outputOption) ? options.value(outputOption) : "output") << endl;
     }
 
-    PrintingWallsVisitor visitor;
-    parser.setVisitor(&visitor);
-
-    parseLine(parser, "#units ct feet save lrud=fb:lurd incab=2.3h");
-    parseLine(parser, "A*1 B1 350i4 41 +25/-6 *2, --, 4,5,C*#Seg /some/really/cool segment;4, 5>");
-    parseLine(parser, "A*1 B1 350 N200mW +25 (*) *2, 3, 4,5,C*#Seg blah;4, 5>");
-    parseLine(parser, "#u tape=it");
-    parseLine(parser, "A1 B1 350 41 +25 15 16 (3, 5) <2, 3,4,5 >#Seg blah;4, 5>");
-
-    parseLine( parser , "A*1 B1 350i4 41 +25/-6 *2, --, 4,5,C*#Seg /some/really/cool segment;4, 5>" );
-    parseLine( parser , "A*1 B1 350 41 +25 *2, 3, 4,5,C*#Q /some/really/cool segment;4, 5>" );
-    parseLine( parser , "A*1 B1 350 41 +25 *2, 3 4,5,C*;4, 5>" );
-    parseLine( parser , "A*1 B1 350 41 +25 *2 3 4 5 C*;4, 5>" );
-    parseLine( parser , "A*1 B1 350 41 +25 *2, 3, 4,5,C*#Seg blah;4, 5>" );
-    parseLine( parser , "A*1 B1 350 41:20 +25 (?,) *2, 3, 4,5,C*#Seg blah;4, 5>" );
-    parseLine( parser , "A*1 *2,3,4,5*" );
-    parseLine( parser , "A*1 B1 350 N41gW +25 (*) *2, 3, 4,5,C*#Seg blah;4, 5>" );
-    parseLine( parser , "A*1 B1 350 N41gW +25 ;(*) *2, 3, 4,5,C*#Seg blah;4, 5>" );
-    parseLine( parser , "A*1 B1 350 N41gW +25 (*) *2, 3, 4m,3f,50g,C*#Seg blah;4, 5>" );
-    parseLine( parser , "A*1 B1 350 N200gW +25 (*) *2, 3, 4,5,C*#Seg blah;4, 5>" );
-    parseLine( parser , "A*1 B1 350 N200mS +25 (*) *2, 3, 4,5,C*#Seg blah;4, 5>" );
-    parseLine( parser , "A*1 *2,3,4,*" );
-    parseLine( parser , "A1, <bash <2,3,4,5>" );
-    parseLine( parser , "A1 <bash <2,3,4,5>" );
-    parseLine( parser , "A1 b<ash <2,3,4,5>" );
-    parseLine( parser , "A1 B1 350 41 +25 (3, 5) <2, 3, 4,5> okay>< weird #Seg blah;4, 5>" );
-    parseLine( parser , "A1 B1 350 41 +25 <2, 3, 4,5>#Seg blah;4, 5>" );
-    parseLine( parser , "A1 B1 350 41 +25 (3, 5) <2, 3,4,5 >#Seg blah;4, 5>" );
-    parseLine( parser , "A1 B1 350 41 +25 (3;, 5) <2, 3,4,5 >#Seg blah;4, 5>" );
-    parseLine( parser , "A1 B1 350 41 +25 (3, 5) <2, 3,4,5 *#Seg blah;4, 5>" );
-    parseLine( parser , "A1 B1 350 41 +25 (3, 5) hello <2, 3,4,5 *#Seg blah;4, 5>" );
-
-    parseLine( parser , "#u tape=it" );
-    parseLine( parser , "A1 B1 350 41 +25 15 16 (3, 5) <2, 3,4,5 >#Seg blah;4, 5>" );
-    parseLine( parser , "A1 B1 350 41 +25 15 16 17 (3, 5) <2, 3,4,5 >#Seg blah;4, 5>" );
-
-    parseLine( parser , "   #flag /This is a test" );
-    parseLine( parser , "   #flag AB30 /This is a test" );
-    parseLine( parser , "   #f" );
-    parseLine( parser , "   #f AB30 CY5 /This is a test" );
-    //parseLine( parser , "   #u prefix1=A prefix2=CR case=lower" );
-    parseLine( parser , "   #u prefix1=A case=lower" );
-    parseLine( parser , "  #prefix2 CR    ;test" );
-
-    parseLine( parser , "   #symbol aslkjb;lkj aslkjasdf a; asdflaksjdf" );
-    parseLine( parser , "   #sym ; asdlkfjasldf" );
-
-    parseLine( parser , "    \tA1 B:B1 350 41 +25 15 16 (3, 5) <2, 3,4,5 >#Seg blah;4, 5>" );
-    parseLine( parser , " FR::A1 B:B1 350 41 +25 15 16 (3, 5) <2, 3,4,5 >#Seg blah;4, 5>" );
-    parseLine( parser , "   #seg /hello/world  blah;comment" );
-
-    parseLine( parser , "   #note FR::A1  blah\\n\" hello\\n hello;comment" );
-
-    parseLine( parser , "#date 2015-01-16" );
-    parseLine( parser , "#date 01-16-2005" );
-    parseLine( parser , "#date 01-16-05" );
-    parseLine( parser , "#date 01/16/05" );
-    parseLine( parser , "#date 01/16/1905" );
-
-    parseLine( parser , "  #[ this is a test" );
-    parseLine( parser , "  blah" );
-    parseLine( parser , "  blah" );
-    parseLine( parser , "  #segment /hello/world" );
-    parseLine( parser , "  ;#]" );
-    parseLine( parser , "  #segment /hello/world" );
-    parseLine( parser , "  #]" );
-
-    parseLine( parser , " FR::A1 B:B1 350 41 +25 15 16 (3, 5) <2, 3,4,5 >#Seg blah;4, 5>" );
-
-    parseLine( parser , " #fox" );
-    parseLine( parser , " #fix GPS9 620765 3461243 123 (R5,?) /Bat Cave Entrance" );
-    parseLine( parser , " #FIX A1 W97:43:52.5 N31:16:45 323f /Entrance #s /hello/world;dms with ft elevations" );
-
-    parseLine( parser , "#uNits $hello=\"er=vad order=NUE\"" );
-
-    parseLine( parser , "#u ord$(hello)" );
-
-//    System.out.println( parser.units.ctOrder );
-//    System.out.println( parser.units.rectOrder );
-
-    parseLine( parser , "#u ord$(hel lo)" );
-    parseLine( parser , "#u ord$(hello" );
-
-    parseLine( parser , "#u o=dav" );
-
-    parseLine( parser , "a - 350 20 +5 *1,2,3,4*" );
-    parseLine( parser , "- a 350 20 +5 *1,2,3,4*" );
-
-    ULength la(2, Length::Meters);
-    ULength lb;
-
-    cout << (la + lb) << endl;
-
-    WallsUnits units;
-    units.typeab_corrected = true;
-    units.typevb_corrected = true;
-    units.inch = ULength(1, Length::Inches);
-    units.incv = UAngle(30, Angle::Degrees);
-    units.incd = ULength(1, Length::Feet);
-
-    ULength dist(20, Length::Feet);
-    UAngle fsInc(35, Angle::Degrees);
-    UAngle bsInc(33, Angle::Degrees);
+    if (options.isSet(statsOption))
+    {
+        double seconds = totalTimer.nsecsElapsed() / 1e9;
+        double parseSeconds = pipelineNanos / 1e9;
+        err << "files:      " << fileCount << " of " << pipeline.surveyCount() << endl;
+        err << "lines:      " << lineCount << endl;
+        err << "shots:      " << shotCount << endl;
+        err << "fixes:      " << fixCount << endl;
+        err << "errors:     " << errorCount << endl;
+        err << "warnings:   " << warningCount << endl;
+        err << "input:      " << QString::number(byteCount / 1e6, 'f', 2) << " MB" << endl;
+        err << "jobs:       " << jobCount << endl;
+        err << "read:       " << QString::number(millis(readNanos), 'f', 1) << " ms (summed over files)" << endl;
+        err << "parse:      " << QString::number(millis(parseNanos), 'f', 1) << " ms (summed over files)" << endl;
+        err << "pipeline:   " << QString::number(millis(pipelineNanos), 'f', 1) << " ms wall time" << endl;
+        foreach (const PipelineStageStats& stage, pipeline.stageStats())
+        {
+            err << "  " << stage.name.leftJustified(8) << QString::number(millis(stage.busyNanos), 'f', 1)
+                << " ms busy, " << QString::number(millis(stage.starvedNanos), 'f', 1) << " ms starved, "
+                << QString::number(millis(stage.blockedNanos), 'f', 1) << " ms blocked ("
+                << stage.items << " files, " << stage.threads << (stage.threads == 1 ? " thread)" : " threads)") << endl;
+        }
+        err << "write:      " << QString::number(millis(writeNanos), 'f', 1) << " ms" << endl;
+        err << "total:      " << QString::number(seconds * 1000, 'f', 1) << " ms" << endl;
+        if (parseSeconds > 0)
+        {
+            err << "throughput: " << QString::number(byteCount / 1e6 / parseSeconds, 'f', 2) << " MB/s, "
+                << QString::number(lineCount / parseSeconds, 'f', 0) << " lines/s, "
+                << QString::number(shotCount / parseSeconds, 'f', 0) << " shots/s" << endl;
+        }
+    }
 
-    units.applyHeightCorrections(dist, fsInc, bsInc, ULength(-5, Length::Inches), ULength());
+    if (profile)
+    {
+        err << productionProfile.report();
+        err.flush();
+    }
 
-    cout << "dist:  " << dist << endl;
-    cout << "fsInc: " << fsInc << endl;
-    cout << "bsInc: " << bsInc << endl;
+    if (!wrote)
+    {
+        return 1;
+    }
+    return errorCount > 0 ? 2 : 0;
 }
@@ -0,0 +1,557 @@
+#include "compiledmodel.h"
+#include <QFile>
+#include <QIODevice>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace dewalls {
+
+using namespace compiledmodel;
+
+typedef UnitizedDouble<Length> ULength;
+typedef UnitizedDouble<Angle> UAngle;
+
+// the record layouts must not depend on the compiler's padding rules
+static_assert(sizeof(Header) == 24, "unexpected Header size");
+static_assert(sizeof(Section) == 24, "unexpected Section size");
+static_assert(sizeof(StringRef) == 8, "unexpected StringRef size");
+static_assert(sizeof(SegmentRecord) == 16, "unexpected SegmentRecord size");
+static_assert(sizeof(StationRecord) == 40, "unexpected StationRecord size");
+static_assert(sizeof(UnitsRecord) == 136, "unexpected UnitsRecord size");
+static_assert(sizeof(SourceLocation) == 8, "unexpected SourceLocation size");
+static_assert(sizeof(FixRecord) == 64, "unexpected FixRecord size");
+
+namespace {
+
+const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+double meters(ULength length)
+{
+    return length.isValid() ? length.get(Length::Meters) : NaN;
+}
+
+double degrees(UAngle angle)
+{
+    return angle.isValid() ? angle.get(Angle::Degrees) : NaN;
+}
+
+qint32 julianDay(QDate date)
+{
+    return date.isValid() ? qint32(date.toJulianDay()) : 0;
+}
+
+qint64 align(qint64 offset)
+{
+    return (offset + 7) & ~qint64(7);
+}
+
+struct SectionData {
+    SectionId id;
+    QList<QPair<const char*, qint64>> parts;
+
+    qint64 size() const {
+        qint64 result = 0;
+        for (auto part : parts) result += part.second;
+        return result;
+    }
+};
+
+template<typename T>
+QPair<const char*, qint64> bytes(const QVector<T>& table)
+{
+    return qMakePair(reinterpret_cast<const char*>(table.constData()), qint64(table.size()) * qint64(sizeof(T)));
+}
+
+} // anonymous namespace
+
+CompiledModelWriter::CompiledModelWriter(QObject* parent)
+    : QObject(parent)
+{
+    _segments << SegmentRecord{string(QString()), -1, 0};
+}
+
+StringRef CompiledModelWriter::string(QString s)
+{
+    auto i = _stringRefs.find(s);
+    if (i != _stringRefs.end())
+    {
+        return i.value();
+    }
+    QByteArray utf8 = s.toUtf8();
+    StringRef ref{quint32(_strings.size()), quint32(utf8.size())};
+    _strings.append(utf8);
+    _stringRefs.insert(s, ref);
+    return ref;
+}
+
+qint32 CompiledModelWriter::station(QString name)
+{
+    auto i = _stationIndices.find(name);
+    if (i != _stationIndices.end())
+    {
+        return i.value();
+    }
+    qint32 index = _stations.size();
+    _stations << StationRecord{string(name), {0, 0, 0}, 0, 0};
+    _stationIndices.insert(name, index);
+    return index;
+}
+
+qint32 CompiledModelWriter::segment(QStringList path)
+{
+    qint32 current = 0;
+    for (QString name : path)
+    {
+        QPair<qint32, QString> key(current, name);
+        auto i = _segmentChildren.find(key);
+        if (i != _segmentChildren.end())
+        {
+            current = i.value();
+            continue;
+        }
+        qint32 child = _segments.size();
+        _segments << SegmentRecord{string(name), current, 0};
+        _segmentChildren.insert(key, child);
+        current = child;
+    }
+    return current;
+}
+
+qint32 CompiledModelWriter::units(const WallsUnits& units)
+{
+    UnitsRecord record;
+    // zero any padding so that equal units have equal bytes
+    memset(&record, 0, sizeof(record));
+    record.decl = degrees(units.decl());
+    record.grid = degrees(units.grid());
+    record.rect = degrees(units.rect());
+    record.incd = meters(units.incd());
+    record.inca = degrees(units.inca());
+    record.incab = degrees(units.incab());
+    record.incv = degrees(units.incv());
+    record.incvb = degrees(units.incvb());
+    record.incs = meters(units.incs());
+    record.inch = meters(units.inch());
+    record.typeabTolerance = degrees(units.typeabTolerance());
+    record.typevbTolerance = degrees(units.typevbTolerance());
+    record.uvh = units.uvh();
+    record.uvv = units.uvv();
+    record.flag = string(units.flag());
+    record.vectorType = qint32(units.vectorType());
+    record.lrud = qint32(units.lrud());
+    record.flags = (units.typeabCorrected() ? TypeabCorrected : 0) |
+            (units.typeabNoAverage() ? TypeabNoAverage : 0) |
+            (units.typevbCorrected() ? TypevbCorrected : 0) |
+            (units.typevbNoAverage() ? TypevbNoAverage : 0);
+
+    QByteArray key(reinterpret_cast<const char*>(&record), sizeof(record));
+    auto i = _unitsIndices.find(key);
+    if (i != _unitsIndices.end())
+    {
+        return i.value();
+    }
+    qint32 index = _units.size();
+    _units << record;
+    _unitsIndices.insert(key, index);
+    return index;
+}
+
+SourceLocation CompiledModelWriter::source(const Segment& sourceSegment)
+{
+    QString file = sourceSegment.source();
+    if (file.isEmpty())
+    {
+        return SourceLocation{-1, sourceSegment.startLine()};
+    }
+    auto i = _sourceFileIndices.find(file);
+    if (i == _sourceFileIndices.end())
+    {
+        i = _sourceFileIndices.insert(file, _sourceFiles.size());
+        _sourceFiles << string(file);
+    }
+    return SourceLocation{i.value(), sourceSegment.startLine()};
+}
+
+void CompiledModelWriter::setStationPosition(QString name, double east, double north, double up)
+{
+    StationRecord& record = _stations[station(name)];
+    record.position[0] = east;
+    record.position[1] = north;
+    record.position[2] = up;
+    record.hasPosition = 1;
+}
+
+void CompiledModelWriter::addVector(Vector vector)
+{
+    WallsUnits vectorUnits = vector.units();
+    _shotFrom << station(vectorUnits.processStationName(vector.from()));
+    _shotTo << (vector.to().isEmpty() ? -1 : station(vectorUnits.processStationName(vector.to())));
+    _shotUnits << units(vectorUnits);
+    _shotSegment << segment(vector.segment());
+    _shotFlags << (vector.cFlag() ? CFlag : 0);
+    _shotDate << julianDay(vector.date());
+    _shotSource << source(vector.sourceSegment());
+
+    _shotMeasurements[Distance] << meters(vector.distance());
+    _shotMeasurements[FrontAzimuth] << degrees(vector.frontAzimuth());
+    _shotMeasurements[BackAzimuth] << degrees(vector.backAzimuth());
+    _shotMeasurements[FrontInclination] << degrees(vector.frontInclination());
+    _shotMeasurements[BackInclination] << degrees(vector.backInclination());
+    _shotMeasurements[InstHeight] << meters(vector.instHeight());
+    _shotMeasurements[TargetHeight] << meters(vector.targetHeight());
+    _shotMeasurements[North] << meters(vector.north());
+    _shotMeasurements[East] << meters(vector.east());
+    _shotMeasurements[RectUp] << meters(vector.rectUp());
+    _shotMeasurements[Left] << meters(vector.left());
+    _shotMeasurements[Right] << meters(vector.right());
+    _shotMeasurements[Up] << meters(vector.up());
+    _shotMeasurements[Down] << meters(vector.down());
+    _shotMeasurements[LrudAngle] << degrees(vector.lrudAngle());
+}
+
+void CompiledModelWriter::addFixStation(FixStation station)
+{
+    FixRecord record;
+    memset(&record, 0, sizeof(record));
+    WallsUnits stationUnits = station.units();
+    record.station = this->station(stationUnits.processStationName(station.name()));
+    record.units = units(stationUnits);
+    record.segment = segment(station.segment());
+    record.date = julianDay(station.date());
+    record.north = meters(station.north());
+    record.east = meters(station.east());
+    record.rectUp = meters(station.rectUp());
+    record.latitude = degrees(station.latitude());
+    record.longitude = degrees(station.longitude());
+    record.source = SourceLocation{-1, -1};
+    _fixes << record;
+}
+
+bool CompiledModelWriter::write(QString fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        return false;
+    }
+    return write(&file);
+}
+
+bool CompiledModelWriter::write(QIODevice* device) const
+{
+    if (Q_BYTE_ORDER != Q_LITTLE_ENDIAN)
+    {
+        // the format is little-endian; writing it portably isn't supported yet
+        return false;
+    }
+
+    QList<SectionData> sections;
+    sections << SectionData{SectionId::Strings, {qMakePair(_strings.constData(), qint64(_strings.size()))}};
+    sections << SectionData{SectionId::Segments, {bytes(_segments)}};
+    sections << SectionData{SectionId::Stations, {bytes(_stations)}};
+    sections << SectionData{SectionId::Units, {bytes(_units)}};
+    sections << SectionData{SectionId::Fixes, {bytes(_fixes)}};
+    sections << SectionData{SectionId::SourceFiles, {bytes(_sourceFiles)}};
+    sections << SectionData{SectionId::ShotFrom, {bytes(_shotFrom)}};
+    sections << SectionData{SectionId::ShotTo, {bytes(_shotTo)}};
+    sections << SectionData{SectionId::ShotUnits, {bytes(_shotUnits)}};
+    sections << SectionData{SectionId::ShotSegment, {bytes(_shotSegment)}};
+    sections << SectionData{SectionId::ShotFlags, {bytes(_shotFlags)}};
+    sections << SectionData{SectionId::ShotDate, {bytes(_shotDate)}};
+    sections << SectionData{SectionId::ShotSource, {bytes(_shotSource)}};
+    SectionData measurements{SectionId::ShotMeasurements, {}};
+    for (int m = 0; m < MeasurementCount; m++)
+    {
+        measurements.parts << bytes(_shotMeasurements[m]);
+    }
+    sections << measurements;
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.byteOrderMark = ByteOrderMark;
+    header.sectionCount = quint32(sections.size());
+
+    QVector<Section> table;
+    qint64 offset = align(sizeof(Header) + sizeof(Section) * sections.size());
+    for (const SectionData& data : sections)
+    {
+        table << Section{quint32(data.id), 0, quint64(offset), quint64(data.size())};
+        offset = align(offset + data.size());
+    }
+
+    const char padding[8] = {0};
+    qint64 position = 0;
+    auto writeBytes = [&](const char* data, qint64 size) {
+        if (device->write(data, size) != size)
+        {
+            return false;
+        }
+        position += size;
+        return true;
+    };
+    auto pad = [&]() {
+        return writeBytes(padding, align(position) - position);
+    };
+
+    if (!writeBytes(reinterpret_cast<const char*>(&header), sizeof(header)) ||
+            !writeBytes(reinterpret_cast<const char*>(table.constData()), sizeof(Section) * table.size()) ||
+            !pad())
+    {
+        return false;
+    }
+    for (const SectionData& data : sections)
+    {
+        for (auto part : data.parts)
+        {
+            if (!writeBytes(part.first, part.second))
+            {
+                return false;
+            }
+        }
+        if (!pad())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+CompiledModel::CompiledModel()
+    : _file(),
+      _buffer(),
+      _data(nullptr),
+      _size(0),
+      _errorString()
+{
+    close();
+}
+
+CompiledModel::~CompiledModel()
+{
+    close();
+}
+
+void CompiledModel::close()
+{
+    // destroying the file unmaps it
+    _file.reset();
+    _buffer.clear();
+    _data = nullptr;
+    _size = 0;
+
+    _strings = nullptr;
+    _stringsSize = 0;
+    _segments = nullptr;
+    _segmentCount = 0;
+    _stations = nullptr;
+    _stationCount = 0;
+    _units = nullptr;
+    _unitsCount = 0;
+    _fixes = nullptr;
+    _fixCount = 0;
+    _sourceFiles = nullptr;
+    _sourceFileCount = 0;
+
+    _shotCount = 0;
+    _shotFrom = nullptr;
+    _shotTo = nullptr;
+    _shotUnits = nullptr;
+    _shotSegment = nullptr;
+    _shotFlags = nullptr;
+    _shotDate = nullptr;
+    _shotSource = nullptr;
+    _shotMeasurements = nullptr;
+}
+
+bool CompiledModel::fail(QString errorString)
+{
+    close();
+    _errorString = errorString;
+    return false;
+}
+
+bool CompiledModel::open(QString fileName)
+{
+    close();
+    _errorString.clear();
+
+    _file.reset(new QFile(fileName));
+    if (!_file->open(QIODevice::ReadOnly))
+    {
+        return fail(_file->errorString());
+    }
+    qint64 size = _file->size();
+    if (size < qint64(sizeof(Header)))
+    {
+        return fail("file is too small to be a compiled model");
+    }
+    const uchar* data = _file->map(0, size);
+    if (!data)
+    {
+        return fail(_file->errorString());
+    }
+    return setData(data, size);
+}
+
+bool CompiledModel::load(QByteArray data)
+{
+    close();
+    _errorString.clear();
+
+    _buffer = data;
+    return setData(reinterpret_cast<const uchar*>(_buffer.constData()), _buffer.size());
+}
+
+bool CompiledModel::setData(const uchar* data, qint64 size)
+{
+    if (size < qint64(sizeof(Header)))
+    {
+        return fail("file is too small to be a compiled model");
+    }
+    if (quintptr(data) % 8)
+    {
+        return fail("compiled model data is misaligned");
+    }
+
+    const Header* header = reinterpret_cast<const Header*>(data);
+    if (memcmp(header->magic, Magic, sizeof(Magic)))
+    {
+        return fail("not a compiled model file");
+    }
+    if (header->byteOrderMark != ByteOrderMark)
+    {
+        return fail("compiled model has the wrong byte order");
+    }
+    if (header->version != Version)
+    {
+        return fail(QString("unsupported compiled model version: %1").arg(header->version));
+    }
+    if (qint64(header->sectionCount) > (size - qint64(sizeof(Header))) / qint64(sizeof(Section)))
+    {
+        return fail("compiled model section table is truncated");
+    }
+
+    QHash<quint32, QPair<const uchar*, qint64>> sections;
+    const Section* table = reinterpret_cast<const Section*>(data + sizeof(Header));
+    for (quint32 i = 0; i < header->sectionCount; i++)
+    {
+        const Section& section = table[i];
+        if (section.offset > quint64(size) || section.size > quint64(size) - section.offset)
+        {
+            return fail(QString("compiled model section %1 is out of bounds").arg(section.id));
+        }
+        if (section.offset % 8)
+        {
+            return fail(QString("compiled model section %1 is misaligned").arg(section.id));
+        }
+        // sections with unknown ids are ignored
+        sections.insert(section.id, qMakePair(data + section.offset, qint64(section.size)));
+    }
+
+    bool ok = true;
+    QString missing;
+    auto get = [&](SectionId id, size_t recordSize, int& count) -> const uchar* {
+        auto i = sections.find(quint32(id));
+        if (i == sections.end() || i.value().second % qint64(recordSize) ||
+                i.value().second / qint64(recordSize) > std::numeric_limits<int>::max())
+        {
+            if (ok) missing = QString::number(quint32(id));
+            ok = false;
+            count = 0;
+            return nullptr;
+        }
+        count = int(i.value().second / qint64(recordSize));
+        return i.value().first;
+    };
+
+    int stringsSize;
+    _strings = reinterpret_cast<const char*>(get(SectionId::Strings, 1, stringsSize));
+    _stringsSize = quint32(stringsSize);
+    _segments = reinterpret_cast<const SegmentRecord*>(get(SectionId::Segments, sizeof(SegmentRecord), _segmentCount));
+    _stations = reinterpret_cast<const StationRecord*>(get(SectionId::Stations, sizeof(StationRecord), _stationCount));
+    _units = reinterpret_cast<const UnitsRecord*>(get(SectionId::Units, sizeof(UnitsRecord), _unitsCount));
+    _fixes = reinterpret_cast<const FixRecord*>(get(SectionId::Fixes, sizeof(FixRecord), _fixCount));
+    _sourceFiles = reinterpret_cast<const StringRef*>(get(SectionId::SourceFiles, sizeof(StringRef), _sourceFileCount));
+
+    int count;
+    _shotFrom = reinterpret_cast<const qint32*>(get(SectionId::ShotFrom, sizeof(qint32), _shotCount));
+    bool shotsOk = true;
+    _shotTo = reinterpret_cast<const qint32*>(get(SectionId::ShotTo, sizeof(qint32), count));
+    shotsOk &= count == _shotCount;
+    _shotUnits = reinterpret_cast<const qint32*>(get(SectionId::ShotUnits, sizeof(qint32), count));
+    shotsOk &= count == _shotCount;
+    _shotSegment = reinterpret_cast<const qint32*>(get(SectionId::ShotSegment, sizeof(qint32), count));
+    shotsOk &= count == _shotCount;
+    _shotFlags = reinterpret_cast<const quint32*>(get(SectionId::ShotFlags, sizeof(quint32), count));
+    shotsOk &= count == _shotCount;
+    _shotDate = reinterpret_cast<const qint32*>(get(SectionId::ShotDate, sizeof(qint32), count));
+    shotsOk &= count == _shotCount;
+    _shotSource = reinterpret_cast<const SourceLocation*>(get(SectionId::ShotSource, sizeof(SourceLocation), count));
+    shotsOk &= count == _shotCount;
+    _shotMeasurements = reinterpret_cast<const double*>(get(SectionId::ShotMeasurements, sizeof(double), count));
+    shotsOk &= qint64(count) == qint64(_shotCount) * MeasurementCount;
+
+    if (!ok)
+    {
+        return fail(QString("compiled model section %1 is missing or malformed").arg(missing));
+    }
+    if (!shotsOk)
+    {
+        return fail("compiled model shot columns have different lengths");
+    }
+    if (_segmentCount == 0)
+    {
+        return fail("compiled model has no root segment");
+    }
+
+    _data = data;
+    _size = size;
+    return true;
+}
+
+quint32 CompiledModel::version() const
+{
+    return _data ? reinterpret_cast<const Header*>(_data)->version : 0;
+}
+
+QString CompiledModel::string(StringRef ref) const
+{
+    if (ref.offset > _stringsSize || ref.length > _stringsSize - ref.offset)
+    {
+        return QString();
+    }
+    return QString::fromUtf8(_strings + ref.offset, int(ref.length));
+}
+
+QStringList CompiledModel::segmentPath(int segment) const
+{
+    QStringList result;
+    // bounded in case of a malformed file with a cycle
+    for (int depth = 0; segment > 0 && segment < _segmentCount && depth < _segmentCount; depth++)
+    {
+        result.prepend(string(_segments[segment].name));
+        segment = _segments[segment].parent;
+    }
+    return result;
+}
+
+int CompiledModel::findStation(QString name) const
+{
+    QByteArray utf8 = name.toUtf8();
+    for (int i = 0; i < _stationCount; i++)
+    {
+        StringRef ref = _stations[i].name;
+        if (ref.length == quint32(utf8.size()) && ref.offset <= _stringsSize &&
+                ref.length <= _stringsSize - ref.offset &&
+                !memcmp(_strings + ref.offset, utf8.constData(), ref.length))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+} // namespace dewalls
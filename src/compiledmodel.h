@@ -0,0 +1,341 @@
+#ifndef DEWALLS_COMPILEDMODEL_H
+#define DEWALLS_COMPILEDMODEL_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QScopedPointer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "vector.h"
+#include "fixstation.h"
+#include "dewallsexport.h"
+
+class QFile;
+class QIODevice;
+
+namespace dewalls {
+
+///
+/// \brief the on-disk layout of compiled model files (see CompiledModelWriter and CompiledModel).
+///
+/// A file starts with a Header and a table of Sections, followed by the sections' data.
+/// Every section is an array of one of the POD records below (or raw bytes, for the string
+/// table), 8-byte aligned, so a reader can use the data in place.  Values are stored in the
+/// writer's native (little-endian) byte order.  Lengths are in meters and angles in degrees;
+/// missing measurements are NaN.
+///
+namespace compiledmodel {
+
+const char Magic[8] = {'D', 'E', 'W', 'A', 'L', 'L', 'S', 'M'};
+const quint32 Version = 1;
+const quint32 ByteOrderMark = 0x01020304;
+
+enum class SectionId : quint32
+{
+    // UTF-8 bytes referenced by StringRefs
+    Strings = 1,
+    // SegmentRecord[]; record 0 is the root
+    Segments = 2,
+    // StationRecord[]
+    Stations = 3,
+    // UnitsRecord[]
+    Units = 4,
+    // FixRecord[]
+    Fixes = 5,
+    // StringRef[]: the names of the files shots and fixes came from
+    SourceFiles = 6,
+    // shot columns, one value per shot
+    ShotFrom = 16,          // qint32 station index
+    ShotTo = 17,            // qint32 station index, or -1 for LRUD-only lines
+    ShotUnits = 18,         // qint32 units index
+    ShotSegment = 19,       // qint32 segment index
+    ShotFlags = 20,         // quint32 ShotFlag bits
+    ShotDate = 21,          // qint32 Julian day, or 0 if none
+    ShotSource = 22,        // SourceLocation
+    ShotMeasurements = 23   // double[MeasurementCount][shot count], column-major
+};
+
+enum ShotMeasurement
+{
+    Distance = 0,
+    FrontAzimuth,
+    BackAzimuth,
+    FrontInclination,
+    BackInclination,
+    InstHeight,
+    TargetHeight,
+    North,
+    East,
+    RectUp,
+    Left,
+    Right,
+    Up,
+    Down,
+    LrudAngle,
+    MeasurementCount
+};
+
+enum ShotFlag
+{
+    CFlag = 0x1
+};
+
+enum UnitsFlag
+{
+    TypeabCorrected = 0x1,
+    TypeabNoAverage = 0x2,
+    TypevbCorrected = 0x4,
+    TypevbNoAverage = 0x8
+};
+
+struct Section {
+    quint32 id;
+    quint32 reserved;
+    quint64 offset;
+    quint64 size;
+};
+
+struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 byteOrderMark;
+    quint32 sectionCount;
+    quint32 reserved;
+    // followed by Section[sectionCount]
+};
+
+struct StringRef {
+    quint32 offset;
+    quint32 length;
+};
+
+struct SegmentRecord {
+    StringRef name;
+    // index of the parent segment, or -1 for the root
+    qint32 parent;
+    qint32 reserved;
+};
+
+struct StationRecord {
+    StringRef name;
+    // reduced east, north and up coordinates, if hasPosition is nonzero
+    double position[3];
+    quint32 hasPosition;
+    quint32 reserved;
+};
+
+struct UnitsRecord {
+    double decl;
+    double grid;
+    double rect;
+    double incd;
+    double inca;
+    double incab;
+    double incv;
+    double incvb;
+    double incs;
+    double inch;
+    double typeabTolerance;
+    double typevbTolerance;
+    double uvh;
+    double uvv;
+    StringRef flag;
+    // VectorType
+    qint32 vectorType;
+    // LrudType
+    qint32 lrud;
+    // UnitsFlag bits
+    quint32 flags;
+    quint32 reserved;
+};
+
+struct SourceLocation {
+    // index into the SourceFiles section, or -1 if unknown
+    qint32 file;
+    // zero-based line number
+    qint32 line;
+};
+
+struct FixRecord {
+    qint32 station;
+    qint32 units;
+    qint32 segment;
+    // Julian day, or 0 if none
+    qint32 date;
+    double north;
+    double east;
+    double rectUp;
+    double latitude;
+    double longitude;
+    SourceLocation source;
+};
+
+} // namespace compiledmodel
+
+///
+/// \brief collects parsed vectors and fixed stations into the tables of a compiled model file.
+/// Connect its slots to WallsSurveyParser's parsedVector and parsedFixStation signals, set the
+/// reduced station positions (if any) and call write().
+///
+/// Stations are stored under their full names, with the #prefix and #units case they were
+/// parsed with applied (see WallsUnits::processStationName()), so the same name under
+/// different prefixes is different stations.
+///
+class DEWALLS_LIB_EXPORT CompiledModelWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    CompiledModelWriter(QObject* parent = nullptr);
+
+    inline int stationCount() const { return _stations.size(); }
+    inline int shotCount() const { return _shotFrom.size(); }
+    inline int fixCount() const { return _fixes.size(); }
+
+    ///
+    /// \brief sets the reduced position of the station with the given full name
+    ///
+    void setStationPosition(QString station, double east, double north, double up);
+
+    bool write(QString fileName) const;
+    bool write(QIODevice* device) const;
+
+public slots:
+    void addVector(Vector vector);
+    void addFixStation(FixStation station);
+
+private:
+    compiledmodel::StringRef string(QString s);
+    qint32 station(QString name);
+    qint32 segment(QStringList path);
+    qint32 units(const WallsUnits& units);
+    compiledmodel::SourceLocation source(const Segment& sourceSegment);
+
+    QByteArray _strings;
+    QHash<QString, compiledmodel::StringRef> _stringRefs;
+    QVector<compiledmodel::SegmentRecord> _segments;
+    QHash<QPair<qint32, QString>, qint32> _segmentChildren;
+    QVector<compiledmodel::StationRecord> _stations;
+    QHash<QString, qint32> _stationIndices;
+    QVector<compiledmodel::UnitsRecord> _units;
+    QHash<QByteArray, qint32> _unitsIndices;
+    QVector<compiledmodel::FixRecord> _fixes;
+    QVector<compiledmodel::StringRef> _sourceFiles;
+    QHash<QString, qint32> _sourceFileIndices;
+
+    QVector<qint32> _shotFrom;
+    QVector<qint32> _shotTo;
+    QVector<qint32> _shotUnits;
+    QVector<qint32> _shotSegment;
+    QVector<quint32> _shotFlags;
+    QVector<qint32> _shotDate;
+    QVector<compiledmodel::SourceLocation> _shotSource;
+    QVector<double> _shotMeasurements[compiledmodel::MeasurementCount];
+};
+
+///
+/// \brief read-only access to a compiled model file.
+///
+/// open() memory-maps the file and checks its header and section table; the accessors return
+/// pointers directly into the mapping, so nothing is deserialized or copied.  The pointers are
+/// valid until close() or destruction.  Indices stored in the tables (station, segment, units
+/// and string references) are not checked when the file is opened.
+///
+class DEWALLS_LIB_EXPORT CompiledModel
+{
+public:
+    CompiledModel();
+    ~CompiledModel();
+
+    bool open(QString fileName);
+    ///
+    /// \brief uses an in-memory copy of a compiled model file instead of a mapped file
+    ///
+    bool load(QByteArray data);
+    void close();
+
+    inline bool isOpen() const { return _data != nullptr; }
+    inline QString errorString() const { return _errorString; }
+    quint32 version() const;
+
+    ///
+    /// \return the given string from the string table, or a null string if it's out of bounds
+    ///
+    QString string(compiledmodel::StringRef ref) const;
+
+    inline int segmentCount() const { return _segmentCount; }
+    inline const compiledmodel::SegmentRecord* segments() const { return _segments; }
+    QStringList segmentPath(int segment) const;
+
+    inline int stationCount() const { return _stationCount; }
+    inline const compiledmodel::StationRecord* stations() const { return _stations; }
+    inline QString stationName(int station) const { return string(_stations[station].name); }
+    ///
+    /// \return the index of the station with the given name, or -1 if there isn't one.  This is
+    /// a linear search; build a hash of the names if you need many lookups.
+    ///
+    int findStation(QString name) const;
+
+    inline int unitsCount() const { return _unitsCount; }
+    inline const compiledmodel::UnitsRecord* units() const { return _units; }
+
+    inline int fixCount() const { return _fixCount; }
+    inline const compiledmodel::FixRecord* fixes() const { return _fixes; }
+
+    inline int sourceFileCount() const { return _sourceFileCount; }
+    inline QString sourceFile(int file) const { return string(_sourceFiles[file]); }
+
+    inline int shotCount() const { return _shotCount; }
+    inline const qint32* shotFrom() const { return _shotFrom; }
+    inline const qint32* shotTo() const { return _shotTo; }
+    inline const qint32* shotUnits() const { return _shotUnits; }
+    inline const qint32* shotSegment() const { return _shotSegment; }
+    inline const quint32* shotFlags() const { return _shotFlags; }
+    inline const qint32* shotDate() const { return _shotDate; }
+    inline const compiledmodel::SourceLocation* shotSource() const { return _shotSource; }
+    inline const double* shotMeasurement(compiledmodel::ShotMeasurement measurement) const {
+        return _shotMeasurements + qint64(measurement) * _shotCount;
+    }
+
+private:
+    Q_DISABLE_COPY(CompiledModel)
+
+    bool setData(const uchar* data, qint64 size);
+    bool fail(QString errorString);
+
+    QScopedPointer<QFile> _file;
+    QByteArray _buffer;
+    const uchar* _data;
+    qint64 _size;
+    QString _errorString;
+
+    const char* _strings;
+    quint32 _stringsSize;
+    const compiledmodel::SegmentRecord* _segments;
+    int _segmentCount;
+    const compiledmodel::StationRecord* _stations;
+    int _stationCount;
+    const compiledmodel::UnitsRecord* _units;
+    int _unitsCount;
+    const compiledmodel::FixRecord* _fixes;
+    int _fixCount;
+    const compiledmodel::StringRef* _sourceFiles;
+    int _sourceFileCount;
+
+    int _shotCount;
+    const qint32* _shotFrom;
+    const qint32* _shotTo;
+    const qint32* _shotUnits;
+    const qint32* _shotSegment;
+    const quint32* _shotFlags;
+    const qint32* _shotDate;
+    const compiledmodel::SourceLocation* _shotSource;
+    const double* _shotMeasurements;
+};
+
+} // namespace dewalls
+
+#endif // DEWALLS_COMPILEDMODEL_H
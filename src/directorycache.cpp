@@ -0,0 +1,59 @@
+#include "directorycache.h"
+#include <QDir>
+#include <QMutexLocker>
+
+namespace dewalls {
+
+DirectoryCache::DirectoryCache()
+    : _mutex(),
+      _listings()
+{
+
+}
+
+const DirectoryCache::Listing& DirectoryCache::listing(const QString& dir)
+{
+    auto it = _listings.constFind(dir);
+    if (it != _listings.constEnd())
+    {
+        return it.value();
+    }
+
+    Listing listing;
+    // a directory that doesn't exist gets an empty listing, so it isn't looked up again
+    foreach (QString name, QDir(dir).entryList(QDir::Files | QDir::Hidden | QDir::System))
+    {
+        QString key = name.toLower();
+        // if several names only differ in case, prefer the one that sorts first like QDir does
+        if (!listing.contains(key))
+        {
+            listing.insert(key, name);
+        }
+    }
+    return _listings.insert(dir, listing).value();
+}
+
+QString DirectoryCache::resolve(const QString& dir, const QString& name)
+{
+    QMutexLocker locker(&_mutex);
+    return listing(dir).value(name.toLower());
+}
+
+bool DirectoryCache::contains(const QString& dir, const QString& name)
+{
+    return !resolve(dir, name).isEmpty();
+}
+
+int DirectoryCache::directoryCount() const
+{
+    QMutexLocker locker(&_mutex);
+    return _listings.size();
+}
+
+void DirectoryCache::clear()
+{
+    QMutexLocker locker(&_mutex);
+    _listings.clear();
+}
+
+} // namespace dewalls
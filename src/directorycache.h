@@ -0,0 +1,51 @@
+#ifndef DEWALLS_DIRECTORYCACHE_H
+#define DEWALLS_DIRECTORYCACHE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include "dewallsexport.h"
+
+namespace dewalls {
+
+///
+/// \brief lists each directory once and resolves file names in it case-insensitively, the
+/// way Walls (on Windows) finds them.  This replaces a stat() per candidate name with one
+/// directory listing per directory, which matters a lot on network drives.
+///
+/// It's safe to use from multiple threads.  Listings are never refreshed; call clear() if
+/// the directories may have changed.
+///
+class DEWALLS_LIB_EXPORT DirectoryCache
+{
+public:
+    DirectoryCache();
+
+    ///
+    /// \return the name of the file in the given directory whose name matches the given one
+    /// ignoring case, or an empty string if there isn't one
+    ///
+    QString resolve(const QString& dir, const QString& name);
+    bool contains(const QString& dir, const QString& name);
+
+    ///
+    /// \return how many directories have been listed
+    ///
+    int directoryCount() const;
+    void clear();
+
+private:
+    typedef QHash<QString, QString> Listing;
+
+    const Listing& listing(const QString& dir);
+
+    mutable QMutex _mutex;
+    QHash<QString, Listing> _listings;
+};
+
+typedef QSharedPointer<DirectoryCache> DirectoryCachePtr;
+
+} // namespace dewalls
+
+#endif // DEWALLS_DIRECTORYCACHE_H
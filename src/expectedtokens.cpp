@@ -0,0 +1,133 @@
+#include "expectedtokens.h"
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+
+namespace dewalls {
+
+namespace {
+
+struct TokenRegistry {
+    QMutex mutex;
+    QVector<QString> items;
+    QHash<QString, int> ids;
+};
+
+TokenRegistry& registry()
+{
+    static TokenRegistry registry;
+    return registry;
+}
+
+} // anonymous namespace
+
+ExpectedTokens::ExpectedTokens(const QString& item)
+    : ExpectedTokens()
+{
+    add(item);
+}
+
+ExpectedTokens::ExpectedTokens(std::initializer_list<QString> items)
+    : ExpectedTokens()
+{
+    for (const QString& item : items)
+    {
+        add(item);
+    }
+}
+
+ExpectedTokens::ExpectedTokens(const QList<QString>& items)
+    : ExpectedTokens()
+{
+    foreach (const QString& item, items)
+    {
+        add(item);
+    }
+}
+
+int ExpectedTokens::intern(const QString& item)
+{
+    // the grammar only has a few hundred distinct items, so after warming up each thread
+    // finds them all in its own cache without locking.  Items that couldn't be interned
+    // aren't cached, so the cache is bounded like the registry.
+    static thread_local QHash<QString, int> cache;
+    auto cached = cache.constFind(item);
+    if (cached != cache.constEnd())
+    {
+        return cached.value();
+    }
+
+    TokenRegistry& r = registry();
+    int id;
+    {
+        QMutexLocker locker(&r.mutex);
+        auto it = r.ids.constFind(item);
+        if (it != r.ids.constEnd())
+        {
+            id = it.value();
+        }
+        else if (r.items.size() >= Capacity)
+        {
+            // the registry lives as long as the process, so it's capped in case callers make
+            // up items at run time
+            return -1;
+        }
+        else
+        {
+            id = r.items.size();
+            r.items << item;
+            r.ids.insert(item, id);
+        }
+    }
+    cache.insert(item, id);
+    return id;
+}
+
+int ExpectedTokens::intern(QChar item)
+{
+    static thread_local QHash<QChar, int> cache;
+    auto cached = cache.constFind(item);
+    if (cached != cache.constEnd())
+    {
+        return cached.value();
+    }
+    int id = intern(QString(item));
+    if (id >= 0)
+    {
+        cache.insert(item, id);
+    }
+    return id;
+}
+
+QString ExpectedTokens::item(int id)
+{
+    TokenRegistry& r = registry();
+    QMutexLocker locker(&r.mutex);
+    return r.items.value(id);
+}
+
+bool ExpectedTokens::contains(const QString& item) const
+{
+    int id = intern(item);
+    if (id >= 0)
+    {
+        return _bits[id >> 6] & (quint64(1) << (id & 63));
+    }
+    return _overflow.contains(item);
+}
+
+QStringList ExpectedTokens::toStringList() const
+{
+    QStringList result;
+    result.reserve(_order.size());
+    TokenRegistry& r = registry();
+    QMutexLocker locker(&r.mutex);
+    for (int id : _order)
+    {
+        result << (id < Capacity ? r.items.at(id) : _overflow.at(id - Capacity));
+    }
+    return result;
+}
+
+} // namespace dewalls
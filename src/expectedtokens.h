@@ -0,0 +1,164 @@
+#ifndef DEWALLS_EXPECTEDTOKENS_H
+#define DEWALLS_EXPECTEDTOKENS_H
+
+#include <QChar>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVarLengthArray>
+#include <initializer_list>
+#include <cstring>
+#include "dewallsexport.h"
+
+namespace dewalls {
+
+///
+/// \brief a set of expected items ("<STATION>", "#units", ...) for parse errors.
+///
+/// Items are interned into process-wide ids, so adding one that's already in the set is a
+/// bit test, and the set only allocates if it gets more than a few items.  They're only turned
+/// back into strings when a message is rendered.
+///
+class DEWALLS_LIB_EXPORT ExpectedTokens
+{
+public:
+    // the most items that get interned; the (rare) rest are kept as strings
+    enum { Capacity = 512 };
+
+    ExpectedTokens();
+    ExpectedTokens(const QString& item);
+    ExpectedTokens(std::initializer_list<QString> items);
+    ExpectedTokens(const QList<QString>& items);
+
+    ///
+    /// \return the id for the given item, interning it if necessary, or -1 if Capacity items
+    /// have already been interned
+    ///
+    static int intern(const QString& item);
+    static int intern(QChar item);
+    static QString item(int id);
+
+    ///
+    /// \brief adds an item by its id from intern(), which must not be -1
+    ///
+    void add(int id);
+    void add(const QString& item);
+    void add(QChar item);
+
+    ExpectedTokens& operator|=(const ExpectedTokens& other);
+
+    bool contains(const QString& item) const;
+    bool isEmpty() const;
+    void clear();
+
+    ///
+    /// \return the items, in the order they were first added
+    ///
+    QStringList toStringList() const;
+
+private:
+    enum { WordCount = Capacity / 64 };
+
+    void addOverflow(const QString& item);
+
+    // which interned items are in the set
+    quint64 _bits[WordCount];
+    // the items in the order they were added: interned ids, or Capacity + an index into
+    // _overflow for items that couldn't be interned
+    QVarLengthArray<int, 16> _order;
+    QStringList _overflow;
+};
+
+inline ExpectedTokens::ExpectedTokens()
+    : _order(),
+      _overflow()
+{
+    std::memset(_bits, 0, sizeof(_bits));
+}
+
+inline void ExpectedTokens::add(int id)
+{
+    quint64 bit = quint64(1) << (id & 63);
+    if (!(_bits[id >> 6] & bit))
+    {
+        _bits[id >> 6] |= bit;
+        _order.append(id);
+    }
+}
+
+inline void ExpectedTokens::add(const QString& item)
+{
+    int id = intern(item);
+    if (id >= 0)
+    {
+        add(id);
+    }
+    else
+    {
+        addOverflow(item);
+    }
+}
+
+inline void ExpectedTokens::add(QChar item)
+{
+    int id = intern(item);
+    if (id >= 0)
+    {
+        add(id);
+    }
+    else
+    {
+        addOverflow(QString(item));
+    }
+}
+
+inline void ExpectedTokens::addOverflow(const QString& item)
+{
+    if (!_overflow.contains(item))
+    {
+        _order.append(Capacity + _overflow.size());
+        _overflow << item;
+    }
+}
+
+inline ExpectedTokens& ExpectedTokens::operator|=(const ExpectedTokens& other)
+{
+    for (int id : other._order)
+    {
+        if (id < Capacity)
+        {
+            add(id);
+        }
+        else
+        {
+            addOverflow(other._overflow.at(id - Capacity));
+        }
+    }
+    return *this;
+}
+
+inline bool ExpectedTokens::isEmpty() const
+{
+    return _order.isEmpty();
+}
+
+inline void ExpectedTokens::clear()
+{
+    // only the words with items in them need clearing
+    for (int id : _order)
+    {
+        if (id < Capacity)
+        {
+            _bits[id >> 6] = 0;
+        }
+    }
+    _order.clear();
+    if (!_overflow.isEmpty())
+    {
+        _overflow.clear();
+    }
+}
+
+} // namespace dewalls
+
+#endif // DEWALLS_EXPECTEDTOKENS_H
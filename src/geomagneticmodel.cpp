@@ -0,0 +1,621 @@
+#include "geomagneticmodel.h"
+#include <QFile>
+#include <QMap>
+#include <QPair>
+#include <QTextStream>
+#include <QStringList>
+#include <cmath>
+#include <algorithm>
+
+namespace dewalls {
+
+typedef UnitizedDouble<Length> ULength;
+typedef UnitizedDouble<Angle> UAngle;
+
+// World Magnetic Model 2020 main field and secular variation coefficients
+// (NOAA NCEI / British Geological Survey, epoch 2020.0, valid 2020-2025).
+static const GeomagneticModel::Coefficient WMM2020[] = {
+    {1, 0, -29404.5, 0.0, 6.7, 0.0},
+    {1, 1, -1450.7, 4652.9, 7.7, -25.1},
+    {2, 0, -2500.0, 0.0, -11.5, 0.0},
+    {2, 1, 2982.0, -2991.6, -7.1, -30.2},
+    {2, 2, 1676.8, -734.8, -2.2, -23.9},
+    {3, 0, 1363.9, 0.0, 2.8, 0.0},
+    {3, 1, -2381.0, -82.2, -6.2, 5.7},
+    {3, 2, 1236.2, 241.8, 3.4, -1.0},
+    {3, 3, 525.7, -542.9, -12.2, 1.1},
+    {4, 0, 903.1, 0.0, -1.1, 0.0},
+    {4, 1, 809.4, 282.0, -1.6, 0.2},
+    {4, 2, 86.2, -158.4, -6.0, 6.9},
+    {4, 3, -309.4, 199.8, 5.4, 3.7},
+    {4, 4, 47.9, -350.1, -5.5, -5.6},
+    {5, 0, -234.4, 0.0, -0.3, 0.0},
+    {5, 1, 363.1, 47.7, 0.6, 0.1},
+    {5, 2, 187.8, 208.4, -0.7, 2.5},
+    {5, 3, -140.7, -121.3, 0.1, -0.9},
+    {5, 4, -151.2, 32.2, 1.2, 3.0},
+    {5, 5, 13.7, 99.1, 1.0, 0.5},
+    {6, 0, 65.9, 0.0, -0.6, 0.0},
+    {6, 1, 65.6, -19.1, -0.4, 0.1},
+    {6, 2, 73.0, 25.0, 0.5, -1.8},
+    {6, 3, -121.5, 52.7, 1.4, -1.4},
+    {6, 4, -36.2, -64.4, -1.4, 0.9},
+    {6, 5, 13.5, 9.0, -0.0, 0.1},
+    {6, 6, -64.7, 68.1, 0.8, 1.0},
+    {7, 0, 80.6, 0.0, -0.1, 0.0},
+    {7, 1, -76.8, -51.4, -0.3, 0.5},
+    {7, 2, -8.3, -16.8, -0.1, 0.6},
+    {7, 3, 56.5, 2.3, 0.7, -0.7},
+    {7, 4, 15.8, 23.5, 0.2, -0.2},
+    {7, 5, 6.4, -2.2, -0.5, -1.2},
+    {7, 6, -7.2, -27.2, -0.8, 0.2},
+    {7, 7, 9.8, -1.9, 1.0, 0.3},
+    {8, 0, 23.6, 0.0, -0.1, 0.0},
+    {8, 1, 9.8, 8.4, 0.1, -0.3},
+    {8, 2, -17.5, -15.3, -0.1, 0.7},
+    {8, 3, -0.4, 12.8, 0.5, -0.2},
+    {8, 4, -21.1, -11.8, -0.1, 0.5},
+    {8, 5, 15.3, 14.9, 0.4, -0.3},
+    {8, 6, 13.7, 3.6, 0.5, -0.5},
+    {8, 7, -16.5, -6.9, 0.0, 0.4},
+    {8, 8, -0.3, 2.8, 0.4, 0.1},
+    {9, 0, 5.0, 0.0, -0.1, 0.0},
+    {9, 1, 8.2, -23.3, -0.2, -0.3},
+    {9, 2, 2.9, 11.1, -0.0, 0.2},
+    {9, 3, -1.4, 9.8, 0.4, -0.4},
+    {9, 4, -1.1, -5.1, -0.3, 0.4},
+    {9, 5, -13.3, -6.2, -0.0, 0.1},
+    {9, 6, 1.1, 7.8, 0.3, -0.0},
+    {9, 7, 8.9, 0.4, -0.0, -0.2},
+    {9, 8, -9.3, -1.5, -0.0, 0.5},
+    {9, 9, -11.9, 9.7, -0.4, 0.2},
+    {10, 0, -1.9, 0.0, 0.0, 0.0},
+    {10, 1, -6.2, 3.4, -0.0, -0.0},
+    {10, 2, -0.1, -0.2, -0.0, 0.1},
+    {10, 3, 1.7, 3.5, 0.2, -0.3},
+    {10, 4, -0.9, 4.8, -0.1, 0.1},
+    {10, 5, 0.6, -8.6, -0.2, -0.2},
+    {10, 6, -0.9, -0.1, -0.0, 0.1},
+    {10, 7, 1.9, -4.2, -0.1, -0.0},
+    {10, 8, 1.4, -3.4, -0.2, -0.1},
+    {10, 9, -2.4, -0.1, -0.1, 0.2},
+    {10, 10, -3.9, -8.8, -0.0, -0.0},
+    {11, 0, 3.0, 0.0, -0.0, 0.0},
+    {11, 1, -1.4, -0.0, -0.1, -0.0},
+    {11, 2, -2.5, 2.6, -0.0, 0.1},
+    {11, 3, 2.4, -0.5, 0.0, 0.0},
+    {11, 4, -0.9, -0.4, -0.0, 0.2},
+    {11, 5, 0.3, 0.6, -0.1, -0.0},
+    {11, 6, -0.7, -0.2, 0.0, 0.0},
+    {11, 7, -0.1, -1.7, -0.0, 0.1},
+    {11, 8, 1.4, -1.6, -0.1, -0.0},
+    {11, 9, -0.6, -3.0, -0.1, -0.1},
+    {11, 10, 0.2, -2.0, -0.1, 0.0},
+    {11, 11, 3.1, -2.6, -0.1, -0.0},
+    {12, 0, -2.0, 0.0, 0.0, 0.0},
+    {12, 1, -0.1, -1.2, -0.0, -0.0},
+    {12, 2, 0.5, 0.5, -0.0, 0.0},
+    {12, 3, 1.3, 1.3, 0.0, -0.1},
+    {12, 4, -1.2, -1.8, -0.0, 0.1},
+    {12, 5, 0.7, 0.1, -0.0, -0.0},
+    {12, 6, 0.3, 0.7, 0.0, 0.0},
+    {12, 7, 0.5, -0.1, -0.0, -0.0},
+    {12, 8, -0.2, 0.6, 0.0, 0.1},
+    {12, 9, -0.5, 0.2, -0.0, -0.0},
+    {12, 10, 0.1, -0.9, -0.0, -0.0},
+    {12, 11, -1.1, -0.0, -0.0, 0.0},
+    {12, 12, -0.3, 0.5, -0.1, -0.1}
+};
+
+// World Magnetic Model 2025 main field and secular variation coefficients
+// (NOAA NCEI / British Geological Survey, epoch 2025.0, valid 2025-2030).
+static const GeomagneticModel::Coefficient WMM2025[] = {
+    {1, 0, -29351.8, 0.0, 12.0, 0.0},
+    {1, 1, -1410.8, 4545.4, 9.7, -21.5},
+    {2, 0, -2556.6, 0.0, -11.6, 0.0},
+    {2, 1, 2951.1, -3133.6, -5.2, -27.7},
+    {2, 2, 1649.3, -815.1, -8.0, -12.1},
+    {3, 0, 1361.0, 0.0, -1.3, 0.0},
+    {3, 1, -2404.1, -56.6, -4.2, 4.0},
+    {3, 2, 1243.8, 237.5, 0.4, -0.3},
+    {3, 3, 453.6, -549.5, -15.6, -4.1},
+    {4, 0, 895.0, 0.0, -1.6, 0.0},
+    {4, 1, 799.5, 278.6, -2.4, -1.1},
+    {4, 2, 55.7, -133.9, -6.0, 4.1},
+    {4, 3, -281.1, 212.0, 5.6, 1.6},
+    {4, 4, 12.1, -375.6, -7.0, -4.4},
+    {5, 0, -233.2, 0.0, 0.6, 0.0},
+    {5, 1, 368.9, 45.4, 1.4, -0.5},
+    {5, 2, 187.2, 220.2, 0.0, 2.2},
+    {5, 3, -138.7, -122.9, 0.6, 0.4},
+    {5, 4, -142.0, 43.0, 2.2, 1.7},
+    {5, 5, 20.9, 106.1, 0.9, 1.9},
+    {6, 0, 64.4, 0.0, -0.2, 0.0},
+    {6, 1, 63.8, -18.4, -0.4, 0.3},
+    {6, 2, 76.9, 16.8, 0.9, -1.6},
+    {6, 3, -115.7, 48.8, 1.2, -0.4},
+    {6, 4, -40.9, -59.8, -0.9, 0.9},
+    {6, 5, 14.9, 10.9, 0.3, 0.7},
+    {6, 6, -60.7, 72.7, 0.9, 0.9},
+    {7, 0, 79.5, 0.0, -0.0, 0.0},
+    {7, 1, -77.0, -48.9, -0.1, 0.6},
+    {7, 2, -8.8, -14.4, -0.1, 0.5},
+    {7, 3, 59.3, -1.0, 0.5, -0.8},
+    {7, 4, 15.8, 23.4, -0.1, 0.0},
+    {7, 5, 2.5, -7.4, -0.8, -1.0},
+    {7, 6, -11.1, -25.1, -0.8, 0.6},
+    {7, 7, 14.2, -2.3, 0.8, -0.2},
+    {8, 0, 23.2, 0.0, -0.1, 0.0},
+    {8, 1, 10.8, 7.1, 0.2, -0.2},
+    {8, 2, -17.5, -12.6, 0.0, 0.5},
+    {8, 3, 2.0, 11.4, 0.5, -0.4},
+    {8, 4, -21.7, -9.7, -0.1, 0.4},
+    {8, 5, 16.9, 12.7, 0.3, -0.5},
+    {8, 6, 15.0, 0.7, 0.2, -0.6},
+    {8, 7, -16.8, -5.2, -0.0, 0.3},
+    {8, 8, 0.9, 3.9, 0.2, 0.2},
+    {9, 0, 4.6, 0.0, -0.0, 0.0},
+    {9, 1, 7.8, -24.8, -0.1, -0.3},
+    {9, 2, 3.0, 12.2, 0.1, 0.3},
+    {9, 3, -0.2, 8.3, 0.3, -0.3},
+    {9, 4, -2.5, -3.4, -0.3, 0.3},
+    {9, 5, -13.1, -5.3, 0.0, 0.2},
+    {9, 6, 2.4, 7.2, 0.3, -0.1},
+    {9, 7, 8.6, -0.6, -0.1, -0.2},
+    {9, 8, -8.7, 0.8, 0.1, 0.4},
+    {9, 9, -12.9, 10.0, -0.1, 0.1},
+    {10, 0, -1.3, 0.0, 0.1, 0.0},
+    {10, 1, -6.4, 3.3, 0.0, 0.0},
+    {10, 2, 0.2, 0.0, 0.1, -0.0},
+    {10, 3, 2.0, 2.4, 0.1, -0.2},
+    {10, 4, -1.0, 5.3, -0.0, 0.1},
+    {10, 5, -0.6, -9.1, -0.3, -0.1},
+    {10, 6, -0.9, 0.4, 0.0, 0.1},
+    {10, 7, 1.5, -4.2, -0.1, 0.0},
+    {10, 8, 0.9, -3.8, -0.1, -0.1},
+    {10, 9, -2.7, 0.9, -0.0, 0.2},
+    {10, 10, -3.9, -9.1, -0.0, -0.0},
+    {11, 0, 2.9, 0.0, 0.0, 0.0},
+    {11, 1, -1.5, 0.0, -0.0, -0.0},
+    {11, 2, -2.5, 2.9, 0.0, 0.1},
+    {11, 3, 2.4, -0.6, 0.0, -0.0},
+    {11, 4, -0.6, 0.2, 0.0, 0.1},
+    {11, 5, -0.1, 0.5, -0.1, -0.0},
+    {11, 6, -0.6, -0.3, 0.0, -0.0},
+    {11, 7, -0.1, -1.2, -0.0, 0.1},
+    {11, 8, 1.1, -1.7, -0.1, -0.0},
+    {11, 9, -1.0, -2.9, -0.1, 0.0},
+    {11, 10, -0.2, -1.8, -0.1, 0.0},
+    {11, 11, 2.6, -2.3, -0.1, 0.0},
+    {12, 0, -2.0, 0.0, 0.0, 0.0},
+    {12, 1, -0.2, -1.3, 0.0, -0.0},
+    {12, 2, 0.3, 0.7, -0.0, 0.0},
+    {12, 3, 1.2, 1.0, -0.0, -0.1},
+    {12, 4, -1.3, -1.4, -0.0, 0.1},
+    {12, 5, 0.6, -0.0, -0.0, -0.0},
+    {12, 6, 0.6, 0.6, 0.1, -0.0},
+    {12, 7, 0.5, -0.1, -0.0, -0.0},
+    {12, 8, -0.1, 0.8, 0.0, 0.0},
+    {12, 9, -0.4, 0.1, 0.0, -0.0},
+    {12, 10, -0.2, -1.0, -0.1, -0.0},
+    {12, 11, -1.3, 0.1, -0.0, 0.0},
+    {12, 12, -0.7, 0.2, -0.1, -0.1}
+};
+
+GeomagneticModel::GeomagneticModel(QString name, double epoch, const QList<Coefficient>& coefficients,
+                                   double validYears)
+    : _name(name),
+      _epoch(epoch),
+      _validUntil(epoch + validYears),
+      _maxDegree(0)
+{
+    foreach (const Coefficient& c, coefficients)
+    {
+        _maxDegree = std::max(_maxDegree, c.n);
+    }
+
+    int size = (_maxDegree + 1) * (_maxDegree + 2) / 2;
+    _g.fill(0.0, size);
+    _h.fill(0.0, size);
+    _dg.fill(0.0, size);
+    _dh.fill(0.0, size);
+
+    foreach (const Coefficient& c, coefficients)
+    {
+        if (c.n < 1 || c.m < 0 || c.m > c.n)
+        {
+            continue;
+        }
+        int k = c.n * (c.n + 1) / 2 + c.m;
+        _g[k] = c.g;
+        _h[k] = c.h;
+        _dg[k] = c.dg;
+        _dh[k] = c.dh;
+    }
+}
+
+template<int N>
+static QList<GeomagneticModel::Coefficient> toList(const GeomagneticModel::Coefficient (&coefficients)[N])
+{
+    QList<GeomagneticModel::Coefficient> result;
+    for (const GeomagneticModel::Coefficient& c : coefficients)
+    {
+        result << c;
+    }
+    return result;
+}
+
+static GeomagneticModelPtr wmm2020Ptr()
+{
+    static const GeomagneticModelPtr model(new GeomagneticModel("WMM-2020", 2020.0, toList(WMM2020)));
+    return model;
+}
+
+static GeomagneticModelPtr wmm2025Ptr()
+{
+    static const GeomagneticModelPtr model(new GeomagneticModel("WMM-2025", 2025.0, toList(WMM2025)));
+    return model;
+}
+
+const GeomagneticModel& GeomagneticModel::wmm2020()
+{
+    return *wmm2020Ptr();
+}
+
+const GeomagneticModel& GeomagneticModel::wmm2025()
+{
+    return *wmm2025Ptr();
+}
+
+QSharedPointer<GeomagneticModel> GeomagneticModel::fromCofFile(QString fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+    {
+        return QSharedPointer<GeomagneticModel>();
+    }
+
+    QTextStream in(&file);
+    QStringList header = in.readLine().split(QRegExp("\\s+"), QString::SkipEmptyParts);
+    bool ok = false;
+    double epoch = header.isEmpty() ? 0.0 : header[0].toDouble(&ok);
+    if (!ok)
+    {
+        return QSharedPointer<GeomagneticModel>();
+    }
+    QString name = header.size() > 1 ? header[1] : fileName;
+
+    QList<Coefficient> coefficients;
+    while (!in.atEnd())
+    {
+        QStringList fields = in.readLine().split(QRegExp("\\s+"), QString::SkipEmptyParts);
+        if (fields.size() < 6 || fields[0].startsWith("9999"))
+        {
+            break;
+        }
+        Coefficient c;
+        c.n = fields[0].toInt();
+        c.m = fields[1].toInt();
+        c.g = fields[2].toDouble();
+        c.h = fields[3].toDouble();
+        c.dg = fields[4].toDouble();
+        c.dh = fields[5].toDouble();
+        coefficients << c;
+    }
+
+    if (coefficients.isEmpty())
+    {
+        return QSharedPointer<GeomagneticModel>();
+    }
+
+    return QSharedPointer<GeomagneticModel>(new GeomagneticModel(name, epoch, coefficients));
+}
+
+double GeomagneticModel::decimalYear(QDate date)
+{
+    return date.year() + (date.dayOfYear() - 1) / double(date.daysInYear());
+}
+
+UAngle GeomagneticModel::declination(QDate date, UAngle latitude, UAngle longitude, ULength elevation) const
+{
+    return declination(decimalYear(date), latitude, longitude, elevation);
+}
+
+UAngle GeomagneticModel::declination(double decimalYear, UAngle latitude, UAngle longitude, ULength elevation) const
+{
+    // WGS84 ellipsoid and geomagnetic reference radius, in km
+    const double a = 6378.137;
+    const double f = 1 / 298.257223563;
+    const double e2 = f * (2 - f);
+    const double re = 6371.2;
+
+    const int N = _maxDegree;
+    const double dt = decimalYear - _epoch;
+
+    double lat = latitude.get(Angle::Radians);
+    double lon = longitude.get(Angle::Radians);
+    double height = elevation.isValid() ? elevation.get(Length::Kilometers) : 0.0;
+
+    // geodetic to geocentric spherical coordinates
+    double sinLat = sin(lat);
+    double rc = a / sqrt(1 - e2 * sinLat * sinLat);
+    double p = (rc + height) * cos(lat);
+    double z = (rc * (1 - e2) + height) * sinLat;
+    double r = sqrt(p * p + z * z);
+    double phi = asin(z / r);
+
+    double x = sin(phi);
+    double y = cos(phi);
+
+    // Schmidt semi-normalized associated Legendre functions of sin(phi) and their
+    // derivatives with respect to phi
+    QVector<double> P(_g.size(), 0.0);
+    QVector<double> dP(_g.size(), 0.0);
+    P[0] = 1.0;
+
+    for (int n = 1; n <= N; n++)
+    {
+        int k = n * (n + 1) / 2;
+        int k1 = (n - 1) * n / 2;
+        int k2 = (n - 2) * (n - 1) / 2;
+        for (int m = 0; m < n; m++)
+        {
+            double c1 = (2.0 * n - 1) / sqrt(double(n * n - m * m));
+            P[k + m] = c1 * x * P[k1 + m];
+            dP[k + m] = c1 * (x * dP[k1 + m] + y * P[k1 + m]);
+            if (n >= 2 && m <= n - 2)
+            {
+                double c2 = sqrt(double((n - 1) * (n - 1) - m * m) / double(n * n - m * m));
+                P[k + m] -= c2 * P[k2 + m];
+                dP[k + m] -= c2 * dP[k2 + m];
+            }
+        }
+        double c = n == 1 ? 1.0 : sqrt(1.0 - 1.0 / (2.0 * n));
+        P[k + n] = c * y * P[k1 + n - 1];
+        dP[k + n] = c * (y * dP[k1 + n - 1] - x * P[k1 + n - 1]);
+    }
+
+    double north = 0.0;
+    double east = 0.0;
+    double down = 0.0;
+
+    for (int n = 1; n <= N; n++)
+    {
+        double ar = pow(re / r, n + 2);
+        int k = n * (n + 1) / 2;
+        for (int m = 0; m <= n; m++)
+        {
+            double g = _g[k + m] + dt * _dg[k + m];
+            double h = _h[k + m] + dt * _dh[k + m];
+            double cosm = cos(m * lon);
+            double sinm = sin(m * lon);
+            double gh = g * cosm + h * sinm;
+            north -= ar * gh * dP[k + m];
+            east += ar * m * (g * sinm - h * cosm) * P[k + m];
+            down -= ar * (n + 1) * gh * P[k + m];
+        }
+    }
+    east /= y;
+
+    // rotate from geocentric to geodetic north (the east component is unaffected)
+    double psi = phi - lat;
+    north = north * cos(psi) - down * sin(psi);
+
+    return UAngle(atan2(east, north), Angle::Radians).in(Angle::Degrees);
+}
+
+GeomagneticModelSet::GeomagneticModelSet()
+    : _models()
+{
+
+}
+
+const GeomagneticModelSet& GeomagneticModelSet::builtin()
+{
+    static const GeomagneticModelSet models = []() {
+        GeomagneticModelSet result;
+        result.add(wmm2020Ptr());
+        result.add(wmm2025Ptr());
+        return result;
+    }();
+    return models;
+}
+
+GeomagneticModelSet GeomagneticModelSet::fromIgrfFile(QString fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+    {
+        return GeomagneticModelSet();
+    }
+
+    // the header row is "g/h n m 1900.0 1905.0 ... 2025.0 2025-30", where the last column is
+    // the secular variation after the last epoch
+    QVector<double> epochs;
+    bool hasSecularVariation = false;
+    // (n, m) -> the g or h value at each epoch, followed by the secular variation
+    QMap<QPair<int, int>, QVector<double>> g;
+    QMap<QPair<int, int>, QVector<double>> h;
+
+    QTextStream in(&file);
+    while (!in.atEnd())
+    {
+        QStringList fields = in.readLine().split(QRegExp("\\s+"), QString::SkipEmptyParts);
+        if (fields.size() < 4 || fields[0].startsWith('#'))
+        {
+            continue;
+        }
+        if (fields[0] == "g/h")
+        {
+            epochs.clear();
+            hasSecularVariation = false;
+            for (int i = 3; i < fields.size(); i++)
+            {
+                bool ok;
+                double epoch = fields[i].toDouble(&ok);
+                if (ok)
+                {
+                    epochs << epoch;
+                }
+                else
+                {
+                    hasSecularVariation = i == fields.size() - 1;
+                }
+            }
+            continue;
+        }
+        if ((fields[0] != "g" && fields[0] != "h") || epochs.isEmpty() ||
+                fields.size() < 3 + epochs.size())
+        {
+            continue;
+        }
+        QVector<double> values;
+        for (int i = 3; i < fields.size() && i < 3 + epochs.size() + (hasSecularVariation ? 1 : 0); i++)
+        {
+            values << fields[i].toDouble();
+        }
+        (fields[0] == "g" ? g : h)[qMakePair(fields[1].toInt(), fields[2].toInt())] = values;
+    }
+
+    GeomagneticModelSet result;
+    for (int e = 0; e < epochs.size(); e++)
+    {
+        bool last = e == epochs.size() - 1;
+        double years = last ? 5.0 : epochs[e + 1] - epochs[e];
+        if (years <= 0)
+        {
+            return GeomagneticModelSet();
+        }
+        auto value = [&](const QMap<QPair<int, int>, QVector<double>>& values, QPair<int, int> nm) {
+            return values.value(nm).value(e);
+        };
+        auto variation = [&](const QMap<QPair<int, int>, QVector<double>>& values, QPair<int, int> nm) {
+            const QVector<double> v = values.value(nm);
+            return last ? v.value(e + 1) : (v.value(e + 1) - v.value(e)) / years;
+        };
+
+        QList<GeomagneticModel::Coefficient> coefficients;
+        foreach (auto nm, g.keys())
+        {
+            GeomagneticModel::Coefficient c;
+            c.n = nm.first;
+            c.m = nm.second;
+            c.g = value(g, nm);
+            c.h = value(h, nm);
+            c.dg = variation(g, nm);
+            c.dh = variation(h, nm);
+            coefficients << c;
+        }
+        if (coefficients.isEmpty())
+        {
+            return GeomagneticModelSet();
+        }
+        result.add(GeomagneticModelPtr(new GeomagneticModel(
+                QString("IGRF-%1").arg(epochs[e]), epochs[e], coefficients, years)));
+    }
+    return result;
+}
+
+void GeomagneticModelSet::add(GeomagneticModelPtr model)
+{
+    if (model.isNull())
+    {
+        return;
+    }
+    int i = _models.size();
+    while (i > 0 && _models[i - 1]->epoch() > model->epoch())
+    {
+        i--;
+    }
+    _models.insert(i, model);
+}
+
+void GeomagneticModelSet::add(const GeomagneticModelSet& models)
+{
+    foreach (GeomagneticModelPtr model, models._models)
+    {
+        add(model);
+    }
+}
+
+QString GeomagneticModelSet::name() const
+{
+    if (_models.isEmpty())
+    {
+        return QString();
+    }
+    if (_models.size() == 1)
+    {
+        return _models.first()->name();
+    }
+    return QString("%1 to %2").arg(_models.first()->name()).arg(_models.last()->name());
+}
+
+double GeomagneticModelSet::epoch() const
+{
+    return _models.isEmpty() ? 0.0 : _models.first()->epoch();
+}
+
+double GeomagneticModelSet::validUntil() const
+{
+    double result = 0.0;
+    foreach (GeomagneticModelPtr model, _models)
+    {
+        result = std::max(result, model->validUntil());
+    }
+    return result;
+}
+
+const GeomagneticModel* GeomagneticModelSet::modelFor(double decimalYear) const
+{
+    // ordered by epoch, so the last model that covers the date is the one to use
+    for (int i = _models.size() - 1; i >= 0; i--)
+    {
+        if (_models[i]->covers(decimalYear))
+        {
+            return _models[i].data();
+        }
+    }
+    return nullptr;
+}
+
+DeclinationCache::DeclinationCache(const GeomagneticModelSet& models, double cellSize)
+    : _models(models),
+      _cellSize(cellSize)
+{
+
+}
+
+UAngle DeclinationCache::declination(QDate date, const GeoReference& reference)
+{
+    return declination(date, reference.latitude, reference.longitude);
+}
+
+UAngle DeclinationCache::declination(QDate date, UAngle latitude, UAngle longitude)
+{
+    const GeomagneticModel* model = _models.modelFor(date);
+    if (!model)
+    {
+        return UAngle();
+    }
+
+    DeclinationCacheKey key;
+    key.julianDay = date.toJulianDay();
+    key.latCell = int(floor(latitude.get(Angle::Degrees) / _cellSize));
+    key.lonCell = int(floor(longitude.get(Angle::Degrees) / _cellSize));
+
+    auto cached = _cache.constFind(key);
+    if (cached != _cache.constEnd())
+    {
+        return UAngle(*cached, Angle::Degrees);
+    }
+
+    UAngle result = model->declination(date,
+            UAngle((key.latCell + 0.5) * _cellSize, Angle::Degrees),
+            UAngle((key.lonCell + 0.5) * _cellSize, Angle::Degrees),
+            ULength(0.0, Length::Meters));
+    _cache.insert(key, result.get(Angle::Degrees));
+    return result;
+}
+
+} // namespace dewalls
@@ -0,0 +1,217 @@
+#ifndef DEWALLS_GEOMAGNETICMODEL_H
+#define DEWALLS_GEOMAGNETICMODEL_H
+
+#include <QDate>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+#include <QSharedPointer>
+#include "unitizeddouble.h"
+#include "length.h"
+#include "angle.h"
+#include "georeference.h"
+#include "dewallsexport.h"
+
+namespace dewalls {
+
+///
+/// \brief a spherical harmonic model of the main geomagnetic field at one epoch (in the format
+/// of the World Magnetic Model), used to derive magnetic declination from survey dates like
+/// Walls does for projects with WpjEntry::deriveDeclFromDate() set.  A model only covers a few
+/// years; see GeomagneticModelSet for covering longer spans.
+///
+class DEWALLS_LIB_EXPORT GeomagneticModel
+{
+public:
+    typedef UnitizedDouble<Length> ULength;
+    typedef UnitizedDouble<Angle> UAngle;
+
+    ///
+    /// \brief a Gauss coefficient pair of degree n and order m (in nT) and its secular
+    /// variation (in nT/year)
+    ///
+    struct Coefficient {
+        int n;
+        int m;
+        double g;
+        double h;
+        double dg;
+        double dh;
+    };
+
+    ///
+    /// \param validYears how long after the epoch the secular variation terms are good for
+    /// (5 years for the WMM)
+    ///
+    GeomagneticModel(QString name, double epoch, const QList<Coefficient>& coefficients,
+                     double validYears = 5.0);
+
+    ///
+    /// \brief the World Magnetic Model 2020 embedded in dewalls (valid 2020-2025)
+    ///
+    static const GeomagneticModel& wmm2020();
+    ///
+    /// \brief the World Magnetic Model 2025 embedded in dewalls (valid 2025-2030)
+    ///
+    static const GeomagneticModel& wmm2025();
+    ///
+    /// \brief reads a model from a WMM-style .COF file, so that models covering other
+    /// epochs can be used.  Returns a null pointer if the file can't be read.
+    ///
+    static QSharedPointer<GeomagneticModel> fromCofFile(QString fileName);
+
+    inline QString name() const { return _name; }
+    inline double epoch() const { return _epoch; }
+    ///
+    /// \return the decimal year the model stops being valid at.  It's valid from epoch()
+    /// until then.
+    ///
+    inline double validUntil() const { return _validUntil; }
+    inline bool covers(double decimalYear) const { return decimalYear >= _epoch && decimalYear < _validUntil; }
+    inline bool covers(QDate date) const { return covers(decimalYear(date)); }
+    inline int maxDegree() const { return _maxDegree; }
+
+    ///
+    /// \return the given date as a decimal year (e.g. 2020.5)
+    ///
+    static double decimalYear(QDate date);
+
+    ///
+    /// \brief evaluates the model.  The secular variation is extrapolated linearly, so the
+    /// result can be off by degrees for dates the model doesn't cover().
+    /// \param decimalYear the date (see decimalYear(QDate))
+    /// \param latitude geodetic (WGS84) latitude, positive north
+    /// \param longitude positive east
+    /// \param elevation height above the ellipsoid
+    /// \return the magnetic declination (positive east)
+    ///
+    UAngle declination(double decimalYear, UAngle latitude, UAngle longitude, ULength elevation) const;
+    UAngle declination(QDate date, UAngle latitude, UAngle longitude, ULength elevation) const;
+
+private:
+    QString _name;
+    double _epoch;
+    double _validUntil;
+    int _maxDegree;
+    // indexed by n * (n + 1) / 2 + m
+    QVector<double> _g;
+    QVector<double> _h;
+    QVector<double> _dg;
+    QVector<double> _dh;
+};
+
+typedef QSharedPointer<const GeomagneticModel> GeomagneticModelPtr;
+
+///
+/// \brief a series of GeomagneticModels for successive epochs, like the IGRF, so that
+/// declinations can be derived for dates over a longer span than one model covers.
+///
+class DEWALLS_LIB_EXPORT GeomagneticModelSet
+{
+public:
+    GeomagneticModelSet();
+
+    ///
+    /// \brief the models embedded in dewalls (WMM2020 and WMM2025, covering 2020-2030)
+    ///
+    static const GeomagneticModelSet& builtin();
+    ///
+    /// \brief reads the models for all of the epochs in an IGRF coefficient table (e.g.
+    /// igrf14coeffs.txt, which covers 1900 on).  The secular variation of each epoch is the
+    /// change to the next one, so evaluating it interpolates linearly between them like the
+    /// IGRF specifies.  Returns an empty set if the file can't be read.
+    ///
+    static GeomagneticModelSet fromIgrfFile(QString fileName);
+
+    ///
+    /// \brief adds a model.  Where models overlap, the one with the latest epoch is used, and
+    /// of models with the same epoch the one added last.
+    ///
+    void add(GeomagneticModelPtr model);
+    void add(const GeomagneticModelSet& models);
+
+    ///
+    /// \return the models, ordered by epoch
+    ///
+    inline const QList<GeomagneticModelPtr>& models() const { return _models; }
+    inline bool isEmpty() const { return _models.isEmpty(); }
+    ///
+    /// \return e.g. "WMM-2020 to WMM-2025"
+    ///
+    QString name() const;
+    ///
+    /// \return the epoch of the first model (0 if the set is empty)
+    ///
+    double epoch() const;
+    ///
+    /// \return the latest validUntil() of the models (0 if the set is empty).  The set
+    /// covers the span from epoch() until then unless the models leave gaps.
+    ///
+    double validUntil() const;
+
+    ///
+    /// \return the model to evaluate for the given date, or null if no model covers it
+    ///
+    const GeomagneticModel* modelFor(double decimalYear) const;
+    inline const GeomagneticModel* modelFor(QDate date) const { return modelFor(GeomagneticModel::decimalYear(date)); }
+    inline bool covers(QDate date) const { return modelFor(date) != nullptr; }
+
+private:
+    QList<GeomagneticModelPtr> _models;
+};
+
+struct DeclinationCacheKey {
+    qint64 julianDay;
+    int latCell;
+    int lonCell;
+
+    inline bool operator ==(const DeclinationCacheKey& other) const {
+        return julianDay == other.julianDay && latCell == other.latCell && lonCell == other.lonCell;
+    }
+};
+
+inline uint qHash(const DeclinationCacheKey& key, uint seed = 0)
+{
+    return qHash(key.julianDay, seed) ^ uint(key.latCell * 92821) ^ uint(key.lonCell);
+}
+
+///
+/// \brief caches declinations computed by a GeomagneticModelSet per (date, location cell), so that
+/// deriving the declination for each #date block is a table lookup instead of a spherical
+/// harmonic evaluation.  Locations are snapped to the center of their cell before evaluation,
+/// so results only depend on the cell.  Not thread-safe; use one cache per thread.
+///
+class DEWALLS_LIB_EXPORT DeclinationCache
+{
+public:
+    typedef UnitizedDouble<Angle> UAngle;
+
+    ///
+    /// \param models the models to evaluate; each date uses the one that covers it
+    /// \param cellSize the size of location cells (in degrees of latitude/longitude)
+    ///
+    DeclinationCache(const GeomagneticModelSet& models = GeomagneticModelSet::builtin(), double cellSize = 0.1);
+
+    inline const GeomagneticModelSet& models() const { return _models; }
+
+    ///
+    /// \return the declination, or an invalid angle if none of the models covers the date
+    ///
+    UAngle declination(QDate date, const GeoReference& reference);
+    UAngle declination(QDate date, UAngle latitude, UAngle longitude);
+
+    inline int size() const { return _cache.size(); }
+    inline void clear() { _cache.clear(); }
+
+private:
+    GeomagneticModelSet _models;
+    double _cellSize;
+    QHash<DeclinationCacheKey, double> _cache;
+};
+
+typedef QSharedPointer<DeclinationCache> DeclinationCachePtr;
+
+} // namespace dewalls
+
+#endif // DEWALLS_GEOMAGNETICMODEL_H
@@ -0,0 +1,33 @@
+#ifndef DEWALLS_GEOREFERENCE_H
+#define DEWALLS_GEOREFERENCE_H
+
+#include <QString>
+#include <QSharedPointer>
+#include "unitizeddouble.h"
+#include "length.h"
+#include "angle.h"
+#include "dewallsexport.h"
+
+namespace dewalls {
+
+struct DEWALLS_LIB_EXPORT GeoReference {
+    typedef UnitizedDouble<Length> ULength;
+    typedef UnitizedDouble<Angle> UAngle;
+
+    // positive for north, negative for south
+    int zone;
+    ULength northing;
+    ULength easting;
+    UAngle gridConvergence;
+    ULength elevation;
+    UAngle latitude;
+    UAngle longitude;
+    int wallsDatumIndex;
+    QString datumName;
+};
+
+typedef QSharedPointer<GeoReference> GeoReferencePtr;
+
+} // namespace dewalls
+
+#endif // DEWALLS_GEOREFERENCE_H
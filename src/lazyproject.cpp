@@ -0,0 +1,160 @@
+#include "lazyproject.h"
+#include <QMutexLocker>
+#include <climits>
+
+namespace dewalls {
+
+LazyProject::LazyProject(qint64 maxBytes)
+    : _root(),
+      _entries(),
+      _entryIndices(),
+      _projectMessages(),
+      _mutex(),
+      _cache(cost(maxBytes)),
+      _loadCount(0)
+{
+
+}
+
+int LazyProject::cost(qint64 bytes)
+{
+    return int(qBound(qint64(1), (bytes + 1023) / 1024, qint64(INT_MAX)));
+}
+
+bool LazyProject::open(QString projectFile)
+{
+    WallsProjectParser parser;
+    parser.setErrorRecovery(true);
+    QList<WallsMessage> messages;
+    QObject::connect(&parser, &WallsProjectParser::message, [&](WallsMessage message) {
+        messages << message;
+    });
+    WpjBookPtr root = parser.parseFile(projectFile);
+
+    QMutexLocker locker(&_mutex);
+    _cache.clear();
+    _loadCount = 0;
+    _projectMessages = messages;
+    _root = root;
+    _entries = parser.flatResult();
+    _entryIndices.clear();
+    for (int i = 0; i < _entries.size(); i++)
+    {
+        _entryIndices.insert(_entries[i].Entry.data(), i);
+    }
+    return !root.isNull();
+}
+
+ParsedSurveyPtr LazyProject::survey(const WpjEntryPtr& entry)
+{
+    QMutexLocker locker(&_mutex);
+    return lockedSurvey(locker, _entryIndices.value(entry.data(), -1));
+}
+
+ParsedSurveyPtr LazyProject::survey(int entryIndex)
+{
+    QMutexLocker locker(&_mutex);
+    return lockedSurvey(locker, entryIndex);
+}
+
+///
+/// \brief the body of survey(), called with _mutex held.  Unlocks it while parsing.
+///
+ParsedSurveyPtr LazyProject::lockedSurvey(QMutexLocker& locker, int entryIndex)
+{
+    if (entryIndex < 0 || entryIndex >= _entries.size() || !_entries[entryIndex].IsSurvey)
+    {
+        return ParsedSurveyPtr();
+    }
+    // a copy, since open() may replace the entries while the survey is parsed
+    const WpjFlatEntry entry = _entries[entryIndex];
+    const WpjEntry* key = entry.Entry.data();
+
+    // object() moves the survey to the front of the LRU list
+    ParsedSurveyPtr* cached = _cache.object(key);
+    if (cached)
+    {
+        return *cached;
+    }
+
+    // parse without holding the lock so that other surveys can be served meanwhile
+    locker.unlock();
+    ParsedSurveyPtr parsed(new ParsedSurvey(ProjectPipeline::parseSurvey(entry.AbsolutePath, entry)));
+    locker.relock();
+
+    if (_entryIndices.value(key, -1) != entryIndex || _entries[entryIndex].Entry != entry.Entry)
+    {
+        // the project was reopened meanwhile, so the result doesn't belong in the cache
+        return parsed;
+    }
+    _loadCount++;
+    cached = _cache.object(key);
+    if (cached)
+    {
+        return *cached;
+    }
+    // if the survey alone is bigger than the cache, this drops it but we still return it
+    _cache.insert(key, new ParsedSurveyPtr(parsed), cost(estimateBytes(*parsed)));
+    return parsed;
+}
+
+bool LazyProject::isCached(const WpjEntryPtr& entry) const
+{
+    QMutexLocker locker(&_mutex);
+    return _cache.contains(entry.data());
+}
+
+void LazyProject::setMaxBytes(qint64 maxBytes)
+{
+    QMutexLocker locker(&_mutex);
+    _cache.setMaxCost(cost(maxBytes));
+}
+
+qint64 LazyProject::maxBytes() const
+{
+    QMutexLocker locker(&_mutex);
+    return qint64(_cache.maxCost()) * 1024;
+}
+
+qint64 LazyProject::cachedBytes() const
+{
+    QMutexLocker locker(&_mutex);
+    return qint64(_cache.totalCost()) * 1024;
+}
+
+int LazyProject::cachedCount() const
+{
+    QMutexLocker locker(&_mutex);
+    return _cache.count();
+}
+
+int LazyProject::loadCount() const
+{
+    QMutexLocker locker(&_mutex);
+    return _loadCount;
+}
+
+void LazyProject::clearCache()
+{
+    QMutexLocker locker(&_mutex);
+    _cache.clear();
+}
+
+qint64 LazyProject::estimateBytes(const ParsedSurvey& survey)
+{
+    // the vectors' source segments share the decoded lines (2 bytes per character)
+    qint64 bytes = sizeof(ParsedSurvey) + survey.bytes * 2;
+    foreach (const Vector& vector, survey.vectors)
+    {
+        bytes += sizeof(VectorData) + (vector.from().size() + vector.to().size() +
+                                       vector.comment().size()) * 2;
+    }
+    bytes += qint64(survey.fixStations.size()) * sizeof(FixStationData);
+    foreach (const WallsMessage& message, survey.messages)
+    {
+        bytes += sizeof(WallsMessage) + message.message().size() * 2;
+    }
+    return bytes;
+}
+
+} // namespace dewalls
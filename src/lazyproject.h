@@ -0,0 +1,97 @@
+#ifndef DEWALLS_LAZYPROJECT_H
+#define DEWALLS_LAZYPROJECT_H
+
+#include <QCache>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+#include "projectpipeline.h"
+#include "wallsmessage.h"
+#include "wallsprojectparser.h"
+#include "dewallsexport.h"
+
+namespace dewalls {
+
+typedef QSharedPointer<const ParsedSurvey> ParsedSurveyPtr;
+
+///
+/// \brief a project whose survey files are parsed on demand.
+///
+/// open() parses the .WPJ tree right away, but each survey file is only parsed the first
+/// time survey() is called for it.  Its parser is set up from the entry's inherited
+/// project settings, so any survey can be loaded without loading the others.  Parsed
+/// surveys are kept in a least-recently-used cache bounded by their estimated memory use;
+/// the least recently used ones are dropped (and parsed again if they're needed later) to
+/// stay under maxBytes().
+///
+/// survey() may be called from multiple threads.  Two threads asking for the same survey
+/// that isn't cached may both parse it; one of the results is kept.
+///
+class DEWALLS_LIB_EXPORT LazyProject
+{
+public:
+    LazyProject(qint64 maxBytes = 64 * 1024 * 1024);
+
+    ///
+    /// \brief parses the given project file (but not its surveys) and clears the cache.
+    /// \return false if the project file couldn't be parsed
+    ///
+    bool open(QString projectFile);
+
+    inline WpjBookPtr root() const { return _root; }
+    ///
+    /// \return the project's entries in depth-first order
+    ///
+    inline const QVector<WpjFlatEntry>& entries() const { return _entries; }
+    ///
+    /// \return the messages from parsing the project file
+    ///
+    inline const QList<WallsMessage>& projectMessages() const { return _projectMessages; }
+
+    ///
+    /// \return the parsed contents of the given survey entry, parsing it if it isn't
+    /// cached, or a null pointer if the entry isn't a survey of this project
+    ///
+    ParsedSurveyPtr survey(const WpjEntryPtr& entry);
+    ParsedSurveyPtr survey(int entryIndex);
+    bool isCached(const WpjEntryPtr& entry) const;
+
+    void setMaxBytes(qint64 maxBytes);
+    qint64 maxBytes() const;
+    ///
+    /// \return the estimated memory used by the cached surveys
+    ///
+    qint64 cachedBytes() const;
+    int cachedCount() const;
+    ///
+    /// \return how many times a survey file has been parsed since open()
+    ///
+    int loadCount() const;
+    void clearCache();
+
+    ///
+    /// \return a rough estimate of the memory the given parse result uses
+    ///
+    static qint64 estimateBytes(const ParsedSurvey& survey);
+
+private:
+    // QCache costs are ints, so they're counted in KiB
+    static int cost(qint64 bytes);
+    ParsedSurveyPtr lockedSurvey(QMutexLocker& locker, int entryIndex);
+
+    WpjBookPtr _root;
+    QVector<WpjFlatEntry> _entries;
+    QHash<const WpjEntry*, int> _entryIndices;
+    QList<WallsMessage> _projectMessages;
+
+    mutable QMutex _mutex;
+    QCache<const WpjEntry*, ParsedSurveyPtr> _cache;
+    int _loadCount;
+};
+
+} // namespace dewalls
+
+#endif // DEWALLS_LAZYPROJECT_H
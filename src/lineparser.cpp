@@ -1,4 +1,7 @@
 #include "lineparser.h"
+#include "numberparsing.h"
+#include <QMutex>
+#include <QMutexLocker>
 
 namespace dewalls {
 
@@ -15,7 +18,8 @@ LineParser::LineParser(Segment line)
     : _line(line),
       _i(0),
       _expectedIndex(0),
-      _expectedItems(QStringList())
+      _expected(),
+      _profile(nullptr)
 {
 
 }
@@ -25,7 +29,7 @@ void LineParser::reset(QString newLine)
     _line = Segment(newLine);
     _i = 0;
     _expectedIndex = 0;
-    _expectedItems.clear();
+    _expected.clear();
 }
 
 void LineParser::reset(Segment newLine)
@@ -33,7 +37,7 @@ void LineParser::reset(Segment newLine)
     _line = newLine;
     _i = 0;
     _expectedIndex = 0;
-    _expectedItems.clear();
+    _expected.clear();
 }
 
 bool LineParser::isAtEnd() const
@@ -43,37 +47,37 @@ bool LineParser::isAtEnd() const
 
 void LineParser::addExpected(const SegmentParseExpectedException& expected)
 {
-    int index = std::max(expected.segment().sourceIndex(), 0) -
+    int index = std::max(expected.sourceIndex(), 0) -
             std::max(_line.sourceIndex(), 0);
 
     if (index > _expectedIndex)
     {
-        _expectedItems.clear();
+        _expected.clear();
         _expectedIndex = index;
     }
     if (index == _expectedIndex)
     {
-        _expectedItems << expected.expectedItems();
+        _expected |= expected.expectedTokens();
     }
 }
 
 SegmentParseExpectedException LineParser::allExpected()
 {
-    if (!_expectedItems.isEmpty())
+    if (!_expected.isEmpty())
     {
         return SegmentParseExpectedException(
-                    _line.atAsSegment(_i), _expectedItems);
+                    _line, _i, _expected);
     }
     return SegmentParseExpectedException(
-                _line.atAsSegment(_i), "<UNKNOWN>");
+                _line, _i, QStringLiteral("<UNKNOWN>"));
 }
 
 void LineParser::throwAllExpected()
 {
-    if (!_expectedItems.isEmpty())
+    if (!_expected.isEmpty())
     {
         throw SegmentParseExpectedException(
-                    _line.atAsSegment(_expectedIndex), _expectedItems);
+                    _line, _expectedIndex, _expected);
     }
 }
 
@@ -99,45 +103,30 @@ void LineParser::expect(const QChar &c, Qt::CaseSensitivity cs)
             return;
         }
     }
-    throw SegmentParseExpectedException(_line.atAsSegment(_i), QString(c));
+    throw SegmentParseExpectedException(_line, _i, QString(c));
 }
 
 void LineParser::expect(const QString &c, Qt::CaseSensitivity cs)
 {
-    if (_i + c.length() <= _line.length())
+    if (_i + c.length() <= _line.length() &&
+            _line.value().midRef(_i, c.length()).compare(c, cs) == 0)
     {
-        QString lhs = c;
-        QString rhs = _line.mid(_i, c.length()).value();
-        if (cs == Qt::CaseInsensitive)
-        {
-            lhs = lhs.toLower();
-            rhs = rhs.toLower();
-        }
-        if (lhs == rhs) {
-            _i += c.length();
-            return;
-        }
+        _i += c.length();
+        return;
     }
-    throw SegmentParseExpectedException(_line.atAsSegment(_i), c);
+    throw SegmentParseExpectedException(_line, _i, c);
 }
 
 Segment LineParser::expect(const QRegExp &rx, std::initializer_list<QString> expectedItems)
 {
-    QRegExp rxcopy = rx;
-    int index = indexIn(rxcopy, _line, _i);
-    if (index != _i) {
-        throw SegmentParseExpectedException(_line.atAsSegment(_i), expectedItems);
-    }
-    int start = _i;
-    _i += rxcopy.matchedLength();
-    return _line.mid(start, rxcopy.matchedLength());
+    return expect(localRx(rx), expectedItems);
 }
 
 Segment LineParser::expect(QRegExp &rx, std::initializer_list<QString> expectedItems)
 {
     int index = indexIn(rx, _line, _i);
     if (index != _i) {
-        throw SegmentParseExpectedException(_line.atAsSegment(_i), expectedItems);
+        throw SegmentParseExpectedException(_line, _i, expectedItems);
     }
     int start = _i;
     _i += rx.matchedLength();
@@ -148,16 +137,30 @@ Segment LineParser::expect(QRegExp &rx, QList<QString> expectedItems)
 {
     int index = indexIn(rx, _line, _i);
     if (index != _i) {
-        throw SegmentParseExpectedException(_line.atAsSegment(_i), expectedItems);
+        throw SegmentParseExpectedException(_line, _i, expectedItems);
     }
     int start = _i;
     _i += rx.matchedLength();
     return _line.mid(start, rx.matchedLength());
 }
 
+QRegExp& LineParser::localRx(const QRegExp& rx)
+{
+    auto it = _localRxs.find(&rx);
+    if (it == _localRxs.end())
+    {
+        // copying compiles rx in place if it hasn't been yet
+        static QMutex mutex;
+        QMutexLocker locker(&mutex);
+        it = _localRxs.insert(&rx, rx);
+    }
+    Q_ASSERT(it.value().pattern() == rx.pattern());
+    return it.value();
+}
+
 Segment LineParser::whitespace()
 {
-    return expect(whitespaceRx, {"<WHITESPACE>"});
+    return expect(whitespaceRx, {QStringLiteral("<WHITESPACE>")});
 }
 
 bool LineParser::maybeWhitespace()
@@ -167,14 +170,20 @@ bool LineParser::maybeWhitespace()
 
 Segment LineParser::nonwhitespace()
 {
-    return expect(nonwhitespaceRx, {"<NONWHITESPACE>"});
+    return expect(nonwhitespaceRx, {QStringLiteral("<NONWHITESPACE>")});
 }
 
 const QRegExp LineParser::unsignedIntLiteralRx("\\d+");
 
 uint LineParser::unsignedIntLiteral()
 {
-    return expect(unsignedIntLiteralRx, {"<UNSIGNED_INT_LITERAL>"}).value().toUInt();
+    // same as matching unsignedIntLiteralRx, but without copying the digits
+    uint value;
+    if (!parseUnsignedInt(_line.value(), _i, value))
+    {
+        throw SegmentParseExpectedException(_line, _i, QStringLiteral("<UNSIGNED_INT_LITERAL>"));
+    }
+    return value;
 }
 
 QHash<QChar, int> createIntSignSignums()
@@ -201,7 +210,13 @@ const QRegExp LineParser::unsignedDoubleLiteralRx("\\d+(\\.\\d*)?|\\.\\d+");
 
 double LineParser::unsignedDoubleLiteral()
 {
-    return expect(unsignedDoubleLiteralRx, {"<UNSIGNED_DOUBLE_LITERAL>"}).value().toDouble();
+    // same as matching unsignedDoubleLiteralRx, but without copying the digits
+    double value;
+    if (!parseUnsignedDecimal(_line.value(), _i, &value))
+    {
+        throw SegmentParseExpectedException(_line, _i, QStringLiteral("<UNSIGNED_DOUBLE_LITERAL>"));
+    }
+    return value;
 }
 
 QHash<QChar, double> createSignSignums()
@@ -228,7 +243,7 @@ void LineParser::endOfLine()
 {
     if (_i != _line.length())
     {
-        throw SegmentParseExpectedException(_line.atAsSegment(_i), "<END_OF_LINE>");
+        throw SegmentParseExpectedException(_line, _i, QStringLiteral("<END_OF_LINE>"));
     }
 }
 
@@ -14,11 +14,18 @@
 #include <initializer_list>
 #include <functional>
 #include "dewallsexport.h"
+#include "productionprofile.h"
 
 #include <iostream>
 
 namespace dewalls {
 
+///
+/// \brief the base of the recursive descent parsers.  Instances are reentrant but not
+/// thread-safe: separate instances can parse on separate threads at the same time, since
+/// the shared static patterns are only ever matched through each instance's own copies (see
+/// localRx()), but one instance must only be used by one thread at a time.
+///
 class DEWALLS_LIB_EXPORT LineParser
 {
 public:
@@ -30,6 +37,14 @@ public:
 
     bool isAtEnd() const;
 
+    ///
+    /// \brief sets where instrumented productions record their counters (nullptr to stop
+    /// recording).  Has no effect unless the library was compiled with
+    /// DEWALLS_PROFILE_PRODUCTIONS; see ProductionProfile.
+    ///
+    inline void setProductionProfile(ProductionProfile* profile) { _profile = profile; }
+    inline ProductionProfile* productionProfile() const { return _profile; }
+
     void addExpected(const SegmentParseExpectedException& ex);
 
     SegmentParseExpectedException allExpected();
@@ -38,6 +53,9 @@ public:
 
     void expect(const QChar& c, Qt::CaseSensitivity cs = Qt::CaseSensitive);
     void expect(const QString& c, Qt::CaseSensitivity cs = Qt::CaseSensitive);
+    ///
+    /// \brief matches a shared pattern through localRx(), so rx must be a static
+    ///
     Segment expect(const QRegExp& rx, std::initializer_list<QString> expectedItems);
     Segment expect(QRegExp& rx, std::initializer_list<QString> expectedItems);
     Segment expect(QRegExp &rx, QList<QString> expectedItems);
@@ -68,6 +86,9 @@ public:
     template<typename V>
     V oneOfMap(QHash<QChar, V> map, V elseValue);
 
+    ///
+    /// \brief matches a shared pattern through localRx(), so rx must be a static
+    ///
     template<typename V>
     V oneOfMapLowercase(const QRegExp& rx, QHash<QString, V> map);
 
@@ -114,10 +135,19 @@ public:
     static const QRegExp nonwhitespaceRx;
 
 protected:
+    ///
+    /// \return this parser's own copy of the given shared regular expression.  QRegExp keeps
+    /// match state, so shared patterns can't be matched directly.  The copies are kept by the
+    /// address of the original, so rx must be a static, never a temporary.
+    ///
+    QRegExp& localRx(const QRegExp& rx);
+
     Segment _line;
     int _i;
     int _expectedIndex;
-    QStringList _expectedItems;
+    ExpectedTokens _expected;
+    ProductionProfile* _profile;
+    QHash<const QRegExp*, QRegExp> _localRxs;
 };
 
 template<typename F>
@@ -263,18 +293,18 @@ void LineParser::oneOfWithLookahead(F production, Args... args)
 template<typename V>
 V LineParser::oneOfMap(QHash<QChar, V> map)
 {
-    QChar c;
-    if (_i >= _line.length() || !map.contains(c = _line.at(_i)))
+    typename QHash<QChar, V>::const_iterator it;
+    if (_i >= _line.length() || (it = map.constFind(_line.at(_i))) == map.constEnd())
     {
-        QList<QString> expectedItems;
-        for (QChar exp : map.keys())
+        ExpectedTokens expected;
+        for (auto exp = map.constBegin(); exp != map.constEnd(); ++exp)
         {
-            expectedItems << QString(exp);
+            expected.add(exp.key());
         }
-        throw SegmentParseExpectedException(_line.atAsSegment(_i), expectedItems);
+        throw SegmentParseExpectedException(_line, _i, expected);
     }
     _i++;
-    return map[c];
+    return it.value();
 }
 
 template<typename V>
@@ -294,22 +324,33 @@ V LineParser::oneOfMap(QHash<QChar, V> map, V elseValue)
 template<typename V>
 V LineParser::oneOfMapLowercase(const QRegExp& rx, QHash<QString, V> map)
 {
-    QRegExp rxCopy = rx;
-    return oneOfMapLowercase(rxCopy, map);
+    return oneOfMapLowercase(localRx(rx), map);
 }
 
 template<typename V>
 V LineParser::oneOfMapLowercase(QRegExp& rx, QHash<QString, V> map)
 {
-    int start = _i;
-    Segment seg = expect(rx, map.keys());
-    QString str = seg.toLower();
-    if (!map.contains(str))
+    auto keys = [&]() {
+        ExpectedTokens expected;
+        for (auto key = map.constBegin(); key != map.constEnd(); ++key)
+        {
+            expected.add(key.key());
+        }
+        return expected;
+    };
+
+    if (indexIn(rx, _line, _i) != _i)
     {
-        _i = start;
-        throw SegmentParseExpectedException(seg, map.keys());
+        throw SegmentParseExpectedException(_line, _i, keys());
+    }
+    int length = rx.matchedLength();
+    auto it = map.constFind(_line.value().mid(_i, length).toLower());
+    if (it == map.constEnd())
+    {
+        throw SegmentParseExpectedException(_line.mid(_i, length), keys());
     }
-    return map[str];
+    _i += length;
+    return it.value();
 }
 
 template<typename F>
@@ -375,7 +416,7 @@ QChar LineParser::expectChar(F charPredicate, std::initializer_list<QString> exp
     QChar c;
     if (_i >= _line.length() || !charPredicate(c = _line.at(_i)))
     {
-        throw SegmentParseExpectedException(_line.atAsSegment(_i), expectedItems);
+        throw SegmentParseExpectedException(_line, _i, expectedItems);
     }
     _i++;
     return c;
@@ -0,0 +1,216 @@
+#ifndef DEWALLS_NUMBERPARSING_H
+#define DEWALLS_NUMBERPARSING_H
+
+#include <cfloat>
+#include <climits>
+#include <QByteArray>
+#include <QChar>
+#include <QString>
+#include <QStringRef>
+#include <QtGlobal>
+
+namespace dewalls {
+
+namespace numberparsing {
+
+inline ushort unicode(QChar c)
+{
+    return c.unicode();
+}
+
+inline ushort unicode(char c)
+{
+    return uchar(c);
+}
+
+inline bool isAsciiDigit(QChar c)
+{
+    return uint(c.unicode() - '0') < 10u;
+}
+
+inline bool isAsciiDigit(char c)
+{
+    return uint(c - '0') < 10u;
+}
+
+// \d in QRegExp also matches non-ASCII digits, which QString conversions reject
+inline bool isOtherDigit(QChar c)
+{
+    return c.unicode() >= 0x80 && c.isDigit();
+}
+
+// raw bytes are only parsed as numbers where they're ASCII
+inline bool isOtherDigit(char)
+{
+    return false;
+}
+
+inline double toDouble(const QChar* s, int n)
+{
+    return QString::fromRawData(s, n).toDouble();
+}
+
+inline double toDouble(const char* s, int n)
+{
+    return QByteArray::fromRawData(s, n).toDouble();
+}
+
+// the powers of ten that are exactly representable as doubles
+static const double exactPowersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+} // namespace numberparsing
+
+///
+/// \brief reads the unsigned integer literal (what LineParser::unsignedIntLiteralRx matches)
+/// at text[i] without copying it, advancing i past it.  Like QString::toUInt(), the value is
+/// 0 if it doesn't fit in a uint.
+/// \return false, leaving i alone, if there's no literal at text[i]
+///
+inline bool parseUnsignedInt(const QString& text, int& i, uint& value)
+{
+    using namespace numberparsing;
+    const QChar* s = text.constData();
+    const int n = text.length();
+    const int start = i;
+    int j = i;
+    quint64 result = 0;
+    bool other = false;
+    while (j < n)
+    {
+        if (isAsciiDigit(s[j]))
+        {
+            if (result <= UINT_MAX)
+            {
+                result = result * 10 + (s[j].unicode() - '0');
+            }
+        }
+        else if (isOtherDigit(s[j]))
+        {
+            other = true;
+        }
+        else
+        {
+            break;
+        }
+        j++;
+    }
+    if (j == start)
+    {
+        return false;
+    }
+    i = j;
+    if (other)
+    {
+        value = QStringRef(&text, start, j - start).toUInt();
+    }
+    else
+    {
+        value = result <= UINT_MAX ? uint(result) : 0;
+    }
+    return true;
+}
+
+namespace numberparsing {
+
+template<typename Char>
+bool parseUnsignedDecimal(const Char* s, int n, int& i, double* value)
+{
+    const int start = i;
+    int j = i;
+    bool hasDigits = false;
+    bool other = false;
+    // the value is mantissa * 10^exponent, with significant digits in mantissa
+    quint64 mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    bool fraction = false;
+    while (j < n)
+    {
+        Char c = s[j];
+        if (isAsciiDigit(c))
+        {
+            int digit = unicode(c) - '0';
+            if (significant > 0 || digit != 0)
+            {
+                if (significant < 19)
+                {
+                    mantissa = mantissa * 10 + digit;
+                }
+                significant++;
+            }
+            if (fraction)
+            {
+                exponent--;
+            }
+            hasDigits = true;
+        }
+        else if (isOtherDigit(c))
+        {
+            other = hasDigits = true;
+        }
+        else if (c == '.' && !fraction)
+        {
+            fraction = true;
+        }
+        else
+        {
+            break;
+        }
+        j++;
+    }
+    if (!hasDigits)
+    {
+        return false;
+    }
+    i = j;
+    if (!value)
+    {
+        return true;
+    }
+#if FLT_EVAL_METHOD == 0
+    // both operands are exact, so the one rounding of the division is the correct one
+    if (!other && significant <= 15 && exponent >= -22)
+    {
+        *value = double(mantissa) / exactPowersOfTen[-exponent];
+        return true;
+    }
+#endif
+    *value = toDouble(s + start, j - start);
+    return true;
+}
+
+} // namespace numberparsing
+
+///
+/// \brief reads the unsigned decimal literal (what LineParser::unsignedDoubleLiteralRx
+/// matches, like "12", "12.", "12.5" or ".5") at text[i] without copying it, advancing i
+/// past it.
+///
+/// The result is the same correctly rounded double QString::toDouble() gives.  Literals with
+/// at most 15 significant digits and 22 decimal places -- all the ones in a typical survey --
+/// are converted with a single exact division (Clinger's fast path); longer ones fall back to
+/// QString::toDouble().
+///
+/// \param value where to store the value, or nullptr to just skip the literal
+/// \return false, leaving i alone, if there's no literal at text[i]
+///
+inline bool parseUnsignedDecimal(const QString& text, int& i, double* value)
+{
+    return numberparsing::parseUnsignedDecimal(text.constData(), text.length(), i, value);
+}
+
+///
+/// \brief the same as parseUnsignedDecimal(const QString&, int&, double*), but reads the
+/// literal from the raw bytes of a line (only ASCII digits count)
+///
+inline bool parseUnsignedDecimal(const char* s, int n, int& i, double* value)
+{
+    return numberparsing::parseUnsignedDecimal(s, n, i, value);
+}
+
+} // namespace dewalls
+
+#endif // DEWALLS_NUMBERPARSING_H
@@ -0,0 +1,316 @@
+#include "passagemesh.h"
+#include <QtConcurrentMap>
+#include <cmath>
+#include <algorithm>
+
+namespace dewalls {
+
+typedef UnitizedDouble<Length> ULength;
+typedef UnitizedDouble<Angle> UAngle;
+
+namespace {
+
+///
+/// \brief a horizontal direction; invalid if it couldn't be determined (e.g. vertical shots)
+///
+struct Direction {
+    double east;
+    double north;
+    bool valid;
+};
+
+Direction direction(double east, double north)
+{
+    double length = sqrt(east * east + north * north);
+    if (length < 1e-9)
+    {
+        return Direction{0.0, 0.0, false};
+    }
+    return Direction{east / length, north / length, true};
+}
+
+Direction shotDirection(const PassageShot& shot)
+{
+    return direction(shot.to[0] - shot.from[0], shot.to[1] - shot.from[1]);
+}
+
+Direction bisect(Direction a, Direction b)
+{
+    if (!a.valid) return b;
+    if (!b.valid) return a;
+    Direction result = direction(a.east + b.east, a.north + b.north);
+    // a U-turn; face the way the passage came from
+    return result.valid ? result : a;
+}
+
+bool hasLruds(const PassageShot& shot)
+{
+    return shot.left >= 0 || shot.right >= 0 || shot.up >= 0 || shot.down >= 0;
+}
+
+bool lrudsAtToStation(const PassageShot& shot)
+{
+    return shot.lrudType == LrudType::To || shot.lrudType == LrudType::TB;
+}
+
+bool lrudsBisect(const PassageShot& shot)
+{
+    return shot.lrudType == LrudType::FB || shot.lrudType == LrudType::TB;
+}
+
+} // anonymous namespace
+
+PassageShot::PassageShot()
+    : fromName(),
+      toName(),
+      left(-1.0),
+      right(-1.0),
+      up(-1.0),
+      down(-1.0),
+      facingAzimuth(NAN),
+      lrudType(LrudType::From)
+{
+    std::fill(from, from + 3, 0.0);
+    std::fill(to, to + 3, 0.0);
+}
+
+PassageShot PassageShot::fromVector(const Vector& vector, const double from[3], const double to[3])
+{
+    WallsUnits units = vector.units();
+
+    auto lrud = [&](ULength measurement) {
+        if (!measurement.isValid())
+        {
+            return -1.0;
+        }
+        return std::max(0.0, double(WallsUnits::correctLength(measurement, units.incs()).get(Length::Meters)));
+    };
+
+    PassageShot result;
+    result.fromName = vector.from();
+    result.toName = vector.to();
+    std::copy(from, from + 3, result.from);
+    std::copy(to, to + 3, result.to);
+    result.left = lrud(vector.left());
+    result.right = lrud(vector.right());
+    result.up = lrud(vector.up());
+    result.down = lrud(vector.down());
+    if (vector.lrudAngle().isValid())
+    {
+        // compass reading -> true -> grid
+        result.facingAzimuth = (vector.lrudAngle() + units.decl() - units.grid()).get(Angle::Degrees);
+    }
+    result.lrudType = units.lrud();
+    return result;
+}
+
+PassageMeshBuilder::PassageMeshBuilder()
+    : PassageMeshBuilder(QVector<PassageShot>())
+{
+
+}
+
+PassageMeshBuilder::PassageMeshBuilder(const QVector<PassageShot>& shots)
+    : _shots(),
+      _passages(),
+      _vertexCount(0),
+      _indexCount(0)
+{
+    std::fill(_origin, _origin + 3, 0.0);
+    setShots(shots);
+}
+
+void PassageMeshBuilder::setOrigin(double east, double north, double up)
+{
+    _origin[0] = east;
+    _origin[1] = north;
+    _origin[2] = up;
+}
+
+void PassageMeshBuilder::setShots(const QVector<PassageShot>& shots)
+{
+    _shots = shots;
+    _passages.clear();
+    _vertexCount = 0;
+    _indexCount = 0;
+
+    for (int i = 0; i < _shots.size(); i++)
+    {
+        const PassageShot& shot = _shots[i];
+        if (shot.fromName.isEmpty() || shot.toName.isEmpty())
+        {
+            // LRUD-only lines and shots from/to unnamed stations don't connect to anything
+            continue;
+        }
+        if (!_passages.isEmpty())
+        {
+            Passage& last = _passages.last();
+            if (last.firstShot + last.shotCount == i &&
+                    _shots[i - 1].toName == shot.fromName)
+            {
+                last.shotCount++;
+                continue;
+            }
+        }
+        _passages << Passage{i, 1, 0, 0};
+    }
+
+    for (Passage& passage : _passages)
+    {
+        passage.vertexOffset = _vertexCount;
+        passage.indexOffset = _indexCount;
+        _vertexCount += vertexCount(passage);
+        _indexCount += indexCount(passage);
+    }
+}
+
+int PassageMeshBuilder::vertexCount(const Passage& passage)
+{
+    // a cross section at each station
+    return (passage.shotCount + 1) * 4;
+}
+
+int PassageMeshBuilder::indexCount(const Passage& passage)
+{
+    // 4 quads between each pair of cross sections, and a quad capping each end
+    return passage.shotCount * 4 * 6 + 2 * 6;
+}
+
+int PassageMeshBuilder::vertexBufferSize() const
+{
+    return _vertexCount * 3;
+}
+
+int PassageMeshBuilder::indexBufferSize() const
+{
+    return _indexCount;
+}
+
+PassageMesh PassageMeshBuilder::build() const
+{
+    PassageMesh mesh;
+    mesh.vertices.resize(vertexBufferSize());
+    mesh.indices.resize(indexBufferSize());
+    build(mesh.vertices.data(), mesh.indices.data());
+    return mesh;
+}
+
+void PassageMeshBuilder::build(float* vertices, quint32* indices, quint32 baseVertex) const
+{
+    QVector<Passage> passages = _passages;
+    QtConcurrent::blockingMap(passages, [&](const Passage& passage) {
+        buildPassage(passage, vertices, indices, baseVertex);
+    });
+}
+
+void PassageMeshBuilder::buildPassage(const Passage& passage, float* vertices, quint32* indices, quint32 baseVertex) const
+{
+    const PassageShot* shots = _shots.constData() + passage.firstShot;
+    const int stationCount = passage.shotCount + 1;
+
+    float* v = vertices + passage.vertexOffset * 3;
+
+    for (int k = 0; k < stationCount; k++)
+    {
+        const PassageShot* before = k > 0 ? &shots[k - 1] : nullptr;
+        const PassageShot* after = k < passage.shotCount ? &shots[k] : nullptr;
+
+        // find the shot the LRUDs at this station were measured on
+        const PassageShot* source = nullptr;
+        if (after && !lrudsAtToStation(*after) && hasLruds(*after))
+        {
+            source = after;
+        }
+        else if (before && lrudsAtToStation(*before) && hasLruds(*before))
+        {
+            source = before;
+        }
+
+        Direction beforeDir = before ? shotDirection(*before) : Direction{0.0, 0.0, false};
+        Direction afterDir = after ? shotDirection(*after) : Direction{0.0, 0.0, false};
+
+        Direction facing;
+        if (source && !std::isnan(source->facingAzimuth))
+        {
+            double azm = UAngle(source->facingAzimuth, Angle::Degrees).get(Angle::Radians);
+            facing = Direction{sin(azm), cos(azm), true};
+        }
+        else if (source && !lrudsBisect(*source))
+        {
+            facing = shotDirection(*source);
+            if (!facing.valid)
+            {
+                facing = bisect(beforeDir, afterDir);
+            }
+        }
+        else
+        {
+            facing = bisect(beforeDir, afterDir);
+        }
+        if (!facing.valid)
+        {
+            facing = Direction{0.0, 1.0, true};
+        }
+
+        const double* station = after ? after->from : before->to;
+        double x = station[0] - _origin[0];
+        double y = station[1] - _origin[1];
+        double z = station[2] - _origin[2];
+
+        double left = source ? std::max(source->left, 0.0) : 0.0;
+        double right = source ? std::max(source->right, 0.0) : 0.0;
+        double up = source ? std::max(source->up, 0.0) : 0.0;
+        double down = source ? std::max(source->down, 0.0) : 0.0;
+
+        // facing north, left is west
+        double leftEast = -facing.north;
+        double leftNorth = facing.east;
+
+        *v++ = float(x + leftEast * left);
+        *v++ = float(y + leftNorth * left);
+        *v++ = float(z);
+
+        *v++ = float(x);
+        *v++ = float(y);
+        *v++ = float(z + up);
+
+        *v++ = float(x - leftEast * right);
+        *v++ = float(y - leftNorth * right);
+        *v++ = float(z);
+
+        *v++ = float(x);
+        *v++ = float(y);
+        *v++ = float(z - down);
+    }
+
+    quint32* i = indices + passage.indexOffset;
+    const quint32 first = baseVertex + quint32(passage.vertexOffset);
+
+    for (int k = 0; k < passage.shotCount; k++)
+    {
+        quint32 a = first + quint32(k * 4);
+        quint32 b = a + 4;
+        for (quint32 j = 0; j < 4; j++)
+        {
+            quint32 j1 = (j + 1) % 4;
+            *i++ = a + j;
+            *i++ = a + j1;
+            *i++ = b + j1;
+
+            *i++ = a + j;
+            *i++ = b + j1;
+            *i++ = b + j;
+        }
+    }
+
+    // start cap faces backward, end cap faces forward
+    quint32 s = first;
+    *i++ = s; *i++ = s + 2; *i++ = s + 1;
+    *i++ = s; *i++ = s + 3; *i++ = s + 2;
+
+    quint32 e = first + quint32(passage.shotCount * 4);
+    *i++ = e; *i++ = e + 1; *i++ = e + 2;
+    *i++ = e; *i++ = e + 2; *i++ = e + 3;
+}
+
+} // namespace dewalls
@@ -0,0 +1,129 @@
+#ifndef DEWALLS_PASSAGEMESH_H
+#define DEWALLS_PASSAGEMESH_H
+
+#include <QString>
+#include <QVector>
+#include "vector.h"
+#include "wallstypes.h"
+#include "dewallsexport.h"
+
+namespace dewalls {
+
+///
+/// \brief a reduced shot and the LRUDs measured on it; the input to PassageMeshBuilder.
+/// Positions are in meters, in a right-handed east/north/up frame.
+///
+struct DEWALLS_LIB_EXPORT PassageShot {
+    PassageShot();
+
+    QString fromName;
+    QString toName;
+    double from[3];
+    double to[3];
+    // LRUD distances in meters; negative means not measured
+    double left;
+    double right;
+    double up;
+    double down;
+    // the direction the LRUDs face, in degrees clockwise from the frame's north, or NaN if
+    // they're perpendicular to the shot(s)
+    double facingAzimuth;
+    LrudType lrudType;
+
+    ///
+    /// \brief creates a PassageShot from a parsed vector and the reduced positions of its
+    /// stations.  LRUDs are corrected by the vector's incs, and the facing angle (if any) is
+    /// converted from a compass reading to the grid frame using its decl and grid.
+    ///
+    static PassageShot fromVector(const Vector& vector, const double from[3], const double to[3]);
+};
+
+///
+/// \brief indexed triangle geometry of passage walls.  Vertices are packed x, y, z floats;
+/// every three indices form a counterclockwise (outward facing) triangle.
+///
+struct DEWALLS_LIB_EXPORT PassageMesh {
+    QVector<float> vertices;
+    QVector<quint32> indices;
+
+    inline int vertexCount() const { return vertices.size() / 3; }
+    inline int triangleCount() const { return indices.size() / 3; }
+};
+
+///
+/// \brief builds passage wall meshes from reduced shots and their LRUDs.
+///
+/// Shots are grouped into passages: runs of consecutive shots where each shot starts at the
+/// station the previous one ended at.  Each station along a passage gets a diamond-shaped
+/// cross section (left, up, right and down points) oriented according to the LrudType of the
+/// shot it was measured on, and consecutive cross sections are joined with quads; the ends of
+/// each passage are capped.
+///
+/// Building happens in two passes: the first computes the size and buffer offsets of every
+/// passage, so the output can be allocated once (or supplied by the caller); the second
+/// generates the passages in parallel, each one writing directly into its own range of the
+/// buffers.
+///
+class DEWALLS_LIB_EXPORT PassageMeshBuilder
+{
+public:
+    PassageMeshBuilder();
+    PassageMeshBuilder(const QVector<PassageShot>& shots);
+
+    void setShots(const QVector<PassageShot>& shots);
+    inline QVector<PassageShot> shots() const { return _shots; }
+
+    ///
+    /// \brief sets a point subtracted from all positions before they're converted to floats.
+    /// Use a point near the survey (e.g. a fixed station) when working in UTM coordinates,
+    /// which are too large to represent precisely as floats.
+    ///
+    void setOrigin(double east, double north, double up);
+
+    ///
+    /// \return the number of passages the shots were grouped into
+    ///
+    inline int passageCount() const { return _passages.size(); }
+    ///
+    /// \return the number of floats build() will write to the vertex buffer
+    ///
+    int vertexBufferSize() const;
+    ///
+    /// \return the number of indices build() will write to the index buffer
+    ///
+    int indexBufferSize() const;
+
+    ///
+    /// \brief generates the mesh into caller-allocated buffers
+    /// \param vertices must have room for vertexBufferSize() floats
+    /// \param indices must have room for indexBufferSize() indices
+    /// \param baseVertex added to every index written, for appending to existing geometry
+    ///
+    void build(float* vertices, quint32* indices, quint32 baseVertex = 0) const;
+    PassageMesh build() const;
+
+private:
+    struct Passage {
+        // range of _shots
+        int firstShot;
+        int shotCount;
+        // offsets into the output buffers, in vertices and indices
+        int vertexOffset;
+        int indexOffset;
+    };
+
+    static int vertexCount(const Passage& passage);
+    static int indexCount(const Passage& passage);
+
+    void buildPassage(const Passage& passage, float* vertices, quint32* indices, quint32 baseVertex) const;
+
+    QVector<PassageShot> _shots;
+    QVector<Passage> _passages;
+    double _origin[3];
+    int _vertexCount;
+    int _indexCount;
+};
+
+} // namespace dewalls
+
+#endif // DEWALLS_PASSAGEMESH_H
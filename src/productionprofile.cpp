@@ -0,0 +1,141 @@
+#include "productionprofile.h"
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QTextStream>
+#include <algorithm>
+
+namespace dewalls {
+
+namespace {
+
+struct ProductionRegistry {
+    QMutex mutex;
+    QStringList names;
+    QHash<QString, int> ids;
+};
+
+ProductionRegistry& registry()
+{
+    static ProductionRegistry registry;
+    return registry;
+}
+
+} // anonymous namespace
+
+ProductionStats::ProductionStats()
+    : entered(0),
+      succeeded(0),
+      backtracks(0),
+      nanos(0)
+{
+
+}
+
+bool ProductionProfile::isCompiledIn()
+{
+#ifdef DEWALLS_PROFILE_PRODUCTIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+int ProductionProfile::productionId(const char* name)
+{
+    ProductionRegistry& r = registry();
+    QMutexLocker locker(&r.mutex);
+    QString key = QString::fromLatin1(name);
+    auto it = r.ids.find(key);
+    if (it != r.ids.end())
+    {
+        return it.value();
+    }
+    int id = r.names.size();
+    r.names << key;
+    r.ids[key] = id;
+    return id;
+}
+
+QString ProductionProfile::productionName(int id)
+{
+    ProductionRegistry& r = registry();
+    QMutexLocker locker(&r.mutex);
+    return r.names.value(id);
+}
+
+int ProductionProfile::productionCount()
+{
+    ProductionRegistry& r = registry();
+    QMutexLocker locker(&r.mutex);
+    return r.names.size();
+}
+
+ProductionStats ProductionProfile::stats(int id) const
+{
+    return id >= 0 && id < _stats.size() ? _stats[id] : ProductionStats();
+}
+
+ProductionStats ProductionProfile::stats(const QString& name) const
+{
+    ProductionRegistry& r = registry();
+    int id;
+    {
+        QMutexLocker locker(&r.mutex);
+        id = r.ids.value(name, -1);
+    }
+    return stats(id);
+}
+
+void ProductionProfile::clear()
+{
+    _stats.clear();
+}
+
+void ProductionProfile::merge(const ProductionProfile& other)
+{
+    for (int id = 0; id < other._stats.size(); id++)
+    {
+        const ProductionStats& src = other._stats[id];
+        ProductionStats& dest = at(id);
+        dest.entered += src.entered;
+        dest.succeeded += src.succeeded;
+        dest.backtracks += src.backtracks;
+        dest.nanos += src.nanos;
+    }
+}
+
+QString ProductionProfile::report() const
+{
+    QVector<int> ids;
+    for (int id = 0; id < _stats.size(); id++)
+    {
+        if (_stats[id].entered)
+        {
+            ids << id;
+        }
+    }
+    std::sort(ids.begin(), ids.end(), [&](int a, int b) {
+        return _stats[a].nanos > _stats[b].nanos;
+    });
+
+    QString result;
+    QTextStream out(&result);
+    out << qSetFieldWidth(28) << left << "production" << qSetFieldWidth(12) << right
+        << "entered" << "succeeded" << "failed" << "backtracks" << "ms" << "ns/entry"
+        << qSetFieldWidth(0) << "\n";
+    foreach (int id, ids)
+    {
+        const ProductionStats& s = _stats[id];
+        out << qSetFieldWidth(28) << left << productionName(id) << qSetFieldWidth(12) << right
+            << s.entered << s.succeeded << s.failed() << s.backtracks
+            << QString::number(s.nanos / 1e6, 'f', 2)
+            << QString::number(double(s.nanos) / s.entered, 'f', 0)
+            << qSetFieldWidth(0) << "\n";
+    }
+    out.flush();
+    return result;
+}
+
+} // namespace dewalls
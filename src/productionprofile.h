@@ -0,0 +1,174 @@
+#ifndef DEWALLS_PRODUCTIONPROFILE_H
+#define DEWALLS_PRODUCTIONPROFILE_H
+
+#include <QString>
+#include <QVector>
+#include <chrono>
+#include "dewallsexport.h"
+
+namespace dewalls {
+
+///
+/// \brief counters for one grammar production
+///
+struct ProductionStats {
+    ProductionStats();
+
+    // how many times the production was entered
+    quint64 entered;
+    // how many times it returned normally
+    quint64 succeeded;
+    // how many times it failed after consuming input, forcing the caller to rewind or give up
+    quint64 backtracks;
+    // total time spent inside the production (including nested productions)
+    qint64 nanos;
+
+    inline quint64 failed() const { return entered - succeeded; }
+};
+
+///
+/// \brief per-production counters collected by a LineParser.
+///
+/// The productions are only instrumented when the library is compiled with
+/// DEWALLS_PROFILE_PRODUCTIONS defined (the qbs project property profileProductions);
+/// otherwise the instrumentation compiles to nothing and profiles stay empty.  Give each
+/// parser (and thread) its own profile and merge() them afterward.
+///
+class DEWALLS_LIB_EXPORT ProductionProfile
+{
+public:
+    ///
+    /// \return whether the library was compiled with production profiling
+    ///
+    static bool isCompiledIn();
+
+    ///
+    /// \return the id for the production with the given name, registering it if necessary.
+    /// Ids are process-wide and stable for the lifetime of the process.
+    ///
+    static int productionId(const char* name);
+    static QString productionName(int id);
+    static int productionCount();
+
+    ///
+    /// \return the counters for the given production id (zeros if it was never entered)
+    ///
+    ProductionStats stats(int id) const;
+    ProductionStats stats(const QString& name) const;
+
+    inline bool isEmpty() const { return _stats.isEmpty(); }
+    void clear();
+    void merge(const ProductionProfile& other);
+
+    ///
+    /// \return a table of the entered productions, most time-consuming first
+    ///
+    QString report() const;
+
+    inline ProductionStats& at(int id)
+    {
+        if (id >= _stats.size())
+        {
+            _stats.resize(id + 1);
+        }
+        return _stats[id];
+    }
+
+private:
+    QVector<ProductionStats> _stats;
+};
+
+///
+/// \brief records entry into a production on construction and success, failure or
+/// backtracking on destruction.  Use the DEWALLS_PRODUCTION macro rather than this directly.
+///
+/// The production succeeded if it called succeed() (through DEWALLS_PRODUCTION_SUCCEEDED or
+/// DEWALLS_PRODUCTION_RETURN) before the scope ended; otherwise it's being unwound by an
+/// exception.
+///
+class ProductionScope
+{
+public:
+    inline ProductionScope(ProductionProfile* profile, int id, const int& position)
+        : _profile(profile),
+          _id(id),
+          _position(position),
+          _start(position),
+          _succeeded(false)
+    {
+        if (_profile)
+        {
+            _profile->at(_id).entered++;
+            _startTime = std::chrono::steady_clock::now();
+        }
+    }
+
+    inline ~ProductionScope()
+    {
+        if (!_profile)
+        {
+            return;
+        }
+        // nested productions may have grown the profile, so look the counters up again
+        ProductionStats& stats = _profile->at(_id);
+        stats.nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - _startTime).count();
+        if (_succeeded)
+        {
+            stats.succeeded++;
+        }
+        else if (_position > _start)
+        {
+            stats.backtracks++;
+        }
+    }
+
+    inline void succeed()
+    {
+        _succeeded = true;
+    }
+
+    ///
+    /// \brief marks the production as succeeded once its return value has been computed
+    ///
+    template<typename T>
+    inline T succeed(T value)
+    {
+        _succeeded = true;
+        return value;
+    }
+
+private:
+    ProductionScope(const ProductionScope&) = delete;
+    ProductionScope& operator=(const ProductionScope&) = delete;
+
+    ProductionProfile* _profile;
+    int _id;
+    const int& _position;
+    int _start;
+    bool _succeeded;
+    std::chrono::steady_clock::time_point _startTime;
+};
+
+} // namespace dewalls
+
+///
+/// Instruments the enclosing LineParser member function as the named production.  Every
+/// normal exit from the production must be marked with DEWALLS_PRODUCTION_SUCCEEDED() (before
+/// a return from a void function, or at its end) or DEWALLS_PRODUCTION_RETURN(value);
+/// unmarked exits count as failures.  These compile to nothing (or a plain return) unless
+/// DEWALLS_PROFILE_PRODUCTIONS is defined.
+///
+#ifdef DEWALLS_PROFILE_PRODUCTIONS
+#define DEWALLS_PRODUCTION(name) \
+    static const int _productionId = ::dewalls::ProductionProfile::productionId(name); \
+    ::dewalls::ProductionScope _productionScope(_profile, _productionId, _i)
+#define DEWALLS_PRODUCTION_SUCCEEDED() _productionScope.succeed()
+#define DEWALLS_PRODUCTION_RETURN(...) return _productionScope.succeed(__VA_ARGS__)
+#else
+#define DEWALLS_PRODUCTION(name)
+#define DEWALLS_PRODUCTION_SUCCEEDED()
+#define DEWALLS_PRODUCTION_RETURN(...) return __VA_ARGS__
+#endif
+
+#endif // DEWALLS_PRODUCTIONPROFILE_H
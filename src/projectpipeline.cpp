@@ -0,0 +1,457 @@
+#include "projectpipeline.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFuture>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QQueue>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <QtConcurrentRun>
+#include "wallssurveyparser.h"
+#include "segmentparseexception.h"
+
+namespace dewalls {
+
+ParsedSurvey::ParsedSurvey()
+    : index(-1),
+      fileName(),
+      entry(),
+      vectors(),
+      fixStations(),
+      flags(),
+      notes(),
+      messages(),
+      bytes(0),
+      lines(0),
+      errors(0),
+      errorSummary(),
+      opened(false),
+      readNanos(0),
+      parseNanos(0),
+      profile()
+{
+
+}
+
+PipelineStageStats::PipelineStageStats()
+    : name(),
+      threads(0),
+      items(0),
+      busyNanos(0),
+      starvedNanos(0),
+      blockedNanos(0)
+{
+
+}
+
+namespace {
+
+///
+/// \brief a FIFO queue between two stages.  push() blocks while the queue is full, and
+/// pop() blocks while it's empty and any producer is still running.
+///
+template<typename T>
+class BoundedQueue
+{
+public:
+    BoundedQueue(int capacity, int producers)
+        : _capacity(capacity),
+          _producers(producers)
+    {
+
+    }
+
+    ///
+    /// \return how long it waited for room in the queue
+    ///
+    qint64 push(const T& item)
+    {
+        QMutexLocker locker(&_mutex);
+        QElapsedTimer timer;
+        timer.start();
+        while (_items.size() >= _capacity)
+        {
+            _notFull.wait(&_mutex);
+        }
+        qint64 waited = timer.nsecsElapsed();
+        _items.enqueue(item);
+        _notEmpty.wakeOne();
+        return waited;
+    }
+
+    ///
+    /// \return false once the queue is empty and all producers are done
+    ///
+    bool pop(T& item, qint64& waited)
+    {
+        QMutexLocker locker(&_mutex);
+        QElapsedTimer timer;
+        timer.start();
+        while (_items.isEmpty() && _producers > 0)
+        {
+            _notEmpty.wait(&_mutex);
+        }
+        waited = timer.nsecsElapsed();
+        if (_items.isEmpty())
+        {
+            return false;
+        }
+        item = _items.dequeue();
+        _notFull.wakeOne();
+        return true;
+    }
+
+    void producerDone()
+    {
+        QMutexLocker locker(&_mutex);
+        if (--_producers == 0)
+        {
+            _notEmpty.wakeAll();
+        }
+    }
+
+private:
+    QMutex _mutex;
+    QWaitCondition _notFull;
+    QWaitCondition _notEmpty;
+    QQueue<T> _items;
+    const int _capacity;
+    int _producers;
+};
+
+struct ReadSurvey {
+    ParsedSurvey survey;
+    QByteArray data;
+};
+
+///
+/// \brief accumulates the timings of one stage across its threads
+///
+class StageCounter
+{
+public:
+    StageCounter(QString name, int threads)
+    {
+        _stats.name = name;
+        _stats.threads = threads;
+    }
+
+    void add(int items, qint64 busyNanos, qint64 starvedNanos, qint64 blockedNanos)
+    {
+        QMutexLocker locker(&_mutex);
+        _stats.items += items;
+        _stats.busyNanos += busyNanos;
+        _stats.starvedNanos += starvedNanos;
+        _stats.blockedNanos += blockedNanos;
+    }
+
+    inline PipelineStageStats stats() const { return _stats; }
+
+private:
+    QMutex _mutex;
+    PipelineStageStats _stats;
+};
+
+void readSurvey(ReadSurvey& item)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    ParsedSurvey& survey = item.survey;
+    QFile file(survey.fileName);
+    if (!file.open(QFile::ReadOnly))
+    {
+        survey.messages << WallsMessage("error", QString("I couldn't open %1").arg(survey.fileName));
+        survey.errors++;
+    }
+    else
+    {
+        survey.opened = true;
+        item.data = file.readAll();
+        survey.bytes = item.data.size();
+    }
+    survey.readNanos = timer.nsecsElapsed();
+}
+
+void parseContents(ReadSurvey& item, bool profile, WallsSurveyParser::Events events, bool topology,
+                   DeclinationCachePtr declinations)
+{
+    ParsedSurvey& survey = item.survey;
+    if (!survey.opened)
+    {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    WallsSurveyParser parser;
+    // keep going so that all of the errors in a project get reported in one run
+    parser.setErrorRecovery(true);
+    parser.setEvents(events);
+    parser.setTopologyMode(topology);
+    if (profile)
+    {
+        parser.setProductionProfile(&survey.profile);
+    }
+    QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector v) { survey.vectors << v; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedFixStation, [&](FixStation s) { survey.fixStations << s; });
+    QObject::connect(&parser, &WallsSurveyParser::message, [&](WallsMessage m) { survey.messages << m; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedFlag, [&](QStringList stations, QString flag) {
+        for (QString& station : stations)
+        {
+            station = parser.units().processStationName(station);
+        }
+        survey.flags << qMakePair(stations, flag);
+    });
+    QObject::connect(&parser, &WallsSurveyParser::parsedNote, [&](QString station, QString note) {
+        survey.notes << qMakePair(parser.units().processStationName(station), note);
+    });
+
+    if (!survey.entry.Entry.isNull())
+    {
+        try
+        {
+            parser.setProjectEntry(survey.entry, declinations);
+        }
+        catch (const SegmentParseException& ex)
+        {
+            survey.messages << WallsMessage(ex);
+            survey.errors++;
+        }
+    }
+
+    survey.lines = parser.parseBuffer(item.data, survey.fileName);
+    survey.errors += parser.errorCount();
+    survey.errorSummary = parser.errorSummary(survey.fileName);
+    // the parsed data no longer refers to the file contents
+    item.data = QByteArray();
+    survey.parseNanos = timer.nsecsElapsed();
+}
+
+} // anonymous namespace
+
+ProjectPipeline::ProjectPipeline()
+    : _reducer(),
+      _parseThreadCount(qMax(1, QThread::idealThreadCount())),
+      _readThreadCount(1),
+      _queueCapacity(2 * _parseThreadCount),
+      _profileProductions(false),
+      _events(WallsSurveyParser::AllEvents),
+      _lintMode(false),
+      _topologyMode(false),
+      _geomagneticModels(GeomagneticModelSet::builtin()),
+      _projectMessages(),
+      _projectErrorCount(0),
+      _surveyCount(0),
+      _stageStats(),
+      _wallNanos(0)
+{
+
+}
+
+void ProjectPipeline::setParseThreadCount(int count)
+{
+    _parseThreadCount = qMax(1, count);
+}
+
+void ProjectPipeline::setReadThreadCount(int count)
+{
+    _readThreadCount = qMax(1, count);
+}
+
+void ProjectPipeline::setQueueCapacity(int capacity)
+{
+    _queueCapacity = qMax(1, capacity);
+}
+
+ParsedSurvey ProjectPipeline::parseSurvey(QString fileName, const WpjFlatEntry& entry,
+                                          DeclinationCachePtr declinations, bool profile,
+                                          WallsSurveyParser::Events events)
+{
+    ReadSurvey item;
+    item.survey.index = 0;
+    item.survey.fileName = fileName;
+    item.survey.entry = entry;
+    readSurvey(item);
+    parseContents(item, profile, events, false, declinations);
+    return item.survey;
+}
+
+bool ProjectPipeline::run(QString projectFile)
+{
+    return runStages([&](const Emit& emitSurvey) {
+        WallsProjectParser parser;
+        parser.setErrorRecovery(true);
+        QObject::connect(&parser, &WallsProjectParser::message, [&](WallsMessage message) {
+            if (message.severity() == "error") _projectErrorCount++;
+            _projectMessages << message;
+        });
+        if (parser.parseFile(projectFile).isNull())
+        {
+            return false;
+        }
+        foreach (const WpjFlatEntry& entry, parser.flatResult())
+        {
+            if (entry.IsSurvey)
+            {
+                ParsedSurvey survey;
+                survey.fileName = entry.AbsolutePath;
+                survey.entry = entry;
+                emitSurvey(survey);
+            }
+        }
+        return true;
+    });
+}
+
+void ProjectPipeline::run(const QStringList& surveyFiles)
+{
+    runStages([&](const Emit& emitSurvey) {
+        foreach (QString fileName, surveyFiles)
+        {
+            ParsedSurvey survey;
+            survey.fileName = fileName;
+            emitSurvey(survey);
+        }
+        return true;
+    });
+}
+
+void ProjectPipeline::run(const QVector<WpjFlatEntry>& entries)
+{
+    runStages([&](const Emit& emitSurvey) {
+        foreach (const WpjFlatEntry& entry, entries)
+        {
+            if (entry.IsSurvey)
+            {
+                ParsedSurvey survey;
+                survey.fileName = entry.AbsolutePath;
+                survey.entry = entry;
+                emitSurvey(survey);
+            }
+        }
+        return true;
+    });
+}
+
+bool ProjectPipeline::runStages(const Source& source)
+{
+    QElapsedTimer wallTimer;
+    wallTimer.start();
+
+    _projectMessages.clear();
+    _projectErrorCount = 0;
+    _surveyCount = 0;
+
+    BoundedQueue<ParsedSurvey> readQueue(_queueCapacity, 1);
+    BoundedQueue<ReadSurvey> parseQueue(_queueCapacity, _readThreadCount);
+    BoundedQueue<ParsedSurvey> reduceQueue(_queueCapacity, _parseThreadCount);
+
+    StageCounter resolveCounter("resolve", 1);
+    StageCounter readCounter("read", _readThreadCount);
+    StageCounter parseCounter("parse", _parseThreadCount);
+    StageCounter reduceCounter("reduce", 1);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(1 + _readThreadCount + _parseThreadCount);
+    QList<QFuture<void>> futures;
+
+    bool sourceOk = true;
+    futures << QtConcurrent::run(&pool, [&]() {
+        QElapsedTimer timer;
+        timer.start();
+        qint64 blocked = 0;
+        sourceOk = source([&](ParsedSurvey& survey) {
+            survey.index = _surveyCount++;
+            blocked += readQueue.push(survey);
+        });
+        resolveCounter.add(_surveyCount, timer.nsecsElapsed() - blocked, 0, blocked);
+        readQueue.producerDone();
+    });
+
+    for (int i = 0; i < _readThreadCount; i++)
+    {
+        futures << QtConcurrent::run(&pool, [&]() {
+            int items = 0;
+            qint64 busy = 0, starved = 0, blocked = 0, waited;
+            ReadSurvey item;
+            while (readQueue.pop(item.survey, waited))
+            {
+                starved += waited;
+                QElapsedTimer timer;
+                timer.start();
+                readSurvey(item);
+                busy += timer.nsecsElapsed();
+                blocked += parseQueue.push(item);
+                item = ReadSurvey();
+                items++;
+            }
+            starved += waited;
+            readCounter.add(items, busy, starved, blocked);
+            parseQueue.producerDone();
+        });
+    }
+
+    const bool profile = _profileProductions;
+    const WallsSurveyParser::Events events = _lintMode ? WallsSurveyParser::NoEvents : _events;
+    const bool topology = _topologyMode;
+    const GeomagneticModelSet geomagneticModels = _geomagneticModels;
+    for (int i = 0; i < _parseThreadCount; i++)
+    {
+        futures << QtConcurrent::run(&pool, [&]() {
+            DeclinationCachePtr declinations(new DeclinationCache(geomagneticModels));
+            int items = 0;
+            qint64 busy = 0, starved = 0, blocked = 0, waited;
+            ReadSurvey item;
+            while (parseQueue.pop(item, waited))
+            {
+                starved += waited;
+                QElapsedTimer timer;
+                timer.start();
+                parseContents(item, profile, events, topology, declinations);
+                busy += timer.nsecsElapsed();
+                blocked += reduceQueue.push(item.survey);
+                item = ReadSurvey();
+                items++;
+            }
+            starved += waited;
+            parseCounter.add(items, busy, starved, blocked);
+            reduceQueue.producerDone();
+        });
+    }
+
+    int items = 0;
+    qint64 busy = 0, starved = 0, waited;
+    ParsedSurvey survey;
+    while (reduceQueue.pop(survey, waited))
+    {
+        starved += waited;
+        QElapsedTimer timer;
+        timer.start();
+        if (_reducer)
+        {
+            _reducer(survey);
+        }
+        busy += timer.nsecsElapsed();
+        survey = ParsedSurvey();
+        items++;
+    }
+    starved += waited;
+    reduceCounter.add(items, busy, starved, 0);
+
+    for (QFuture<void>& future : futures)
+    {
+        future.waitForFinished();
+    }
+
+    _stageStats.clear();
+    _stageStats << resolveCounter.stats() << readCounter.stats()
+                << parseCounter.stats() << reduceCounter.stats();
+    _wallNanos = wallTimer.nsecsElapsed();
+    return sourceOk;
+}
+
+} // namespace dewalls
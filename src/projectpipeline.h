@@ -0,0 +1,207 @@
+#ifndef DEWALLS_PROJECTPIPELINE_H
+#define DEWALLS_PROJECTPIPELINE_H
+
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+#include "vector.h"
+#include "fixstation.h"
+#include "wallsmessage.h"
+#include "wallsprojectparser.h"
+#include "wallssurveyparser.h"
+#include "productionprofile.h"
+#include "geomagneticmodel.h"
+#include "dewallsexport.h"
+
+namespace dewalls {
+
+///
+/// \brief everything parsed from one survey file by a ProjectPipeline
+///
+struct DEWALLS_LIB_EXPORT ParsedSurvey {
+    ParsedSurvey();
+
+    // position of the survey among all surveys of the run (results can arrive out of order)
+    int index;
+    QString fileName;
+    // has a null Entry for standalone .SRV files
+    WpjFlatEntry entry;
+    QList<Vector> vectors;
+    QList<FixStation> fixStations;
+    // (stations, flag) from #flag directives, with full station names (see
+    // WallsUnits::processStationName())
+    QList<QPair<QStringList, QString>> flags;
+    // (station, note) from #note directives, with full station names
+    QList<QPair<QString, QString>> notes;
+    QList<WallsMessage> messages;
+    qint64 bytes;
+    int lines;
+    int errors;
+    QString errorSummary;
+    bool opened;
+    qint64 readNanos;
+    qint64 parseNanos;
+    ProductionProfile profile;
+};
+
+///
+/// \brief how much time one stage of a ProjectPipeline spent working and waiting
+/// (summed over its threads)
+///
+struct DEWALLS_LIB_EXPORT PipelineStageStats {
+    PipelineStageStats();
+
+    QString name;
+    int threads;
+    int items;
+    qint64 busyNanos;
+    // time spent waiting for the previous stage
+    qint64 starvedNanos;
+    // time spent waiting for room in the queue to the next stage
+    qint64 blockedNanos;
+};
+
+///
+/// \brief opens a project (or a list of survey files) as a pipeline of stages connected
+/// by bounded queues:
+///
+/// - resolve: parses the .WPJ file and resolves the paths of its surveys
+/// - read:    reads whole survey files into memory
+/// - parse:   parses survey files (on several threads)
+/// - reduce:  passes each ParsedSurvey to the reducer, on the thread that called run()
+///
+/// The stages run concurrently, so reading overlaps parsing and both overlap reduction,
+/// and the whole run takes about as long as the slowest stage instead of the sum of all
+/// of them.  A full queue blocks the stage feeding it, so no more than a few files are
+/// ever in flight per stage regardless of project size.
+///
+/// The reducer sees surveys in the order they finish parsing; use ParsedSurvey::index to
+/// put them back in project order.
+///
+class DEWALLS_LIB_EXPORT ProjectPipeline
+{
+public:
+    typedef std::function<void(ParsedSurvey&)> Reducer;
+
+    ProjectPipeline();
+
+    inline void setReducer(Reducer reducer) { _reducer = reducer; }
+    ///
+    /// \brief sets the number of threads parsing survey files (default: the number of cores)
+    ///
+    void setParseThreadCount(int count);
+    inline int parseThreadCount() const { return _parseThreadCount; }
+    ///
+    /// \brief sets the number of threads reading survey files (default: 1)
+    ///
+    void setReadThreadCount(int count);
+    inline int readThreadCount() const { return _readThreadCount; }
+    ///
+    /// \brief sets how many items each queue between stages holds before the stage
+    /// feeding it blocks (default: twice the number of parse threads)
+    ///
+    void setQueueCapacity(int capacity);
+    inline int queueCapacity() const { return _queueCapacity; }
+    ///
+    /// \brief collects a ProductionProfile for each survey if enabled
+    ///
+    inline void setProfileProductions(bool profile) { _profileProductions = profile; }
+    ///
+    /// \brief sets which parser events the surveys are parsed with (see
+    /// WallsSurveyParser::setEvents()); the results only have what's in the mask
+    ///
+    inline void setEvents(WallsSurveyParser::Events events) { _events = events; }
+    inline WallsSurveyParser::Events events() const { return _events; }
+    ///
+    /// \brief parses the surveys in lint mode (see WallsSurveyParser::setLintMode()) if
+    /// enabled, so that the results only have messages, error counts and line counts.  This
+    /// overrides the event mask without changing it, so turning lint mode back off parses with
+    /// the mask again.
+    ///
+    inline void setLintMode(bool lintMode) { _lintMode = lintMode; }
+    inline bool lintMode() const { return _lintMode; }
+    ///
+    /// \brief parses the surveys in topology mode (see WallsSurveyParser::setTopologyMode())
+    /// if enabled.  Decode the measurements later if needed with
+    /// WallsSurveyParser::decodeMeasurements().
+    ///
+    inline void setTopologyMode(bool topologyMode) { _topologyMode = topologyMode; }
+    ///
+    /// \brief sets the models to derive declinations from #date with, for entries that have
+    /// WpjEntry::deriveDeclFromDate() set (default: GeomagneticModelSet::builtin())
+    ///
+    inline void setGeomagneticModels(const GeomagneticModelSet& models) { _geomagneticModels = models; }
+    inline const GeomagneticModelSet& geomagneticModels() const { return _geomagneticModels; }
+
+    ///
+    /// \brief opens the given .WPJ file and parses all of its surveys.
+    /// \return false if the project file couldn't be parsed at all
+    ///
+    bool run(QString projectFile);
+    ///
+    /// \brief parses the given survey files
+    ///
+    void run(const QStringList& surveyFiles);
+    ///
+    /// \brief parses the surveys among the given flattened project entries
+    ///
+    void run(const QVector<WpjFlatEntry>& entries);
+
+    ///
+    /// \brief reads and parses one survey file on the calling thread, the same way the
+    /// pipeline does
+    /// \param entry the project entry to set the parser up from (ignored if its Entry is null)
+    /// \param events the parser events to build (see WallsSurveyParser::setEvents())
+    ///
+    static ParsedSurvey parseSurvey(QString fileName, const WpjFlatEntry& entry = WpjFlatEntry(),
+                                    DeclinationCachePtr declinations = DeclinationCachePtr(),
+                                    bool profile = false,
+                                    WallsSurveyParser::Events events = WallsSurveyParser::AllEvents);
+
+    ///
+    /// \return the messages from parsing the project file in the last run
+    ///
+    inline const QList<WallsMessage>& projectMessages() const { return _projectMessages; }
+    inline int projectErrorCount() const { return _projectErrorCount; }
+    ///
+    /// \return the number of surveys the last run parsed
+    ///
+    inline int surveyCount() const { return _surveyCount; }
+    ///
+    /// \return the stages of the last run, in order
+    ///
+    inline const QList<PipelineStageStats>& stageStats() const { return _stageStats; }
+    ///
+    /// \return the wall time of the last run
+    ///
+    inline qint64 wallNanos() const { return _wallNanos; }
+
+private:
+    typedef std::function<void(ParsedSurvey&)> Emit;
+    typedef std::function<bool(const Emit&)> Source;
+
+    bool runStages(const Source& source);
+
+    Reducer _reducer;
+    int _parseThreadCount;
+    int _readThreadCount;
+    int _queueCapacity;
+    bool _profileProductions;
+    WallsSurveyParser::Events _events;
+    bool _lintMode;
+    bool _topologyMode;
+    GeomagneticModelSet _geomagneticModels;
+
+    QList<WallsMessage> _projectMessages;
+    int _projectErrorCount;
+    int _surveyCount;
+    QList<PipelineStageStats> _stageStats;
+    qint64 _wallNanos;
+};
+
+} // namespace dewalls
+
+#endif // DEWALLS_PROJECTPIPELINE_H
@@ -0,0 +1,539 @@
+#include "projectsession.h"
+#include <algorithm>
+#include <utility>
+#include <QDir>
+#include <QFileInfo>
+#include <QMultiHash>
+#include "projectpipeline.h"
+
+namespace dewalls {
+
+typedef UnitizedDouble<Length> ULength;
+typedef UnitizedDouble<Angle> UAngle;
+
+bool SurveyDelta::isEmpty() const
+{
+    return addedVectors.isEmpty() && removedVectors.isEmpty() && changedVectors.isEmpty() &&
+            addedFixStations.isEmpty() && removedFixStations.isEmpty() && changedFixStations.isEmpty() &&
+            messages.isEmpty();
+}
+
+namespace {
+
+QString field(ULength length)
+{
+    return length.isValid() ? QString::number(length.get(Length::Meters), 'g', 17) : QString();
+}
+
+QString field(UAngle angle)
+{
+    return angle.isValid() ? QString::number(angle.get(Angle::Degrees), 'g', 17) : QString();
+}
+
+///
+/// \brief the units that change how a shot or fix is reduced, even though its parsed
+/// measurements stay the same
+///
+QString fingerprint(const WallsUnits& units)
+{
+    QStringList fields;
+    fields << field(units.decl()) << field(units.grid()) << field(units.rect())
+           << field(units.incd()) << field(units.inca()) << field(units.incab())
+           << field(units.incv()) << field(units.incvb()) << field(units.incs()) << field(units.inch())
+           << QString::number(units.typeabCorrected()) << field(units.typeabTolerance())
+           << QString::number(units.typeabNoAverage())
+           << QString::number(units.typevbCorrected()) << field(units.typevbTolerance())
+           << QString::number(units.typevbNoAverage())
+           << QString::number(int(units.lrud()))
+           << QString::number(units.uvh(), 'g', 17) << QString::number(units.uvv(), 'g', 17);
+    foreach (TapingMethodMeasurement measurement, units.tape())
+    {
+        fields << QString::number(int(measurement));
+    }
+    return fields.join(',');
+}
+
+///
+/// \brief identifies a shot by its full station names, parsed data and the units it's reduced
+/// with, but not where it is in the file
+///
+QString fingerprint(const Vector& v)
+{
+    WallsUnits units = v.units();
+    QStringList fields;
+    fields << units.processStationName(v.from()) << units.processStationName(v.to())
+           << field(v.distance())
+           << field(v.frontAzimuth()) << field(v.backAzimuth())
+           << field(v.frontInclination()) << field(v.backInclination())
+           << field(v.instHeight()) << field(v.targetHeight())
+           << field(v.north()) << field(v.east()) << field(v.rectUp())
+           << field(v.left()) << field(v.right()) << field(v.up()) << field(v.down())
+           << field(v.lrudAngle())
+           << (v.cFlag() ? "C" : "")
+           << (v.horizVariance().isNull() ? QString() : v.horizVariance()->toString())
+           << (v.vertVariance().isNull() ? QString() : v.vertVariance()->toString())
+           << v.segment().join('/')
+           << v.date().toString(Qt::ISODate)
+           << v.comment()
+           << fingerprint(units);
+    return fields.join('\t');
+}
+
+QString fingerprint(FixStation s)
+{
+    WallsUnits units = s.units();
+    QStringList fields;
+    fields << units.processStationName(s.name())
+           << field(s.north()) << field(s.east()) << field(s.rectUp())
+           << field(s.latitude()) << field(s.longitude())
+           << (s.horizVariance().isNull() ? QString() : s.horizVariance()->toString())
+           << (s.vertVariance().isNull() ? QString() : s.vertVariance()->toString())
+           << s.note()
+           << s.segment().join('/')
+           << s.date().toString(Qt::ISODate)
+           << s.comment()
+           << fingerprint(units);
+    return fields.join('\t');
+}
+
+///
+/// \brief the project settings that affect how a survey file is parsed
+///
+QString settings(const WpjFlatEntry& entry)
+{
+    QStringList fields;
+    foreach (const Segment& options, entry.Options)
+    {
+        fields << options.value();
+    }
+    fields << entry.SegmentPath.join('/');
+    if (entry.DeriveDeclFromDate && !entry.Reference.isNull())
+    {
+        fields << field(entry.Reference->latitude) << field(entry.Reference->longitude)
+               << field(entry.Reference->elevation);
+    }
+    return fields.join('\n');
+}
+
+///
+/// \brief finds the items of before that aren't in after and vice versa
+///
+template<typename T>
+void diff(const QList<T>& before, const QList<T>& after, QList<T>& removed, QList<T>& added)
+{
+    QHash<QString, int> remaining;
+    foreach (const T& item, before)
+    {
+        remaining[fingerprint(item)]++;
+    }
+    foreach (const T& item, after)
+    {
+        auto it = remaining.find(fingerprint(item));
+        if (it != remaining.end() && it.value() > 0)
+        {
+            it.value()--;
+        }
+        else
+        {
+            added << item;
+        }
+    }
+    for (int i = before.size() - 1; i >= 0; i--)
+    {
+        auto it = remaining.find(fingerprint(before[i]));
+        if (it.value() > 0)
+        {
+            it.value()--;
+            removed.prepend(before[i]);
+        }
+    }
+}
+
+///
+/// \brief what identifies a shot whose data changed: the full names of its stations
+///
+QPair<QString, QString> changeKey(const Vector& v)
+{
+    WallsUnits units = v.units();
+    return qMakePair(units.processStationName(v.from()), units.processStationName(v.to()));
+}
+
+///
+/// \brief what identifies a fixed station whose data changed: its full name
+///
+QString changeKey(FixStation s)
+{
+    return s.units().processStationName(s.name());
+}
+
+///
+/// \brief like diff(), but pairs up removed and added items with the same changeKey() as
+/// (old, new) changes instead
+///
+template<typename T>
+void diffChanges(const QList<T>& before, const QList<T>& after,
+                 QList<T>& removedItems, QList<T>& addedItems, QList<QPair<T, T>>& changedItems)
+{
+    QList<T> removed;
+    QList<T> added;
+    diff(before, after, removed, added);
+
+    typedef decltype(changeKey(std::declval<T>())) Key;
+    QMultiHash<Key, int> removedByKey;
+    for (int i = removed.size() - 1; i >= 0; i--)
+    {
+        removedByKey.insert(changeKey(removed[i]), i);
+    }
+    QVector<bool> paired(removed.size(), false);
+    foreach (const T& item, added)
+    {
+        auto it = removedByKey.find(changeKey(item));
+        if (it != removedByKey.end())
+        {
+            paired[it.value()] = true;
+            changedItems << qMakePair(removed[it.value()], item);
+            removedByKey.erase(it);
+        }
+        else
+        {
+            addedItems << item;
+        }
+    }
+    for (int i = 0; i < removed.size(); i++)
+    {
+        if (!paired[i])
+        {
+            removedItems << removed[i];
+        }
+    }
+}
+
+} // anonymous namespace
+
+ProjectSession::ProjectSession(QObject* parent)
+    : QObject(parent),
+      _projectFile(),
+      _surveys(),
+      _surveyOrder(),
+      _changed(),
+      _watcher(),
+      _settleTimer(),
+      _parseThreadCount(0)
+{
+    _settleTimer.setSingleShot(true);
+    _settleTimer.setInterval(50);
+    connect(&_settleTimer, &QTimer::timeout, this, &ProjectSession::update);
+    connect(&_watcher, &QFileSystemWatcher::fileChanged, this, &ProjectSession::fileChanged);
+    connect(&_watcher, &QFileSystemWatcher::directoryChanged, this, &ProjectSession::directoryChanged);
+}
+
+void ProjectSession::setSettleInterval(int msec)
+{
+    _settleTimer.setInterval(msec);
+}
+
+bool ProjectSession::open(QString projectFile)
+{
+    close();
+    _projectFile = QDir::cleanPath(QFileInfo(projectFile).absoluteFilePath());
+
+    ProjectDelta delta;
+    QVector<WpjFlatEntry> changed;
+    if (!reloadProject(delta, changed))
+    {
+        publish(delta);
+        _projectFile.clear();
+        return false;
+    }
+    parseSurveys(changed, delta);
+    watch();
+    publish(delta);
+    return true;
+}
+
+void ProjectSession::close()
+{
+    _settleTimer.stop();
+    if (!_watcher.files().isEmpty())
+    {
+        _watcher.removePaths(_watcher.files());
+    }
+    if (!_watcher.directories().isEmpty())
+    {
+        _watcher.removePaths(_watcher.directories());
+    }
+    _projectFile.clear();
+    _surveys.clear();
+    _surveyOrder.clear();
+    _changed.clear();
+}
+
+QList<Vector> ProjectSession::vectors(QString surveyFile) const
+{
+    return _surveys.value(surveyFile).vectors;
+}
+
+QList<FixStation> ProjectSession::fixStations(QString surveyFile) const
+{
+    return _surveys.value(surveyFile).fixStations;
+}
+
+void ProjectSession::markChanged(QString fileName)
+{
+    _changed.insert(QDir::cleanPath(QFileInfo(fileName).absoluteFilePath()));
+    _settleTimer.start();
+}
+
+void ProjectSession::fileChanged(QString fileName)
+{
+    markChanged(fileName);
+}
+
+void ProjectSession::directoryChanged(QString dirPath)
+{
+    // editors that save by writing a new file and renaming it over the old one make the
+    // watcher drop the file; pick it up again when it reappears
+    QStringList watchedFiles = _watcher.files();
+    QDir dir(dirPath);
+    foreach (QString fileName, _surveyOrder + QStringList(_projectFile))
+    {
+        if (QFileInfo(fileName).dir() == dir && !watchedFiles.contains(fileName) &&
+                QFileInfo(fileName).exists())
+        {
+            markChanged(fileName);
+        }
+    }
+}
+
+ProjectDelta ProjectSession::update()
+{
+    _settleTimer.stop();
+    ProjectDelta delta;
+    if (_projectFile.isEmpty())
+    {
+        return delta;
+    }
+
+    QSet<QString> changed = _changed;
+    _changed.clear();
+
+    QVector<WpjFlatEntry> entries;
+    if (changed.contains(_projectFile))
+    {
+        // keep the surveys we have if the project file is broken
+        reloadProject(delta, entries);
+    }
+    QSet<QString> queued;
+    foreach (const WpjFlatEntry& entry, entries)
+    {
+        queued.insert(entry.AbsolutePath);
+    }
+    foreach (QString fileName, changed)
+    {
+        auto it = _surveys.constFind(fileName);
+        if (it != _surveys.constEnd() && !queued.contains(fileName))
+        {
+            entries << it->entry;
+            queued.insert(fileName);
+        }
+    }
+
+    parseSurveys(entries, delta);
+    watch();
+    publish(delta);
+    return delta;
+}
+
+bool ProjectSession::reloadProject(ProjectDelta& delta, QVector<WpjFlatEntry>& changed)
+{
+    WallsProjectParser parser;
+    parser.setErrorRecovery(true);
+    connect(&parser, &WallsProjectParser::message, [&](WallsMessage message) {
+        delta.projectMessages << message;
+    });
+    if (parser.parseFile(_projectFile).isNull())
+    {
+        return false;
+    }
+
+    QStringList order;
+    QSet<QString> present;
+    foreach (const WpjFlatEntry& entry, parser.flatResult())
+    {
+        if (!entry.IsSurvey || entry.AbsolutePath.isEmpty() || present.contains(entry.AbsolutePath))
+        {
+            continue;
+        }
+        order << entry.AbsolutePath;
+        present.insert(entry.AbsolutePath);
+
+        QString entrySettings = settings(entry);
+        auto it = _surveys.find(entry.AbsolutePath);
+        if (it == _surveys.end())
+        {
+            it = _surveys.insert(entry.AbsolutePath, SurveyState());
+            it->settings = entrySettings;
+            changed << entry;
+        }
+        else if (it->settings != entrySettings)
+        {
+            it->settings = entrySettings;
+            changed << entry;
+        }
+        it->entry = entry;
+    }
+
+    foreach (QString fileName, _surveyOrder)
+    {
+        if (!present.contains(fileName))
+        {
+            SurveyState state = _surveys.take(fileName);
+            SurveyDelta survey;
+            survey.fileName = fileName;
+            survey.entry = state.entry;
+            survey.removedVectors = state.vectors;
+            survey.removedFixStations = state.fixStations;
+            delta.surveys << survey;
+        }
+    }
+    _surveyOrder = order;
+    return true;
+}
+
+void ProjectSession::parseSurveys(const QVector<WpjFlatEntry>& entries, ProjectDelta& delta)
+{
+    if (entries.isEmpty())
+    {
+        return;
+    }
+
+    QList<SurveyDelta> surveys;
+    QVector<int> indices;
+
+    ProjectPipeline pipeline;
+    if (_parseThreadCount > 0)
+    {
+        pipeline.setParseThreadCount(_parseThreadCount);
+    }
+    pipeline.setReducer([&](ParsedSurvey& parsed) {
+        SurveyState& state = _surveys[parsed.fileName];
+
+        SurveyDelta survey;
+        survey.fileName = parsed.fileName;
+        survey.entry = parsed.entry;
+        survey.messages = parsed.messages;
+        diffChanges(state.vectors, parsed.vectors,
+                    survey.removedVectors, survey.addedVectors, survey.changedVectors);
+        diffChanges(state.fixStations, parsed.fixStations,
+                    survey.removedFixStations, survey.addedFixStations, survey.changedFixStations);
+
+        state.vectors = parsed.vectors;
+        state.fixStations = parsed.fixStations;
+        if (!survey.isEmpty())
+        {
+            surveys << survey;
+            indices << parsed.index;
+        }
+    });
+    pipeline.run(entries);
+
+    // report in project order
+    QVector<int> order(surveys.size());
+    for (int i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return indices[a] < indices[b]; });
+    foreach (int i, order)
+    {
+        delta.surveys << surveys[i];
+    }
+}
+
+void ProjectSession::publish(const ProjectDelta& delta)
+{
+    foreach (const WallsMessage& m, delta.projectMessages)
+    {
+        emit message(m);
+    }
+    foreach (const SurveyDelta& survey, delta.surveys)
+    {
+        foreach (const Vector& vector, survey.removedVectors)
+        {
+            emit removedVector(vector);
+        }
+        foreach (const FixStation& station, survey.removedFixStations)
+        {
+            emit removedFixStation(station);
+        }
+        foreach (const Vector& vector, survey.addedVectors)
+        {
+            emit addedVector(vector);
+        }
+        typedef QPair<Vector, Vector> VectorPair;
+        foreach (const VectorPair& pair, survey.changedVectors)
+        {
+            emit changedVector(pair.first, pair.second);
+        }
+        foreach (const FixStation& station, survey.addedFixStations)
+        {
+            emit addedFixStation(station);
+        }
+        typedef QPair<FixStation, FixStation> FixStationPair;
+        foreach (const FixStationPair& pair, survey.changedFixStations)
+        {
+            emit changedFixStation(pair.first, pair.second);
+        }
+        foreach (const WallsMessage& m, survey.messages)
+        {
+            emit message(m);
+        }
+    }
+    if (!delta.isEmpty())
+    {
+        emit updated(delta);
+    }
+}
+
+void ProjectSession::watch()
+{
+    QSet<QString> files;
+    QSet<QString> dirs;
+    files.insert(_projectFile);
+    dirs.insert(QFileInfo(_projectFile).absolutePath());
+    foreach (QString fileName, _surveyOrder)
+    {
+        files.insert(fileName);
+        dirs.insert(QFileInfo(fileName).absolutePath());
+    }
+
+    QStringList stale;
+    foreach (QString path, _watcher.files() + _watcher.directories())
+    {
+        if (!files.contains(path) && !dirs.contains(path))
+        {
+            stale << path;
+        }
+    }
+    if (!stale.isEmpty())
+    {
+        _watcher.removePaths(stale);
+    }
+
+    // the watcher drops files that were deleted or replaced, so add them back
+    QStringList watched = _watcher.files() + _watcher.directories();
+    QStringList missing;
+    foreach (QString path, files + dirs)
+    {
+        if (!watched.contains(path) && QFileInfo(path).exists())
+        {
+            missing << path;
+        }
+    }
+    if (!missing.isEmpty())
+    {
+        _watcher.addPaths(missing);
+    }
+}
+
+} // namespace dewalls
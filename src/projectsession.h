@@ -0,0 +1,155 @@
+#ifndef DEWALLS_PROJECTSESSION_H
+#define DEWALLS_PROJECTSESSION_H
+
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+#include "vector.h"
+#include "fixstation.h"
+#include "wallsmessage.h"
+#include "wallsprojectparser.h"
+#include "dewallsexport.h"
+
+namespace dewalls {
+
+///
+/// \brief how the data of one survey file changed between two parses
+///
+struct DEWALLS_LIB_EXPORT SurveyDelta {
+    QString fileName;
+    WpjFlatEntry entry;
+    QList<Vector> addedVectors;
+    QList<Vector> removedVectors;
+    // (old, new) pairs of shots between the same stations whose data changed; these
+    // aren't included in addedVectors or removedVectors
+    QList<QPair<Vector, Vector>> changedVectors;
+    QList<FixStation> addedFixStations;
+    QList<FixStation> removedFixStations;
+    // (old, new) pairs of fixed stations with the same name whose data changed; these
+    // aren't included in addedFixStations or removedFixStations
+    QList<QPair<FixStation, FixStation>> changedFixStations;
+    // the messages from parsing the file again
+    QList<WallsMessage> messages;
+
+    bool isEmpty() const;
+};
+
+///
+/// \brief the surveys that changed in one ProjectSession update
+///
+struct DEWALLS_LIB_EXPORT ProjectDelta {
+    QList<SurveyDelta> surveys;
+    // messages from parsing the project file again
+    QList<WallsMessage> projectMessages;
+
+    inline bool isEmpty() const { return surveys.isEmpty() && projectMessages.isEmpty(); }
+};
+
+///
+/// \brief keeps the parsed data of a project up to date as its files change on disk.
+///
+/// open() parses the whole project; afterward the session watches the .WPJ and all of
+/// the survey files with a QFileSystemWatcher.  When files change it waits for the edits
+/// to settle (see setSettleInterval()), parses only the surveys whose files changed (or
+/// whose inherited project settings changed, if the .WPJ was edited), and reports what
+/// changed through the same kind of signals WallsSurveyParser emits, followed by
+/// updated() with the whole delta.  open() reports the initial data the same way, as
+/// additions.
+///
+/// Shots are compared by their stations and parsed data (not their line numbers), so
+/// inserting a line at the top of a file doesn't report every shot below it as changed.
+/// Fixed stations are compared the same way, and are reported as changed when the data of a
+/// fix with the same name changes.
+///
+class DEWALLS_LIB_EXPORT ProjectSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    ProjectSession(QObject* parent = nullptr);
+
+    ///
+    /// \brief parses the given project and starts watching its files.
+    /// \return false if the project file couldn't be parsed
+    ///
+    bool open(QString projectFile);
+    void close();
+
+    inline QString projectFile() const { return _projectFile; }
+    ///
+    /// \return the absolute paths of the project's survey files, in project order
+    ///
+    inline QStringList surveyFiles() const { return _surveyOrder; }
+    QList<Vector> vectors(QString surveyFile) const;
+    QList<FixStation> fixStations(QString surveyFile) const;
+
+    ///
+    /// \brief sets how long to wait after the last change notification before parsing
+    /// (default: 50 ms).  Editors often write a file in several steps.
+    ///
+    void setSettleInterval(int msec);
+    inline int settleInterval() const { return _settleTimer.interval(); }
+
+    ///
+    /// \brief sets the number of threads used to parse changed surveys
+    ///
+    inline void setParseThreadCount(int count) { _parseThreadCount = count; }
+
+    ///
+    /// \brief marks a file as changed, as if the watcher had reported it
+    ///
+    void markChanged(QString fileName);
+
+public slots:
+    ///
+    /// \brief parses the files that changed since the last update right away (instead of
+    /// waiting for the settle interval) and emits the changes
+    ///
+    ProjectDelta update();
+
+signals:
+    void addedVector(Vector vector);
+    void removedVector(Vector vector);
+    void changedVector(Vector oldVector, Vector newVector);
+    void addedFixStation(FixStation station);
+    void removedFixStation(FixStation station);
+    void changedFixStation(FixStation oldStation, FixStation newStation);
+    void message(WallsMessage message);
+    void updated(ProjectDelta delta);
+
+private slots:
+    void fileChanged(QString fileName);
+    void directoryChanged(QString dirPath);
+
+private:
+    struct SurveyState {
+        WpjFlatEntry entry;
+        QString settings;
+        QList<Vector> vectors;
+        QList<FixStation> fixStations;
+    };
+
+    bool reloadProject(ProjectDelta& delta, QVector<WpjFlatEntry>& changed);
+    void parseSurveys(const QVector<WpjFlatEntry>& entries, ProjectDelta& delta);
+    void publish(const ProjectDelta& delta);
+    void watch();
+
+    QString _projectFile;
+    QHash<QString, SurveyState> _surveys;
+    QStringList _surveyOrder;
+    QSet<QString> _changed;
+    QFileSystemWatcher _watcher;
+    QTimer _settleTimer;
+    int _parseThreadCount;
+};
+
+} // namespace dewalls
+
+#endif // DEWALLS_PROJECTSESSION_H
@@ -29,19 +29,28 @@ SegmentImpl::SegmentImpl(SegmentPtr sourceSegment, int sourceIndex, QString valu
       _endLine(startLine),
       _endCol(startCol + value.length() - 1)
 {
-    QRegExp LINE_BREAK("\r\n|\r|\n");
-
-    int pos = 0;
-    while ((pos = LINE_BREAK.indexIn(value, pos)) != -1)
+    // every parsed line comes through here, so scan for line breaks (\r\n, \r or \n)
+    // directly instead of with a QRegExp
+    const QChar* chars = value.constData();
+    int length = value.length();
+    for (int pos = 0; pos < length; pos++)
     {
-        int end = pos + LINE_BREAK.matchedLength();
-        if (end >= value.length())
+        if (chars[pos] != '\r' && chars[pos] != '\n')
+        {
+            continue;
+        }
+        int end = pos + 1;
+        if (chars[pos] == '\r' && end < length && chars[end] == '\n')
+        {
+            end++;
+        }
+        if (end >= length)
         {
             break;
         }
         _endLine++;
-        _endCol = value.length() - end - 1;
-        pos = end;
+        _endCol = length - end - 1;
+        pos = end - 1;
     }
 }
 
@@ -13,23 +13,43 @@ class DEWALLS_LIB_EXPORT SegmentParseException : public QException
 public:
     SegmentParseException(Segment segment);
     SegmentParseException(Segment segment, QString detailMessage);
+    ///
+    /// \brief an exception at the given index of line (or at its end).  The Segment for it is
+    /// only made when segment() is called: most of the exceptions thrown while trying
+    /// alternatives are caught and dropped without it, so they shouldn't allocate one.
+    ///
+    SegmentParseException(Segment line, int index);
     Segment segment() const;
+    ///
+    /// \return the index of segment() in its source segment, without making it
+    ///
+    int sourceIndex() const;
     virtual QString detailMessage() const;
     virtual QString message() const;
     virtual void raise() const { throw *this; }
     virtual SegmentParseException *clone() const { return new SegmentParseException(*this); }
 private:
+    // the whole line when _index >= 0
     Segment _segment;
+    int _index;
     QString _detailMessage;
 };
 
 inline SegmentParseException::SegmentParseException(Segment segment, QString detailMessage)
     : _segment(segment),
+      _index(-1),
       _detailMessage(detailMessage)
 {
 
 }
 
+inline SegmentParseException::SegmentParseException(Segment line, int index)
+    : _segment(line),
+      _index(index)
+{
+
+}
+
 inline SegmentParseException::SegmentParseException(Segment segment)
     : SegmentParseException(segment, "")
 {
@@ -38,7 +58,17 @@ inline SegmentParseException::SegmentParseException(Segment segment)
 
 inline Segment SegmentParseException::segment() const
 {
-    return _segment;
+    return _index < 0 ? _segment : _segment.atAsSegment(_index);
+}
+
+inline int SegmentParseException::sourceIndex() const
+{
+    if (_index < 0)
+    {
+        return _segment.sourceIndex();
+    }
+    // the same as Segment::mid() gives it
+    return _segment.sourceIndex() >= 0 ? _segment.sourceIndex() + _index : _index;
 }
 
 inline QString SegmentParseException::detailMessage() const
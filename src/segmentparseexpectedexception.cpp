@@ -3,36 +3,40 @@
 
 namespace dewalls {
 
-SegmentParseExpectedException::SegmentParseExpectedException(Segment segment, QList<QString> expectedItems)
+SegmentParseExpectedException::SegmentParseExpectedException(Segment segment, const ExpectedTokens& expected)
     : SegmentParseException(segment),
-      _expectedItems(expectedItems)
+      _expected(expected)
+{
+
+}
+
+SegmentParseExpectedException::SegmentParseExpectedException(Segment line, int index, const ExpectedTokens& expected)
+    : SegmentParseException(line, index),
+      _expected(expected)
+{
+
+}
+
+SegmentParseExpectedException::SegmentParseExpectedException(Segment segment, QList<QString> expectedItems)
+    : SegmentParseExpectedException(segment, ExpectedTokens(expectedItems))
 {
 
 }
 
 SegmentParseExpectedException::SegmentParseExpectedException(Segment segment, QString expectedItem)
-    : SegmentParseExpectedException(segment, QList<QString>({expectedItem}))
+    : SegmentParseExpectedException(segment, ExpectedTokens(expectedItem))
 {
 }
 
 SegmentParseExpectedException::SegmentParseExpectedException(Segment segment, std::initializer_list<QString> expectedItems)
-    : SegmentParseExpectedException(segment, QList<QString>(expectedItems))
+    : SegmentParseExpectedException(segment, ExpectedTokens(expectedItems))
 {
 }
 
 QString SegmentParseExpectedException::detailMessage() const
 {
-    QSet<QString> uniq;
-    QStringList uniqList;
-
-    foreach (QString item, _expectedItems)
-    {
-        if (!uniq.contains(item))
-        {
-            uniq << item;
-            uniqList << item;
-        }
-    }
+    // the items are already unique
+    QStringList uniqList = _expected.toStringList();
 
     if (uniqList.size() == 1)
     {
@@ -4,6 +4,7 @@
 #include <QSet>
 #include <QList>
 #include "segmentparseexception.h"
+#include "expectedtokens.h"
 #include <initializer_list>
 #include "dewallsexport.h"
 
@@ -15,17 +16,32 @@ public:
     SegmentParseExpectedException(Segment segment, QString expectedItem);
     SegmentParseExpectedException(Segment segment, QList<QString> expectedItems);
     SegmentParseExpectedException(Segment segment, std::initializer_list<QString> expectedItems);
+    SegmentParseExpectedException(Segment segment, const ExpectedTokens& expected);
+    ///
+    /// \brief an exception at the given index of line; see
+    /// SegmentParseException::SegmentParseException(Segment, int)
+    ///
+    SegmentParseExpectedException(Segment line, int index, const ExpectedTokens& expected);
+    ///
+    /// \return the expected items, in the order they were expected
+    ///
     QList<QString> expectedItems() const;
+    const ExpectedTokens& expectedTokens() const;
     virtual QString detailMessage() const;
     virtual void raise() const { throw *this; }
     virtual SegmentParseException *clone() const { return new SegmentParseExpectedException(*this); }
 private:
-    QList<QString> _expectedItems;
+    ExpectedTokens _expected;
 };
 
 inline QList<QString> SegmentParseExpectedException::expectedItems() const
 {
-    return _expectedItems;
+    return _expected.toStringList();
+}
+
+inline const ExpectedTokens& SegmentParseExpectedException::expectedTokens() const
+{
+    return _expected;
 }
 
 } // namespace dewalls
@@ -0,0 +1,537 @@
+#include "spatialindex.h"
+#include <QPair>
+#include <QThread>
+#include <QtConcurrentMap>
+#include <algorithm>
+#include <cmath>
+
+namespace dewalls {
+
+namespace {
+
+const int LeafSize = 4;
+// deep enough for balanced trees over any int-indexed item count
+const int StackSize = 64;
+
+// Morton codes have 10 bits per axis
+const int MortonBits = 30;
+const int RadixBits = 10;
+
+struct MortonItem {
+    quint32 code;
+    int item;
+};
+
+///
+/// \brief a subtree whose nodes are built together
+///
+struct Subtree {
+    int node;
+    // where the node's descendants go
+    int next;
+    // range of Tree::items
+    int first;
+    int count;
+};
+
+///
+/// \brief spreads the low 10 bits of v out so that there are two zero bits between each
+///
+quint32 expandBits(quint32 v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+quint32 quantize(double value, double min, double scale)
+{
+    double q = (value - min) * scale;
+    return quint32(std::max(0.0, std::min(1023.0, q)));
+}
+
+///
+/// \brief sorts items by code with an LSD radix sort, which keeps items with equal codes in order
+///
+void radixSort(QVector<MortonItem>& items)
+{
+    const quint32 mask = (1u << RadixBits) - 1;
+    QVector<MortonItem> buffer(items.size());
+    for (int shift = 0; shift < MortonBits; shift += RadixBits)
+    {
+        int offsets[(1 << RadixBits) + 1] = {};
+        const MortonItem* in = items.constData();
+        const MortonItem* end = in + items.size();
+        for (const MortonItem* m = in; m < end; m++)
+        {
+            offsets[((m->code >> shift) & mask) + 1]++;
+        }
+        for (quint32 bucket = 0; bucket < mask; bucket++)
+        {
+            offsets[bucket + 1] += offsets[bucket];
+        }
+        MortonItem* out = buffer.data();
+        for (const MortonItem* m = in; m < end; m++)
+        {
+            out[offsets[(m->code >> shift) & mask]++] = *m;
+        }
+        items.swap(buffer);
+    }
+}
+
+///
+/// \return the number of nodes in the tree SpatialIndex builds over count items, and in the
+/// tree over count + 1 items.  Subtrees at the same depth have one of two adjacent sizes, so
+/// this only takes one step per level.
+///
+QPair<int, int> nodeCounts(int count)
+{
+    if (count + 1 <= LeafSize)
+    {
+        return qMakePair(1, 1);
+    }
+    QPair<int, int> half = nodeCounts(count / 2);
+    if (count % 2 == 0)
+    {
+        return qMakePair(count <= LeafSize ? 1 : 1 + 2 * half.first, 1 + half.first + half.second);
+    }
+    return qMakePair(count <= LeafSize ? 1 : 1 + half.first + half.second, 1 + 2 * half.second);
+}
+
+inline int nodeCount(int count)
+{
+    return nodeCounts(count).first;
+}
+
+double segmentDistanceSquared(const double a[3], const double b[3], const double p[3])
+{
+    double ab[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    double ap[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+    double lengthSquared = ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2];
+    double t = 0;
+    if (lengthSquared > 0)
+    {
+        t = (ap[0] * ab[0] + ap[1] * ab[1] + ap[2] * ab[2]) / lengthSquared;
+        t = std::max(0.0, std::min(1.0, t));
+    }
+    double result = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double d = ap[axis] - t * ab[axis];
+        result += d * d;
+    }
+    return result;
+}
+
+double pointDistanceSquared(const double a[3], const double p[3])
+{
+    double result = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double d = p[axis] - a[axis];
+        result += d * d;
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+BoundingBox::BoundingBox()
+{
+    std::fill(min, min + 3, std::numeric_limits<double>::infinity());
+    std::fill(max, max + 3, -std::numeric_limits<double>::infinity());
+}
+
+BoundingBox::BoundingBox(double minX, double minY, double minZ, double maxX, double maxY, double maxZ)
+{
+    min[0] = minX;
+    min[1] = minY;
+    min[2] = minZ;
+    max[0] = maxX;
+    max[1] = maxY;
+    max[2] = maxZ;
+}
+
+bool BoundingBox::isEmpty() const
+{
+    return min[0] > max[0] || min[1] > max[1] || min[2] > max[2];
+}
+
+void BoundingBox::add(const double point[3])
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        min[axis] = std::min(min[axis], point[axis]);
+        max[axis] = std::max(max[axis], point[axis]);
+    }
+}
+
+void BoundingBox::add(const BoundingBox& other)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        min[axis] = std::min(min[axis], other.min[axis]);
+        max[axis] = std::max(max[axis], other.max[axis]);
+    }
+}
+
+bool BoundingBox::contains(const double point[3]) const
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (point[axis] < min[axis] || point[axis] > max[axis])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BoundingBox::intersects(const BoundingBox& other) const
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (other.max[axis] < min[axis] || other.min[axis] > max[axis])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BoundingBox::intersectsSegment(const double a[3], const double b[3]) const
+{
+    // clip the segment's parameter range against each slab
+    double t0 = 0;
+    double t1 = 1;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double d = b[axis] - a[axis];
+        if (d == 0)
+        {
+            if (a[axis] < min[axis] || a[axis] > max[axis])
+            {
+                return false;
+            }
+            continue;
+        }
+        double tmin = (min[axis] - a[axis]) / d;
+        double tmax = (max[axis] - a[axis]) / d;
+        if (tmin > tmax)
+        {
+            std::swap(tmin, tmax);
+        }
+        t0 = std::max(t0, tmin);
+        t1 = std::min(t1, tmax);
+        if (t0 > t1)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+double BoundingBox::distanceSquared(const double point[3]) const
+{
+    double result = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double d = 0;
+        if (point[axis] < min[axis]) d = min[axis] - point[axis];
+        else if (point[axis] > max[axis]) d = point[axis] - max[axis];
+        result += d * d;
+    }
+    return result;
+}
+
+SpatialIndex::SpatialIndex()
+    : _positions(),
+      _shotStations(),
+      _stationTree(),
+      _shotTree()
+{
+
+}
+
+void SpatialIndex::build(const QVector<double>& stationPositions, const QVector<int>& shotStations)
+{
+    _positions = stationPositions;
+    _shotStations = shotStations;
+
+    const double* positions = _positions.constData();
+    const int* stations = _shotStations.constData();
+
+    buildTree(_stationTree, stationCount(), [=](int station) {
+        BoundingBox box;
+        box.add(positions + station * 3);
+        return box;
+    });
+    buildTree(_shotTree, shotCount(), [=](int shot) {
+        BoundingBox box;
+        box.add(positions + stations[shot * 2] * 3);
+        box.add(positions + stations[shot * 2 + 1] * 3);
+        return box;
+    });
+}
+
+template<typename ItemBox>
+void SpatialIndex::buildTree(Tree& tree, int itemCount, ItemBox itemBox)
+{
+    tree.nodes.clear();
+    tree.items.clear();
+    if (itemCount == 0)
+    {
+        return;
+    }
+
+    BoundingBox centers;
+    for (int i = 0; i < itemCount; i++)
+    {
+        BoundingBox box = itemBox(i);
+        double center[3] = {
+            (box.min[0] + box.max[0]) * 0.5,
+            (box.min[1] + box.max[1]) * 0.5,
+            (box.min[2] + box.max[2]) * 0.5,
+        };
+        centers.add(center);
+    }
+
+    double scale[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double extent = centers.max[axis] - centers.min[axis];
+        scale[axis] = extent > 0 ? 1023.0 / extent : 0.0;
+    }
+
+    QVector<MortonItem> sorted(itemCount);
+    for (int i = 0; i < itemCount; i++)
+    {
+        sorted[i].item = i;
+    }
+    QtConcurrent::blockingMap(sorted, [&](MortonItem& m) {
+        BoundingBox box = itemBox(m.item);
+        quint32 code = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            double center = (box.min[axis] + box.max[axis]) * 0.5;
+            code |= expandBits(quantize(center, centers.min[axis], scale[axis])) << (2 - axis);
+        }
+        m.code = code;
+    });
+    radixSort(sorted);
+
+    tree.items.resize(itemCount);
+    for (int i = 0; i < itemCount; i++)
+    {
+        tree.items[i] = sorted[i].item;
+    }
+
+    tree.nodes.resize(nodeCount(itemCount));
+    Node* nodes = tree.nodes.data();
+    const int* items = tree.items.constData();
+
+    // split the top of the tree into subtrees to build concurrently.  The layout is the same as
+    // building the whole tree with buildNode(): a node's children are next to each other,
+    // followed by all of the left child's descendants, then all of the right child's.
+    const int subtreeSize = std::max(LeafSize, itemCount / (4 * std::max(1, QThread::idealThreadCount())));
+    QVector<Subtree> pending;
+    QVector<Subtree> subtrees;
+    QVector<int> topNodes;
+    pending << Subtree{0, 1, 0, itemCount};
+    while (!pending.isEmpty())
+    {
+        Subtree subtree = pending.takeLast();
+        if (subtree.count <= subtreeSize)
+        {
+            subtrees << subtree;
+            continue;
+        }
+        int left = subtree.next;
+        int half = subtree.count / 2;
+        nodes[subtree.node] = Node{BoundingBox(), left, 0};
+        topNodes << subtree.node;
+        pending << Subtree{left, left + 2, subtree.first, half}
+                << Subtree{left + 1, left + 1 + nodeCount(half), subtree.first + half, subtree.count - half};
+    }
+
+    QtConcurrent::blockingMap(subtrees, [&](const Subtree& subtree) {
+        buildNode(nodes, items, subtree.node, subtree.next, subtree.first, subtree.count, itemBox);
+    });
+
+    // children come after their parents in topNodes
+    for (int i = topNodes.size() - 1; i >= 0; i--)
+    {
+        Node& node = nodes[topNodes[i]];
+        node.box = nodes[node.first].box;
+        node.box.add(nodes[node.first + 1].box);
+    }
+}
+
+template<typename ItemBox>
+int SpatialIndex::buildNode(Node* nodes, const int* items, int node, int next, int first, int count,
+                            ItemBox& itemBox)
+{
+    if (count <= LeafSize)
+    {
+        BoundingBox box;
+        for (int i = first; i < first + count; i++)
+        {
+            box.add(itemBox(items[i]));
+        }
+        nodes[node] = Node{box, first, count};
+        return next;
+    }
+
+    int left = next;
+    int half = count / 2;
+    next = buildNode(nodes, items, left, left + 2, first, half, itemBox);
+    next = buildNode(nodes, items, left + 1, next, first + half, count - half, itemBox);
+
+    BoundingBox box = nodes[left].box;
+    box.add(nodes[left + 1].box);
+    nodes[node] = Node{box, left, 0};
+    return next;
+}
+
+template<typename Visit>
+void SpatialIndex::query(const Tree& tree, const BoundingBox& box, Visit visit)
+{
+    if (tree.nodes.isEmpty())
+    {
+        return;
+    }
+
+    const Node* nodes = tree.nodes.constData();
+    int stack[StackSize];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        const Node& node = nodes[stack[--top]];
+        if (!node.box.intersects(box))
+        {
+            continue;
+        }
+        if (node.count > 0)
+        {
+            for (int i = node.first; i < node.first + node.count; i++)
+            {
+                visit(tree.items[i]);
+            }
+        }
+        else
+        {
+            stack[top++] = node.first + 1;
+            stack[top++] = node.first;
+        }
+    }
+}
+
+template<typename ItemDistanceSquared>
+int SpatialIndex::nearest(const Tree& tree, const double point[3], double maxDistance, double* distance,
+                          ItemDistanceSquared itemDistanceSquared)
+{
+    int best = -1;
+    double bestDistanceSquared = maxDistance * maxDistance;
+
+    if (!tree.nodes.isEmpty())
+    {
+        const Node* nodes = tree.nodes.constData();
+        int stack[StackSize];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0)
+        {
+            const Node& node = nodes[stack[--top]];
+            if (node.box.distanceSquared(point) > bestDistanceSquared)
+            {
+                continue;
+            }
+            if (node.count > 0)
+            {
+                for (int i = node.first; i < node.first + node.count; i++)
+                {
+                    int item = tree.items[i];
+                    double d = itemDistanceSquared(item);
+                    if (d < bestDistanceSquared || (best < 0 && d <= bestDistanceSquared))
+                    {
+                        best = item;
+                        bestDistanceSquared = d;
+                    }
+                }
+            }
+            else
+            {
+                // visit the nearer child first so that more of the farther one gets pruned
+                int left = node.first;
+                int right = node.first + 1;
+                if (nodes[right].box.distanceSquared(point) < nodes[left].box.distanceSquared(point))
+                {
+                    std::swap(left, right);
+                }
+                stack[top++] = right;
+                stack[top++] = left;
+            }
+        }
+    }
+
+    if (distance)
+    {
+        *distance = best >= 0 ? sqrt(bestDistanceSquared) : std::numeric_limits<double>::quiet_NaN();
+    }
+    return best;
+}
+
+BoundingBox SpatialIndex::bounds() const
+{
+    return _stationTree.nodes.isEmpty() ? BoundingBox() : _stationTree.nodes[0].box;
+}
+
+QVector<int> SpatialIndex::stationsInBox(const BoundingBox& box) const
+{
+    QVector<int> result;
+    query(_stationTree, box, [&](int station) {
+        if (box.contains(stationPosition(station)))
+        {
+            result << station;
+        }
+    });
+    return result;
+}
+
+QVector<int> SpatialIndex::shotsInBox(const BoundingBox& box) const
+{
+    QVector<int> result;
+    query(_shotTree, box, [&](int shot) {
+        if (box.intersectsSegment(stationPosition(shotFrom(shot)), stationPosition(shotTo(shot))))
+        {
+            result << shot;
+        }
+    });
+    return result;
+}
+
+double SpatialIndex::shotDistanceSquared(int shot, const double point[3]) const
+{
+    return segmentDistanceSquared(stationPosition(shotFrom(shot)), stationPosition(shotTo(shot)), point);
+}
+
+int SpatialIndex::nearestStation(const double point[3], double maxDistance, double* distance) const
+{
+    return nearest(_stationTree, point, maxDistance, distance, [&](int station) {
+        return pointDistanceSquared(stationPosition(station), point);
+    });
+}
+
+int SpatialIndex::nearestShot(const double point[3], double maxDistance, double* distance) const
+{
+    return nearest(_shotTree, point, maxDistance, distance, [&](int shot) {
+        return shotDistanceSquared(shot, point);
+    });
+}
+
+} // namespace dewalls
@@ -0,0 +1,138 @@
+#ifndef DEWALLS_SPATIALINDEX_H
+#define DEWALLS_SPATIALINDEX_H
+
+#include <QVector>
+#include <limits>
+#include "dewallsexport.h"
+
+namespace dewalls {
+
+///
+/// \brief an axis-aligned box in a reduced survey's east/north/up frame
+///
+struct DEWALLS_LIB_EXPORT BoundingBox {
+    double min[3];
+    double max[3];
+
+    ///
+    /// \brief creates an empty box
+    ///
+    BoundingBox();
+    BoundingBox(double minX, double minY, double minZ, double maxX, double maxY, double maxZ);
+
+    bool isEmpty() const;
+    void add(const double point[3]);
+    void add(const BoundingBox& other);
+
+    bool contains(const double point[3]) const;
+    bool intersects(const BoundingBox& other) const;
+    ///
+    /// \return whether the line segment from a to b passes through this box
+    ///
+    bool intersectsSegment(const double a[3], const double b[3]) const;
+    ///
+    /// \return the squared distance from the given point to the nearest point in this box
+    ///
+    double distanceSquared(const double point[3]) const;
+};
+
+///
+/// \brief a bounding volume hierarchy over the stations and shots of a reduced survey, for
+/// box queries and nearest-station/nearest-shot picking.
+///
+/// The hierarchy is bulk loaded: items are radix sorted along a Morton (Z-order) curve through
+/// their centers (computed in parallel) and the sorted list is split recursively into a packed,
+/// balanced tree with a few items per leaf, whose top-level subtrees are built in parallel.  Queries traverse it with an explicit stack and
+/// don't allocate beyond their results.  Positions are copied in, so the index doesn't refer
+/// to the caller's data once built.  Const methods may be called from multiple threads.
+///
+class DEWALLS_LIB_EXPORT SpatialIndex
+{
+public:
+    SpatialIndex();
+
+    ///
+    /// \brief (re)builds the index
+    /// \param stationPositions x, y, z of each station
+    /// \param shotStations from and to station index of each shot
+    ///
+    void build(const QVector<double>& stationPositions, const QVector<int>& shotStations);
+
+    inline int stationCount() const { return _positions.size() / 3; }
+    inline int shotCount() const { return _shotStations.size() / 2; }
+    inline const double* stationPosition(int station) const { return _positions.constData() + station * 3; }
+    inline int shotFrom(int shot) const { return _shotStations[shot * 2]; }
+    inline int shotTo(int shot) const { return _shotStations[shot * 2 + 1]; }
+
+    ///
+    /// \return the bounds of all stations
+    ///
+    BoundingBox bounds() const;
+
+    ///
+    /// \return the indices of stations inside the given box
+    ///
+    QVector<int> stationsInBox(const BoundingBox& box) const;
+    ///
+    /// \return the indices of shots passing through the given box
+    ///
+    QVector<int> shotsInBox(const BoundingBox& box) const;
+
+    ///
+    /// \return the index of the station nearest the given point, or -1 if there are no
+    /// stations within maxDistance
+    /// \param distance if non-null, receives the distance to the station
+    ///
+    int nearestStation(const double point[3],
+                       double maxDistance = std::numeric_limits<double>::infinity(),
+                       double* distance = nullptr) const;
+    ///
+    /// \return the index of the shot nearest the given point, or -1 if there are no
+    /// shots within maxDistance
+    /// \param distance if non-null, receives the distance to the shot
+    ///
+    int nearestShot(const double point[3],
+                    double maxDistance = std::numeric_limits<double>::infinity(),
+                    double* distance = nullptr) const;
+
+private:
+    struct Node {
+        BoundingBox box;
+        // for leaves, the range of Tree::items; for internal nodes, first is the index of the
+        // left child (the right child follows it) and count is 0
+        int first;
+        int count;
+    };
+
+    struct Tree {
+        QVector<Node> nodes;
+        QVector<int> items;
+    };
+
+    double shotDistanceSquared(int shot, const double point[3]) const;
+
+    template<typename ItemBox>
+    static void buildTree(Tree& tree, int itemCount, ItemBox itemBox);
+    ///
+    /// \brief builds the subtree at the given node, putting its descendants at next onward
+    /// \return the index after its last descendant
+    ///
+    template<typename ItemBox>
+    static int buildNode(Node* nodes, const int* items, int node, int next, int first, int count,
+                         ItemBox& itemBox);
+
+    template<typename Visit>
+    static void query(const Tree& tree, const BoundingBox& box, Visit visit);
+    template<typename ItemDistanceSquared>
+    static int nearest(const Tree& tree, const double point[3], double maxDistance, double* distance,
+                       ItemDistanceSquared itemDistanceSquared);
+
+    QVector<double> _positions;
+    QVector<int> _shotStations;
+    Tree _stationTree;
+    Tree _shotTree;
+};
+
+} // namespace dewalls
+
+#endif // DEWALLS_SPATIALINDEX_H
@@ -0,0 +1,238 @@
+#include "surveyindex.h"
+#include <algorithm>
+#include "projectpipeline.h"
+#include "wallssurveyparser.h"
+
+namespace dewalls {
+
+SurveyIndex::SurveyIndex(QObject* parent)
+    : QObject(parent),
+      _shots(),
+      _stationShots(),
+      _flagStations(),
+      _stationFlags(),
+      _stationNotes(),
+      _sorted(true),
+      _bySegment(),
+      _byDate()
+{
+
+}
+
+void SurveyIndex::attach(WallsSurveyParser* parser)
+{
+    connect(parser, &WallsSurveyParser::parsedVector, this, &SurveyIndex::addVector);
+    // the directives give the names as written, so apply the parser's current prefix and case
+    connect(parser, &WallsSurveyParser::parsedFlag, this, [this, parser](QStringList stations, QString flag) {
+        for (QString& station : stations)
+        {
+            station = parser->units().processStationName(station);
+        }
+        addFlag(stations, flag);
+    });
+    connect(parser, &WallsSurveyParser::parsedNote, this, [this, parser](QString station, QString note) {
+        addNote(parser->units().processStationName(station), note);
+    });
+}
+
+void SurveyIndex::add(const ParsedSurvey& survey)
+{
+    _shots.reserve(_shots.size() + survey.vectors.size());
+    foreach (const Vector& vector, survey.vectors)
+    {
+        addVector(vector);
+    }
+    typedef QPair<QStringList, QString> Flag;
+    foreach (const Flag& flag, survey.flags)
+    {
+        addFlag(flag.first, flag.second);
+    }
+    typedef QPair<QString, QString> Note;
+    foreach (const Note& note, survey.notes)
+    {
+        addNote(note.first, note.second);
+    }
+}
+
+void SurveyIndex::clear()
+{
+    _shots.clear();
+    _stationShots.clear();
+    _flagStations.clear();
+    _stationFlags.clear();
+    _stationNotes.clear();
+    _bySegment.clear();
+    _byDate.clear();
+    _sorted = true;
+}
+
+void SurveyIndex::addVector(Vector vector)
+{
+    int shot = _shots.size();
+    _shots << vector;
+    WallsUnits units = vector.units();
+    QString from = units.processStationName(vector.from());
+    QString to = vector.to().isEmpty() ? QString() : units.processStationName(vector.to());
+    _stationShots[from] << shot;
+    if (!to.isEmpty() && to != from)
+    {
+        _stationShots[to] << shot;
+    }
+
+    QString flag = units.flag();
+    if (!flag.isEmpty())
+    {
+        QStringList stations(from);
+        if (!to.isEmpty())
+        {
+            stations << to;
+        }
+        addFlag(stations, flag);
+    }
+    _sorted = false;
+}
+
+void SurveyIndex::addFlag(QStringList stations, QString flag)
+{
+    flag = flag.trimmed();
+    QSet<QString>& flagged = _flagStations[flag];
+    foreach (QString station, stations)
+    {
+        if (!flagged.contains(station))
+        {
+            flagged.insert(station);
+            _stationFlags[station] << flag;
+        }
+    }
+}
+
+void SurveyIndex::addNote(QString station, QString note)
+{
+    _stationNotes[station] << note;
+}
+
+QString SurveyIndex::segmentKey(const QStringList& segment)
+{
+    QString key;
+    foreach (QString part, segment)
+    {
+        key += part;
+        key += '/';
+    }
+    return key;
+}
+
+void SurveyIndex::finish()
+{
+    ensureSorted();
+}
+
+void SurveyIndex::ensureSorted() const
+{
+    if (_sorted)
+    {
+        return;
+    }
+    _bySegment.clear();
+    _byDate.clear();
+    _bySegment.reserve(_shots.size());
+    for (int shot = 0; shot < _shots.size(); shot++)
+    {
+        const Vector& vector = _shots[shot];
+        _bySegment << qMakePair(segmentKey(vector.segment()), shot);
+        if (vector.date().isValid())
+        {
+            _byDate << qMakePair(vector.date().toJulianDay(), shot);
+        }
+    }
+    std::sort(_bySegment.begin(), _bySegment.end());
+    std::sort(_byDate.begin(), _byDate.end());
+    _sorted = true;
+}
+
+QVector<int> SurveyIndex::shotsAt(QString station) const
+{
+    return _stationShots.value(station);
+}
+
+QVector<int> SurveyIndex::shotsInSegment(QString segment) const
+{
+    return shotsInSegment(segment.split('/', QString::SkipEmptyParts));
+}
+
+QVector<int> SurveyIndex::shotsInSegment(QStringList segment) const
+{
+    ensureSorted();
+
+    auto begin = _bySegment.constBegin();
+    auto end = _bySegment.constEnd();
+    if (!segment.isEmpty())
+    {
+        // every key in the subtree starts with prefix, and '0' comes right after '/'
+        QString prefix = segmentKey(segment);
+        QString limit = prefix;
+        limit[limit.size() - 1] = '0';
+        auto byKey = [](const QPair<QString, int>& item, const QString& key) { return item.first < key; };
+        begin = std::lower_bound(begin, end, prefix, byKey);
+        end = std::lower_bound(begin, end, limit, byKey);
+    }
+
+    QVector<int> result;
+    result.reserve(int(end - begin));
+    for (auto it = begin; it != end; ++it)
+    {
+        result << it->second;
+    }
+    return result;
+}
+
+QVector<int> SurveyIndex::shotsBetween(QDate first, QDate last) const
+{
+    ensureSorted();
+
+    QVector<int> result;
+    if (!first.isValid() || !last.isValid() || last < first)
+    {
+        return result;
+    }
+    auto byDay = [](const QPair<qint64, int>& item, qint64 day) { return item.first < day; };
+    auto begin = std::lower_bound(_byDate.constBegin(), _byDate.constEnd(), first.toJulianDay(), byDay);
+    auto end = std::lower_bound(begin, _byDate.constEnd(), last.toJulianDay() + 1, byDay);
+    result.reserve(int(end - begin));
+    for (auto it = begin; it != end; ++it)
+    {
+        result << it->second;
+    }
+    return result;
+}
+
+QStringList SurveyIndex::stationsWithFlag(QString flag) const
+{
+    flag = flag.trimmed();
+    if (flag.startsWith('/'))
+    {
+        flag.remove(0, 1);
+    }
+    QStringList result = _flagStations.value(flag).toList();
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+QStringList SurveyIndex::flags(QString station) const
+{
+    return _stationFlags.value(station);
+}
+
+QStringList SurveyIndex::notes(QString station) const
+{
+    return _stationNotes.value(station);
+}
+
+QStringList SurveyIndex::stationsWithNotes() const
+{
+    QStringList result = _stationNotes.keys();
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+} // namespace dewalls
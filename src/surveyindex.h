@@ -0,0 +1,111 @@
+#ifndef DEWALLS_SURVEYINDEX_H
+#define DEWALLS_SURVEYINDEX_H
+
+#include <QDate>
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "vector.h"
+#include "dewallsexport.h"
+
+namespace dewalls {
+
+class WallsSurveyParser;
+struct ParsedSurvey;
+
+///
+/// \brief secondary indexes over parsed shots, flags and notes for answering questions like
+/// "which shots touch station A12" without scanning everything that was parsed.
+///
+/// Feed it while parsing by connecting a WallsSurveyParser with attach() (or its slots to
+/// the parser's signals yourself), or add whole ParsedSurveys from a ProjectPipeline or
+/// LazyProject.  Shots are numbered in the order they're added.
+///
+/// Stations are indexed and looked up by their full names, with the #prefix and #units case
+/// they were parsed with applied (see WallsUnits::processStationName()), so "A12" and
+/// "EAST:A12" are different stations.  Station lookups are hash lookups.  Segment and date queries binary search lists sorted
+/// by segment path and date, which are built by the first such query after shots are added
+/// (or by finish()).  Call finish() before querying from multiple threads.
+///
+class DEWALLS_LIB_EXPORT SurveyIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    SurveyIndex(QObject* parent = nullptr);
+
+    ///
+    /// \brief connects this index to the given parser's parsedVector, parsedFlag and
+    /// parsedNote signals
+    ///
+    void attach(WallsSurveyParser* parser);
+    void add(const ParsedSurvey& survey);
+    void clear();
+    ///
+    /// \brief builds the sorted lists for segment and date queries now
+    ///
+    void finish();
+
+    inline int shotCount() const { return _shots.size(); }
+    inline const Vector& shot(int shot) const { return _shots[shot]; }
+
+    ///
+    /// \return the shots from or to the given station
+    ///
+    QVector<int> shotsAt(QString station) const;
+    ///
+    /// \return the shots in the given segment or any segment under it (e.g. "/Upper/East"
+    /// or {"Upper", "East"}), in segment order
+    ///
+    QVector<int> shotsInSegment(QStringList segment) const;
+    QVector<int> shotsInSegment(QString segment) const;
+    ///
+    /// \return the shots dated from first through last (inclusive), in date order.
+    /// Shots without a date are never included.
+    ///
+    QVector<int> shotsBetween(QDate first, QDate last) const;
+
+    ///
+    /// \return the stations with the given flag (without the leading slash), either named
+    /// in a #flag directive or in shots made while the flag was in effect
+    ///
+    QStringList stationsWithFlag(QString flag) const;
+    QStringList flags(QString station) const;
+    QStringList notes(QString station) const;
+    QStringList stationsWithNotes() const;
+
+public slots:
+    void addVector(Vector vector);
+    ///
+    /// \brief adds a flag to the stations with the given full names.  WallsSurveyParser's
+    /// parsedFlag signal gives the names as written; attach() converts them.
+    ///
+    void addFlag(QStringList stations, QString flag);
+    ///
+    /// \brief adds a note to the station with the given full name
+    ///
+    void addNote(QString station, QString note);
+
+private:
+    static QString segmentKey(const QStringList& segment);
+    void ensureSorted() const;
+
+    QVector<Vector> _shots;
+    QHash<QString, QVector<int>> _stationShots;
+    QHash<QString, QSet<QString>> _flagStations;
+    QHash<QString, QStringList> _stationFlags;
+    QHash<QString, QStringList> _stationNotes;
+
+    // shots sorted by segmentKey() and date; rebuilt when _sorted is false
+    mutable bool _sorted;
+    mutable QVector<QPair<QString, int>> _bySegment;
+    mutable QVector<QPair<qint64, int>> _byDate;
+};
+
+} // namespace dewalls
+
+#endif // DEWALLS_SURVEYINDEX_H
@@ -49,7 +49,9 @@ public:
           segment(),
           comment(),
           date(),
-          units() { }
+          units(),
+          rawMeasurementsStart(-1),
+          rawMeasurementsLength(0) { }
 
     Segment sourceSegment;
     QString from;
@@ -76,6 +78,9 @@ public:
     QString comment;
     QDate date;
     WallsUnits units;
+    // where the undecoded measurements are in sourceSegment, or -1 if they're decoded
+    int rawMeasurementsStart;
+    int rawMeasurementsLength;
 };
 
 class DEWALLS_LIB_EXPORT Vector
@@ -113,6 +118,18 @@ public:
     inline QString comment() const { return d->comment; }
     inline QDate date() const { return d->date; }
     inline WallsUnits units() const { return d->units; }
+    ///
+    /// \return whether the measurements haven't been decoded yet, which is the case for
+    /// vectors parsed in topology mode (see WallsSurveyParser::setTopologyMode())
+    ///
+    inline bool hasRawMeasurements() const { return d->rawMeasurementsStart >= 0; }
+    ///
+    /// \return the undecoded measurements (distance through LRUDs), which are part of
+    /// sourceSegment()
+    ///
+    inline Segment rawMeasurements() const { return d->sourceSegment.mid(d->rawMeasurementsStart, d->rawMeasurementsLength); }
+    inline int rawMeasurementsStart() const { return d->rawMeasurementsStart; }
+    inline int rawMeasurementsLength() const { return d->rawMeasurementsLength; }
 
     inline void setSourceSegment(Segment sourceSegment) { d->sourceSegment = sourceSegment; }
     inline void setFrom(QString from) { d->from = from; }
@@ -139,6 +156,8 @@ public:
     inline void setComment(QString comment) { d->comment = comment; }
     inline void setDate(QDate date) { d->date = date; }
     inline void setUnits(WallsUnits units) { d->units = units; }
+    inline void setRawMeasurements(int start, int length) { d->rawMeasurementsStart = start; d->rawMeasurementsLength = length; }
+    inline void clearRawMeasurements() { setRawMeasurements(-1, 0); }
 
     ///
     /// \brief derives compass-and-tape measurements from the rect measurements.
@@ -20,12 +20,7 @@ WallsMessage::WallsMessage(QString severity, QString message, Segment segment)
 }
 
 WallsMessage::WallsMessage(const SegmentParseException& ex)
-    : Severity("error"),
-      Message(ex.detailMessage()),
-      Source(ex.segment().source()),
-      StartLine(ex.segment().startLine()), StartColumn(ex.segment().startCol()),
-      EndLine(ex.segment().endLine()), EndColumn(ex.segment().endCol()),
-      Context(ex.segment().underlineInContext())
+    : WallsMessage("error", ex.detailMessage(), ex.segment())
 {
 }
 
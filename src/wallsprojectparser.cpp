@@ -51,7 +51,7 @@ typedef UnitizedDouble<Angle> UAngle;
 // .REF	2308552.729 324501.432 16 -0.601 27 6 20 52 14.229 88 41 13.085 0 "Adindan"
 
 WallsProjectParser::WallsProjectParser(QObject* parent)
-    : QObject(parent), LineParser()
+    : QObject(parent), LineParser(), ErrorRecovery(false), ErrorCount(0), FlatEntries()
 {
 
 }
@@ -209,28 +209,62 @@ QDir WpjEntry::dir() const {
     return Parent.toStrongRef()->dir();
 }
 
-QString WpjEntry::absolutePath() const {
+DirectoryCachePtr WpjEntry::directoryCache() const {
+    WpjBookPtr parent = Parent.toStrongRef();
+    if (!parent.isNull()) {
+        return parent->directoryCache();
+    }
     if (isBook()) {
-        return QDir::cleanPath(dir().absolutePath());
+        return static_cast<const WpjBook*>(this)->Directories;
     }
-    else {
-        QString name = Name.value();
-        if (name.isEmpty()) {
-            return QString();
+    return DirectoryCachePtr();
+}
+
+namespace {
+
+///
+/// \brief resolves the file an entry refers to within the given directory
+///
+QString resolveFilePath(const WpjEntry& entry, const QDir& dir, const DirectoryCachePtr& cache) {
+    if (entry.isBook()) {
+        return QDir::cleanPath(dir.absolutePath());
+    }
+    QString name = entry.Name.value();
+    if (name.isEmpty()) {
+        return QString();
+    }
+    if (!cache.isNull() && !name.contains('/') && !name.contains('\\')) {
+        QString dirPath = QDir::cleanPath(dir.absolutePath());
+        if (entry.isSurvey() && !name.endsWith(".SRV", Qt::CaseInsensitive)) {
+            QString resolved = cache->resolve(dirPath, name + ".SRV");
+            name = resolved.isEmpty() ? name + ".SRV" : resolved;
         }
-        if (isSurvey() && !name.endsWith(".SRV", Qt::CaseInsensitive)) {
-            if (QFileInfo(QDir::cleanPath(dir().absoluteFilePath(name + ".SRV"))).exists()) {
-                name += ".SRV";
-            }
-            else if (QFileInfo(QDir::cleanPath(dir().absoluteFilePath(name + ".srv"))).exists()) {
-                name += ".srv";
-            }
-            else {
-                name += ".SRV";
+        else {
+            QString resolved = cache->resolve(dirPath, name);
+            if (!resolved.isEmpty()) {
+                name = resolved;
             }
         }
-        return QDir::cleanPath(dir().absoluteFilePath(name));
+        return QDir::cleanPath(dirPath + '/' + name);
+    }
+    if (entry.isSurvey() && !name.endsWith(".SRV", Qt::CaseInsensitive)) {
+        if (QFileInfo(QDir::cleanPath(dir.absoluteFilePath(name + ".SRV"))).exists()) {
+            name += ".SRV";
+        }
+        else if (QFileInfo(QDir::cleanPath(dir.absoluteFilePath(name + ".srv"))).exists()) {
+            name += ".srv";
+        }
+        else {
+            name += ".SRV";
+        }
     }
+    return QDir::cleanPath(dir.absoluteFilePath(name));
+}
+
+} // anonymous namespace
+
+QString WpjEntry::absolutePath() const {
+    return resolveFilePath(*this, dir(), directoryCache());
 }
 
 QList<Segment> WpjEntry::allOptions() const {
@@ -255,6 +289,133 @@ QStringList WpjEntry::segment() const {
     return result;
 }
 
+WpjFlatEntry::WpjFlatEntry()
+    : Entry(),
+      ParentIndex(-1),
+      Depth(0),
+      Dir(),
+      AbsolutePath(),
+      Options(),
+      SegmentPath(),
+      Reference(),
+      IsBook(false),
+      IsSurvey(false),
+      IsOther(false),
+      NameDefinesSegment(false),
+      ReviewUnits(WpjEntry::Meters),
+      DeriveDeclFromDate(false),
+      GridRelative(false),
+      PreserveVertShotOrientation(false),
+      PreserveVertShotLength(false),
+      LaunchOptions(WpjEntry::Properties),
+      DefaultViewAfterCompilation(WpjEntry::NorthOrEast)
+{
+
+}
+
+namespace {
+
+// mirrors the inheritance rules of WpjEntry::deriveDeclFromDate() etc.
+bool inheritFlag(int status, int offBit, int onBit, const WpjFlatEntry* parent, bool WpjFlatEntry::*flag) {
+    if (status & offBit) {
+        return false;
+    }
+    if (status & onBit) {
+        return true;
+    }
+    return parent ? parent->*flag : false;
+}
+
+void flattenInto(WpjEntryPtr entry, int parentIndex, const DirectoryCachePtr& cache,
+                 QVector<WpjFlatEntry>& result) {
+    const WpjFlatEntry* parent = parentIndex >= 0 ? &result[parentIndex] : nullptr;
+    const int status = entry->Status;
+
+    WpjFlatEntry flat;
+    flat.Entry = entry;
+    flat.ParentIndex = parentIndex;
+    flat.Depth = parent ? parent->Depth + 1 : 0;
+
+    if (!parent || QDir::isAbsolutePath(entry->Path)) {
+        flat.Dir = entry->Path;
+    }
+    else if (!entry->Path.isNull()) {
+        flat.Dir = QDir::cleanPath(parent->Dir + '/' + entry->Path);
+    }
+    else {
+        flat.Dir = parent->Dir;
+    }
+    flat.AbsolutePath = resolveFilePath(*entry, QDir(flat.Dir), cache);
+
+    if (parent) {
+        flat.Options = parent->Options;
+        flat.SegmentPath = parent->SegmentPath;
+    }
+    if (!entry->Options.isEmpty()) {
+        flat.Options << entry->Options;
+    }
+    if (entry->nameDefinesSegment() && !entry->Name.isEmpty()) {
+        flat.SegmentPath << entry->Name.value();
+    }
+
+    if (!(status & WpjEntry::ReferenceUnspecifiedBit)) {
+        flat.Reference = !entry->Reference.isNull() ? entry->Reference
+                       : parent ? parent->Reference : GeoReferencePtr();
+    }
+
+    flat.IsBook = entry->isBook();
+    flat.IsSurvey = entry->isSurvey();
+    flat.IsOther = entry->isOther();
+    flat.NameDefinesSegment = entry->nameDefinesSegment();
+    flat.ReviewUnits = entry->reviewUnits();
+    flat.DeriveDeclFromDate = inheritFlag(status, WpjEntry::DontDeriveDeclBit, WpjEntry::DeriveDeclBit,
+                                          parent, &WpjFlatEntry::DeriveDeclFromDate);
+    flat.GridRelative = inheritFlag(status, WpjEntry::NotGridRelativeBit, WpjEntry::GridRelativeBit,
+                                    parent, &WpjFlatEntry::GridRelative);
+    flat.PreserveVertShotOrientation = inheritFlag(status,
+                                                   WpjEntry::DontPreserveVertShotOrientationBit,
+                                                   WpjEntry::PreserveVertShotOrientationBit,
+                                                   parent, &WpjFlatEntry::PreserveVertShotOrientation);
+    flat.PreserveVertShotLength = inheritFlag(status,
+                                              WpjEntry::DontPreserveVertShotLengthBit,
+                                              WpjEntry::PreserveVertShotLengthBit,
+                                              parent, &WpjFlatEntry::PreserveVertShotLength);
+    flat.LaunchOptions = entry->launchOptions();
+    switch (status & WpjEntry::DefaultViewAfterCompilationMask) {
+    case WpjEntry::NorthOrEastViewBits:
+    case WpjEntry::NorthOrWestViewBits:
+    case WpjEntry::NorthViewBits:
+    case WpjEntry::EastViewBits:
+    case WpjEntry::WestViewBits:
+        flat.DefaultViewAfterCompilation = entry->defaultViewAfterCompilation();
+        break;
+    default:
+        flat.DefaultViewAfterCompilation = parent ? parent->DefaultViewAfterCompilation : WpjEntry::NorthOrEast;
+        break;
+    }
+
+    // parent is invalidated once result grows
+    parent = nullptr;
+    const int index = result.size();
+    result << flat;
+
+    if (entry->isBook()) {
+        foreach (WpjEntryPtr child, entry.staticCast<WpjBook>()->Children) {
+            flattenInto(child, index, cache, result);
+        }
+    }
+}
+
+} // anonymous namespace
+
+QVector<WpjFlatEntry> WallsProjectParser::flatten(WpjBookPtr root) {
+    QVector<WpjFlatEntry> result;
+    if (!root.isNull()) {
+        flattenInto(root, -1, root->Directories, result);
+    }
+    return result;
+}
+
 void WallsProjectParser::parseLine(QString line) {
     parseLine(Segment(line));
 }
@@ -353,6 +514,8 @@ void WallsProjectParser::commentLine() {
     remaining();
 }
 
+const QRegExp WallsProjectParser::datumNameRx("[^\"]+");
+
 void WallsProjectParser::refLine() {
     expect(".REF", Qt::CaseInsensitive);
     whitespace();
@@ -391,7 +554,7 @@ void WallsProjectParser::refLine() {
     ref.wallsDatumIndex = unsignedIntLiteral();
     whitespace();
     expect('"');
-    ref.datumName = expect(QRegExp("[^\"]+"), {"<DATUM_NAME>"}).value();
+    ref.datumName = expect(datumNameRx, {"<DATUM_NAME>"}).value();
     expect('"');
     maybeWhitespace();
     endOfLine();
@@ -400,6 +563,12 @@ void WallsProjectParser::refLine() {
 }
 
 WpjBookPtr WallsProjectParser::parseFile(QString fileName) {
+    // start over, so that the same parser can parse several files
+    FlatEntries.clear();
+    ProjectRoot.clear();
+    CurrentEntry.clear();
+    resetErrorCount();
+
     QFile file(fileName);
 
     if (!file.open(QFile::ReadOnly))
@@ -429,8 +598,11 @@ WpjBookPtr WallsProjectParser::parseFile(QString fileName) {
         }
         catch (const SegmentParseException& ex) {
             emit message(WallsMessage(ex));
-            file.close();
-            return WpjBookPtr();
+            if (!ErrorRecovery) {
+                file.close();
+                return WpjBookPtr();
+            }
+            ErrorCount++;
         }
 
         lineNumber++;
@@ -444,12 +616,18 @@ WpjBookPtr WallsProjectParser::parseFile(QString fileName) {
                                   QString("unexpected end of file: %1").arg(fileName),
                                   fileName,
                                   lineNumber));
-        return WpjBookPtr();
+        if (!ErrorRecovery) {
+            return WpjBookPtr();
+        }
+        ErrorCount++;
+        CurrentEntry.clear();
     }
 
     if (!ProjectRoot.isNull()) {
         ProjectRoot->Path = QFileInfo(fileName).dir().canonicalPath();
+        ProjectRoot->Directories = DirectoryCachePtr(new DirectoryCache());
     }
+    FlatEntries = flatten(ProjectRoot);
 
     return ProjectRoot;
 }
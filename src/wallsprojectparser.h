@@ -8,10 +8,13 @@
 #include <QDir>
 #include <QSharedPointer>
 #include <QFile>
+#include <QVector>
 #include "unitizeddouble.h"
 #include "dewallsexport.h"
 #include "angle.h"
 #include "length.h"
+#include "georeference.h"
+#include "directorycache.h"
 
 #include "wallsmessage.h"
 #include "lineparser.h"
@@ -20,24 +23,6 @@ namespace dewalls {
 
 class Segment;
 
-struct DEWALLS_LIB_EXPORT GeoReference {
-    typedef UnitizedDouble<Length> ULength;
-    typedef UnitizedDouble<Angle> UAngle;
-
-    // positive for north, negative for south
-    int zone;
-    ULength northing;
-    ULength easting;
-    UAngle gridConvergence;
-    ULength elevation;
-    UAngle latitude;
-    UAngle longitude;
-    int wallsDatumIndex;
-    QString datumName;
-};
-
-typedef QSharedPointer<GeoReference> GeoReferencePtr;
-
 class WpjEntry;
 class WpjBook;
 
@@ -103,9 +88,15 @@ public:
      */
     QDir dir() const;
     /**
-     * @return the absolute path to this entry's file (or this book's directory)
+     * @return the absolute path to this entry's file (or this book's directory).  If the
+     * project root has a directory cache, file names are matched case-insensitively
+     * against its listings instead of checking for each candidate name on disk.
      */
     QString absolutePath() const;
+    /**
+     * @return the directory cache of the project root this entry belongs to (may be null)
+     */
+    DirectoryCachePtr directoryCache() const;
     /**
      * @return the inherited and own #units options for this entry (or this book's subentries)
      */
@@ -149,6 +140,41 @@ public:
     virtual bool isBook() const { return true; }
 
     QList<WpjEntryPtr> Children;
+    // resolves the file names of all entries in the tree (only used on the root book);
+    // WallsProjectParser::parseFile() sets this
+    DirectoryCachePtr Directories;
+};
+
+///
+/// \brief an entry of a project tree with everything it inherits from its ancestors
+/// already worked out, so that batch jobs can walk the whole project without locking
+/// Parent pointers or rebuilding lists on every call.  The fields match the WpjEntry
+/// accessors of the same names.
+///
+struct DEWALLS_LIB_EXPORT WpjFlatEntry {
+    WpjFlatEntry();
+
+    WpjEntryPtr Entry;
+    // index of the parent book in the flattened array, or -1 for the root
+    int ParentIndex;
+    int Depth;
+    // the path of dir()
+    QString Dir;
+    QString AbsolutePath;
+    QList<Segment> Options;
+    QStringList SegmentPath;
+    GeoReferencePtr Reference;
+    bool IsBook;
+    bool IsSurvey;
+    bool IsOther;
+    bool NameDefinesSegment;
+    WpjEntry::ReviewUnits ReviewUnits;
+    bool DeriveDeclFromDate;
+    bool GridRelative;
+    bool PreserveVertShotOrientation;
+    bool PreserveVertShotLength;
+    WpjEntry::LaunchOptions LaunchOptions;
+    WpjEntry::View DefaultViewAfterCompilation;
 };
 
 ///
@@ -166,6 +192,30 @@ public:
     void parseLine(Segment line);
     WpjBookPtr parseFile(QString file);
 
+    ///
+    /// \brief turns error recovery on or off.  When it's on, parseFile() emits an "error"
+    /// message for each line it can't parse, skips that line and keeps going, and still
+    /// returns the project tree (closing any books left open at the end of the file).
+    ///
+    inline void setErrorRecovery(bool errorRecovery) {
+        ErrorRecovery = errorRecovery;
+    }
+    inline bool errorRecovery() const {
+        return ErrorRecovery;
+    }
+    ///
+    /// \return the number of errors the last parseFile() call has recovered from
+    ///
+    inline int errorCount() const {
+        return ErrorCount;
+    }
+    ///
+    /// \brief sets errorCount() back to 0 (parseFile() does this when it starts)
+    ///
+    inline void resetErrorCount() {
+        ErrorCount = 0;
+    }
+
     void emptyLine();
     void bookLine();
     void endbookLine();
@@ -177,10 +227,25 @@ public:
     void pathLine();
     void commentLine();
 
+    static const QRegExp datumNameRx;
+
     inline WpjBookPtr result() const {
         return ProjectRoot;
     }
 
+    ///
+    /// \return the tree returned by the last parseFile() call, flattened in depth-first
+    /// order (each book comes before its children)
+    ///
+    inline const QVector<WpjFlatEntry>& flatResult() const {
+        return FlatEntries;
+    }
+
+    ///
+    /// \brief flattens the given project tree in depth-first order
+    ///
+    static QVector<WpjFlatEntry> flatten(WpjBookPtr root);
+
     inline WpjBookPtr currentBook() const {
         if (CurrentEntry.isNull()) {
             return WpjBookPtr();
@@ -197,6 +262,9 @@ signals:
 private:
     WpjEntryPtr CurrentEntry;
     WpjBookPtr ProjectRoot;
+    bool ErrorRecovery;
+    int ErrorCount;
+    QVector<WpjFlatEntry> FlatEntries;
 };
 
 } // namespace dewalls
@@ -1,5 +1,10 @@
 #include "wallssurveyparser.h"
 #include "unitizedmath.h"
+#include "numberparsing.h"
+#include <algorithm>
+#include <cstring>
+#include <QMetaMethod>
+#include <QtConcurrentMap>
 
 namespace dewalls {
 
@@ -307,12 +312,25 @@ WallsSurveyParser::WallsSurveyParser(QString line)
 
 WallsSurveyParser::WallsSurveyParser(Segment segment)
     : LineParser(segment),
+      _errorRecovery(false),
+      _errorCount(0),
+      _fastPathEnabled(true),
+      _fastPathLineCount(0),
+      _events(AllEvents),
+      _topologyMode(false),
       _inBlockComment(false),
       _units(),
+      _vectorPlanDirty(true),
+      _vectorPlan(),
       _stack(),
       _macros(),
       _segment(),
       _date(),
+      _declReference(),
+      _declCache(),
+      _derivedDecl(),
+      _declUnitsSource(),
+      _declUnits(),
       _fromStationSegment(),
       _toStationSegment(),
       _azmSegment(),
@@ -344,11 +362,12 @@ ULength WallsSurveyParser::unsignedLengthNonInches(Length::Unit defaultUnit)
 
 ULength WallsSurveyParser::unsignedLength(Length::Unit defaultUnit)
 {
+    DEWALLS_PRODUCTION("unsignedLength");
     ULength result;
     oneOfR(result,
            [&]() { return unsignedLengthNonInches(defaultUnit); },
     [&]() { return unsignedLengthInches(); });
-    return result;
+    DEWALLS_PRODUCTION_RETURN(result);
 }
 
 ULength WallsSurveyParser::length(Length::Unit defaultUnit)
@@ -360,6 +379,7 @@ ULength WallsSurveyParser::length(Length::Unit defaultUnit)
 
 UAngle WallsSurveyParser::unsignedAngle(QHash<QChar, Angle::Unit> unitSuffixes, Angle::Unit defaultUnit)
 {
+    DEWALLS_PRODUCTION("unsignedAngle");
     auto expectColon = [&]() { expect(':'); };
     auto _unsignedDoubleLiteral = [&]{ return unsignedDoubleLiteral(); };
 
@@ -378,15 +398,15 @@ UAngle WallsSurveyParser::unsignedAngle(QHash<QChar, Angle::Unit> unitSuffixes,
         {
             throwAllExpected();
         }
-        return UAngle((hasValue   ? value 		     : 0) +
+        DEWALLS_PRODUCTION_RETURN(UAngle((hasValue   ? value 		     : 0) +
                       (hasMinutes ? minutes / 60.0   : 0) +
-                      (hasSeconds ? seconds / 3600.0 : 0), Angle::Degrees);
+                      (hasSeconds ? seconds / 3600.0 : 0), Angle::Degrees));
     }
     else if (!hasValue)
     {
         throwAllExpected();
     }
-    return UAngle(value, oneOfMap(unitSuffixes, defaultUnit));
+    DEWALLS_PRODUCTION_RETURN(UAngle(value, oneOfMap(unitSuffixes, defaultUnit)));
 }
 
 UAngle WallsSurveyParser::unsignedDmsAngle()
@@ -487,10 +507,11 @@ UAngle WallsSurveyParser::quadrantAzimuth()
 
 UAngle WallsSurveyParser::azimuth(Angle::Unit defaultUnit)
 {
+    DEWALLS_PRODUCTION("azimuth");
     UAngle result;
     oneOfR(result, [&]() { return quadrantAzimuth(); },
     [&]() { return nonQuadrantAzimuth(defaultUnit); });
-    return result;
+    DEWALLS_PRODUCTION_RETURN(result);
 }
 
 UAngle WallsSurveyParser::azimuthOffset(Angle::Unit defaultUnit)
@@ -518,6 +539,7 @@ UAngle WallsSurveyParser::unsignedInclination(Angle::Unit defaultUnit)
 
 UAngle WallsSurveyParser::inclination(Angle::Unit defaultUnit)
 {
+    DEWALLS_PRODUCTION("inclination");
     int start = _i;
     double signum;
     bool hasSignum = maybe(signum, [this]() { return oneOfMap(signSignums); } );
@@ -529,13 +551,14 @@ UAngle WallsSurveyParser::inclination(Angle::Unit defaultUnit)
         {
             throw SegmentParseException(_line.mid(start, _i), "zero inclinations must not be preceded by a sign");
         }
-        return angle * signum;
+        DEWALLS_PRODUCTION_RETURN(angle * signum);
     }
-    return angle;
+    DEWALLS_PRODUCTION_RETURN(angle);
 }
 
 VarianceOverridePtr WallsSurveyParser::varianceOverride(Length::Unit defaultUnit)
 {
+    DEWALLS_PRODUCTION("varianceOverride");
     VarianceOverridePtr result;
     oneOfR(result,
            [&]() { return floatedVectorVarianceOverride(); },
@@ -543,7 +566,7 @@ VarianceOverridePtr WallsSurveyParser::varianceOverride(Length::Unit defaultUnit
     [&]() { return lengthVarianceOverride(defaultUnit); },
     [&]() { return rmsErrorVarianceOverride(defaultUnit); },
     [&]() { return VarianceOverridePtr(NULL); });
-    return result;
+    DEWALLS_PRODUCTION_RETURN(result);
 }
 
 VarianceOverridePtr WallsSurveyParser::floatedVectorVarianceOverride()
@@ -560,13 +583,24 @@ VarianceOverridePtr WallsSurveyParser::floatedTraverseVarianceOverride()
 
 VarianceOverridePtr WallsSurveyParser::lengthVarianceOverride(Length::Unit defaultUnit)
 {
-    return VarianceOverridePtr(new LengthOverride(unsignedLength(defaultUnit)));
+    ULength length = unsignedLength(defaultUnit);
+    if (!(_events & VarianceFields))
+    {
+        // only whether there is an override matters then
+        return VarianceOverride::FLOATED;
+    }
+    return VarianceOverridePtr(new LengthOverride(length));
 }
 
 VarianceOverridePtr WallsSurveyParser::rmsErrorVarianceOverride(Length::Unit defaultUnit)
 {
     expect('r', Qt::CaseInsensitive);
-    return VarianceOverridePtr(new RMSError(unsignedLength(defaultUnit)));
+    ULength error = unsignedLength(defaultUnit);
+    if (!(_events & VarianceFields))
+    {
+        return VarianceOverride::FLOATED;
+    }
+    return VarianceOverridePtr(new RMSError(error));
 }
 
 QString WallsSurveyParser::quotedTextOrNonwhitespace()
@@ -579,10 +613,11 @@ QString WallsSurveyParser::quotedTextOrNonwhitespace()
 
 QString WallsSurveyParser::quotedText()
 {
+    DEWALLS_PRODUCTION("quotedText");
     expect('"');
-    QString result = escapedText([](QChar c) { return c != '"'; }, {"<QUOTED TEXT>"});
+    QString result = escapedText([](QChar c) { return c != '"'; }, {QStringLiteral("<QUOTED TEXT>")});
     expect('"');
-    return result;
+    DEWALLS_PRODUCTION_RETURN(result);
 }
 
 QString WallsSurveyParser::movePastEndQuote()
@@ -618,11 +653,243 @@ void WallsSurveyParser::parseLine(Segment line)
 
 void WallsSurveyParser::parseLine()
 {
+    if (!_errorRecovery)
+    {
+        surveyLine();
+        return;
+    }
+
+    // these are all implicitly shared, so saving them is cheap
+    bool inBlockComment = _inBlockComment;
+    WallsUnits units = _units;
+    QStack<WallsUnits> stack = _stack;
+    QHash<QString, QString> macros = _macros;
+    QStringList segment = _segment;
+    QDate date = _date;
+    UAngle derivedDecl = _derivedDecl;
+
+    try
+    {
+        surveyLine();
+    }
+    catch (const SegmentParseException& ex)
+    {
+        _inBlockComment = inBlockComment;
+        _units = units;
+        _vectorPlanDirty = true;
+        _stack = stack;
+        _macros = macros;
+        _segment = segment;
+        _date = date;
+        _derivedDecl = derivedDecl;
+        _errorCount++;
+        emit message(WallsMessage(ex));
+    }
+}
+
+namespace {
+
+inline QString decode(const char* data, int size, WallsSurveyParser::Encoding encoding)
+{
+    return encoding == WallsSurveyParser::Utf8 ? QString::fromUtf8(data, size) : QString::fromLatin1(data, size);
+}
+
+///
+/// \return the start of the first line from p (which must start a line) on that may end a
+/// block comment, or end if there is none.  That's a line starting with #] after whitespace,
+/// where non-ASCII characters count as whitespace since they may be.
+///
+const char* findBlockCommentEnd(const char* p, const char* end)
+{
+    const char* hash = p;
+    while (hash < end && (hash = static_cast<const char*>(std::memchr(hash, '#', end - hash))))
+    {
+        if (hash + 1 < end && hash[1] == ']')
+        {
+            const char* lineStart = hash;
+            while (lineStart > p && lineStart[-1] != '\n' &&
+                   (lineStart[-1] == ' ' || lineStart[-1] == '\t' || lineStart[-1] == '\r' ||
+                    lineStart[-1] == '\v' || lineStart[-1] == '\f' ||
+                    static_cast<unsigned char>(lineStart[-1]) >= 0x80))
+            {
+                lineStart--;
+            }
+            if (lineStart == p || lineStart[-1] == '\n')
+            {
+                return lineStart;
+            }
+        }
+        hash++;
+    }
+    return end;
+}
+
+} // anonymous namespace
+
+int WallsSurveyParser::parseBuffer(const QByteArray& data, QString source, Encoding encoding)
+{
+    const char* p = data.constData();
+    const char* end = p + data.size();
+    if (data.startsWith("\xEF\xBB\xBF"))
+    {
+        encoding = Utf8;
+        p += 3;
+    }
+
+    // the lines inside block comments only matter as comments
+    const bool wantsComments = (_events & CommentEvents) &&
+            isSignalConnected(QMetaMethod::fromSignal(&WallsSurveyParser::parsedComment));
+
+    int lineNumber = 0;
+    while (p < end)
+    {
+        if (_inBlockComment && !wantsComments)
+        {
+            // jump straight to the line that may end it, counting the lines skipped
+            const char* next = findBlockCommentEnd(p, end);
+            lineNumber += int(std::count(p, next, '\n'));
+            if (next == end)
+            {
+                if (end[-1] != '\n')
+                {
+                    // the last line has no newline
+                    lineNumber++;
+                }
+                break;
+            }
+            p = next;
+        }
+
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!eol)
+        {
+            eol = end;
+        }
+        const char* lineEnd = eol;
+        if (lineEnd > p && lineEnd[-1] == '\r')
+        {
+            lineEnd--;
+        }
+
+        if (!parseRawLine(p, lineEnd, encoding, source, lineNumber))
+        {
+            parseLine(Segment(decode(p, int(lineEnd - p), encoding), source, lineNumber, 0));
+        }
+
+        lineNumber++;
+        if (eol == end)
+        {
+            break;
+        }
+        p = eol + 1;
+    }
+    return lineNumber;
+}
+
+///
+/// \brief handles the lines that don't need the grammar without decoding them: blank lines,
+/// comment lines, lines inside block comments, and (with the fast path enabled) vector and
+/// #fix lines of the usual shape.  Only what gets emitted is decoded.
+/// \return true if the line was handled, false if it needs to be decoded and go through
+/// parseLine()
+///
+bool WallsSurveyParser::parseRawLine(const char* begin, const char* end, Encoding encoding,
+                                     const QString& source, int lineNumber)
+{
+    const char* p = begin;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\v' || *p == '\f'))
+    {
+        p++;
+    }
+    if (p == end)
+    {
+        return true;
+    }
+    if (static_cast<unsigned char>(*p) >= 0x80)
+    {
+        // could be non-ASCII whitespace
+        return false;
+    }
+    if (_inBlockComment)
+    {
+        if (end - p >= 2 && p[0] == '#' && p[1] == ']')
+        {
+            return false;
+        }
+        if (_events & CommentEvents)
+        {
+            emit parsedComment(decode(p, int(end - p), encoding));
+        }
+        return true;
+    }
+    if (*p == ';')
+    {
+        if (_events & CommentEvents)
+        {
+            emit parsedComment(decode(p + 1, int(end - p - 1), encoding));
+        }
+        return true;
+    }
+    if (!_fastPathEnabled)
+    {
+        return false;
+    }
+    if (*p == '#')
+    {
+        return rawFixLine(begin, p, end, encoding);
+    }
+    return rawVectorLine(begin, p, end, encoding, source, lineNumber);
+}
+
+void WallsSurveyParser::setErrorRecovery(bool errorRecovery)
+{
+    _errorRecovery = errorRecovery;
+}
+
+void WallsSurveyParser::setFastPathEnabled(bool fastPathEnabled)
+{
+    _fastPathEnabled = fastPathEnabled;
+}
+
+void WallsSurveyParser::setEvents(Events events)
+{
+    _events = events;
+}
+
+void WallsSurveyParser::setLintMode(bool lintMode)
+{
+    setEvents(lintMode ? NoEvents : AllEvents);
+}
+
+void WallsSurveyParser::setTopologyMode(bool topologyMode)
+{
+    _topologyMode = topologyMode;
+}
+
+void WallsSurveyParser::resetErrorCount()
+{
+    _errorCount = 0;
+}
+
+QString WallsSurveyParser::errorSummary(QString source) const
+{
+    if (!_errorCount)
+    {
+        return QString();
+    }
+    QString summary = _errorCount == 1 ? QString("1 error") : QString("%1 errors").arg(_errorCount);
+    return source.isEmpty() ? summary : QString("%1 in %2").arg(summary, source);
+}
+
+void WallsSurveyParser::surveyLine()
+{
+    DEWALLS_PRODUCTION("line");
     _parsedSegmentDirective = false;
     maybeWhitespace();
 
     if (isAtEnd())
     {
+        DEWALLS_PRODUCTION_SUCCEEDED();
         return;
     }
 
@@ -633,22 +900,25 @@ void WallsSurveyParser::parseLine()
             [&]() { insideBlockCommentLine(); });
         });
     }
-    else
+    else if (!_fastPathEnabled || !fastVectorLine())
     {
         throwAllExpected([&]() { oneOf([&]() { comment(); },
             [&]() { directiveLine(); },
             [&]() { vectorLine(); });
         });
     }
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 void WallsSurveyParser::directiveLine()
 {
+    DEWALLS_PRODUCTION("directiveLine");
     int start = _i;
     OwnProduction directive = oneOfMapLowercase(directiveRx, directivesMap);
     _i = start;
     if (directive != &WallsSurveyParser::fixLine) replaceMacros();
     (this->*directive)();
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 QString WallsSurveyParser::replaceMacro()
@@ -669,14 +939,15 @@ QString WallsSurveyParser::replaceMacro()
         }
         else if (c.isSpace())
         {
-            throw SegmentParseExpectedException(_line.atAsSegment(_i - 1), "<NONWHITESPACE>");
+            throw SegmentParseExpectedException(_line, _i - 1, QStringLiteral("<NONWHITESPACE>"));
         }
     }
-    throw SegmentParseExpectedException(_line.atAsSegment(_i), std::initializer_list<QString>{"<NON_WHITESPACE>", ")"});
+    throw SegmentParseExpectedException(_line, _i, std::initializer_list<QString>{"<NON_WHITESPACE>", ")"});
 }
 
 void WallsSurveyParser::replaceMacros()
 {
+    DEWALLS_PRODUCTION("replaceMacros");
     QString newLine;
 
     bool replaced = false;
@@ -715,26 +986,27 @@ void WallsSurveyParser::replaceMacros()
     {
         _line = Segment(newLine, _line.source(), _line.startLine(), _line.startCol());
     }
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 void WallsSurveyParser::beginBlockCommentLine()
 {
     maybeWhitespace();
-    expect("#[");
+    expect(QStringLiteral("#["));
     _inBlockComment = true;
 }
 
 void WallsSurveyParser::endBlockCommentLine()
 {
     maybeWhitespace();
-    expect("#]");
+    expect(QStringLiteral("#]"));
     remaining();
     _inBlockComment = false;
 }
 
 void WallsSurveyParser::insideBlockCommentLine()
 {
-    emit parsedComment(remaining().value());
+    emitRemainingAsComment();
 }
 
 Segment WallsSurveyParser::untilComment(std::initializer_list<QString> expectedItems)
@@ -744,29 +1016,31 @@ Segment WallsSurveyParser::untilComment(std::initializer_list<QString> expectedI
 
 void WallsSurveyParser::segmentLine()
 {
+    DEWALLS_PRODUCTION("segmentLine");
     maybeWhitespace();
     _segment = segmentDirective();
     maybeWhitespace();
     inlineCommentOrEndOfLine();
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 void WallsSurveyParser::segmentSeparator()
 {
-    oneOf([&]() { expect("/"); },
-    [&]() { expect("\\"); });
+    oneOf([&]() { expect(QStringLiteral("/")); },
+    [&]() { expect(QStringLiteral("\\")); });
 }
 
 QString WallsSurveyParser::initialSegmentPart()
 {
     QString result;
-    oneOfR(result, [&]() { expect("."); return "."; },
-    [&]() { expect(".."); return ".."; });
+    oneOfR(result, [&]() { expect(QStringLiteral(".")); return "."; },
+    [&]() { expect(QStringLiteral("..")); return ".."; });
     return result;
 }
 
 QString WallsSurveyParser::nonInitialSegmentPart()
 {
-    return expect(segmentPartRx, {"<PATH ELEMENT>"}).value();
+    return expect(segmentPartRx, {QStringLiteral("<PATH ELEMENT>")}).value();
 }
 
 QStringList WallsSurveyParser::segmentPath()
@@ -803,9 +1077,10 @@ QStringList WallsSurveyParser::segmentPath()
 
 QStringList WallsSurveyParser::segmentDirective()
 {
-    oneOf([&]() { expect("#segment", Qt::CaseInsensitive); },
-    [&]() { expect("#seg", Qt::CaseInsensitive); },
-    [&]() { expect("#s", Qt::CaseInsensitive); } );
+    DEWALLS_PRODUCTION("segmentDirective");
+    oneOf([&]() { expect(QStringLiteral("#segment"), Qt::CaseInsensitive); },
+    [&]() { expect(QStringLiteral("#seg"), Qt::CaseInsensitive); },
+    [&]() { expect(QStringLiteral("#s"), Qt::CaseInsensitive); } );
 
     _parsedSegmentDirective = true;
 
@@ -816,7 +1091,7 @@ QStringList WallsSurveyParser::segmentDirective()
         maybe(result, [&]() { return segmentPath(); });
     }
 
-    return result;
+    DEWALLS_PRODUCTION_RETURN(result);
 }
 
 void WallsSurveyParser::prefixLine()
@@ -829,12 +1104,14 @@ void WallsSurveyParser::prefixLine()
 
 void WallsSurveyParser::prefixDirective()
 {
+    DEWALLS_PRODUCTION("prefixDirective");
     int prefixIndex = oneOfMapLowercase(nonwhitespaceRx, prefixDirectives);
 
     if (maybeWhitespace())
     {
-        _units.setPrefix(prefixIndex, expect(prefixRx, {"<PREFIX>"}).value());
+        _units.setPrefix(prefixIndex, expect(prefixRx, {QStringLiteral("<PREFIX>")}).value());
     }
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 void WallsSurveyParser::noteLine()
@@ -847,15 +1124,24 @@ void WallsSurveyParser::noteLine()
 
 void WallsSurveyParser::noteDirective()
 {
-    oneOf([&]() { expect("#note", Qt::CaseInsensitive); },
-    [&]() { expect("#n", Qt::CaseInsensitive); });
+    DEWALLS_PRODUCTION("noteDirective");
+    oneOf([&]() { expect(QStringLiteral("#note"), Qt::CaseInsensitive); },
+    [&]() { expect(QStringLiteral("#n"), Qt::CaseInsensitive); });
 
     whitespace();
     QString _station = station().value();
     whitespace();
-    QString _note = escapedText([](QChar c) { return c != ';'; }, {"<NOTE>"});
-
-    emit parsedNote(_station, _note);
+    auto noteChar = [](QChar c) { return c != ';'; };
+    if (_events & NoteEvents)
+    {
+        QString _note = escapedText(noteChar, {QStringLiteral("<NOTE>")});
+        emit parsedNote(_station, _note);
+    }
+    else
+    {
+        skipEscapedText(noteChar, {QStringLiteral("<NOTE>")});
+    }
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 void WallsSurveyParser::flagLine()
@@ -868,28 +1154,35 @@ void WallsSurveyParser::flagLine()
 
 void WallsSurveyParser::flagDirective()
 {
-    oneOf([&]() { expect("#flag", Qt::CaseInsensitive); },
-    [&]() { expect("#f", Qt::CaseInsensitive); });
+    DEWALLS_PRODUCTION("flagDirective");
+    oneOf([&]() { expect(QStringLiteral("#flag"), Qt::CaseInsensitive); },
+    [&]() { expect(QStringLiteral("#f"), Qt::CaseInsensitive); });
 
+    const bool wanted = _events & FlagEvents;
     QStringList stations;
+    bool hasStations = false;
 
     maybeWhitespace();
 
     do
     {
-        QString _station;
-        if (!maybe(_station, [&]() { return station().value(); }))
+        Segment _station;
+        if (!maybe(_station, [&]() { return station(); }))
         {
             break;
         }
-        stations << _station;
+        hasStations = true;
+        if (wanted)
+        {
+            stations << _station.value();
+        }
     } while(maybe([&]() { oneOf([&]() { whitespace(); }, [&]() { expect(','); }); }));
 
     QString _flag;
     bool hasFlag = maybe(_flag, [&]() { return slashPrefixedFlag(); });
     maybeWhitespace();
 
-    if (stations.isEmpty())
+    if (!hasStations)
     {
         _units.flag() = _flag;
     }
@@ -899,24 +1192,28 @@ void WallsSurveyParser::flagDirective()
         {
             throwAllExpected();
         }
-        emit parsedFlag(stations, _flag);
+        if (wanted)
+        {
+            emit parsedFlag(stations, _flag);
+        }
     }
 
     inlineCommentOrEndOfLine();
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 QString WallsSurveyParser::slashPrefixedFlag()
 {
     expect('/');
-    return expect(notSemicolonRx, {"<FLAG>"}).value();
+    return expect(notSemicolonRx, {QStringLiteral("<FLAG>")}).value();
 }
 
 void WallsSurveyParser::symbolLine()
 {
     maybeWhitespace();
 
-    oneOf([&]() { expect("#symbol", Qt::CaseInsensitive); },
-    [&]() { expect("#sym", Qt::CaseInsensitive); });
+    oneOf([&]() { expect(QStringLiteral("#symbol"), Qt::CaseInsensitive); },
+    [&]() { expect(QStringLiteral("#sym"), Qt::CaseInsensitive); });
 
     // ignore the rest for now
     remaining();
@@ -925,70 +1222,141 @@ void WallsSurveyParser::symbolLine()
 void WallsSurveyParser::dateLine()
 {
     maybeWhitespace();
-    emit parsedDate(dateDirective());
+    QDate date = dateDirective();
+    if (_events & DateEvents)
+    {
+        emit parsedDate(date);
+    }
     maybeWhitespace();
     inlineCommentOrEndOfLine();
 }
 
 QDate WallsSurveyParser::dateDirective()
 {
-    expect("#date", Qt::CaseInsensitive);
+    DEWALLS_PRODUCTION("dateDirective");
+    expect(QStringLiteral("#date"), Qt::CaseInsensitive);
     whitespace();
+    int start = _i;
     oneOfR(_date,
            [&]() { return isoDate(); },
     [&]() { return usDate1(); },
     [&]() { return usDate2(); },
     [&]() { return usDate3(); });
-    return _date;
+    updateDerivedDecl();
+    if (!_declReference.isNull() && _date.isValid() && !_derivedDecl.isValid())
+    {
+        const GeomagneticModelSet& models = _declCache->models();
+        QString text = QString("can't derive the declination for this date: the geomagnetic models (%1) "
+                               "only cover %2 to %3; using the #units declination instead")
+                .arg(models.name()).arg(models.epoch()).arg(models.validUntil());
+        emit message(WallsMessage("warning", text, _line.mid(start, _i - start)));
+    }
+    DEWALLS_PRODUCTION_RETURN(_date);
+}
+
+void WallsSurveyParser::setDeclinationReference(GeoReferencePtr reference, DeclinationCachePtr cache)
+{
+    _declReference = reference;
+    _declCache = cache;
+    if (!_declReference.isNull() && _declCache.isNull())
+    {
+        _declCache = DeclinationCachePtr(new DeclinationCache());
+    }
+    updateDerivedDecl();
+}
+
+void WallsSurveyParser::setProjectEntry(WpjEntryPtr entry, DeclinationCachePtr cache)
+{
+    QStringList segment = entry->segment();
+    setRootSegment(segment);
+    setSegment(segment);
+    foreach (Segment options, entry->allOptions())
+    {
+        parseUnitsOptions(options);
+    }
+    setDeclinationReference(entry->deriveDeclFromDate() ? entry->reference() : GeoReferencePtr(), cache);
+}
+
+void WallsSurveyParser::setProjectEntry(const WpjFlatEntry& entry, DeclinationCachePtr cache)
+{
+    setRootSegment(entry.SegmentPath);
+    setSegment(entry.SegmentPath);
+    foreach (Segment options, entry.Options)
+    {
+        parseUnitsOptions(options);
+    }
+    setDeclinationReference(entry.DeriveDeclFromDate ? entry.Reference : GeoReferencePtr(), cache);
+}
+
+void WallsSurveyParser::updateDerivedDecl()
+{
+    if (_declReference.isNull() || !_date.isValid())
+    {
+        _derivedDecl = UAngle();
+        return;
+    }
+    _derivedDecl = _declCache->declination(_date, *_declReference);
 }
 
 QDate WallsSurveyParser::isoDate()
 {
-    Segment dateSegment = expect(isoDateRx, {"<DATE>"});
+    Segment dateSegment = expect(isoDateRx, {QStringLiteral("<DATE>")});
     return QDate::fromString(dateSegment.value(), Qt::ISODate);
 }
 
 QDate WallsSurveyParser::usDate1()
 {
-    QString str = expect(usDateRx1, {"<DATE>"}).value();
+    QString str = expect(usDateRx1, {QStringLiteral("<DATE>")}).value();
     return QDate::fromString(str, str.length() > 8 ? "MM-dd-yyyy" : "MM-dd-yy");
 }
 
 QDate WallsSurveyParser::usDate2()
 {
-    QString str = expect(usDateRx2, {"<DATE>"}).value();
+    QString str = expect(usDateRx2, {QStringLiteral("<DATE>")}).value();
     return QDate::fromString(str, str.length() > 8 ? "MM/dd/yyyy" : "MM/dd/yy");
 }
 
 QDate WallsSurveyParser::usDate3()
 {
-    QString str = expect(usDateRx3, {"<DATE>"}).value();
+    QString str = expect(usDateRx3, {QStringLiteral("<DATE>")}).value();
     return QDate::fromString(str, "yyyy-MM-dd");
 }
 void WallsSurveyParser::unitsLine()
 {
+    DEWALLS_PRODUCTION("unitsLine");
     maybeWhitespace();
-    oneOf([&]() { expect("#units", Qt::CaseInsensitive); },
-    [&]() { expect("#u", Qt::CaseInsensitive); });
+    oneOf([&]() { expect(QStringLiteral("#units"), Qt::CaseInsensitive); },
+    [&]() { expect(QStringLiteral("#u"), Qt::CaseInsensitive); });
 
-    emit willParseUnits();
+    if (_events & UnitsEvents)
+    {
+        emit willParseUnits();
+    }
 
     if (maybeWhitespace())
     {
         unitsOptions();
-        emit parsedUnits();
+        if (_events & UnitsEvents)
+        {
+            emit parsedUnits();
+        }
     }
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 void WallsSurveyParser::parseUnitsOptions(Segment options)
 {
     reset(options);
     unitsOptions();
-    emit parsedUnits();
+    if (_events & UnitsEvents)
+    {
+        emit parsedUnits();
+    }
 }
 
 void WallsSurveyParser::unitsOptions()
 {
+    _vectorPlanDirty = true;
     bool gotOne = false;
     while(!maybe([&]() { inlineCommentOrEndOfLine(); } ))
     {
@@ -1012,20 +1380,24 @@ void WallsSurveyParser::unitsOptions()
 
 void WallsSurveyParser::unitsOption()
 {
+    DEWALLS_PRODUCTION("unitsOption");
     void (WallsSurveyParser::*option)() = oneOfMapLowercase(unitsOptionRx, unitsOptionMap);
     (this->*option)();
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 void WallsSurveyParser::macroOption()
 {
+    DEWALLS_PRODUCTION("macroOption");
     expect('$');
-    QString macroName = expect(macroNameRx, {"<MACRO NAME>"}).value();
+    QString macroName = expect(macroNameRx, {QStringLiteral("<MACRO NAME>")}).value();
     QString macroValue;
     if (maybeChar('='))
     {
         macroValue = quotedTextOrNonwhitespace();
     }
     _macros[macroName] = macroValue;
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 void WallsSurveyParser::save()
@@ -1295,7 +1667,7 @@ void WallsSurveyParser::prefix(int index)
 
     if (maybeChar('='))
     {
-        prefix = expect(prefixRx, {"<PREFIX>"}).value();
+        prefix = expect(prefixRx, {QStringLiteral("<PREFIX>")}).value();
     }
     _units.setPrefix(index, prefix);
 }
@@ -1338,6 +1710,7 @@ void WallsSurveyParser::flag()
 
 void WallsSurveyParser::vectorLine()
 {
+    DEWALLS_PRODUCTION("vectorLine");
     maybeWhitespace();
     fromStation();
     _parsedSegmentDirective = false;
@@ -1345,53 +1718,689 @@ void WallsSurveyParser::vectorLine()
     afterFromStation();
     maybeWhitespace();
     endOfLine();
+    finishVectorLine();
+    DEWALLS_PRODUCTION_SUCCEEDED();
+}
+
+///
+/// \return the units to emit vectors with: the current units, with the derived declination
+/// if there is one.  The derived declination isn't applied to _units itself, so it doesn't
+/// get saved by #units save or outlive the declination reference.
+///
+const WallsUnits& WallsSurveyParser::vectorUnits()
+{
+    if (!_derivedDecl.isValid() || _units.decl() == _derivedDecl)
+    {
+        return _units;
+    }
+    if (!_declUnitsSource.isSharedWith(_units) || _declUnits.decl() != _derivedDecl)
+    {
+        _declUnitsSource = _units;
+        _declUnits = _units;
+        _declUnits.setDecl(_derivedDecl);
+    }
+    return _declUnits;
+}
+
+void WallsSurveyParser::finishVectorLine()
+{
+    if (!(_events & VectorEvents))
+    {
+        return;
+    }
     if (_parsedSegmentDirective) {
         _vector.setSegment(_segment);
     }
     _vector.setDate(_date);
-    _vector.setUnits(_units);
+    _vector.setUnits(vectorUnits());
     emit parsedVector(_vector);
 }
 
+namespace {
+
+using numberparsing::unicode;
+
+template<typename Char>
+inline bool skipSpaces(const Char* s, int n, int& i)
+{
+    int start = i;
+    while (i < n && (s[i] == ' ' || s[i] == '\t'))
+    {
+        i++;
+    }
+    return i > start;
+}
+
+///
+/// \brief scans a station name without prefixes that stationRx would match
+///
+template<typename Char>
+inline bool fastStation(const Char* s, int n, int& i)
+{
+    int start = i;
+    while (i < n)
+    {
+        ushort c = unicode(s[i]);
+        if (c <= ' ' || c >= 0x7f || c == ':' || c == ';' || c == ',' || c == '#' || c == '/')
+        {
+            break;
+        }
+        i++;
+    }
+    // leading dashes could be an omitted station
+    return i > start && i - start <= 8 && s[start] != '-';
+}
+
+inline bool isSpace(QChar c)
+{
+    return c.isSpace();
+}
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+///
+/// \return true for characters the fast paths can't classify: raw bytes that aren't ASCII
+/// could be whitespace (or part of one) once decoded
+///
+inline bool isUndecoded(QChar)
+{
+    return false;
+}
+
+inline bool isUndecoded(char c)
+{
+    return uchar(c) >= 0x80;
+}
+
+} // anonymous namespace
+
+///
+/// \brief scans a vector line of the usual shape (from s[i] on, after the leading whitespace)
+/// without going through the grammar or changing anything.  To make sure the results are the
+/// same, it gives up on anything that would make the grammar emit a warning or throw.  Works on
+/// decoded lines and on the raw bytes of ASCII ones.
+///
+template<typename Char>
+bool WallsSurveyParser::scanFastVectorLine(const Char* s, int n, int i, FastVectorLine& fields)
+{
+    const bool topology = _topologyMode && (_events & VectorEvents);
+    const VectorPlan& plan = vectorPlan();
+    if (!plan.fast && !topology)
+    {
+        return false;
+    }
+
+    fields.fromStart = i;
+    if (!fastStation(s, n, i))
+    {
+        return false;
+    }
+    fields.fromEnd = i;
+    if (!skipSpaces(s, n, i))
+    {
+        return false;
+    }
+    fields.toStart = i;
+    if (!fastStation(s, n, i))
+    {
+        return false;
+    }
+    fields.toEnd = i;
+    fields.rawStart = fields.rawEnd = -1;
+    fields.hasLruds = false;
+
+    if (topology)
+    {
+        // see rawMeasurements()
+        if (s[fields.toStart] == '*' || s[fields.toStart] == '<' || !skipSpaces(s, n, i))
+        {
+            return false;
+        }
+        int rawStart = i;
+        int rawEnd = i;
+        while (i < n && s[i] != ';')
+        {
+            if (s[i] == '#' || isUndecoded(s[i]))
+            {
+                return false;
+            }
+            if (!isSpace(s[i++]))
+            {
+                rawEnd = i;
+            }
+        }
+        if (rawEnd == rawStart)
+        {
+            return false;
+        }
+        fields.rawStart = rawStart;
+        fields.rawEnd = rawEnd;
+        fields.comment = i < n ? i : -1;
+        return true;
+    }
+
+    for (int k = 0; k < 3; k++)
+    {
+        if (!skipSpaces(s, n, i))
+        {
+            return false;
+        }
+        double signum = 0.0;
+        if (plan.fastSlots[k] == 2 && i < n && (s[i] == '+' || s[i] == '-'))
+        {
+            signum = s[i] == '-' ? -1.0 : 1.0;
+            i++;
+        }
+        double value;
+        if (!numberparsing::parseUnsignedDecimal(s, n, i, &value))
+        {
+            return false;
+        }
+        switch (plan.fastSlots[k])
+        {
+        case 0:
+            fields.dist = ULength(value, _units.dUnit());
+            if (correctionChangesSign(fields.dist, _units.incd()))
+            {
+                return false;
+            }
+            break;
+        case 1:
+            fields.azm = UAngle(value, _units.aUnit());
+            if (approx(fields.azm.get(Angle::Degrees)) >= 360.0)
+            {
+                return false;
+            }
+            break;
+        default:
+            fields.inc = UAngle(value, _units.vUnit());
+            if (approx(fields.inc.get(Angle::Degrees)) > 90.0)
+            {
+                return false;
+            }
+            if (signum != 0.0)
+            {
+                if (value == 0.0)
+                {
+                    return false;
+                }
+                fields.inc = fields.inc * signum;
+            }
+            break;
+        }
+    }
+
+    // anything but LRUDs or a comment next (heights, variance overrides, unit suffixes,
+    // backsights...) needs the grammar
+    bool spaced = skipSpaces(s, n, i);
+    if (spaced && i < n && (s[i] == '*' || s[i] == '<'))
+    {
+        // the values are only needed to check the correction if nobody wants them
+        const bool lrudValues = (_events & LrudFields) || _units.incs().isNonzero();
+        char close = s[i] == '*' ? '*' : '>';
+        i++;
+        skipSpaces(s, n, i);
+        for (int m = 0; m < 4; m++)
+        {
+            if (m > 0)
+            {
+                bool separated = skipSpaces(s, n, i);
+                if (i < n && s[i] == ',')
+                {
+                    i++;
+                    skipSpaces(s, n, i);
+                }
+                else if (!separated)
+                {
+                    return false;
+                }
+            }
+            double value;
+            if (!numberparsing::parseUnsignedDecimal(s, n, i, lrudValues ? &value : nullptr))
+            {
+                return false;
+            }
+            if (!lrudValues)
+            {
+                continue;
+            }
+            ULength& lrud = fields.lruds[plan.fastLrudSlots[m]];
+            lrud = ULength(value, _units.sUnit());
+            if (correctionChangesSign(lrud, _units.incs()))
+            {
+                return false;
+            }
+        }
+        skipSpaces(s, n, i);
+        if (i >= n || s[i] != close)
+        {
+            return false;
+        }
+        i++;
+        fields.hasLruds = _events & LrudFields;
+        skipSpaces(s, n, i);
+    }
+    if (i < n && s[i] != ';')
+    {
+        return false;
+    }
+    fields.comment = i < n ? i : -1;
+    return true;
+}
+
+///
+/// \brief decodes a vector line of the usual shape without going through the grammar.  It
+/// doesn't change anything unless it succeeds, so when it returns false the line can go
+/// through vectorLine() as if this had never been called.
+///
+bool WallsSurveyParser::fastVectorLine()
+{
+    DEWALLS_PRODUCTION("fastVectorLine");
+    const QString line = _line.value();
+    FastVectorLine fields;
+    if (!scanFastVectorLine(line.constData(), line.length(), _i, fields))
+    {
+        DEWALLS_PRODUCTION_RETURN(false);
+    }
+    _i = line.length();
+    finishFastVectorLine(fields);
+    DEWALLS_PRODUCTION_RETURN(true);
+}
+
+///
+/// \brief emits what scanFastVectorLine() found.  Only reads _line (which must be the line
+/// that was scanned) if something wants the vector or its comment.
+///
+void WallsSurveyParser::finishFastVectorLine(const FastVectorLine& fields)
+{
+    _fastPathLineCount++;
+    if (fields.comment >= 0 && (_events & CommentEvents))
+    {
+        emit parsedComment(_line.value().mid(fields.comment + 1));
+    }
+    if (!(_events & VectorEvents))
+    {
+        finishVectorLine();
+        return;
+    }
+
+    const QString line = _line.value();
+    _vector = Vector();
+    _vector.setSourceSegment(_line);
+    _vector.setFrom(line.mid(fields.fromStart, fields.fromEnd - fields.fromStart));
+    _vector.setTo(line.mid(fields.toStart, fields.toEnd - fields.toStart));
+    if (fields.rawStart >= 0)
+    {
+        _vector.setRawMeasurements(fields.rawStart, fields.rawEnd - fields.rawStart);
+        finishVectorLine();
+        return;
+    }
+    _vector.setDistance(fields.dist);
+    _vector.setFrontAzimuth(fields.azm);
+    _vector.setFrontInclination(fields.inc);
+    if (fields.hasLruds)
+    {
+        _vector.setLeft(fields.lruds[0]);
+        _vector.setRight(fields.lruds[1]);
+        _vector.setUp(fields.lruds[2]);
+        _vector.setDown(fields.lruds[3]);
+    }
+    finishVectorLine();
+}
+
+///
+/// \brief scans a #fix line of the usual shape -- "#FIX STATION east north up" (in the
+/// #units rect order) with plain numbers, optionally followed by a comment -- without going
+/// through the grammar or changing anything.  Works on decoded lines and on the raw bytes of
+/// ASCII ones.
+///
+template<typename Char>
+bool WallsSurveyParser::scanFastFixLine(const Char* s, int n, int i, FastFixLine& fields)
+{
+    // directiveRx would take anything longer for a different directive
+    if (n - i < 5 || s[i] != '#' ||
+            (s[i + 1] != 'f' && s[i + 1] != 'F') ||
+            (s[i + 2] != 'i' && s[i + 2] != 'I') ||
+            (s[i + 3] != 'x' && s[i + 3] != 'X'))
+    {
+        return false;
+    }
+    i += 4;
+    if (!skipSpaces(s, n, i))
+    {
+        return false;
+    }
+    fields.nameStart = i;
+    if (!fastStation(s, n, i))
+    {
+        return false;
+    }
+    fields.nameEnd = i;
+
+    for (int k = 0; k < 3; k++)
+    {
+        fields.hasRect[k] = false;
+    }
+    foreach (RectMeasurement elem, _units.rectOrder())
+    {
+        if (!skipSpaces(s, n, i))
+        {
+            return false;
+        }
+        bool negate = i < n && s[i] == '-';
+        if (negate)
+        {
+            i++;
+        }
+        double value;
+        if (!numberparsing::parseUnsignedDecimal(s, n, i, &value))
+        {
+            return false;
+        }
+        // anything else (unit suffixes, latitudes and longitudes) needs the grammar
+        if (i < n && s[i] != ' ' && s[i] != '\t' && s[i] != ';')
+        {
+            return false;
+        }
+        int slot = elem == RectMeasurement::E ? 0 : elem == RectMeasurement::N ? 1 : 2;
+        ULength length(value, _units.dUnit());
+        fields.rect[slot] = negate ? -length : length;
+        fields.hasRect[slot] = true;
+    }
+
+    // variance overrides, notes and inline directives need the grammar
+    skipSpaces(s, n, i);
+    if (i < n && s[i] != ';')
+    {
+        return false;
+    }
+    fields.comment = i < n ? i : -1;
+    return true;
+}
+
+///
+/// \brief decodes a vector line from its raw bytes, the way fastVectorLine() would once it
+/// was decoded.  The line is only decoded if something wants the vector or its comment.
+/// \param p the first non-whitespace byte of the line
+///
+bool WallsSurveyParser::rawVectorLine(const char* begin, const char* p, const char* end, Encoding encoding,
+                                      const QString& source, int lineNumber)
+{
+    const int n = int(end - begin);
+    FastVectorLine fields;
+    if (!scanFastVectorLine(begin, n, int(p - begin), fields))
+    {
+        return false;
+    }
+    _parsedSegmentDirective = false;
+    if (_events & (VectorEvents | CommentEvents))
+    {
+        reset(Segment(decode(begin, n, encoding), source, lineNumber, 0));
+        _i = _line.length();
+    }
+    finishFastVectorLine(fields);
+    return true;
+}
+
+///
+/// \brief decodes a #fix line from its raw bytes, like fixLine() would.  Fixed stations
+/// don't keep their source line, so only the station name and comment get decoded.
+/// \param p the first non-whitespace byte of the line
+///
+bool WallsSurveyParser::rawFixLine(const char* begin, const char* p, const char* end, Encoding encoding)
+{
+    FastFixLine fields;
+    if (!scanFastFixLine(begin, int(end - begin), int(p - begin), fields))
+    {
+        return false;
+    }
+    _fastPathLineCount++;
+    _parsedSegmentDirective = false;
+    if (!(_events & FixStationEvents))
+    {
+        return true;
+    }
+    _fixStation = FixStation();
+    // the name is ASCII
+    _fixStation.setName(QString::fromLatin1(begin + fields.nameStart, fields.nameEnd - fields.nameStart));
+    if (fields.hasRect[0])
+    {
+        _fixStation.setEast(fields.rect[0]);
+    }
+    if (fields.hasRect[1])
+    {
+        _fixStation.setNorth(fields.rect[1]);
+    }
+    if (fields.hasRect[2])
+    {
+        _fixStation.setRectUp(fields.rect[2]);
+    }
+    if (fields.comment >= 0 && (_events & CommentEvents))
+    {
+        const char* comment = begin + fields.comment + 1;
+        _fixStation.setComment(decode(comment, int(end - comment), encoding));
+    }
+    _fixStation.setSegment(_segment);
+    _fixStation.setDate(_date);
+    _fixStation.setUnits(_units);
+    emit parsedFixStation(_fixStation);
+    return true;
+}
+
 Segment WallsSurveyParser::station()
 {
-    return expect(stationRx, {"<STATION>"});
+    DEWALLS_PRODUCTION("station");
+    DEWALLS_PRODUCTION_RETURN(expect(stationRx, {QStringLiteral("<STATION>")}));
 }
 
 void WallsSurveyParser::fromStation()
 {
     _fromStationSegment = station();
     QString from = _fromStationSegment.value();
-    if (optionalStationRx.exactMatch(from)) {
+    if (localRx(optionalStationRx).exactMatch(from)) {
         from.clear();
     }
-    _vector = Vector();
-    _vector.setSourceSegment(_line);
+    // if nobody wants vectors, nothing reads the measurements left over from the last
+    // line, so the same vector is reused
+    if (_events & VectorEvents)
+    {
+        _vector = Vector();
+        _vector.setSourceSegment(_line);
+    }
     _vector.setFrom(from);
 }
 
 void WallsSurveyParser::afterFromStation()
 {
+    // a line with only LRUDs starts with one of these after the from station
+    if (_topologyMode && (_events & VectorEvents) && !isAtEnd() && _line.at(_i) != '*' && _line.at(_i) != '<')
+    {
+        toStation();
+        whitespace();
+        rawMeasurements();
+        return;
+    }
     oneOfWithLookahead([&]() {
         toStation();
         whitespace();
         afterToStation();
     }, [&]() {
         // clear all measurements
-        QString from = _vector.from();
-        _vector = Vector();
-        _vector.setSourceSegment(_line);
-        _vector.setFrom(from);
+        if (_events & VectorEvents)
+        {
+            QString from = _vector.from();
+            _vector = Vector();
+            _vector.setSourceSegment(_line);
+            _vector.setFrom(from);
+        }
         lruds();
         afterLruds();
     });
 }
 
+///
+/// \brief skips the measurements of a vector line in topology mode, recording where they are
+///
+void WallsSurveyParser::rawMeasurements()
+{
+    DEWALLS_PRODUCTION("rawMeasurements");
+    // measurements can't contain inline directives or comments
+    int start = _i;
+    int end = _i;
+    while (_i < _line.length())
+    {
+        QChar c = _line.at(_i);
+        if (c == '#' || c == ';')
+        {
+            break;
+        }
+        _i++;
+        if (!c.isSpace())
+        {
+            end = _i;
+        }
+    }
+    _i = start;
+    if (end == start)
+    {
+        // let the grammar report what's missing
+        afterToStation();
+        DEWALLS_PRODUCTION_SUCCEEDED();
+        return;
+    }
+    _i = end;
+    _vector.setRawMeasurements(start, end - start);
+    afterLruds();
+    DEWALLS_PRODUCTION_SUCCEEDED();
+}
+
+///
+/// \brief makes the given units the current ones, unless they already are, so that the
+/// vector plan only gets rebuilt when the units actually change
+///
+void WallsSurveyParser::loadUnits(const WallsUnits& units)
+{
+    if (!_units.isSharedWith(units))
+    {
+        _units = units;
+        _vectorPlanDirty = true;
+    }
+}
+
+bool WallsSurveyParser::decodeMeasurements(Vector& vector)
+{
+    if (!vector.hasRawMeasurements())
+    {
+        return true;
+    }
+
+    WallsUnits units = _units;
+    bool decoded;
+    try
+    {
+        decoded = decodeRawMeasurements(vector);
+    }
+    catch (const SegmentParseException&)
+    {
+        loadUnits(units);
+        throw;
+    }
+    loadUnits(units);
+    return decoded;
+}
+
+///
+/// \brief decodes the raw measurements of a vector, switching to its units if they aren't the
+/// current ones.  Leaves its units current, so that decoding a run of vectors with the same
+/// units only switches once.
+///
+bool WallsSurveyParser::decodeRawMeasurements(Vector& vector)
+{
+    Vector vectorInProgress = _vector;
+    try
+    {
+        loadUnits(vector.units());
+        // cut off the inline directive and comment, which were already parsed
+        reset(vector.sourceSegment().left(vector.rawMeasurementsStart() + vector.rawMeasurementsLength()));
+        _i = vector.rawMeasurementsStart();
+        _vector = vector;
+        _vector.clearRawMeasurements();
+        afterToStation();
+        vector = _vector;
+    }
+    catch (const SegmentParseException& ex)
+    {
+        _vector = vectorInProgress;
+        if (!_errorRecovery)
+        {
+            throw;
+        }
+        _errorCount++;
+        emit message(WallsMessage(ex));
+        return false;
+    }
+    _vector = vectorInProgress;
+    return true;
+}
+
+int WallsSurveyParser::decodeMeasurements(QVector<Vector>& vectors, QList<WallsMessage>* messages)
+{
+    struct Chunk {
+        int begin;
+        int end;
+        int failed;
+        QList<WallsMessage> messages;
+    };
+
+    const int chunkSize = 4096;
+    QVector<Chunk> chunks;
+    for (int begin = 0; begin < vectors.size(); begin += chunkSize)
+    {
+        Chunk chunk;
+        chunk.begin = begin;
+        chunk.end = qMin(begin + chunkSize, vectors.size());
+        chunk.failed = 0;
+        chunks << chunk;
+    }
+
+    // detach up front so that the chunks can be decoded in place from multiple threads
+    Vector* data = vectors.data();
+    QtConcurrent::blockingMap(chunks, [data](Chunk& chunk) {
+        WallsSurveyParser parser;
+        parser.setErrorRecovery(true);
+        QObject::connect(&parser, &WallsSurveyParser::message, [&](WallsMessage message) {
+            chunk.messages << message;
+        });
+        // the parser is thrown away with the chunk, so there are no units to restore
+        for (int i = chunk.begin; i < chunk.end; i++)
+        {
+            if (data[i].hasRawMeasurements() && !parser.decodeRawMeasurements(data[i]))
+            {
+                chunk.failed++;
+            }
+        }
+    });
+
+    int failed = 0;
+    foreach (const Chunk& chunk, chunks)
+    {
+        failed += chunk.failed;
+        if (messages)
+        {
+            *messages << chunk.messages;
+        }
+    }
+    return failed;
+}
+
 void WallsSurveyParser::toStation()
 {
     _toStationSegment = station();
     QString to = _toStationSegment.value();
-    if (optionalStationRx.exactMatch(to))
+    if (localRx(optionalStationRx).exactMatch(to))
     {
         to.clear();
     }
@@ -1402,35 +2411,101 @@ void WallsSurveyParser::toStation()
     _vector.setTo(to);
 }
 
-void WallsSurveyParser::afterToStation()
+WallsSurveyParser::VectorPlan::VectorPlan()
+    : ct(true),
+      stepCount(0),
+      lrudStepCount(0),
+      fast(false)
 {
-    int k = 0;
-    if (_units.vectorType() == VectorType::RECT)
+
+}
+
+void WallsSurveyParser::buildVectorPlan()
+{
+    VectorPlan plan;
+    plan.ct = _units.vectorType() != VectorType::RECT;
+    if (plan.ct)
     {
-        foreach(RectMeasurement elem, _units.rectOrder())
+        foreach(CtMeasurement elem, _units.ctOrder())
         {
-            if (k++ > 0)
+            switch(elem)
             {
-                whitespace();
+            case CtMeasurement::D:
+                plan.fastSlots[plan.stepCount] = 0;
+                plan.steps[plan.stepCount++] = &WallsSurveyParser::distance;
+                break;
+            case CtMeasurement::A:
+                plan.fastSlots[plan.stepCount] = 1;
+                plan.steps[plan.stepCount++] = &WallsSurveyParser::azimuth;
+                break;
+            case CtMeasurement::V:
+                plan.fastSlots[plan.stepCount] = 2;
+                plan.steps[plan.stepCount++] = &WallsSurveyParser::inclination;
+                break;
             }
-            rectMeasurement(elem);
         }
     }
     else
     {
-        foreach(CtMeasurement elem, _units.ctOrder())
+        foreach(RectMeasurement elem, _units.rectOrder())
         {
-            if (k++ > 0)
-            {
-                whitespace();
+            switch(elem) {
+            case RectMeasurement::E:
+                plan.steps[plan.stepCount++] = &WallsSurveyParser::east;
+                break;
+            case RectMeasurement::N:
+                plan.steps[plan.stepCount++] = &WallsSurveyParser::north;
+                break;
+            case RectMeasurement::U:
+                plan.steps[plan.stepCount++] = &WallsSurveyParser::rectUp;
+                break;
             }
-            ctMeasurement(elem);
         }
     }
+    foreach(LrudMeasurement elem, _units.lrudOrder())
+    {
+        switch(elem)
+        {
+        case LrudMeasurement::L:
+            plan.fastLrudSlots[plan.lrudStepCount] = 0;
+            plan.lrudSteps[plan.lrudStepCount++] = &WallsSurveyParser::left;
+            break;
+        case LrudMeasurement::R:
+            plan.fastLrudSlots[plan.lrudStepCount] = 1;
+            plan.lrudSteps[plan.lrudStepCount++] = &WallsSurveyParser::right;
+            break;
+        case LrudMeasurement::U:
+            plan.fastLrudSlots[plan.lrudStepCount] = 2;
+            plan.lrudSteps[plan.lrudStepCount++] = &WallsSurveyParser::up;
+            break;
+        case LrudMeasurement::D:
+            plan.fastLrudSlots[plan.lrudStepCount] = 3;
+            plan.lrudSteps[plan.lrudStepCount++] = &WallsSurveyParser::down;
+            break;
+        }
+    }
+    plan.fast = plan.ct && plan.stepCount == 3 && plan.lrudStepCount == 4;
+    _vectorPlan = plan;
+    _vectorPlanDirty = false;
+}
+
+void WallsSurveyParser::afterToStation()
+{
+    const VectorPlan& plan = vectorPlan();
+    for (int k = 0; k < plan.stepCount; k++)
+    {
+        if (k > 0)
+        {
+            whitespace();
+        }
+        DEWALLS_PRODUCTION("vectorMeasurement");
+        (this->*plan.steps[k])();
+        DEWALLS_PRODUCTION_SUCCEEDED();
+    }
 
     using namespace std;
 
-    if (_units.vectorType() == VectorType::CT)
+    if (plan.ct)
     {
         if (!_vector.frontAzimuth().isValid() && !_vector.backAzimuth().isValid() &&
                 !WallsUnits::isVertical(_vector.frontInclination(), _vector.backInclination()))
@@ -1445,21 +2520,6 @@ void WallsSurveyParser::afterToStation()
     afterVectorMeasurements();
 }
 
-void WallsSurveyParser::rectMeasurement(RectMeasurement elem)
-{
-    switch(elem) {
-    case RectMeasurement::E:
-        east();
-        break;
-    case RectMeasurement::N:
-        north();
-        break;
-    case RectMeasurement::U:
-        rectUp();
-        break;
-    }
-}
-
 void WallsSurveyParser::east()
 {
     _vector.setEast(length(_units.dUnit()));
@@ -1475,25 +2535,14 @@ void WallsSurveyParser::rectUp()
     _vector.setRectUp(length(_units.dUnit()));
 }
 
-void WallsSurveyParser::ctMeasurement(CtMeasurement elem)
+bool WallsSurveyParser::correctionChangesSign(ULength measurement, ULength correction)
 {
-    switch(elem)
-    {
-    case CtMeasurement::D:
-        distance();
-        break;
-    case CtMeasurement::A:
-        azimuth();
-        break;
-    case CtMeasurement::V:
-        inclination();
-        break;
-    }
+    return measurement.isNonzero() && correction.isNonzero() &&
+            measurement.signum() != (measurement + correction).signum();
 }
 
 void WallsSurveyParser::checkCorrectedSign(int segStart, ULength measurement, ULength correction) {
-    if (measurement.isNonzero() && correction.isNonzero() &&
-            measurement.signum() != (measurement + correction).signum()) {
+    if (correctionChangesSign(measurement, correction)) {
         throw SegmentParseException(_line.mid(segStart, _i - segStart), "correction changes sign of measurement");
     }
 }
@@ -1623,25 +2672,6 @@ void WallsSurveyParser::targetHeight()
     }
 }
 
-void WallsSurveyParser::lrudMeasurement(LrudMeasurement elem)
-{
-    switch(elem)
-    {
-    case LrudMeasurement::L:
-        left();
-        break;
-    case LrudMeasurement::R:
-        right();
-        break;
-    case LrudMeasurement::U:
-        up();
-        break;
-    case LrudMeasurement::D:
-        down();
-        break;
-    }
-}
-
 template<class T>
 void WallsSurveyParser::warnIfNegative(UnitizedDouble<T> measurement, int start, QString name)
 {
@@ -1659,7 +2689,10 @@ void WallsSurveyParser::left()
     {
         warnIfNegative(left, start, "LRUD");
         checkCorrectedSign(start, left, _units.incs());
-        _vector.setLeft(left);
+        if (_events & LrudFields)
+        {
+            _vector.setLeft(left);
+        }
     }
 }
 
@@ -1671,7 +2704,10 @@ void WallsSurveyParser::right()
     {
         warnIfNegative(right, start, "LRUD");
         checkCorrectedSign(start, right, _units.incs());
-        _vector.setRight(right);
+        if (_events & LrudFields)
+        {
+            _vector.setRight(right);
+        }
     }
 }
 
@@ -1683,7 +2719,10 @@ void WallsSurveyParser::up()
     {
         warnIfNegative(up, start, "LRUD");
         checkCorrectedSign(start, up, _units.incs());
-        _vector.setUp(up);
+        if (_events & LrudFields)
+        {
+            _vector.setUp(up);
+        }
     }
 }
 
@@ -1695,7 +2734,10 @@ void WallsSurveyParser::down()
     {
         warnIfNegative(down, start, "LRUD");
         checkCorrectedSign(start, down, _units.incs());
-        _vector.setDown(down);
+        if (_events & LrudFields)
+        {
+            _vector.setDown(down);
+        }
     }
 }
 
@@ -1711,10 +2753,15 @@ void WallsSurveyParser::afterVectorMeasurements()
 template<class T>
 void WallsSurveyParser::varianceOverrides(T& target)
 {
+    DEWALLS_PRODUCTION("varianceOverrides");
     expect('(');
     maybeWhitespace();
+    const bool wanted = _events & VarianceFields;
     VarianceOverridePtr horizontal = varianceOverride(_units.dUnit());
-    target.setHorizVariance(horizontal);
+    if (wanted)
+    {
+        target.setHorizVariance(horizontal);
+    }
     maybeWhitespace();
     if (maybeChar(','))
     {
@@ -1724,13 +2771,17 @@ void WallsSurveyParser::varianceOverrides(T& target)
         {
             throw allExpected();
         }
-        target.setVertVariance(vertical);
+        if (wanted)
+        {
+            target.setVertVariance(vertical);
+        }
     }
-    else if (!horizontal.isNull())
+    else if (!horizontal.isNull() && wanted)
     {
         target.setVertVariance(horizontal);
     }
     expect(')');
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 void WallsSurveyParser::afterVectorVarianceOverrides()
@@ -1744,6 +2795,7 @@ void WallsSurveyParser::afterVectorVarianceOverrides()
 
 void WallsSurveyParser::lruds()
 {
+    DEWALLS_PRODUCTION("lruds");
     oneOfWithLookahead([&]() {
         expect('<');
         try
@@ -1773,26 +2825,34 @@ void WallsSurveyParser::lruds()
         }
         expect('*');
     });
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 void WallsSurveyParser::lrudContent()
 {
+    DEWALLS_PRODUCTION("lrudContent");
     maybeWhitespace();
-    int m = 0;
-    foreach(LrudMeasurement elem, _units.lrudOrder())
+    const VectorPlan& plan = vectorPlan();
+    for (int m = 0; m < plan.lrudStepCount; m++)
     {
-        if (m++ > 0)
+        if (m > 0)
         {
             oneOfWithLookahead([&]() { maybeWhitespace(); expect(','); maybeWhitespace(); },
             [&]() { whitespace(); });
         }
-        if (!maybe([&]() { lrudMeasurement(elem); }))
+        VectorPlan::Step step = plan.lrudSteps[m];
+        if (!maybe([&]() {
+            DEWALLS_PRODUCTION("lrudMeasurement");
+            (this->*step)();
+            DEWALLS_PRODUCTION_SUCCEEDED();
+        }))
         {
             emit message(WallsMessage("warning", "missing LRUD measurement; use -- to indicate omitted measurements", _line.mid(_i)));
         }
     }
     maybeWhitespace();
     afterRequiredLrudMeasurements();
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 void WallsSurveyParser::afterRequiredLrudMeasurements()
@@ -1816,13 +2876,20 @@ void WallsSurveyParser::afterRequiredLrudMeasurements()
 
 void WallsSurveyParser::lrudFacingAngle()
 {
-    _vector.setLrudAngle(azimuth(_units.aUnit()));
+    UAngle angle = azimuth(_units.aUnit());
+    if (_events & LrudFields)
+    {
+        _vector.setLrudAngle(angle);
+    }
 }
 
 void WallsSurveyParser::lrudCFlag()
 {
     expect('c', Qt::CaseInsensitive);
-    _vector.setCFlag(true);
+    if (_events & LrudFields)
+    {
+        _vector.setCFlag(true);
+    }
 }
 
 void WallsSurveyParser::afterLruds()
@@ -1855,8 +2922,9 @@ void WallsSurveyParser::inlineSegmentDirective(T& target)
 
 void WallsSurveyParser::fixLine()
 {
+    DEWALLS_PRODUCTION("fixLine");
     maybeWhitespace();
-    expect("#fix", Qt::CaseInsensitive);
+    expect(QStringLiteral("#fix"), Qt::CaseInsensitive);
     whitespace();
     fixedStation();
     whitespace();
@@ -1864,6 +2932,11 @@ void WallsSurveyParser::fixLine()
     afterFixedStation();
     maybeWhitespace();
     endOfLine();
+    if (!(_events & FixStationEvents))
+    {
+        DEWALLS_PRODUCTION_SUCCEEDED();
+        return;
+    }
     if (!_parsedSegmentDirective)
     {
         _fixStation.setSegment(_segment);
@@ -1871,13 +2944,17 @@ void WallsSurveyParser::fixLine()
     _fixStation.setDate(_date);
     _fixStation.setUnits(_units);
     emit parsedFixStation(_fixStation);
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 void WallsSurveyParser::fixedStation()
 {
     QString fixed = station().value();
-    _fixStation = FixStation();
-    _fixStation.setName(fixed);
+    if (_events & FixStationEvents)
+    {
+        _fixStation = FixStation();
+        _fixStation.setName(fixed);
+    }
 }
 
 void WallsSurveyParser::afterFixedStation()
@@ -1950,7 +3027,7 @@ template<class T>
 void WallsSurveyParser::inlineNote(T& target)
 {
     expect('/');
-    target.setNote(escapedText([](QChar c) { return c != ';' && c != '#'; }, {"<NOTE>"}).trimmed());
+    target.setNote(escapedText([](QChar c) { return c != ';' && c != '#'; }, {QStringLiteral("<NOTE>")}).trimmed());
 }
 
 void WallsSurveyParser::afterInlineFixNote()
@@ -1964,35 +3041,56 @@ void WallsSurveyParser::afterInlineFixNote()
 
 void WallsSurveyParser::inlineCommentOrEndOfLine()
 {
+    DEWALLS_PRODUCTION("inlineCommentOrEndOfLine");
     oneOf([&]() { inlineComment(); },
     [&]() { endOfLine(); });
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 template<class T>
 void WallsSurveyParser::inlineCommentOrEndOfLine(T& target)
 {
+    DEWALLS_PRODUCTION("inlineCommentOrEndOfLine");
     oneOf([&]() { inlineComment(target); },
     [&]() { endOfLine(); });
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 void WallsSurveyParser::comment()
 {
+    DEWALLS_PRODUCTION("comment");
     expect(';');
-    emit parsedComment(remaining().value());
+    emitRemainingAsComment();
+    DEWALLS_PRODUCTION_SUCCEEDED();
 }
 
 void WallsSurveyParser::inlineComment()
 {
     expect(';');
-    emit parsedComment(remaining().value());
+    emitRemainingAsComment();
 }
 
 template<class T>
 void WallsSurveyParser::inlineComment(T& target)
 {
     expect(';');
+    if (!(_events & CommentEvents) || !(_events & FixStationEvents))
+    {
+        _i = _line.length();
+        return;
+    }
     target.setComment(remaining().value());
 }
 
+void WallsSurveyParser::emitRemainingAsComment()
+{
+    if (!(_events & CommentEvents))
+    {
+        _i = _line.length();
+        return;
+    }
+    emit parsedComment(remaining().value());
+}
+
 
 } // namespace dewalls
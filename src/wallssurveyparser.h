@@ -6,6 +6,7 @@
 #include <QHash>
 #include <QSharedPointer>
 #include <QStack>
+#include <QVector>
 
 #include "lineparser.h"
 #include "unitizeddouble.h"
@@ -18,6 +19,9 @@
 #include "vector.h"
 #include "fixstation.h"
 #include "wallsmessage.h"
+#include "georeference.h"
+#include "geomagneticmodel.h"
+#include "wallsprojectparser.h"
 #include "dewallsexport.h"
 
 namespace dewalls {
@@ -28,6 +32,11 @@ namespace dewalls {
 /// signals for the various types of data it parses.  The parsed data must be interpreted
 /// in the context of the current units(), date(), and segment().
 ///
+/// Parsers are reentrant: any number of instances may parse on different threads at the
+/// same time (each emits its signals on the thread that calls it), but one instance must not
+/// be used by more than one thread at a time.  The static decodeMeasurements() may be
+/// called from any thread.
+///
 class DEWALLS_LIB_EXPORT WallsSurveyParser : public QObject, public LineParser
 {
     Q_OBJECT
@@ -38,6 +47,34 @@ public:
     typedef QSharedPointer<VarianceOverride> VarianceOverridePtr;
     typedef void (WallsSurveyParser::*OwnProduction)();
 
+    enum Encoding {
+        // Walls itself writes files in the Windows ANSI code page
+        Latin1,
+        Utf8
+    };
+
+    ///
+    /// \brief the signals and fields a consumer wants the parser to build (see setEvents())
+    ///
+    enum Event {
+        NoEvents = 0,
+        VectorEvents = 0x1,
+        FixStationEvents = 0x2,
+        // parsedComment and the comments of Vectors and FixStations
+        CommentEvents = 0x4,
+        NoteEvents = 0x8,
+        FlagEvents = 0x10,
+        DateEvents = 0x20,
+        // willParseUnits and parsedUnits
+        UnitsEvents = 0x40,
+        // the LRUDs, LRUD angle and C flag of Vectors
+        LrudFields = 0x100,
+        // the variance overrides of Vectors and FixStations
+        VarianceFields = 0x200,
+        AllEvents = 0x37f
+    };
+    Q_DECLARE_FLAGS(Events, Event)
+
     WallsSurveyParser();
     WallsSurveyParser(QString line);
     WallsSurveyParser(Segment segment);
@@ -57,6 +94,20 @@ public:
     ///
     void parseLine(Segment line);
     ///
+    /// \brief parses the raw contents of a whole .SRV file.  Lines are found in the bytes
+    /// directly, and blank lines and comment lines are handled without decoding the line.
+    /// With the fast path enabled, vector and #fix lines of the usual shape are tokenized
+    /// from the bytes too: a vector line is only decoded if something wants the vector (whose
+    /// source segment is the decoded line) or its comment, and a #fix line only has its
+    /// station name and comment decoded.  Other lines are decoded to a QString (once each)
+    /// and parsed with parseLine(Segment).  If nothing is listening for parsedComment, the
+    /// lines inside #[ ... #] block comments are skipped in one search for the next line
+    /// starting with #].
+    /// \param encoding the encoding of the file, unless it starts with a UTF-8 byte order mark
+    /// \return the number of lines
+    ///
+    int parseBuffer(const QByteArray& data, QString source, Encoding encoding = Latin1);
+    ///
     /// \brief parses units options that come after "#units"
     /// this can be used to parse options given by a .OPTIONS line in
     /// a .WPJ file
@@ -91,6 +142,112 @@ public:
     /// from a project file.
     ///
     void setRootSegment(QStringList rootSegment);
+    ///
+    /// \brief makes the parser derive the declination of each #date block from the date and
+    /// the given reference location, like Walls does for WpjEntry::deriveDeclFromDate().
+    /// The derived declination takes precedence over #units decl= for vectors dated after
+    /// the #date.  Dates the geomagnetic model doesn't cover get a warning and keep the
+    /// #units declination.  Pass a null reference to turn this off.
+    /// \param cache the cache to look up declinations in; may be shared between the parsers
+    /// for all surveys of a project (on the same thread).  If null, a new one is created.
+    ///
+    void setDeclinationReference(GeoReferencePtr reference, DeclinationCachePtr cache = DeclinationCachePtr());
+    ///
+    /// \return the declination derived from the current date, or an invalid angle if
+    /// declinations aren't being derived or there is no current date
+    ///
+    UAngle derivedDecl() const;
+    ///
+    /// \brief sets up the parser to parse the file of the given survey entry from a project:
+    /// sets the segment and root segment, applies the entry's inherited .OPTIONS, and
+    /// derives declinations from dates if the entry calls for it.  Throws a
+    /// SegmentParseException if the options are invalid.
+    /// \param cache passed to setDeclinationReference()
+    ///
+    void setProjectEntry(WpjEntryPtr entry, DeclinationCachePtr cache = DeclinationCachePtr());
+    ///
+    /// \brief same as above, but takes everything from a flattened entry instead of walking
+    /// up the project tree
+    ///
+    void setProjectEntry(const WpjFlatEntry& entry, DeclinationCachePtr cache = DeclinationCachePtr());
+
+    ///
+    /// \brief turns error recovery on or off.  When it's on, parseLine() doesn't throw
+    /// SegmentParseExceptions; instead it emits each one as an "error" message, puts the
+    /// units, units stack, macros, segment, date and block comment state back the way they
+    /// were before the line, and returns so parsing can resume with the next line.
+    ///
+    void setErrorRecovery(bool errorRecovery);
+    bool errorRecovery() const;
+    ///
+    /// \return the number of lines that failed to parse in error recovery mode
+    ///
+    int errorCount() const;
+    void resetErrorCount();
+    ///
+    /// \return a one-line summary like "3 errors in cave.srv", or an empty string if there
+    /// were no errors
+    ///
+    QString errorSummary(QString source = QString()) const;
+
+    ///
+    /// \brief turns the vector line fast path on or off (it's on by default).  Lines of the
+    /// usual shape -- "FROM TO dist azm inc" with plain numbers, optionally followed by four
+    /// plain LRUDs and an inline comment -- are decoded directly instead of through the
+    /// grammar, with the same results.  parseBuffer() also decodes "#FIX STATION e n u"
+    /// lines with plain numbers this way.  Anything else falls back to the grammar.
+    ///
+    void setFastPathEnabled(bool fastPathEnabled);
+    bool fastPathEnabled() const;
+    ///
+    /// \return the number of vector and #fix lines the fast path has decoded
+    ///
+    int fastPathLineCount() const;
+
+    ///
+    /// \brief chooses which signals to emit and which fields to fill in (all of them by
+    /// default).  The parser still runs the whole grammar and emits the same messages
+    /// (errors and warnings) whatever the mask is, but it scans past the text of anything
+    /// nobody wants instead of building strings, Vectors or variance overrides for it.
+    /// Message signals and the units, date and segment state aren't affected.
+    ///
+    void setEvents(Events events);
+    Events events() const;
+    ///
+    /// \brief turns lint mode on or off.  Lint mode is the same as setEvents(NoEvents): the
+    /// parser emits the same messages as usual but builds no Vectors, FixStations or comment
+    /// strings and emits none of the other signals.  Use it when you only need to know
+    /// what's wrong with a file.
+    ///
+    void setLintMode(bool lintMode);
+    bool lintMode() const;
+
+    ///
+    /// \brief turns topology mode on or off.  In topology mode stations, directives, segments
+    /// and comments are parsed as usual, but the measurements of vector lines (everything
+    /// from the distance up to an inline directive or comment) aren't decoded: the emitted
+    /// Vectors just record where they are (see Vector::hasRawMeasurements()), along with the
+    /// units to decode them with.  Problems with the measurements aren't reported until
+    /// they're decoded with decodeMeasurements().  Lines with only LRUDs are decoded right
+    /// away.  Lint mode takes precedence over this.
+    ///
+    void setTopologyMode(bool topologyMode);
+    bool topologyMode() const;
+    ///
+    /// \brief decodes the measurements of a vector parsed in topology mode, with the units it
+    /// was parsed with, emitting any warnings as message()s.  If the measurements are
+    /// invalid, this throws a SegmentParseException, or in error recovery mode emits it as
+    /// an error message and returns false, leaving the vector alone.  Doesn't change the
+    /// parser's state, but don't call it from a slot connected to this parser.
+    ///
+    bool decodeMeasurements(Vector& vector);
+    ///
+    /// \brief decodes the raw measurements of all the given vectors in parallel, each chunk
+    /// with its own parser in error recovery mode.
+    /// \param messages if given, the warnings and errors are appended to it in vector order
+    /// \return the number of vectors whose measurements were invalid
+    ///
+    static int decodeMeasurements(QVector<Vector>& vectors, QList<WallsMessage>* messages = nullptr);
 
     ULength unsignedLengthInches();
     ULength unsignedLengthNonInches(Length::Unit defaultUnit);
@@ -121,6 +278,11 @@ public:
     QChar escapedChar(F charPredicate, std::initializer_list<QString> expectedItems);
     template<typename F>
     QString escapedText(F charPredicate, std::initializer_list<QString> expectedItems);
+    ///
+    /// \brief advances past the same text as escapedText() without building it
+    ///
+    template<typename F>
+    void skipEscapedText(F charPredicate, std::initializer_list<QString> expectedItems);
     QString quotedTextOrNonwhitespace();
     QString quotedText();
 
@@ -137,6 +299,11 @@ public:
     void endBlockCommentLine();
     void insideBlockCommentLine();
 
+    bool parseRawLine(const char* begin, const char* end, Encoding encoding, const QString& source, int lineNumber);
+    bool rawVectorLine(const char* begin, const char* p, const char* end, Encoding encoding,
+                       const QString& source, int lineNumber);
+    bool rawFixLine(const char* begin, const char* p, const char* end, Encoding encoding);
+    void surveyLine();
     void directiveLine();
     void segmentLine();
     void prefixLine();
@@ -146,6 +313,7 @@ public:
     void dateLine();
     void unitsLine();
     void vectorLine();
+    bool fastVectorLine();
 
 signals:
     void parsedVector(Vector parsedVector);
@@ -299,25 +467,26 @@ private:
     void uv();
     void flag();
 
+    static bool correctionChangesSign(ULength measurement, ULength correction);
     void checkCorrectedSign(int segStart, ULength measurement, ULength correction);
 
     Segment station();
 
     void fromStation();
     void afterFromStation();
+    void finishVectorLine();
+    void rawMeasurements();
+    void emitRemainingAsComment();
     void toStation();
     void afterToStation();
-    void rectMeasurement(RectMeasurement elem);
     void east();
     void north();
     void rectUp();
-    void ctMeasurement(CtMeasurement elem);
     void distance();
     void azimuth();
     void inclination();
     void instrumentHeight();
     void targetHeight();
-    void lrudMeasurement(LrudMeasurement elem);
     void left();
     void right();
     void up();
@@ -355,14 +524,110 @@ private:
 
     void comment();
 
+    void updateDerivedDecl();
+    const WallsUnits& vectorUnits();
+
+    void loadUnits(const WallsUnits& units);
+    bool decodeRawMeasurements(Vector& vector);
+
+    ///
+    /// \brief the measurement productions of a vector line under the current units, in
+    /// order.  Built from the units' vector type and element orders when they change, so
+    /// that vector lines just run through it instead of interpreting the units every time.
+    ///
+    struct VectorPlan {
+        typedef void (WallsSurveyParser::*Step)();
+
+        VectorPlan();
+
+        bool ct;
+        int stepCount;
+        Step steps[3];
+        int lrudStepCount;
+        Step lrudSteps[4];
+
+        // whether fastVectorLine() can decode lines under these units, and for each
+        // position, which measurement it is (0-2 for D, A, V and 0-3 for L, R, U, D)
+        bool fast;
+        int fastSlots[3];
+        int fastLrudSlots[4];
+    };
+
+    ///
+    /// \brief what scanFastVectorLine() found on a line: positions in the line and the
+    /// measurements
+    ///
+    struct FastVectorLine {
+        int fromStart;
+        int fromEnd;
+        int toStart;
+        int toEnd;
+        // the raw measurements, in topology mode
+        int rawStart;
+        int rawEnd;
+        // the position of the ;, or -1 if there's no comment
+        int comment;
+        ULength dist;
+        UAngle azm;
+        UAngle inc;
+        bool hasLruds;
+        ULength lruds[4];
+    };
+
+    ///
+    /// \brief what scanFastFixLine() found on a #fix line
+    ///
+    struct FastFixLine {
+        int nameStart;
+        int nameEnd;
+        // the position of the ;, or -1 if there's no comment
+        int comment;
+        ULength rect[3];
+        bool hasRect[3];
+    };
+
+    template<typename Char>
+    bool scanFastVectorLine(const Char* s, int n, int i, FastVectorLine& fields);
+    template<typename Char>
+    bool scanFastFixLine(const Char* s, int n, int i, FastFixLine& fields);
+    void finishFastVectorLine(const FastVectorLine& fields);
+
+    void buildVectorPlan();
+    inline const VectorPlan& vectorPlan()
+    {
+        if (_vectorPlanDirty)
+        {
+            buildVectorPlan();
+        }
+        return _vectorPlan;
+    }
+
+    bool _errorRecovery;
+    int _errorCount;
+    bool _fastPathEnabled;
+    int _fastPathLineCount;
+    Events _events;
+    bool _topologyMode;
+
     bool _inBlockComment;
     WallsUnits _units;
+    // set whenever _units may have changed
+    bool _vectorPlanDirty;
+    VectorPlan _vectorPlan;
     QStack<WallsUnits> _stack;
     QHash<QString, QString> _macros;
     QStringList _segment;
     QStringList _rootSegment;
     QDate _date;
 
+    GeoReferencePtr _declReference;
+    DeclinationCachePtr _declCache;
+    UAngle _derivedDecl;
+    // _units with _derivedDecl applied, for the vectors; rebuilt when _units no longer
+    // shares its data with _declUnitsSource
+    WallsUnits _declUnitsSource;
+    WallsUnits _declUnits;
+
     bool _parsedSegmentDirective;
     Segment _fromStationSegment;
     Segment _toStationSegment;
@@ -373,6 +638,8 @@ private:
     FixStation _fixStation;
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(WallsSurveyParser::Events)
+
 inline WallsUnits WallsSurveyParser::units() const
 {
     return _units;
@@ -388,6 +655,41 @@ inline QDate WallsSurveyParser::date() const
     return _date;
 }
 
+inline bool WallsSurveyParser::errorRecovery() const
+{
+    return _errorRecovery;
+}
+
+inline int WallsSurveyParser::errorCount() const
+{
+    return _errorCount;
+}
+
+inline bool WallsSurveyParser::fastPathEnabled() const
+{
+    return _fastPathEnabled;
+}
+
+inline int WallsSurveyParser::fastPathLineCount() const
+{
+    return _fastPathLineCount;
+}
+
+inline WallsSurveyParser::Events WallsSurveyParser::events() const
+{
+    return _events;
+}
+
+inline bool WallsSurveyParser::lintMode() const
+{
+    return _events == NoEvents;
+}
+
+inline bool WallsSurveyParser::topologyMode() const
+{
+    return _topologyMode;
+}
+
 inline QStringList WallsSurveyParser::rootSegment() const
 {
     return _rootSegment;
@@ -408,6 +710,11 @@ inline void WallsSurveyParser::setSegment(QStringList segment)
     _segment = segment;
 }
 
+inline WallsSurveyParser::UAngle WallsSurveyParser::derivedDecl() const
+{
+    return _derivedDecl;
+}
+
 template<typename F>
 QChar WallsSurveyParser::escapedChar(F charPredicate, std::initializer_list<QString> expectedItems)
 {
@@ -423,6 +730,12 @@ QString WallsSurveyParser::escapedText(F charPredicate, std::initializer_list<QS
     return result;
 }
 
+template<typename F>
+void WallsSurveyParser::skipEscapedText(F charPredicate, std::initializer_list<QString> expectedItems)
+{
+    while (maybe([&]() { escapedChar(charPredicate, expectedItems); } ));
+}
+
 template<typename R, typename F>
 bool WallsSurveyParser::optional(R& result, F production)
 {
@@ -432,7 +745,7 @@ bool WallsSurveyParser::optional(R& result, F production)
     }
     catch (const SegmentParseExpectedException& ex)
     {
-        if (maybe([&]() { return expect(optionalRx, {"-", "--"}); }))
+        if (maybe([&]() { return expect(optionalRx, {QStringLiteral("-"), QStringLiteral("--")}); }))
         {
             return false;
         }
@@ -453,7 +766,7 @@ bool WallsSurveyParser::optionalWithLookahead(R& result, F production)
     catch (const SegmentParseExpectedException& ex)
     {
         _i = start;
-        if (maybe([&]() { return expect(optionalRx, {"-", "--"}); }))
+        if (maybe([&]() { return expect(optionalRx, {QStringLiteral("-"), QStringLiteral("--")}); }))
         {
             return false;
         }
@@ -269,6 +269,12 @@ public:
     ///
     static bool isVertical(UAngle fsInc, UAngle bsInc);
 
+    ///
+    /// \return true if these units share their data with the given ones, which means they
+    /// haven't been changed since one was copied from the other
+    ///
+    inline bool isSharedWith(const WallsUnits& other) const { return d.constData() == other.d.constData(); }
+
 private:
     QSharedDataPointer<WallsUnitsData> d;
 };
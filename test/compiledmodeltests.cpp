@@ -0,0 +1,156 @@
+#include "catch.hpp"
+#include "../src/wallssurveyparser.h"
+#include "../src/compiledmodel.h"
+#include <QBuffer>
+#include <QTemporaryDir>
+#include <cmath>
+
+using namespace dewalls;
+using namespace dewalls::compiledmodel;
+
+namespace {
+
+QStringList compile(CompiledModelWriter& writer)
+{
+    WallsSurveyParser parser;
+    QObject::connect(&parser, &WallsSurveyParser::parsedVector, &writer, &CompiledModelWriter::addVector);
+    QObject::connect(&parser, &WallsSurveyParser::parsedFixStation, &writer, &CompiledModelWriter::addFixStation);
+
+    parser.parseLine(Segment("#date 2004-06-12", "test.srv", 0, 0));
+    parser.parseLine(Segment("#segment /Entrance/Upper", "test.srv", 1, 0));
+    QStringList segment = parser.segment();
+    parser.parseLine(Segment("A1 A2 10 90 5 *1 2 3 4*", "test.srv", 2, 0));
+    parser.parseLine(Segment("#units feet decl=2", "test.srv", 3, 0));
+    parser.parseLine(Segment("A2 A3 20 180 -5 (?)", "test.srv", 4, 0));
+    parser.parseLine(Segment("#fix A1 100 200 300", "test.srv", 5, 0));
+
+    writer.setStationPosition("A2", 1, 2, 3);
+    return segment;
+}
+
+void checkModel(const CompiledModel& model, QStringList segment)
+{
+    REQUIRE( model.isOpen() );
+    CHECK( model.version() == Version );
+
+    REQUIRE( model.stationCount() == 3 );
+    CHECK( model.stationName(0) == "A1" );
+    CHECK( model.stationName(1) == "A2" );
+    CHECK( model.stationName(2) == "A3" );
+    CHECK( model.findStation("A3") == 2 );
+    CHECK( model.findStation("B1") == -1 );
+    CHECK( !model.stations()[0].hasPosition );
+    CHECK( model.stations()[1].hasPosition );
+    CHECK( model.stations()[1].position[2] == 3 );
+
+    REQUIRE( model.shotCount() == 2 );
+    CHECK( model.shotFrom()[0] == 0 );
+    CHECK( model.shotTo()[0] == 1 );
+    CHECK( model.shotFrom()[1] == 1 );
+    CHECK( model.shotTo()[1] == 2 );
+    CHECK( model.shotDate()[0] == QDate(2004, 6, 12).toJulianDay() );
+    REQUIRE( !segment.isEmpty() );
+    CHECK( model.segmentPath(model.shotSegment()[0]) == segment );
+    CHECK( model.shotSource()[1].line == 4 );
+    CHECK( model.sourceFile(model.shotSource()[1].file) == "test.srv" );
+
+    CHECK( model.shotMeasurement(Distance)[0] == Approx(10) );
+    CHECK( model.shotMeasurement(Distance)[1] == Approx(20 * 0.3048) );
+    CHECK( model.shotMeasurement(FrontAzimuth)[1] == Approx(180) );
+    CHECK( std::isnan(model.shotMeasurement(BackAzimuth)[0]) );
+    CHECK( model.shotMeasurement(Down)[0] == Approx(4) );
+
+    REQUIRE( model.unitsCount() == 2 );
+    CHECK( model.shotUnits()[0] != model.shotUnits()[1] );
+    CHECK( model.units()[model.shotUnits()[1]].decl == Approx(2) );
+
+    REQUIRE( model.fixCount() == 1 );
+    CHECK( model.fixes()[0].station == 0 );
+    CHECK( model.fixes()[0].rectUp == Approx(300 * 0.3048) );
+}
+
+}
+
+TEST_CASE( "compiled models round trip through files", "[CompiledModel]" ) {
+    CompiledModelWriter writer;
+    QStringList segment = compile(writer);
+
+    QTemporaryDir dir;
+    REQUIRE( dir.isValid() );
+    QString fileName = dir.filePath("model.dwm");
+    REQUIRE( writer.write(fileName) );
+
+    CompiledModel model;
+    REQUIRE( model.open(fileName) );
+    checkModel(model, segment);
+
+    model.close();
+    CHECK( !model.isOpen() );
+    CHECK( model.shotCount() == 0 );
+}
+
+TEST_CASE( "compiled models round trip through memory", "[CompiledModel]" ) {
+    CompiledModelWriter writer;
+    QStringList segment = compile(writer);
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    REQUIRE( writer.write(&buffer) );
+
+    CompiledModel model;
+    REQUIRE( model.load(buffer.data()) );
+    checkModel(model, segment);
+}
+
+TEST_CASE( "compiled models keep stations under different prefixes apart", "[CompiledModel]" ) {
+    CompiledModelWriter writer;
+    QStringList surveys;
+    surveys << "#prefix EAST" << "#prefix WEST";
+    foreach (QString prefix, surveys)
+    {
+        WallsSurveyParser parser;
+        QObject::connect(&parser, &WallsSurveyParser::parsedVector, &writer, &CompiledModelWriter::addVector);
+        QObject::connect(&parser, &WallsSurveyParser::parsedFixStation, &writer, &CompiledModelWriter::addFixStation);
+        parser.parseLine(Segment(prefix, "test.srv", 0, 0));
+        parser.parseLine(Segment("A1 A2 10 90 5", "test.srv", 1, 0));
+        parser.parseLine(Segment("#fix A1 100 200 300", "test.srv", 2, 0));
+    }
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    REQUIRE( writer.write(&buffer) );
+
+    CompiledModel model;
+    REQUIRE( model.load(buffer.data()) );
+    REQUIRE( model.stationCount() == 4 );
+    CHECK( model.stationName(0) == "EAST:A1" );
+    CHECK( model.stationName(1) == "EAST:A2" );
+    CHECK( model.stationName(2) == "WEST:A1" );
+    CHECK( model.stationName(3) == "WEST:A2" );
+    REQUIRE( model.shotCount() == 2 );
+    CHECK( model.shotFrom()[1] == 2 );
+    CHECK( model.shotTo()[1] == 3 );
+    REQUIRE( model.fixCount() == 2 );
+    CHECK( model.fixes()[0].station == 0 );
+    CHECK( model.fixes()[1].station == 2 );
+}
+
+TEST_CASE( "CompiledModel rejects invalid data", "[CompiledModel]" ) {
+    CompiledModel model;
+    CHECK( !model.load(QByteArray("not a model at all, just some text")) );
+    CHECK( !model.isOpen() );
+    CHECK( !model.errorString().isEmpty() );
+
+    CompiledModelWriter writer;
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    REQUIRE( writer.write(&buffer) );
+
+    QByteArray truncated = buffer.data();
+    truncated.chop(16);
+    CHECK( !model.load(truncated) );
+
+    CHECK( model.load(buffer.data()) );
+    CHECK( model.shotCount() == 0 );
+    CHECK( model.segmentCount() == 1 );
+}
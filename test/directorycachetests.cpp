@@ -0,0 +1,66 @@
+#include "catch.hpp"
+#include "../src/directorycache.h"
+#include "../src/wallsprojectparser.h"
+#include <QTemporaryDir>
+#include <QTextStream>
+
+using namespace dewalls;
+
+namespace {
+
+void touch(QString fileName)
+{
+    QFile file(fileName);
+    REQUIRE( file.open(QFile::WriteOnly) );
+}
+
+}
+
+TEST_CASE( "DirectoryCache resolves names case-insensitively", "[DirectoryCache]" ) {
+    QTemporaryDir dir;
+    REQUIRE( dir.isValid() );
+    touch(dir.filePath("Cave.Srv"));
+    touch(dir.filePath("notes.TXT"));
+
+    DirectoryCache cache;
+    CHECK( cache.resolve(dir.path(), "CAVE.SRV") == "Cave.Srv" );
+    CHECK( cache.resolve(dir.path(), "notes.txt") == "notes.TXT" );
+    CHECK( cache.resolve(dir.path(), "missing.srv").isEmpty() );
+    CHECK( !cache.contains(dir.path() + "/nonexistent", "Cave.Srv") );
+    CHECK( cache.directoryCount() == 2 );
+
+    // listings aren't refreshed until the cache is cleared
+    touch(dir.filePath("late.srv"));
+    CHECK( !cache.contains(dir.path(), "late.srv") );
+    cache.clear();
+    CHECK( cache.contains(dir.path(), "late.srv") );
+}
+
+TEST_CASE( "parsed projects resolve survey files from the directory cache", "[DirectoryCache]" ) {
+    QTemporaryDir dir;
+    REQUIRE( dir.isValid() );
+    touch(dir.filePath("Entrance.Srv"));
+    {
+        QFile file(dir.filePath("cave.wpj"));
+        REQUIRE( file.open(QFile::WriteOnly) );
+        QTextStream out(&file);
+        out << ".BOOK Cave\r\n"
+            << ".SURVEY Entrance\r\n"
+            << ".NAME ENTRANCE\r\n"
+            << ".SURVEY Missing\r\n"
+            << ".NAME MISSING\r\n"
+            << ".ENDBOOK\r\n";
+    }
+
+    WallsProjectParser parser;
+    WpjBookPtr root = parser.parseFile(dir.filePath("cave.wpj"));
+    REQUIRE( !root.isNull() );
+    REQUIRE( !root->Directories.isNull() );
+    REQUIRE( root->Children.size() == 2 );
+
+    QString canonicalDir = QDir(dir.path()).canonicalPath();
+    CHECK( root->Children[0]->directoryCache() == root->Directories );
+    CHECK( root->Children[0]->absolutePath() == canonicalDir + "/Entrance.Srv" );
+    CHECK( root->Children[1]->absolutePath() == canonicalDir + "/MISSING.SRV" );
+    CHECK( root->Directories->directoryCount() == 1 );
+}
@@ -0,0 +1,95 @@
+#include "catch.hpp"
+#include "../src/wallssurveyparser.h"
+#include "../src/wallsprojectparser.h"
+#include <QTemporaryDir>
+#include <QTextStream>
+
+using namespace dewalls;
+
+TEST_CASE( "error recovery reports every bad line and keeps the state consistent", "[dewalls]" ) {
+    WallsSurveyParser parser;
+    parser.setErrorRecovery(true);
+
+    QList<Vector> vectors;
+    QList<WallsMessage> messages;
+    QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector v) { vectors << v; });
+    QObject::connect(&parser, &WallsSurveyParser::message, [&](WallsMessage m) { messages << m; });
+
+    // feet gets applied before v=foo fails, and must be rolled back
+    CHECK_NOTHROW( parser.parseLine(Segment("#units feet v=foo", "test.srv", 0, 0)) );
+    CHECK( parser.units().dUnit() == Length::Meters );
+
+    CHECK_NOTHROW( parser.parseLine(Segment("A1 A2 10 20 x", "test.srv", 1, 0)) );
+    CHECK( vectors.isEmpty() );
+
+    parser.parseLine(Segment("#units save feet", "test.srv", 2, 0));
+    // the first restore succeeds, then the second fails and the whole line is undone
+    parser.parseLine(Segment("#units restore restore", "test.srv", 3, 0));
+    CHECK( parser.units().dUnit() == Length::Feet );
+    parser.parseLine(Segment("#units restore", "test.srv", 4, 0));
+    CHECK( parser.units().dUnit() == Length::Meters );
+
+    parser.parseLine(Segment("A2 A3 10 20 30", "test.srv", 5, 0));
+    REQUIRE( vectors.size() == 1 );
+    CHECK( vectors[0].from() == "A2" );
+
+    CHECK( parser.errorCount() == 3 );
+    REQUIRE( messages.size() == 3 );
+    CHECK( messages[0].severity() == "error" );
+    CHECK( messages[0].startLine() == 0 );
+    CHECK( messages[1].startLine() == 1 );
+    CHECK( messages[2].startLine() == 3 );
+    CHECK( parser.errorSummary("test.srv") == "3 errors in test.srv" );
+
+    parser.resetErrorCount();
+    CHECK( parser.errorSummary().isEmpty() );
+}
+
+TEST_CASE( "parsers throw on errors without error recovery", "[dewalls]" ) {
+    WallsSurveyParser parser;
+    CHECK( !parser.errorRecovery() );
+    CHECK_THROWS_AS( parser.parseLine("A1 A2 10 20 x"), SegmentParseException );
+    CHECK( parser.errorCount() == 0 );
+}
+
+TEST_CASE( "project error recovery skips bad lines", "[WallsProjectParser]" ) {
+    QTemporaryDir dir;
+    REQUIRE( dir.isValid() );
+    QString fileName = dir.filePath("bad.wpj");
+    {
+        QFile file(fileName);
+        REQUIRE( file.open(QFile::WriteOnly) );
+        QTextStream out(&file);
+        out << ".BOOK Root\r\n"
+            << ".BOGUS line\r\n"
+            << ".SURVEY Survey\r\n"
+            << ".NAME S1\r\n";
+    }
+
+    WallsProjectParser strict;
+    CHECK( strict.parseFile(fileName).isNull() );
+
+    WallsProjectParser parser;
+    parser.setErrorRecovery(true);
+    QList<WallsMessage> messages;
+    QObject::connect(&parser, &WallsProjectParser::message, [&](WallsMessage m) { messages << m; });
+
+    WpjBookPtr root = parser.parseFile(fileName);
+    REQUIRE( !root.isNull() );
+    REQUIRE( root->Children.size() == 1 );
+    CHECK( root->Children[0]->Title == "Survey" );
+    // the bad line and the missing .ENDBOOK
+    CHECK( parser.errorCount() == 2 );
+    CHECK( messages.size() == 2 );
+
+    // each file's errors are counted on their own
+    WpjBookPtr again = parser.parseFile(fileName);
+    REQUIRE( !again.isNull() );
+    CHECK( again != root );
+    CHECK( again->Children.size() == 1 );
+    CHECK( parser.errorCount() == 2 );
+    CHECK( parser.flatResult().size() == 2 );
+
+    parser.resetErrorCount();
+    CHECK( parser.errorCount() == 0 );
+}
@@ -0,0 +1,192 @@
+#include "catch.hpp"
+#include "../src/wallssurveyparser.h"
+#include "../bench/srvgenerator.h"
+#include "testhelpers.h"
+
+using namespace dewalls;
+
+namespace {
+
+struct Results
+{
+    QStringList messages;
+    QList<Vector> vectors;
+    QList<FixStation> fixStations;
+    int comments = 0;
+    int notes = 0;
+    int flags = 0;
+    int dates = 0;
+    int units = 0;
+};
+
+Results parse(const QStringList& lines, WallsSurveyParser::Events events)
+{
+    WallsSurveyParser parser;
+    parser.setErrorRecovery(true);
+    parser.setEvents(events);
+
+    Results result;
+    QObject::connect(&parser, &WallsSurveyParser::message, [&](WallsMessage message) {
+        result.messages << describe(message);
+    });
+    QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector v) { result.vectors << v; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedFixStation, [&](FixStation s) { result.fixStations << s; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedComment, [&](QString) { result.comments++; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedNote, [&](QString, QString) { result.notes++; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedDate, [&](QDate) { result.dates++; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedFlag, [&](QStringList, QString) { result.flags++; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedUnits, [&]() { result.units++; });
+
+    QByteArray data;
+    foreach (QString line, lines)
+    {
+        data += line.toUtf8() + "\r\n";
+    }
+    parser.parseBuffer(data, "test.srv", WallsSurveyParser::Utf8);
+    return result;
+}
+
+void requireSameMessages(const Results& expected, const Results& actual)
+{
+    REQUIRE( actual.messages.size() == expected.messages.size() );
+    for (int i = 0; i < expected.messages.size(); i++)
+    {
+        CHECK( actual.messages[i].toStdString() == expected.messages[i].toStdString() );
+    }
+}
+
+QStringList sampleLines()
+{
+    QStringList lines;
+    lines << ";header"
+          << "#date 2015-06-12"
+          << "#units typeab=c,2 typevb=c,2"
+          << "A1 A2 10 20/25 30/36 (5,6) *1 2 3 4 C* ;first"
+          << "A2 A3 10 20 30 *1 -2 3 4*"
+          << "A3 A4 10 20 30 <1,2,3,4,90>"
+          << "A4 A5 10 20 30 (R4) ;plain"
+          << "A5 A6 10 20 91"
+          << "A6 A7 10 -- 30"
+          << "#fix A1 100 200 300 (?) /fixed note ;fixed"
+          << "#note A1 /big\\q room"
+          << "#note A2 /bad escape\\"
+          << "#flag A1 A2 /survey marker"
+          << "#flag /everything"
+          << "#[ "
+          << "inside a block comment"
+          << "#]"
+          << "#segment /upper"
+          << "#units order=nonsense"
+          << "A7 A8 10 20 30 ;still fine";
+    return lines;
+}
+
+} // anonymous namespace
+
+TEST_CASE( "event masks don't change the messages", "[dewalls][events]" ) {
+    QList<WallsSurveyParser::Events> masks;
+    masks << WallsSurveyParser::NoEvents
+          << WallsSurveyParser::Events(WallsSurveyParser::VectorEvents)
+          << (WallsSurveyParser::VectorEvents | WallsSurveyParser::LrudFields)
+          << (WallsSurveyParser::FixStationEvents | WallsSurveyParser::VarianceFields)
+          << (WallsSurveyParser::CommentEvents | WallsSurveyParser::NoteEvents | WallsSurveyParser::FlagEvents)
+          << (WallsSurveyParser::Events(WallsSurveyParser::AllEvents) ^ WallsSurveyParser::CommentEvents);
+
+    SECTION( "warnings and errors" ) {
+        Results full = parse(sampleLines(), WallsSurveyParser::AllEvents);
+        CHECK( full.messages.size() > 0 );
+        foreach (WallsSurveyParser::Events mask, masks)
+        {
+            requireSameMessages(full, parse(sampleLines(), mask));
+        }
+    }
+
+    SECTION( "generated survey" ) {
+        SrvGeneratorOptions options;
+        options.lineCount = 2000;
+        options.unitSuffixRatio = 0.1;
+        options.backsightRatio = 0.2;
+        options.commentRatio = 0.1;
+        options.mode = SrvGeneratorOptions::Mixed;
+        QStringList lines = SrvGenerator(options).generateLines();
+        Results full = parse(lines, WallsSurveyParser::AllEvents);
+        foreach (WallsSurveyParser::Events mask, masks)
+        {
+            requireSameMessages(full, parse(lines, mask));
+        }
+    }
+}
+
+TEST_CASE( "event masks only emit what was asked for", "[dewalls][events]" ) {
+    Results full = parse(sampleLines(), WallsSurveyParser::AllEvents);
+    REQUIRE( full.vectors.size() > 0 );
+    REQUIRE( full.fixStations.size() == 1 );
+    CHECK( full.comments > 0 );
+    CHECK( full.notes == 1 );
+    CHECK( full.flags == 1 );
+    CHECK( full.dates == 1 );
+    CHECK( full.units > 0 );
+
+    SECTION( "shots only" ) {
+        Results shots = parse(sampleLines(), WallsSurveyParser::VectorEvents);
+        REQUIRE( shots.vectors.size() == full.vectors.size() );
+        CHECK( shots.fixStations.isEmpty() );
+        CHECK( shots.comments == 0 );
+        CHECK( shots.notes == 0 );
+        CHECK( shots.flags == 0 );
+        CHECK( shots.dates == 0 );
+        CHECK( shots.units == 0 );
+        for (int i = 0; i < full.vectors.size(); i++)
+        {
+            const Vector& expected = full.vectors[i];
+            const Vector& actual = shots.vectors[i];
+            CHECK( actual.from() == expected.from() );
+            CHECK( actual.to() == expected.to() );
+            CHECK( actual.distance() == expected.distance() );
+            CHECK( actual.frontAzimuth() == expected.frontAzimuth() );
+            CHECK( actual.frontInclination() == expected.frontInclination() );
+            CHECK( actual.backAzimuth() == expected.backAzimuth() );
+            CHECK( actual.backInclination() == expected.backInclination() );
+            CHECK( !actual.left().isValid() );
+            CHECK( !actual.right().isValid() );
+            CHECK( !actual.up().isValid() );
+            CHECK( !actual.down().isValid() );
+            CHECK( !actual.lrudAngle().isValid() );
+            CHECK( !actual.cFlag() );
+            CHECK( actual.horizVariance().isNull() );
+            CHECK( actual.vertVariance().isNull() );
+            CHECK( actual.comment().isNull() );
+        }
+    }
+
+    SECTION( "fields" ) {
+        Results lruds = parse(sampleLines(), WallsSurveyParser::VectorEvents | WallsSurveyParser::LrudFields |
+                              WallsSurveyParser::VarianceFields | WallsSurveyParser::FixStationEvents);
+        REQUIRE( lruds.vectors.size() == full.vectors.size() );
+        for (int i = 0; i < full.vectors.size(); i++)
+        {
+            const Vector& expected = full.vectors[i];
+            const Vector& actual = lruds.vectors[i];
+            CHECK( actual.left() == expected.left() );
+            CHECK( actual.down() == expected.down() );
+            CHECK( actual.lrudAngle() == expected.lrudAngle() );
+            CHECK( actual.cFlag() == expected.cFlag() );
+            CHECK( actual.horizVariance().isNull() == expected.horizVariance().isNull() );
+            CHECK( actual.comment().isNull() );
+        }
+        REQUIRE( lruds.fixStations.size() == 1 );
+        CHECK( !lruds.fixStations[0].horizVariance().isNull() );
+        CHECK( lruds.fixStations[0].comment().isNull() );
+        CHECK( lruds.comments == 0 );
+    }
+
+    SECTION( "lint mode is the empty mask" ) {
+        WallsSurveyParser parser;
+        parser.setLintMode(true);
+        CHECK( parser.events() == WallsSurveyParser::NoEvents );
+        parser.setEvents(WallsSurveyParser::NoteEvents);
+        CHECK( !parser.lintMode() );
+        parser.setLintMode(false);
+        CHECK( parser.events() == WallsSurveyParser::AllEvents );
+    }
+}
@@ -0,0 +1,83 @@
+#include "catch.hpp"
+#include "../src/wallssurveyparser.h"
+#include "../src/expectedtokens.h"
+
+using namespace dewalls;
+
+TEST_CASE( "ExpectedTokens interns and merges items", "[ExpectedTokens]" ) {
+    int id = ExpectedTokens::intern("<TEST TOKEN>");
+    CHECK( ExpectedTokens::intern(QString("<TEST TOKEN>")) == id );
+    CHECK( ExpectedTokens::item(id) == "<TEST TOKEN>" );
+    CHECK( ExpectedTokens::intern(QChar('q')) == ExpectedTokens::intern("q") );
+
+    ExpectedTokens a({"b", "<TEST TOKEN>"});
+    ExpectedTokens b("a");
+    CHECK( !a.contains("a") );
+    a |= b;
+    a.add("b");
+    CHECK( a.contains("a") );
+    CHECK( a.toStringList() == QStringList({"b", "<TEST TOKEN>", "a"}) );
+
+    ExpectedTokens c("c");
+    c |= a;
+    CHECK( c.toStringList() == QStringList({"c", "b", "<TEST TOKEN>", "a"}) );
+
+    a.clear();
+    CHECK( a.isEmpty() );
+    CHECK( ExpectedTokens().isEmpty() );
+}
+
+TEST_CASE( "parse errors render all expected items of the furthest failure", "[ExpectedTokens]" ) {
+    WallsSurveyParser parser;
+    try
+    {
+        parser.parseLine("#units feet v=foo");
+        FAIL( "expected a parse error" );
+    }
+    catch (const SegmentParseExpectedException& ex)
+    {
+        QList<QString> items = ex.expectedItems();
+        CHECK( items.contains("degrees") );
+        CHECK( items.contains("grads") );
+        CHECK( ex.detailMessage().startsWith("Expected one of:") );
+    }
+}
+
+TEST_CASE( "parse exceptions at an index of a line locate it like atAsSegment", "[ExpectedTokens]" ) {
+    Segment line = Segment("#fix A1 10 20 30", "test.srv", 3, 0).mid(5);
+    for (int index : {0, 3, line.length()})
+    {
+        SegmentParseExpectedException ex(line, index, QStringLiteral("<TEST TOKEN>"));
+        Segment expected = line.atAsSegment(index);
+        CHECK( ex.sourceIndex() == expected.sourceIndex() );
+        CHECK( ex.segment().sourceIndex() == expected.sourceIndex() );
+        CHECK( ex.segment().value() == expected.value() );
+        CHECK( ex.segment().source() == "test.srv" );
+        CHECK( ex.segment().startLine() == expected.startLine() );
+        CHECK( ex.segment().startCol() == expected.startCol() );
+        CHECK( ex.segment().endCol() == expected.endCol() );
+    }
+}
+
+// fills the process-wide registry, so it runs after the other tests here
+TEST_CASE( "ExpectedTokens stops interning at its capacity", "[ExpectedTokens]" ) {
+    int last = -1;
+    for (int i = 0; i <= ExpectedTokens::Capacity; i++)
+    {
+        last = ExpectedTokens::intern(QString("<FILLER %1>").arg(i));
+    }
+    CHECK( last == -1 );
+    CHECK( ExpectedTokens::intern("<TEST TOKEN>") >= 0 );
+
+    ExpectedTokens a("<NEW TOKEN 1>");
+    a.add("<TEST TOKEN>");
+    a.add(QChar(0x2603));
+    a |= ExpectedTokens({"<NEW TOKEN 2>", "<NEW TOKEN 1>"});
+    CHECK( a.contains("<NEW TOKEN 2>") );
+    CHECK( !a.contains("<NEW TOKEN 3>") );
+    CHECK( a.toStringList() == QStringList({"<NEW TOKEN 1>", "<TEST TOKEN>", QString(QChar(0x2603)),
+                                            "<NEW TOKEN 2>"}) );
+    a.clear();
+    CHECK( a.isEmpty() );
+    CHECK( a.toStringList().isEmpty() );
+}
@@ -0,0 +1,226 @@
+#include "catch.hpp"
+#include "../src/wallssurveyparser.h"
+#include "../bench/srvgenerator.h"
+#include "testhelpers.h"
+
+using namespace dewalls;
+
+namespace {
+
+void connectEvents(WallsSurveyParser& parser, QStringList& events)
+{
+    QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector v) {
+        events << describe(v);
+    });
+    QObject::connect(&parser, &WallsSurveyParser::parsedFixStation, [&](FixStation fix) {
+        events << describe(fix);
+    });
+    QObject::connect(&parser, &WallsSurveyParser::parsedComment, [&](QString comment) {
+        events << "comment " + comment;
+    });
+    QObject::connect(&parser, &WallsSurveyParser::message, [&](WallsMessage message) {
+        events << describe(message);
+    });
+}
+
+QStringList parse(const QStringList& lines, bool fastPath, int* fastPathLines = nullptr,
+                  WallsSurveyParser::Events mask = WallsSurveyParser::AllEvents)
+{
+    WallsSurveyParser parser;
+    parser.setErrorRecovery(true);
+    parser.setFastPathEnabled(fastPath);
+    parser.setEvents(mask);
+
+    QStringList events;
+    connectEvents(parser, events);
+
+    for (int i = 0; i < lines.size(); i++)
+    {
+        parser.parseLine(Segment(lines[i], "test.srv", i, 0));
+    }
+    if (fastPathLines)
+    {
+        *fastPathLines = parser.fastPathLineCount();
+    }
+    return events;
+}
+
+///
+/// \brief parses the lines with parseBuffer(), which tokenizes the lines it can from the bytes
+///
+QStringList parseBuffer(const QStringList& lines, int* fastPathLines = nullptr,
+                        WallsSurveyParser::Events mask = WallsSurveyParser::AllEvents)
+{
+    WallsSurveyParser parser;
+    parser.setErrorRecovery(true);
+    parser.setEvents(mask);
+
+    QStringList events;
+    connectEvents(parser, events);
+
+    parser.parseBuffer(lines.join("\r\n").toUtf8(), "test.srv", WallsSurveyParser::Utf8);
+    if (fastPathLines)
+    {
+        *fastPathLines = parser.fastPathLineCount();
+    }
+    return events;
+}
+
+void requireSame(const QStringList& slow, const QStringList& fast)
+{
+    REQUIRE( fast.size() == slow.size() );
+    for (int i = 0; i < slow.size(); i++)
+    {
+        INFO( "event " << i );
+        CHECK( fast[i].toStdString() == slow[i].toStdString() );
+    }
+}
+
+void requireSameEvents(const QStringList& lines, int* fastPathLines = nullptr)
+{
+    requireSame(parse(lines, false), parse(lines, true, fastPathLines));
+}
+
+void requireSameBufferEvents(const QStringList& lines, int* fastPathLines = nullptr)
+{
+    requireSame(parse(lines, false), parseBuffer(lines, fastPathLines));
+    WallsSurveyParser::Events lint = WallsSurveyParser::NoEvents;
+    requireSame(parse(lines, false, nullptr, lint), parseBuffer(lines, nullptr, lint));
+    WallsSurveyParser::Events fixes = WallsSurveyParser::FixStationEvents | WallsSurveyParser::CommentEvents;
+    requireSame(parse(lines, false, nullptr, fixes), parseBuffer(lines, nullptr, fixes));
+}
+
+} // anonymous namespace
+
+TEST_CASE( "fast path matches the grammar on generated surveys", "[dewalls][fastpath]" ) {
+    SrvGeneratorOptions options;
+    options.lineCount = 3000;
+    options.commentRatio = 0.1;
+    options.unitsRatio = 0.05;
+
+    SECTION( "plain compass surveys" ) {
+        options.seed = 7;
+        int fastPathLines = 0;
+        requireSameEvents(SrvGenerator(options).generateLines(), &fastPathLines);
+        CHECK( fastPathLines > 0 );
+    }
+
+    SECTION( "with unit suffixes, backsights and macros" ) {
+        options.seed = 11;
+        options.unitSuffixRatio = 0.2;
+        options.backsightRatio = 0.2;
+        options.macros = true;
+        requireSameEvents(SrvGenerator(options).generateLines());
+    }
+
+    SECTION( "switching between compass and rect" ) {
+        options.seed = 13;
+        options.mode = SrvGeneratorOptions::Mixed;
+        options.unitsRatio = 0.1;
+        requireSameEvents(SrvGenerator(options).generateLines());
+    }
+}
+
+TEST_CASE( "fast path falls back on unusual lines", "[dewalls][fastpath]" ) {
+    QStringList lines;
+    lines << "A1 A2 10 20 30"
+          << "  A1\tA2  10.  .5 -30  ;comment "
+          << "A1 A2 10 20 +0"
+          << "A1 A2 10 20 -0"
+          << "A1 A2 10 360 0"
+          << "A1 A2 10 20 91"
+          << "A1 A2 10 20 30 5 6"
+          << "A1 A2 10 20 30 (R5)"
+          << "A1 A2 10f 20 30"
+          << "A1 A2 10 20:30 30"
+          << "A1 A2 10 N20E 30"
+          << "A1 A2 10 20/200 30"
+          << "A1 A2 10 20 30 *1 2 3 4*"
+          << "A1 A2 10 20 30 <1,2 , 3 ,4>;x"
+          << "A1 A2 10 20 30 *1 2 3*"
+          << "A1 A2 10 20 30 <1,2,3,4,>"
+          << "A1 A2 10 20 30 *1 2 3 4 90*"
+          << "A1 A2 10 20 30 *1 2 3 4 C*"
+          << "A1 A2 10 20 30 *1 -2 3 4*"
+          << "A1 A2 10 20 30 *1 -- 3 4*"
+          << "A1 A2 10 20 30*1 2 3 4*"
+          << "A1 A2 10 20 30 #s /x"
+          << "ABCDEFGHI A2 10 20 30"
+          << "Q:A1 A2 10 20 30"
+          << "-- A2 10 20 30"
+          << "A1 A2 10 20 30  "
+          << "A1 A2 1\xd9\xa2 20 30"
+          << "A1 *1 2 3 4*"
+          << "#units incd=-2 incs=-3"
+          << "A1 A2 1 20 30 *1 2 5 5*"
+          << "A1 A2 3 20 30 *5 5 5 5*"
+          << "#units order=vda lrud=from:durl v=grads"
+          << "A1 A2 -30 10 20 *1 2 3 4*"
+          << "A1 A2 101 10 20"
+          << "#units order=da"
+          << "A1 A2 10 20";
+    requireSameEvents(lines);
+}
+
+TEST_CASE( "parseBuffer tokenizes vector and fix lines from the bytes like the grammar", "[dewalls][fastpath]" ) {
+    SrvGeneratorOptions options;
+    options.lineCount = 3000;
+    options.commentRatio = 0.1;
+    options.unitsRatio = 0.05;
+
+    SECTION( "plain compass surveys" ) {
+        options.seed = 7;
+        int fastPathLines = 0;
+        requireSameBufferEvents(SrvGenerator(options).generateLines(), &fastPathLines);
+        CHECK( fastPathLines > 0 );
+    }
+
+    SECTION( "with unit suffixes, backsights and macros" ) {
+        options.seed = 11;
+        options.unitSuffixRatio = 0.2;
+        options.backsightRatio = 0.2;
+        options.macros = true;
+        requireSameBufferEvents(SrvGenerator(options).generateLines());
+    }
+
+    SECTION( "unusual vector and fix lines" ) {
+        QStringList lines;
+        lines << "A1 A2 10 20 30"
+              << "  A1\tA2  10.  .5 -30  ;caf\u00e9 "
+              << "A1 A2 10 20 30 *1 2 3 4*"
+              << "A1 A2 10 20 x"
+              << "A1 A2 10 20 30 ;\u00e9"
+              << "A1 A2 1\u0662 20 30"
+              << "A\u00e9 A2 10 20 30"
+              << "#FIX A1 100 200 300"
+              << "  #fix\tA2 -100 200.5 -.5 ;fixed \u00e9"
+              << "#Fix A3 100 200 300;x"
+              << "#fix A4 100f 200 300"
+              << "#fix A5 100 200 300 (?,5)"
+              << "#fix A6 100 200 300 /note"
+              << "#fix A7 100 200 300 #s /seg"
+              << "#fix A8 W97:43:52.5 N31:16:45 300"
+              << "#fix Q:A9 100 200 300"
+              << "#fix A10 100 200"
+              << "#fix A11 100 200 300 400"
+              << "#fixed A12 100 200 300"
+              << "#fix A13 100 200 +300"
+              << "#units order=une"
+              << "#fix A14 1 2 3"
+              << "#units order=en"
+              << "#fix A15 1 2"
+              << "#fix A16 1 2 3"
+              << "#segment /Upper"
+              << "#date 2021-03-04"
+              << "#fix A17 1 2"
+              << "#units prefix=P"
+              << "#FIX A18 1 2 ;x"
+              << "#[";
+        lines << "#fix A19 1 2 3"
+              << "#]"
+              << "#fix A20 1 2 3";
+        int fastPathLines = 0;
+        requireSameBufferEvents(lines, &fastPathLines);
+        CHECK( fastPathLines == 12 );
+    }
+}
@@ -0,0 +1,220 @@
+#include "catch.hpp"
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include "../src/wallssurveyparser.h"
+#include "../src/geomagneticmodel.h"
+
+using namespace dewalls;
+
+typedef UnitizedDouble<Length> ULength;
+typedef UnitizedDouble<Angle> UAngle;
+
+namespace {
+
+double declination(const GeomagneticModel& model, double year, double latitude, double longitude)
+{
+    return model.declination(year,
+            UAngle(latitude, Angle::Degrees),
+            UAngle(longitude, Angle::Degrees),
+            ULength(0, Length::Meters)).get(Angle::Degrees);
+}
+
+double declination(double year, double latitude, double longitude)
+{
+    return declination(GeomagneticModel::wmm2020(), year, latitude, longitude);
+}
+
+}
+
+TEST_CASE( "builtin geomagnetic model matches WMM2020 test values", "[GeomagneticModel]" ) {
+    CHECK( declination(2020.0,  80,   0) == Approx(-1.28).margin(0.01) );
+    CHECK( declination(2020.0,   0, 120) == Approx( 0.16).margin(0.01) );
+    CHECK( declination(2020.0, -80, 240) == Approx(69.36).margin(0.01) );
+    CHECK( declination(2022.5,  80,   0) == Approx( 0.01).margin(0.01) );
+    CHECK( declination(2022.5, -80, 240) == Approx(69.13).margin(0.01) );
+}
+
+TEST_CASE( "builtin geomagnetic model matches WMM2025 test values", "[GeomagneticModel]" ) {
+    const GeomagneticModel& model = GeomagneticModel::wmm2025();
+    CHECK( declination(model, 2025.0,  80,   0) == Approx( 1.28).margin(0.01) );
+    CHECK( declination(model, 2025.0,   0, 120) == Approx(-0.16).margin(0.01) );
+    CHECK( declination(model, 2025.0, -80, 240) == Approx(68.78).margin(0.01) );
+    CHECK( declination(model, 2027.5,  80,   0) == Approx( 2.59).margin(0.01) );
+    CHECK( declination(model, 2027.5, -80, 240) == Approx(68.49).margin(0.01) );
+}
+
+TEST_CASE( "GeomagneticModelSet picks the model for each date", "[GeomagneticModel]" ) {
+    const GeomagneticModelSet& models = GeomagneticModelSet::builtin();
+    REQUIRE( models.models().size() == 2 );
+    CHECK( models.name() == "WMM-2020 to WMM-2025" );
+    CHECK( models.epoch() == 2020.0 );
+    CHECK( models.validUntil() == 2030.0 );
+    CHECK( models.modelFor(QDate(2021, 3, 4)) == &GeomagneticModel::wmm2020() );
+    CHECK( models.modelFor(QDate(2026, 10, 18)) == &GeomagneticModel::wmm2025() );
+    CHECK( models.modelFor(QDate(1987, 6, 1)) == nullptr );
+    CHECK( models.modelFor(QDate(2030, 1, 1)) == nullptr );
+
+    DeclinationCache cache;
+    UAngle latitude(20.85, Angle::Degrees);
+    UAngle longitude(-88.69, Angle::Degrees);
+    CHECK( cache.declination(QDate(2026, 10, 18), latitude, longitude).get(Angle::Degrees) ==
+           Approx(GeomagneticModel::wmm2025().declination(QDate(2026, 10, 18),
+                  UAngle(20.85, Angle::Degrees), UAngle(-88.65, Angle::Degrees),
+                  ULength(0, Length::Meters)).get(Angle::Degrees)) );
+}
+
+TEST_CASE( "GeomagneticModelSet reads IGRF coefficient tables", "[GeomagneticModel]" ) {
+    QTemporaryDir dir;
+    REQUIRE( dir.isValid() );
+    QString fileName = dir.filePath("igrf.txt");
+    {
+        QFile file(fileName);
+        REQUIRE( file.open(QFile::WriteOnly) );
+        QTextStream out(&file);
+        out << "# test coefficients\n"
+            << "c/s deg ord IGRF IGRF SV\n"
+            << "g/h n m 1985.0 1990.0 1990-95\n"
+            << "g 1 0 -29873 -29775 18.0\n"
+            << "g 1 1 -1905 -1848 10.6\n"
+            << "h 1 1 5500 5406 -16.1\n"
+            << "g 2 0 -2072 -2131 -12.9\n"
+            << "g 2 1 3044 3044 1.7\n"
+            << "h 2 1 -2197 -2279 -16.5\n";
+    }
+
+    GeomagneticModelSet models = GeomagneticModelSet::fromIgrfFile(fileName);
+    REQUIRE( models.models().size() == 2 );
+    CHECK( models.name() == "IGRF-1985 to IGRF-1990" );
+    CHECK( models.validUntil() == 1995.0 );
+
+    const GeomagneticModel* model = models.modelFor(QDate(1987, 6, 1));
+    REQUIRE( model );
+    CHECK( model->epoch() == 1985.0 );
+    CHECK( model->validUntil() == 1990.0 );
+
+    // the secular variation of each epoch interpolates to the next one
+    QList<GeomagneticModel::Coefficient> coefficients;
+    coefficients << GeomagneticModel::Coefficient{1, 0, -29873, 0, (-29775 + 29873) / 5.0, 0}
+                 << GeomagneticModel::Coefficient{1, 1, -1905, 5500, (-1848 + 1905) / 5.0, (5406 - 5500) / 5.0}
+                 << GeomagneticModel::Coefficient{2, 0, -2072, 0, (-2131 + 2072) / 5.0, 0}
+                 << GeomagneticModel::Coefficient{2, 1, 3044, -2197, 0, (-2279 + 2197) / 5.0};
+    GeomagneticModel expected("expected", 1985.0, coefficients);
+    CHECK( declination(*model, 1987.5, 40, -105) == Approx(declination(expected, 1987.5, 40, -105)) );
+    CHECK( declination(*models.modelFor(1992.0), 1992.0, 40, -105) ==
+           Approx(declination(GeomagneticModel("expected", 1990.0, QList<GeomagneticModel::Coefficient>()
+                  << GeomagneticModel::Coefficient{1, 0, -29775, 0, 18.0, 0}
+                  << GeomagneticModel::Coefficient{1, 1, -1848, 5406, 10.6, -16.1}
+                  << GeomagneticModel::Coefficient{2, 0, -2131, 0, -12.9, 0}
+                  << GeomagneticModel::Coefficient{2, 1, 3044, -2279, 1.7, -16.5}), 1992.0, 40, -105)) );
+
+    CHECK( GeomagneticModelSet::fromIgrfFile(dir.filePath("missing.txt")).isEmpty() );
+
+    models.add(GeomagneticModelSet::builtin());
+    CHECK( models.name() == "IGRF-1985 to WMM-2025" );
+    CHECK( models.modelFor(QDate(1987, 6, 1))->name() == "IGRF-1985" );
+    CHECK( models.modelFor(QDate(2026, 10, 18))->name() == "WMM-2025" );
+    CHECK( !models.covers(QDate(2000, 1, 1)) );
+}
+
+TEST_CASE( "DeclinationCache evaluates each date and cell once", "[GeomagneticModel]" ) {
+    DeclinationCache cache;
+
+    UAngle a = cache.declination(QDate(2021, 3, 4), UAngle(20.85, Angle::Degrees), UAngle(-88.69, Angle::Degrees));
+    CHECK( cache.size() == 1 );
+    UAngle b = cache.declination(QDate(2021, 3, 4), UAngle(20.86, Angle::Degrees), UAngle(-88.68, Angle::Degrees));
+    CHECK( cache.size() == 1 );
+    CHECK( a == b );
+
+    cache.declination(QDate(2021, 3, 5), UAngle(20.85, Angle::Degrees), UAngle(-88.69, Angle::Degrees));
+    CHECK( cache.size() == 2 );
+}
+
+TEST_CASE( "WallsSurveyParser derives declination from #date", "[GeomagneticModel]" ) {
+    WallsSurveyParser parser;
+
+    Vector vector;
+    QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector v) { vector = v; });
+
+    GeoReferencePtr reference(new GeoReference);
+    reference->latitude = UAngle(20.85, Angle::Degrees);
+    reference->longitude = UAngle(-88.69, Angle::Degrees);
+    reference->elevation = ULength(27, Length::Meters);
+
+    DeclinationCachePtr cache(new DeclinationCache());
+
+    parser.setDeclinationReference(reference, cache);
+    CHECK( !parser.derivedDecl().isValid() );
+
+    parser.parseLine("A1 A2 2.5 350 2.3");
+    CHECK( vector.units().decl().isZero() );
+
+    parser.parseLine("#date 2021-03-04");
+    REQUIRE( parser.derivedDecl().isValid() );
+    CHECK( parser.derivedDecl() == cache->declination(QDate(2021, 3, 4), *reference) );
+
+    parser.parseLine("#units decl=5");
+    parser.parseLine("A1 A2 2.5 350 2.3");
+    CHECK( vector.units().decl() == parser.derivedDecl() );
+
+    parser.setDeclinationReference(GeoReferencePtr());
+    CHECK( !parser.derivedDecl().isValid() );
+}
+
+TEST_CASE( "WallsSurveyParser warns about dates the geomagnetic model doesn't cover", "[GeomagneticModel]" ) {
+    CHECK( GeomagneticModelSet::builtin().covers(QDate(2021, 3, 4)) );
+    CHECK( GeomagneticModelSet::builtin().covers(QDate(2025, 1, 1)) );
+    CHECK( !GeomagneticModelSet::builtin().covers(QDate(1987, 6, 1)) );
+
+    WallsSurveyParser parser;
+
+    Vector vector;
+    QList<WallsMessage> messages;
+    QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector v) { vector = v; });
+    QObject::connect(&parser, &WallsSurveyParser::message, [&](WallsMessage m) { messages << m; });
+
+    GeoReferencePtr reference(new GeoReference);
+    reference->latitude = UAngle(20.85, Angle::Degrees);
+    reference->longitude = UAngle(-88.69, Angle::Degrees);
+    parser.setDeclinationReference(reference);
+
+    parser.parseLine("#units decl=5");
+    parser.parseLine("#date 1987-06-01");
+    CHECK( !parser.derivedDecl().isValid() );
+    REQUIRE( messages.size() == 1 );
+    CHECK( messages[0].severity() == "warning" );
+    CHECK( messages[0].message().contains("WMM-2020 to WMM-2025") );
+
+    parser.parseLine("A1 A2 2.5 350 2.3");
+    CHECK( vector.units().decl() == UAngle(5, Angle::Degrees) );
+}
+
+TEST_CASE( "the derived declination only applies to the emitted vectors", "[GeomagneticModel]" ) {
+    WallsSurveyParser parser;
+
+    Vector vector;
+    QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector v) { vector = v; });
+
+    GeoReferencePtr reference(new GeoReference);
+    reference->latitude = UAngle(20.85, Angle::Degrees);
+    reference->longitude = UAngle(-88.69, Angle::Degrees);
+    parser.setDeclinationReference(reference);
+
+    parser.parseLine("#units decl=5");
+    parser.parseLine("#date 2021-03-04");
+    REQUIRE( parser.derivedDecl().isValid() );
+    parser.parseLine("A1 A2 2.5 350 2.3");
+    CHECK( vector.units().decl() == parser.derivedDecl() );
+    CHECK( parser.units().decl() == UAngle(5, Angle::Degrees) );
+
+    parser.parseLine("#units save");
+    parser.parseLine("#units decl=2");
+    parser.parseLine("A2 A3 2.5 350 2.3");
+    CHECK( vector.units().decl() == parser.derivedDecl() );
+    parser.parseLine("#units restore");
+    CHECK( parser.units().decl() == UAngle(5, Angle::Degrees) );
+
+    parser.setDeclinationReference(GeoReferencePtr());
+    parser.parseLine("A3 A4 2.5 350 2.3");
+    CHECK( vector.units().decl() == UAngle(5, Angle::Degrees) );
+}
@@ -0,0 +1,72 @@
+#include "catch.hpp"
+#include "../src/lazyproject.h"
+#include "testhelpers.h"
+#include <QTemporaryDir>
+
+using namespace dewalls;
+
+TEST_CASE( "LazyProject parses surveys on demand", "[LazyProject]" ) {
+    QTemporaryDir dir;
+    REQUIRE( dir.isValid() );
+    QString wpj = ".BOOK Cave\r\n.OPTIONS feet\r\n";
+    for (int i = 0; i < 3; i++) {
+        wpj += QString(".SURVEY S%1\r\n.NAME S%1\r\n").arg(i);
+        QString srv;
+        for (int k = 0; k < 100; k++) {
+            srv += QString("A%1 A%2 10 20 30\r\n").arg(k).arg(k + 1);
+        }
+        writeFile(dir.filePath(QString("S%1.SRV").arg(i)), srv);
+    }
+    wpj += ".ENDBOOK\r\n";
+    writeFile(dir.filePath("cave.wpj"), wpj);
+
+    LazyProject project;
+    REQUIRE( project.open(dir.filePath("cave.wpj")) );
+    REQUIRE( project.root()->Children.size() == 3 );
+    CHECK( project.entries().size() == 4 );
+    CHECK( project.loadCount() == 0 );
+    CHECK( project.cachedCount() == 0 );
+
+    WpjEntryPtr s0 = project.root()->Children[0];
+    WpjEntryPtr s1 = project.root()->Children[1];
+    WpjEntryPtr s2 = project.root()->Children[2];
+
+    ParsedSurveyPtr survey = project.survey(s1);
+    REQUIRE( !survey.isNull() );
+    CHECK( survey->vectors.size() == 100 );
+    // inherited from the book
+    CHECK( survey->vectors[0].distance() == UnitizedDouble<Length>(10, Length::Feet) );
+    CHECK( project.loadCount() == 1 );
+    CHECK( project.isCached(s1) );
+    CHECK( !project.isCached(s0) );
+
+    CHECK( project.survey(s1) == survey );
+    CHECK( project.loadCount() == 1 );
+
+    CHECK( project.survey(project.root()).isNull() );
+    CHECK( project.survey(WpjEntryPtr(new WpjEntry(WpjBookPtr(), "other"))).isNull() );
+
+    SECTION( "the least recently used surveys are evicted to stay under the memory limit" ) {
+        qint64 size = LazyProject::estimateBytes(*survey);
+        project.setMaxBytes(size * 2 + size / 2);
+
+        project.survey(s0);
+        project.survey(s1);
+        project.survey(s2);
+        CHECK( project.loadCount() == 3 );
+        CHECK( project.cachedCount() == 2 );
+        CHECK( !project.isCached(s0) );
+        CHECK( project.cachedBytes() <= project.maxBytes() );
+
+        // an evicted survey is still valid for whoever holds it, and is parsed again
+        CHECK( project.survey(s0)->vectors.size() == 100 );
+        CHECK( project.loadCount() == 4 );
+    }
+
+    SECTION( "surveys bigger than the cache are still returned" ) {
+        project.setMaxBytes(1);
+        project.clearCache();
+        CHECK( project.survey(s2)->vectors.size() == 100 );
+        CHECK( project.cachedCount() == 0 );
+    }
+}
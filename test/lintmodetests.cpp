@@ -0,0 +1,89 @@
+#include "catch.hpp"
+#include "../src/wallssurveyparser.h"
+#include "../bench/srvgenerator.h"
+#include "testhelpers.h"
+
+using namespace dewalls;
+
+namespace {
+
+QStringList messages(const QStringList& lines, bool lint, int* otherSignals)
+{
+    WallsSurveyParser parser;
+    parser.setErrorRecovery(true);
+    parser.setLintMode(lint);
+
+    QStringList result;
+    int others = 0;
+    QObject::connect(&parser, &WallsSurveyParser::message, [&](WallsMessage message) {
+        result << describe(message);
+    });
+    QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector) { others++; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedFixStation, [&](FixStation) { others++; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedComment, [&](QString) { others++; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedNote, [&](QString, QString) { others++; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedDate, [&](QDate) { others++; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedFlag, [&](QStringList, QString) { others++; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedUnits, [&]() { others++; });
+
+    QByteArray data;
+    foreach (QString line, lines)
+    {
+        data += line.toUtf8() + "\r\n";
+    }
+    parser.parseBuffer(data, "test.srv", WallsSurveyParser::Utf8);
+    *otherSignals = others;
+    return result;
+}
+
+void requireSameMessages(const QStringList& lines)
+{
+    int fullSignals = 0;
+    int lintSignals = 0;
+    QStringList full = messages(lines, false, &fullSignals);
+    QStringList lint = messages(lines, true, &lintSignals);
+    CHECK( fullSignals > 0 );
+    CHECK( lintSignals == 0 );
+    REQUIRE( lint.size() == full.size() );
+    for (int i = 0; i < full.size(); i++)
+    {
+        CHECK( lint[i].toStdString() == full[i].toStdString() );
+    }
+}
+
+} // anonymous namespace
+
+TEST_CASE( "lint mode reports the same messages without building results", "[dewalls][lint]" ) {
+    SECTION( "warnings and errors" ) {
+        QStringList lines;
+        lines << ";header"
+              << "#date 2015-06-12"
+              << "#units typeab=c,2 typevb=c,2"
+              << "A1 A2 10 20/25 30/36"
+              << "A2 A3 10 20 30 *1 -2 3 4*"
+              << "A3 A4 10 20 30 <1,2,3>"
+              << "A4 A5 10 20 91"
+              << "A5 A6 10 -- 30"
+              << "#fix A1 100 200 300 ;fixed"
+              << "#note A1 /big room"
+              << "#flag A1 A2 /survey marker"
+              << "#[ "
+              << "inside a block comment"
+              << "#]"
+              << "#segment /upper"
+              << "A6 A7 10 20 30 #s /lower ;comment"
+              << "#units order=nonsense"
+              << "A7 A8 10 20 30 ;still fine";
+        requireSameMessages(lines);
+    }
+
+    SECTION( "generated survey" ) {
+        SrvGeneratorOptions options;
+        options.lineCount = 2000;
+        options.unitSuffixRatio = 0.1;
+        options.backsightRatio = 0.2;
+        options.commentRatio = 0.1;
+        options.mode = SrvGeneratorOptions::Mixed;
+        requireSameMessages(SrvGenerator(options).generateLines());
+    }
+}
@@ -0,0 +1,122 @@
+#include "catch.hpp"
+#include "../src/numberparsing.h"
+#include "../src/lineparser.h"
+#include <random>
+
+using namespace dewalls;
+
+namespace {
+
+double decimal(QString text, int* length = nullptr)
+{
+    int i = 0;
+    double value = -1;
+    bool parsed = parseUnsignedDecimal(text, i, &value);
+    if (length)
+    {
+        *length = parsed ? i : -1;
+    }
+    return value;
+}
+
+} // anonymous namespace
+
+TEST_CASE( "parseUnsignedDecimal matches unsignedDoubleLiteralRx", "[dewalls][numbers]" ) {
+    int length;
+    CHECK( decimal("12", &length) == 12.0 );
+    CHECK( length == 2 );
+    CHECK( decimal("12.", &length) == 12.0 );
+    CHECK( length == 3 );
+    CHECK( decimal(".5f", &length) == 0.5 );
+    CHECK( length == 2 );
+    CHECK( decimal("3.25.7", &length) == 3.25 );
+    CHECK( length == 4 );
+    CHECK( decimal("007.50", &length) == 7.5 );
+    CHECK( length == 6 );
+
+    decimal(".", &length);
+    CHECK( length == -1 );
+    decimal("-1", &length);
+    CHECK( length == -1 );
+    decimal("", &length);
+    CHECK( length == -1 );
+
+    int i = 2;
+    CHECK( parseUnsignedDecimal("A 4.5 B", i, nullptr) );
+    CHECK( i == 5 );
+}
+
+TEST_CASE( "parseUnsignedDecimal rounds like QString::toDouble", "[dewalls][numbers]" ) {
+    QStringList literals;
+    literals << "0.1" << "0.3" << "2.675" << "9007199254740993" << "123456789012345.6"
+             << "0.000000000000000000000001" << "1.7976931348623157" << "99999999999999999999"
+             << "179769313486231570000000000000000000000000000000000000000000000000000000000000000"
+                "000000000000000000000000000000000000000000000000000000000000000000000000000000000"
+                "000000000000000000000000000000000000000000000000000000000000000000000000000000000"
+                "000000000000000000000000000000000000000000000000000000000000000000000000000000000";
+
+    std::mt19937 random(1);
+    for (int k = 0; k < 100000; k++)
+    {
+        QString literal;
+        int whole = random() % 8;
+        int fraction = random() % 12;
+        for (int d = 0; d < whole; d++)
+        {
+            literal += QChar('0' + random() % 10);
+        }
+        if (fraction || !whole)
+        {
+            literal += '.';
+            for (int d = 0; d < qMax(fraction, 1); d++)
+            {
+                literal += QChar('0' + random() % 10);
+            }
+        }
+        literals << literal;
+    }
+
+    foreach (QString literal, literals)
+    {
+        INFO( literal.toStdString() );
+        int length;
+        CHECK( decimal(literal, &length) == literal.toDouble() );
+        CHECK( length == literal.length() );
+    }
+}
+
+TEST_CASE( "parseUnsignedInt matches unsignedIntLiteralRx", "[dewalls][numbers]" ) {
+    uint value;
+    int i = 0;
+    CHECK( parseUnsignedInt("0042x", i, value) );
+    CHECK( i == 4 );
+    CHECK( value == 42u );
+
+    i = 0;
+    CHECK( parseUnsignedInt("4294967295", i, value) );
+    CHECK( value == 4294967295u );
+
+    // too big for a uint, like QString::toUInt()
+    i = 0;
+    CHECK( parseUnsignedInt("4294967296", i, value) );
+    CHECK( i == 10 );
+    CHECK( value == 0u );
+
+    i = 0;
+    CHECK( !parseUnsignedInt("x1", i, value) );
+    CHECK( i == 0 );
+}
+
+TEST_CASE( "LineParser number literals", "[dewalls][numbers]" ) {
+    LineParser parser(Segment("12.5 -3 +7"));
+    CHECK( parser.unsignedDoubleLiteral() == 12.5 );
+    parser.whitespace();
+    CHECK( parser.intLiteral() == -3 );
+    parser.whitespace();
+    CHECK( parser.doubleLiteral() == 7.0 );
+    CHECK( parser.isAtEnd() );
+
+    LineParser invalid(Segment("x"));
+    CHECK_THROWS_AS( invalid.unsignedDoubleLiteral(), SegmentParseExpectedException );
+    CHECK_THROWS_AS( invalid.unsignedIntLiteral(), SegmentParseExpectedException );
+}
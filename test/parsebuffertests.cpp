@@ -0,0 +1,90 @@
+#include "catch.hpp"
+#include "../src/wallssurveyparser.h"
+
+using namespace dewalls;
+
+TEST_CASE( "parseBuffer parses whole files", "[dewalls]" ) {
+    WallsSurveyParser parser;
+    parser.setErrorRecovery(true);
+
+    QList<Vector> vectors;
+    QStringList comments;
+    QList<WallsMessage> messages;
+    QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector v) { vectors << v; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedComment, [&](QString c) { comments << c; });
+    QObject::connect(&parser, &WallsSurveyParser::message, [&](WallsMessage m) { messages << m; });
+
+    QByteArray data(";caf\xe9\r\n"
+                    "\r\n"
+                    "   \t\r\n"
+                    "#units feet\r\n"
+                    "A1 A2 10 20 30\r\n"
+                    "#[\r\n"
+                    "  inside\r\n"
+                    "#]\r\n"
+                    "A2 A3 10 20 x\r\n"
+                    "A3 A4 10 20 30 ;note");
+
+    CHECK( parser.parseBuffer(data, "test.srv") == 10 );
+
+    REQUIRE( vectors.size() == 2 );
+    CHECK( vectors[0].distance() == UnitizedDouble<Length>(10, Length::Feet) );
+    CHECK( vectors[1].from() == "A3" );
+
+    CHECK( comments == QStringList({QString::fromLatin1("caf\xe9"), "inside", "note"}) );
+
+    REQUIRE( messages.size() == 1 );
+    CHECK( messages[0].source() == "test.srv" );
+    CHECK( messages[0].startLine() == 8 );
+}
+
+TEST_CASE( "parseBuffer decodes UTF-8 files with a byte order mark", "[dewalls]" ) {
+    WallsSurveyParser parser;
+    QStringList comments;
+    QObject::connect(&parser, &WallsSurveyParser::parsedComment, [&](QString c) { comments << c; });
+
+    CHECK( parser.parseBuffer(QByteArray("\xef\xbb\xbf;caf\xc3\xa9\n"), "test.srv") == 1 );
+    CHECK( comments == QStringList({QString::fromUtf8("caf\xc3\xa9")}) );
+}
+
+TEST_CASE( "parseBuffer skips block comments when nobody wants comments", "[dewalls]" ) {
+    QByteArray data("A1 A2 10 20 30\r\n"
+                    "  #[\r\n");
+    for (int i = 0; i < 1000; i++)
+    {
+        data += "A2 A3 10 20 x #] ;disabled\r\n";
+    }
+    data += "\t#]\r\n"
+            "A3 A4 10 20 x\r\n"
+            "#[\n"
+            "#]\n"
+            "A4 A5 10 20 30\n"
+            "#[\n"
+            "A5 A6 10 20 x";
+
+    int lines[2];
+    QList<QPair<int, int>> results;
+    for (int withComments = 0; withComments < 2; withComments++)
+    {
+        WallsSurveyParser parser;
+        parser.setErrorRecovery(true);
+
+        int vectors = 0;
+        QList<WallsMessage> messages;
+        QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector) { vectors++; });
+        QObject::connect(&parser, &WallsSurveyParser::message, [&](WallsMessage m) { messages << m; });
+        if (withComments)
+        {
+            QObject::connect(&parser, &WallsSurveyParser::parsedComment, [&](QString) { });
+        }
+
+        lines[withComments] = parser.parseBuffer(data, "test.srv");
+        CHECK( vectors == 2 );
+        REQUIRE( messages.size() == 1 );
+        results << qMakePair(messages[0].startLine(), messages[0].startColumn());
+    }
+    CHECK( lines[0] == 1009 );
+    CHECK( lines[1] == lines[0] );
+    CHECK( results[0].first == 1003 );
+    CHECK( results[1] == results[0] );
+}
@@ -0,0 +1,109 @@
+#include "catch.hpp"
+#include "../src/passagemesh.h"
+
+using namespace dewalls;
+
+namespace {
+
+PassageShot shot(QString from, QString to, double fx, double fy, double tx, double ty)
+{
+    PassageShot result;
+    result.fromName = from;
+    result.toName = to;
+    result.from[0] = fx;
+    result.from[1] = fy;
+    result.from[2] = 0;
+    result.to[0] = tx;
+    result.to[1] = ty;
+    result.to[2] = 0;
+    result.left = 1;
+    result.right = 2;
+    result.up = 3;
+    result.down = 4;
+    return result;
+}
+
+}
+
+TEST_CASE( "PassageMeshBuilder groups connected shots into passages", "[PassageMesh]" ) {
+    QVector<PassageShot> shots;
+    shots << shot("A1", "A2", 0, 0, 0, 10)
+          << shot("A2", "A3", 0, 10, 10, 10)
+          << shot("B1", "B2", 50, 0, 50, 10);
+
+    PassageShot lrudOnly = shot("B2", "", 50, 10, 50, 10);
+    shots << lrudOnly;
+
+    PassageMeshBuilder builder(shots);
+    CHECK( builder.passageCount() == 2 );
+    CHECK( builder.vertexBufferSize() == (3 + 2) * 4 * 3 );
+    CHECK( builder.indexBufferSize() == (2 + 1) * 24 + 2 * 12 );
+
+    PassageMesh mesh = builder.build();
+    CHECK( mesh.vertexCount() == 20 );
+    CHECK( mesh.triangleCount() == builder.indexBufferSize() / 3 );
+    for (quint32 index : mesh.indices)
+    {
+        CHECK( index < quint32(mesh.vertexCount()) );
+    }
+}
+
+TEST_CASE( "PassageMeshBuilder orients cross sections", "[PassageMesh]" ) {
+    QVector<PassageShot> shots;
+    shots << shot("A1", "A2", 0, 0, 0, 10);
+
+    SECTION( "perpendicular to the shot" ) {
+        PassageMesh mesh = PassageMeshBuilder(shots).build();
+        // facing north, the left point is 1 m west and the right point 2 m east
+        CHECK( mesh.vertices[0] == Approx(-1) );
+        CHECK( mesh.vertices[1] == Approx(0) );
+        CHECK( mesh.vertices[5] == Approx(3) );
+        CHECK( mesh.vertices[6] == Approx(2) );
+        CHECK( mesh.vertices[11] == Approx(-4) );
+        // no LRUDs were measured at A2
+        CHECK( mesh.vertices[12] == Approx(0) );
+        CHECK( mesh.vertices[13] == Approx(10) );
+    }
+
+    SECTION( "at the to station" ) {
+        shots[0].lrudType = LrudType::To;
+        PassageMesh mesh = PassageMeshBuilder(shots).build();
+        CHECK( mesh.vertices[0] == Approx(0) );
+        CHECK( mesh.vertices[12] == Approx(-1) );
+        CHECK( mesh.vertices[13] == Approx(10) );
+    }
+
+    SECTION( "facing a given azimuth" ) {
+        shots[0].facingAzimuth = 90;
+        PassageMesh mesh = PassageMeshBuilder(shots).build();
+        // facing east, the left point is 1 m north
+        CHECK( mesh.vertices[0] == Approx(0).margin(1e-6) );
+        CHECK( mesh.vertices[1] == Approx(1) );
+    }
+
+    SECTION( "relative to an origin" ) {
+        PassageMeshBuilder builder(shots);
+        builder.setOrigin(100, 200, 300);
+        PassageMesh mesh = builder.build();
+        CHECK( mesh.vertices[0] == Approx(-101) );
+        CHECK( mesh.vertices[1] == Approx(-200) );
+        CHECK( mesh.vertices[2] == Approx(-300) );
+    }
+}
+
+TEST_CASE( "PassageMeshBuilder builds into caller buffers", "[PassageMesh]" ) {
+    QVector<PassageShot> shots;
+    shots << shot("A1", "A2", 0, 0, 0, 10);
+
+    PassageMeshBuilder builder(shots);
+    QVector<float> vertices(builder.vertexBufferSize());
+    QVector<quint32> indices(builder.indexBufferSize());
+    builder.build(vertices.data(), indices.data(), 100);
+
+    PassageMesh mesh = builder.build();
+    CHECK( vertices == mesh.vertices );
+    for (int i = 0; i < indices.size(); i++)
+    {
+        CHECK( indices[i] == mesh.indices[i] + 100 );
+    }
+}
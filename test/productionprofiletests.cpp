@@ -0,0 +1,61 @@
+#include "catch.hpp"
+#include "../src/wallssurveyparser.h"
+#include "../src/productionprofile.h"
+
+using namespace dewalls;
+
+TEST_CASE( "production ids are stable and merged by id", "[ProductionProfile]" ) {
+    int id = ProductionProfile::productionId("testProduction");
+    CHECK( ProductionProfile::productionId("testProduction") == id );
+    CHECK( ProductionProfile::productionName(id) == "testProduction" );
+    CHECK( ProductionProfile::productionCount() > id );
+
+    ProductionProfile a;
+    a.at(id).entered = 3;
+    a.at(id).succeeded = 2;
+    a.at(id).backtracks = 1;
+    a.at(id).nanos = 100;
+
+    ProductionProfile b;
+    b.at(id).entered = 1;
+    b.at(id).succeeded = 1;
+    b.merge(a);
+
+    CHECK( b.stats(id).entered == 4 );
+    CHECK( b.stats(id).succeeded == 3 );
+    CHECK( b.stats(id).failed() == 1 );
+    CHECK( b.stats("testProduction").backtracks == 1 );
+    CHECK( b.stats("noSuchProduction").entered == 0 );
+    CHECK( b.report().contains("testProduction") );
+
+    b.clear();
+    CHECK( b.isEmpty() );
+}
+
+TEST_CASE( "parsers record production counters when profiling is compiled in", "[ProductionProfile]" ) {
+    ProductionProfile profile;
+    WallsSurveyParser parser;
+    parser.setProductionProfile(&profile);
+    // the fast path decodes plain vector lines without entering vectorLine
+    parser.setFastPathEnabled(false);
+
+    parser.parseLine("A1 A2 10 20 30 *1 2 3 4*");
+    parser.parseLine("#units feet");
+    parser.parseLine("A2 A3 10 20 30");
+    CHECK_THROWS( parser.parseLine("A3 A4 10 20 +") );
+
+    if (!ProductionProfile::isCompiledIn())
+    {
+        CHECK( profile.isEmpty() );
+        return;
+    }
+
+    CHECK( profile.stats("line").entered == 4 );
+    CHECK( profile.stats("line").succeeded == 3 );
+    CHECK( profile.stats("vectorLine").entered == 3 );
+    CHECK( profile.stats("vectorLine").succeeded == 2 );
+    CHECK( profile.stats("vectorLine").backtracks == 1 );
+    CHECK( profile.stats("lruds").succeeded == 1 );
+    CHECK( profile.stats("unitsOption").succeeded == 1 );
+    CHECK( profile.stats("directiveLine").entered == 1 );
+}
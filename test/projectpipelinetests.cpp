@@ -0,0 +1,113 @@
+#include "catch.hpp"
+#include "../src/projectpipeline.h"
+#include "testhelpers.h"
+#include <QTemporaryDir>
+
+using namespace dewalls;
+
+TEST_CASE( "ProjectPipeline parses every survey of a project", "[ProjectPipeline]" ) {
+    QTemporaryDir dir;
+    REQUIRE( dir.isValid() );
+
+    const int surveyCount = 20;
+    QString wpj = ".BOOK Cave\r\n.NAME CAVE\r\n.STATUS 8\r\n.OPTIONS feet\r\n";
+    for (int i = 0; i < surveyCount; i++) {
+        QString name = QString("S%1").arg(i);
+        wpj += QString(".SURVEY %1\r\n.NAME %1\r\n").arg(name);
+        QString srv;
+        for (int k = 0; k <= i; k++) {
+            srv += QString("A%1 A%2 10 20 30\r\n").arg(k).arg(k + 1);
+        }
+        if (i == 3) {
+            srv += "A1 A2 10 20 x\r\n";
+        }
+        writeFile(dir.filePath(name + ".SRV"), srv);
+    }
+    wpj += ".SURVEY Missing\r\n.NAME MISSING\r\n.ENDBOOK\r\n";
+    writeFile(dir.filePath("cave.wpj"), wpj);
+
+    ProjectPipeline pipeline;
+    pipeline.setParseThreadCount(3);
+    // make every stage block on the next one
+    pipeline.setQueueCapacity(1);
+
+    QList<ParsedSurvey> results;
+    pipeline.setReducer([&](ParsedSurvey& survey) { results << survey; });
+
+    REQUIRE( pipeline.run(dir.filePath("cave.wpj")) );
+    CHECK( pipeline.projectErrorCount() == 0 );
+    CHECK( pipeline.surveyCount() == surveyCount + 1 );
+    REQUIRE( results.size() == surveyCount + 1 );
+
+    QVector<bool> seen(surveyCount + 1, false);
+    foreach (const ParsedSurvey& survey, results) {
+        REQUIRE( survey.index >= 0 );
+        REQUIRE( survey.index <= surveyCount );
+        CHECK( !seen[survey.index] );
+        seen[survey.index] = true;
+
+        if (survey.index == surveyCount) {
+            CHECK( !survey.opened );
+            CHECK( survey.errors == 1 );
+            continue;
+        }
+        CHECK( survey.opened );
+        CHECK( survey.entry.Entry->Title == QString("S%1").arg(survey.index) );
+        REQUIRE( survey.vectors.size() == survey.index + 1 );
+        CHECK( survey.vectors[0].distance() == UnitizedDouble<Length>(10, Length::Feet) );
+        CHECK( survey.vectors[0].segment() == QStringList("CAVE") );
+        CHECK( survey.errors == (survey.index == 3 ? 1 : 0) );
+    }
+
+    const QList<PipelineStageStats>& stages = pipeline.stageStats();
+    REQUIRE( stages.size() == 4 );
+    CHECK( stages[0].name == "resolve" );
+    CHECK( stages[2].name == "parse" );
+    CHECK( stages[2].threads == 3 );
+    foreach (const PipelineStageStats& stage, stages) {
+        CHECK( stage.items == surveyCount + 1 );
+    }
+}
+
+TEST_CASE( "ProjectPipeline parses standalone survey files", "[ProjectPipeline]" ) {
+    QTemporaryDir dir;
+    REQUIRE( dir.isValid() );
+    writeFile(dir.filePath("a.srv"), "A1 A2 10 20 30\r\n");
+    writeFile(dir.filePath("b.srv"), "B1 B2 10 20 30\r\nB2 B3 10 20 30\r\n");
+
+    ProjectPipeline pipeline;
+    int shots = 0;
+    pipeline.setReducer([&](ParsedSurvey& survey) { shots += survey.vectors.size(); });
+    pipeline.run(QStringList() << dir.filePath("a.srv") << dir.filePath("b.srv"));
+
+    CHECK( pipeline.surveyCount() == 2 );
+    CHECK( shots == 3 );
+
+    CHECK( !pipeline.run(dir.filePath("nonexistent.wpj")) );
+    CHECK( pipeline.projectErrorCount() == 1 );
+}
+
+TEST_CASE( "ProjectPipeline lint mode keeps the event mask", "[ProjectPipeline]" ) {
+    QTemporaryDir dir;
+    REQUIRE( dir.isValid() );
+    writeFile(dir.filePath("a.srv"), "#note A1 /entrance\r\nA1 A2 10 20 30\r\n");
+
+    ProjectPipeline pipeline;
+    int shots = 0;
+    int notes = 0;
+    pipeline.setReducer([&](ParsedSurvey& survey) {
+        shots += survey.vectors.size();
+        notes += survey.notes.size();
+    });
+    pipeline.setEvents(WallsSurveyParser::VectorEvents);
+
+    pipeline.setLintMode(true);
+    pipeline.run(QStringList() << dir.filePath("a.srv"));
+    CHECK( shots == 0 );
+
+    pipeline.setLintMode(false);
+    CHECK( pipeline.events() == WallsSurveyParser::VectorEvents );
+    pipeline.run(QStringList() << dir.filePath("a.srv"));
+    CHECK( shots == 1 );
+    CHECK( notes == 0 );
+}
@@ -0,0 +1,140 @@
+#include "catch.hpp"
+#include "../src/projectsession.h"
+#include "testhelpers.h"
+#include <QCoreApplication>
+#include <QTemporaryDir>
+
+using namespace dewalls;
+
+TEST_CASE( "ProjectSession reparses only changed surveys", "[ProjectSession]" ) {
+    // the file system watcher and settle timer need an application object
+    int argc = 1;
+    char arg0[] = "dewalls-test";
+    char* argv[] = {arg0, nullptr};
+    QScopedPointer<QCoreApplication> app;
+    if (!QCoreApplication::instance()) {
+        app.reset(new QCoreApplication(argc, argv));
+    }
+
+    QTemporaryDir dir;
+    REQUIRE( dir.isValid() );
+    writeFile(dir.filePath("a.srv"), "A1 A2 10 20 30\r\nA2 A3 10 20 30\r\n");
+    writeFile(dir.filePath("b.srv"), "B1 B2 10 20 30\r\n#fix B1 1 2 3\r\n");
+    writeFile(dir.filePath("cave.wpj"),
+              ".BOOK Cave\r\n"
+              ".SURVEY A\r\n.NAME A\r\n"
+              ".SURVEY B\r\n.NAME B\r\n"
+              ".ENDBOOK\r\n");
+
+    ProjectSession session;
+    int added = 0;
+    int removed = 0;
+    int changed = 0;
+    QList<ProjectDelta> deltas;
+    QObject::connect(&session, &ProjectSession::addedVector, [&](Vector) { added++; });
+    QObject::connect(&session, &ProjectSession::removedVector, [&](Vector) { removed++; });
+    QObject::connect(&session, &ProjectSession::changedVector, [&](Vector, Vector) { changed++; });
+    QObject::connect(&session, &ProjectSession::updated, [&](ProjectDelta delta) { deltas << delta; });
+
+    REQUIRE( session.open(dir.filePath("cave.wpj")) );
+    REQUIRE( session.surveyFiles().size() == 2 );
+    QString a = session.surveyFiles()[0];
+    QString b = session.surveyFiles()[1];
+    CHECK( added == 3 );
+    REQUIRE( deltas.size() == 1 );
+    REQUIRE( deltas[0].surveys.size() == 2 );
+    CHECK( deltas[0].surveys[1].addedFixStations.size() == 1 );
+
+    SECTION( "editing a survey reports only its changed shots" ) {
+        added = 0;
+        writeFile(a, "; new comment line\r\nA1 A2 10 20 30\r\nA2 A3 15 20 30\r\nA3 A4 10 20 30\r\n");
+        session.markChanged(a);
+        ProjectDelta delta = session.update();
+
+        REQUIRE( delta.surveys.size() == 1 );
+        CHECK( delta.surveys[0].fileName == a );
+        CHECK( added == 1 );
+        CHECK( removed == 0 );
+        REQUIRE( changed == 1 );
+        REQUIRE( delta.surveys[0].changedVectors.size() == 1 );
+        CHECK( delta.surveys[0].changedVectors[0].second.distance() == UnitizedDouble<Length>(15, Length::Meters) );
+        CHECK( session.vectors(a).size() == 3 );
+        CHECK( session.vectors(b).size() == 1 );
+    }
+
+    SECTION( "changing the units of unchanged shots reports them as changed" ) {
+        writeFile(a, "#units decl=2\r\nA1 A2 10 20 30\r\nA2 A3 10 20 30\r\n");
+        session.markChanged(a);
+        ProjectDelta delta = session.update();
+
+        REQUIRE( delta.surveys.size() == 1 );
+        CHECK( delta.surveys[0].changedVectors.size() == 2 );
+        CHECK( changed == 2 );
+        CHECK( added == 3 );
+        CHECK( removed == 0 );
+    }
+
+    SECTION( "changing the prefix renames the shots" ) {
+        writeFile(a, "#prefix Z\r\nA1 A2 10 20 30\r\nA2 A3 10 20 30\r\n");
+        session.markChanged(a);
+        ProjectDelta delta = session.update();
+
+        REQUIRE( delta.surveys.size() == 1 );
+        CHECK( delta.surveys[0].changedVectors.isEmpty() );
+        CHECK( delta.surveys[0].removedVectors.size() == 2 );
+        CHECK( delta.surveys[0].addedVectors.size() == 2 );
+    }
+
+    SECTION( "moving a fixed station reports it as changed" ) {
+        int changedFixes = 0;
+        QObject::connect(&session, &ProjectSession::changedFixStation, [&](FixStation, FixStation) { changedFixes++; });
+        writeFile(b, "B1 B2 10 20 30\r\n#fix B1 1 2 4\r\n");
+        session.markChanged(b);
+        ProjectDelta delta = session.update();
+
+        REQUIRE( delta.surveys.size() == 1 );
+        CHECK( delta.surveys[0].addedFixStations.isEmpty() );
+        CHECK( delta.surveys[0].removedFixStations.isEmpty() );
+        REQUIRE( delta.surveys[0].changedFixStations.size() == 1 );
+        CHECK( delta.surveys[0].changedFixStations[0].first.name() == "B1" );
+        CHECK( delta.surveys[0].changedFixStations[0].second.rectUp() == UnitizedDouble<Length>(4, Length::Meters) );
+        CHECK( changedFixes == 1 );
+        CHECK( changed == 0 );
+    }
+
+    SECTION( "touching a survey without changing it reports nothing" ) {
+        deltas.clear();
+        session.markChanged(b);
+        CHECK( session.update().isEmpty() );
+        CHECK( deltas.isEmpty() );
+    }
+
+    SECTION( "changing inherited options reparses the affected surveys" ) {
+        writeFile(dir.filePath("cave.wpj"),
+                  ".BOOK Cave\r\n"
+                  ".SURVEY A\r\n.NAME A\r\n.OPTIONS feet\r\n"
+                  ".SURVEY B\r\n.NAME B\r\n"
+                  ".ENDBOOK\r\n");
+        session.markChanged(dir.filePath("cave.wpj"));
+        ProjectDelta delta = session.update();
+
+        REQUIRE( delta.surveys.size() == 1 );
+        CHECK( delta.surveys[0].fileName == a );
+        CHECK( delta.surveys[0].changedVectors.size() == 2 );
+    }
+
+    SECTION( "removing a survey from the project removes its data" ) {
+        writeFile(dir.filePath("cave.wpj"),
+                  ".BOOK Cave\r\n"
+                  ".SURVEY A\r\n.NAME A\r\n"
+                  ".ENDBOOK\r\n");
+        session.markChanged(dir.filePath("cave.wpj"));
+        ProjectDelta delta = session.update();
+
+        REQUIRE( delta.surveys.size() == 1 );
+        CHECK( delta.surveys[0].fileName == b );
+        CHECK( delta.surveys[0].removedVectors.size() == 1 );
+        CHECK( delta.surveys[0].removedFixStations.size() == 1 );
+        CHECK( session.surveyFiles() == QStringList(a) );
+    }
+}
@@ -0,0 +1,127 @@
+#include "catch.hpp"
+#include "../src/spatialindex.h"
+#include <cmath>
+
+using namespace dewalls;
+
+namespace {
+
+// a deterministic random walk of stations connected by shots
+void randomWalk(int stationCount, QVector<double>& positions, QVector<int>& shotStations)
+{
+    quint32 seed = 12345;
+    auto random = [&]() {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 8) / double(1 << 24) - 0.5;
+    };
+
+    double position[3] = {0, 0, 0};
+    for (int i = 0; i < stationCount; i++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            position[axis] += random() * 10;
+            positions << position[axis];
+        }
+        if (i > 0)
+        {
+            shotStations << i - 1 << i;
+        }
+    }
+}
+
+double distanceSquared(const double* a, const double* b)
+{
+    double result = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        result += (a[axis] - b[axis]) * (a[axis] - b[axis]);
+    }
+    return result;
+}
+
+}
+
+TEST_CASE( "BoundingBox", "[SpatialIndex]" ) {
+    BoundingBox box(0, 0, 0, 10, 10, 10);
+
+    double a[3] = {-5, 5, 5};
+    double b[3] = {15, 5, 5};
+    double c[3] = {-5, 15, 5};
+    CHECK( box.intersectsSegment(a, b) );
+    CHECK( !box.intersectsSegment(a, c) );
+    CHECK( box.distanceSquared(a) == 25 );
+    CHECK( box.distanceSquared(c) == 50 );
+
+    CHECK( BoundingBox().isEmpty() );
+    CHECK( !box.isEmpty() );
+}
+
+TEST_CASE( "SpatialIndex queries match linear scans", "[SpatialIndex]" ) {
+    const int stationCount = 2000;
+    QVector<double> positions;
+    QVector<int> shotStations;
+    randomWalk(stationCount, positions, shotStations);
+
+    SpatialIndex index;
+    index.build(positions, shotStations);
+    REQUIRE( index.stationCount() == stationCount );
+    REQUIRE( index.shotCount() == stationCount - 1 );
+
+    for (double x = -60; x <= 60; x += 30)
+    {
+        for (double y = -60; y <= 60; y += 30)
+        {
+            double point[3] = {x, y, x - y};
+
+            double nearestDistance = INFINITY;
+            for (int i = 0; i < stationCount; i++)
+            {
+                nearestDistance = std::min(nearestDistance, distanceSquared(positions.constData() + i * 3, point));
+            }
+            double distance;
+            int station = index.nearestStation(point, INFINITY, &distance);
+            REQUIRE( station >= 0 );
+            CHECK( distance == Approx(sqrt(nearestDistance)) );
+            CHECK( distanceSquared(index.stationPosition(station), point) == Approx(nearestDistance) );
+
+            BoundingBox box(x, y, x - y, x + 20, y + 20, x - y + 20);
+            int stationsInBox = 0;
+            for (int i = 0; i < stationCount; i++)
+            {
+                if (box.contains(positions.constData() + i * 3)) stationsInBox++;
+            }
+            CHECK( index.stationsInBox(box).size() == stationsInBox );
+
+            int shotsInBox = 0;
+            for (int i = 0; i < index.shotCount(); i++)
+            {
+                if (box.intersectsSegment(positions.constData() + i * 3, positions.constData() + i * 3 + 3)) shotsInBox++;
+            }
+            CHECK( index.shotsInBox(box).size() == shotsInBox );
+        }
+    }
+}
+
+TEST_CASE( "SpatialIndex finds the nearest shot", "[SpatialIndex]" ) {
+    QVector<double> positions;
+    positions << 0 << 0 << 0
+              << 10 << 0 << 0
+              << 10 << 10 << 0;
+    QVector<int> shotStations;
+    shotStations << 0 << 1 << 1 << 2;
+
+    SpatialIndex index;
+    index.build(positions, shotStations);
+
+    double point[3] = {5, 2, 0};
+    double distance;
+    CHECK( index.nearestShot(point, INFINITY, &distance) == 0 );
+    CHECK( distance == Approx(2) );
+
+    double far[3] = {5, 5, 100};
+    CHECK( index.nearestShot(far, 10) == -1 );
+    CHECK( index.nearestStation(far, 10) == -1 );
+
+    CHECK( SpatialIndex().nearestStation(point) == -1 );
+}
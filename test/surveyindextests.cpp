@@ -0,0 +1,83 @@
+#include "catch.hpp"
+#include "../src/surveyindex.h"
+#include "../src/wallssurveyparser.h"
+
+using namespace dewalls;
+
+TEST_CASE( "SurveyIndex answers station, segment, date, flag and note queries", "[SurveyIndex]" ) {
+    WallsSurveyParser parser;
+    SurveyIndex index;
+    index.attach(&parser);
+
+    parser.parseLine("#date 1997-06-01");
+    parser.parseLine("#segment /Upper");
+    parser.parseLine("A1 A2 10 20 30");
+    parser.parseLine("#date 1999-03-04");
+    parser.parseLine("#segment /Upper/East");
+    parser.parseLine("A2 A3 10 20 30");
+    parser.parseLine("#segment /Upper/Eastern");
+    parser.parseLine("A3 A4 10 20 30");
+    parser.parseLine("#date 2003-12-31");
+    parser.parseLine("#segment /Upper/East/Pit");
+    parser.parseLine("#flag /ENTRANCE");
+    parser.parseLine("A4 A12 10 20 30");
+    parser.parseLine("#flag");
+    parser.parseLine("#date 2004-01-01");
+    parser.parseLine("#segment /Lower");
+    parser.parseLine("A12 A13 10 20 30");
+    parser.parseLine("#flag B1 B2 /ENTRANCE");
+    parser.parseLine("#note A13 tight squeeze");
+
+    REQUIRE( index.shotCount() == 5 );
+
+    CHECK( index.shotsAt("A12") == QVector<int>({3, 4}) );
+    CHECK( index.shotsAt("A1") == QVector<int>({0}) );
+    CHECK( index.shotsAt("Z9").isEmpty() );
+    CHECK( index.shot(4).from() == "A12" );
+
+    CHECK( index.shotsInSegment("/Upper/East") == QVector<int>({1, 3}) );
+    CHECK( index.shotsInSegment(QStringList() << "Upper") == QVector<int>({0, 1, 3, 2}) );
+    CHECK( index.shotsInSegment("/Lower") == QVector<int>({4}) );
+    CHECK( index.shotsInSegment("/").size() == 5 );
+    CHECK( index.shotsInSegment("/Middle").isEmpty() );
+
+    CHECK( index.shotsBetween(QDate(1998, 1, 1), QDate(2003, 12, 31)) == QVector<int>({1, 2, 3}) );
+    CHECK( index.shotsBetween(QDate(2004, 1, 1), QDate(2004, 1, 1)) == QVector<int>({4}) );
+    CHECK( index.shotsBetween(QDate(2005, 1, 1), QDate(2000, 1, 1)).isEmpty() );
+
+    CHECK( index.stationsWithFlag("/ENTRANCE") == QStringList({"A12", "A4", "B1", "B2"}) );
+    CHECK( index.flags("B1") == QStringList("ENTRANCE") );
+    CHECK( index.notes("A13") == QStringList("tight squeeze") );
+    CHECK( index.stationsWithNotes() == QStringList("A13") );
+
+    // adding more shots invalidates the sorted lists
+    parser.parseLine("#segment /Upper/East");
+    parser.parseLine("A13 A14 10 20 30");
+    CHECK( index.shotsInSegment("/Upper/East") == QVector<int>({1, 5, 3}) );
+
+    index.clear();
+    CHECK( index.shotCount() == 0 );
+    CHECK( index.shotsInSegment("/Upper").isEmpty() );
+}
+
+TEST_CASE( "SurveyIndex keeps stations under different prefixes apart", "[SurveyIndex]" ) {
+    WallsSurveyParser parser;
+    SurveyIndex index;
+    index.attach(&parser);
+
+    parser.parseLine("A1 A2 10 20 30");
+    parser.parseLine("#prefix EAST");
+    parser.parseLine("A1 A2 10 20 30");
+    parser.parseLine("A2 WEST:A1 10 20 30");
+    parser.parseLine("#flag A2 /JUNCTION");
+    parser.parseLine("#note A1 survey station");
+
+    REQUIRE( index.shotCount() == 3 );
+    CHECK( index.shotsAt("A1") == QVector<int>({0}) );
+    CHECK( index.shotsAt("EAST:A1") == QVector<int>({1}) );
+    CHECK( index.shotsAt("EAST:A2") == QVector<int>({1, 2}) );
+    CHECK( index.shotsAt("WEST:A1") == QVector<int>({2}) );
+    CHECK( index.stationsWithFlag("JUNCTION") == QStringList("EAST:A2") );
+    CHECK( index.notes("EAST:A1") == QStringList("survey station") );
+    CHECK( index.notes("A1").isEmpty() );
+}
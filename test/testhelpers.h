@@ -0,0 +1,77 @@
+#ifndef TESTHELPERS_H
+#define TESTHELPERS_H
+
+#include "catch.hpp"
+#include "../src/vector.h"
+#include "../src/fixstation.h"
+#include "../src/wallsmessage.h"
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+namespace dewalls {
+
+inline void writeFile(QString fileName, QString contents)
+{
+    QFile file(fileName);
+    REQUIRE( file.open(QFile::WriteOnly | QFile::Truncate) );
+    QTextStream out(&file);
+    out << contents;
+}
+
+template<class T>
+inline QString describe(UnitizedDouble<T> value)
+{
+    if (!value.isValid())
+    {
+        return "-";
+    }
+    return QString("%1u%2").arg(value.get(value.unit()), 0, 'g', 17).arg(int(value.unit()));
+}
+
+inline QString describe(const Vector& vector)
+{
+    QStringList parts;
+    parts << vector.from() << vector.to()
+          << describe(vector.distance())
+          << describe(vector.frontAzimuth()) << describe(vector.backAzimuth())
+          << describe(vector.frontInclination()) << describe(vector.backInclination())
+          << describe(vector.instHeight()) << describe(vector.targetHeight())
+          << describe(vector.north()) << describe(vector.east()) << describe(vector.rectUp())
+          << QString::number(!vector.horizVariance().isNull())
+          << QString::number(!vector.vertVariance().isNull())
+          << describe(vector.left()) << describe(vector.right())
+          << describe(vector.up()) << describe(vector.down())
+          << describe(vector.lrudAngle()) << QString::number(vector.cFlag())
+          << vector.segment().join('/') << vector.comment()
+          << vector.date().toString(Qt::ISODate)
+          << describe(vector.units().decl()) << vector.units().flag()
+          << vector.sourceSegment().value()
+          << QString::number(vector.sourceSegment().startLine());
+    return "vector " + parts.join('|');
+}
+
+inline QString describe(FixStation fix)
+{
+    QStringList parts;
+    parts << fix.name()
+          << describe(fix.east()) << describe(fix.north()) << describe(fix.rectUp())
+          << describe(fix.latitude()) << describe(fix.longitude())
+          << QString::number(!fix.horizVariance().isNull())
+          << QString::number(!fix.vertVariance().isNull())
+          << fix.note() << fix.segment().join('/') << fix.comment()
+          << fix.date().toString(Qt::ISODate)
+          << describe(fix.units().decl()) << fix.units().prefix().join(':');
+    return "fix " + parts.join('|');
+}
+
+inline QString describe(const WallsMessage& message)
+{
+    return QString("%1 %2 %3:%4-%5")
+            .arg(message.severity(), message.message())
+            .arg(message.startLine()).arg(message.startColumn()).arg(message.endColumn());
+}
+
+}
+
+#endif // TESTHELPERS_H
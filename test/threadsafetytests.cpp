@@ -0,0 +1,117 @@
+#include "catch.hpp"
+#include "../src/wallssurveyparser.h"
+#include "../bench/srvgenerator.h"
+#include <QTextStream>
+#include <QThread>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace dewalls;
+
+namespace {
+
+template<class T>
+QString measurement(UnitizedDouble<T> value, typename T::Unit unit)
+{
+    return value.isValid() ? QString::number(value.get(unit), 'g', 17) : QString("--");
+}
+
+///
+/// \return everything the parser produced from the given file, as one string
+///
+QString summarize(const QByteArray& data, int variant)
+{
+    WallsSurveyParser parser;
+    parser.setErrorRecovery(true);
+    parser.setFastPathEnabled(variant % 2 == 0);
+
+    QString result;
+    QTextStream out(&result);
+    QObject::connect(&parser, &WallsSurveyParser::message, [&](WallsMessage message) {
+        out << message.severity() << ' ' << message.message() << ' ' << message.startLine()
+            << ':' << message.startColumn() << '\n';
+    });
+    QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector v) {
+        out << v.from() << ' ' << v.to() << ' ' << measurement(v.distance(), Length::Meters) << ' '
+            << measurement(v.frontAzimuth(), Angle::Degrees) << ' '
+            << measurement(v.frontInclination(), Angle::Degrees) << ' '
+            << measurement(v.north(), Length::Meters) << ' ' << measurement(v.left(), Length::Meters) << ' '
+            << v.comment() << '\n';
+    });
+    QObject::connect(&parser, &WallsSurveyParser::parsedComment, [&](QString comment) {
+        out << ';' << comment << '\n';
+    });
+    QObject::connect(&parser, &WallsSurveyParser::parsedUnits, [&]() {
+        out << "#units " << int(parser.units().vectorType()) << '\n';
+    });
+
+    parser.parseBuffer(data, "test.srv");
+    out.flush();
+    return result;
+}
+
+} // anonymous namespace
+
+TEST_CASE( "separate parsers can parse on separate threads at once", "[dewalls][threads]" ) {
+    // build with the threadSanitizer project property to have data races reported
+    QList<QByteArray> files;
+    for (int f = 0; f < 4; f++)
+    {
+        SrvGeneratorOptions options;
+        options.seed = quint32(f + 1);
+        options.lineCount = 1500;
+        options.unitSuffixRatio = 0.2;
+        options.backsightRatio = 0.3;
+        options.commentRatio = 0.1;
+        options.unitsRatio = 0.02;
+        options.macros = f % 2 == 1;
+        options.mode = SrvGeneratorOptions::Mixed;
+        QByteArray data = SrvGenerator(options).generate();
+        // something for the error messages to report
+        data += "A1 A2 10 20 x\r\n#units order=nonsense\r\n";
+        files << data;
+    }
+
+    QStringList expected;
+    for (int f = 0; f < files.size(); f++)
+    {
+        expected << summarize(files[f], 0);
+    }
+
+    const int threadCount = qMax(4, QThread::idealThreadCount());
+    const int runsPerThread = 4;
+    std::vector<QStringList> results(threadCount);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&, t]() {
+            // start together so that the new parsers copy the shared patterns at the same time
+            while (!go.load())
+            {
+                std::this_thread::yield();
+            }
+            for (int r = 0; r < runsPerThread; r++)
+            {
+                int f = (t + r) % files.size();
+                results[t] << summarize(files[f], t + r);
+            }
+        });
+    }
+    go = true;
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (int t = 0; t < threadCount; t++)
+    {
+        REQUIRE( results[t].size() == runsPerThread );
+        for (int r = 0; r < runsPerThread; r++)
+        {
+            int f = (t + r) % files.size();
+            CHECK( results[t][r] == expected[f] );
+        }
+    }
+}
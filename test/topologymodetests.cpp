@@ -0,0 +1,116 @@
+#include "catch.hpp"
+#include "../src/wallssurveyparser.h"
+#include "../bench/srvgenerator.h"
+#include "testhelpers.h"
+
+using namespace dewalls;
+
+namespace {
+
+QVector<Vector> parse(const QStringList& lines, bool topology)
+{
+    WallsSurveyParser parser;
+    parser.setErrorRecovery(true);
+    parser.setTopologyMode(topology);
+    QVector<Vector> vectors;
+    QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector v) { vectors << v; });
+    for (int i = 0; i < lines.size(); i++)
+    {
+        parser.parseLine(Segment(lines[i], "test.srv", i, 0));
+    }
+    return vectors;
+}
+
+} // anonymous namespace
+
+TEST_CASE( "topology mode records measurements without decoding them", "[dewalls][topology]" ) {
+    WallsSurveyParser parser;
+    parser.setErrorRecovery(true);
+    parser.setTopologyMode(true);
+    QList<Vector> vectors;
+    QStringList comments;
+    QList<WallsMessage> messages;
+    QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector v) { vectors << v; });
+    QObject::connect(&parser, &WallsSurveyParser::parsedComment, [&](QString c) { comments << c; });
+    QObject::connect(&parser, &WallsSurveyParser::message, [&](WallsMessage m) { messages << m; });
+
+    SECTION( "plain lines" ) {
+        parser.parseLine("A1 A2 10 20 30 *1,2,3,4* ;first");
+        REQUIRE( vectors.size() == 1 );
+        CHECK( vectors[0].from() == "A1" );
+        CHECK( vectors[0].to() == "A2" );
+        CHECK( vectors[0].hasRawMeasurements() );
+        CHECK( vectors[0].rawMeasurements().value() == "10 20 30 *1,2,3,4*" );
+        CHECK( !vectors[0].distance().isValid() );
+        CHECK( comments == QStringList("first") );
+
+        REQUIRE( parser.decodeMeasurements(vectors[0]) );
+        CHECK( !vectors[0].hasRawMeasurements() );
+        CHECK( vectors[0].distance() == UnitizedDouble<Length>(10, Length::Meters) );
+        CHECK( vectors[0].frontAzimuth() == UnitizedDouble<Angle>(20, Angle::Degrees) );
+        CHECK( vectors[0].down() == UnitizedDouble<Length>(4, Length::Meters) );
+        // the comment isn't parsed again
+        CHECK( comments.size() == 1 );
+    }
+
+    SECTION( "inline segment directives" ) {
+        QString line("A1 A2 10 20 30#s /upper;comment");
+        parser.parseLine(line);
+        REQUIRE( vectors.size() == 1 );
+        CHECK( vectors[0].rawMeasurements().value() == "10 20 30" );
+        CHECK( comments == QStringList("comment") );
+
+        WallsSurveyParser fullParser;
+        QList<Vector> fullVectors;
+        QObject::connect(&fullParser, &WallsSurveyParser::parsedVector, [&](Vector v) { fullVectors << v; });
+        fullParser.parseLine(line);
+        REQUIRE( fullVectors.size() == 1 );
+        CHECK( vectors[0].segment() == fullVectors[0].segment() );
+    }
+
+    SECTION( "invalid measurements are only reported when decoded" ) {
+        parser.parseLine("#units feet");
+        parser.parseLine("A1 A2 10 20 95");
+        parser.parseLine("#units meters");
+        REQUIRE( vectors.size() == 1 );
+        CHECK( messages.isEmpty() );
+
+        Vector vector = vectors[0];
+        CHECK( !parser.decodeMeasurements(vector) );
+        CHECK( vector.hasRawMeasurements() );
+        REQUIRE( messages.size() == 1 );
+        CHECK( messages[0].severity() == "error" );
+        // the parser's own units are untouched
+        CHECK( parser.units().dUnit() == Length::Meters );
+    }
+
+    SECTION( "lines with only LRUDs are decoded right away" ) {
+        parser.parseLine("A1 *1 2 3 4*");
+        REQUIRE( vectors.size() == 1 );
+        CHECK( !vectors[0].hasRawMeasurements() );
+        CHECK( vectors[0].left() == UnitizedDouble<Length>(1, Length::Meters) );
+    }
+}
+
+TEST_CASE( "decoding topology mode vectors matches a full parse", "[dewalls][topology]" ) {
+    SrvGeneratorOptions options;
+    options.lineCount = 10000;
+    options.mode = SrvGeneratorOptions::Mixed;
+    options.unitSuffixRatio = 0.2;
+    options.backsightRatio = 0.2;
+    options.unitsRatio = 0.05;
+    options.macros = true;
+    QStringList lines = SrvGenerator(options).generateLines();
+
+    QVector<Vector> full = parse(lines, false);
+    QVector<Vector> topology = parse(lines, true);
+    REQUIRE( topology.size() == full.size() );
+
+    QList<WallsMessage> messages;
+    CHECK( WallsSurveyParser::decodeMeasurements(topology, &messages) == 0 );
+    for (int i = 0; i < full.size(); i++)
+    {
+        CHECK( !topology[i].hasRawMeasurements() );
+        CHECK( describe(topology[i]).toStdString() == describe(full[i]).toStdString() );
+    }
+}
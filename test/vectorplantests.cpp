@@ -0,0 +1,49 @@
+#include "catch.hpp"
+#include "../src/wallssurveyparser.h"
+
+using namespace dewalls;
+
+typedef UnitizedDouble<Length> ULength;
+typedef UnitizedDouble<Angle> UAngle;
+
+TEST_CASE( "vector lines follow units changes", "[dewalls]" ) {
+    WallsSurveyParser parser;
+    parser.setErrorRecovery(true);
+    QList<Vector> vectors;
+    QObject::connect(&parser, &WallsSurveyParser::parsedVector, [&](Vector v) { vectors << v; });
+
+    parser.parseLine("A1 A2 10 20 30 *1 2 3 4*");
+    parser.parseLine("#units order=avd lrud=from:durl");
+    parser.parseLine("A2 A3 20 30 10 *1 2 3 4*");
+    parser.parseLine("#units save rect order=nue");
+    parser.parseLine("A3 A4 1 2 3");
+    // the failed line must not leave its order in effect
+    parser.parseLine("#units order=eun v=foo");
+    parser.parseLine("A4 A5 1 2 3");
+    parser.parseLine("#units restore");
+    parser.parseLine("A5 A6 20 30 10");
+
+    REQUIRE( vectors.size() == 5 );
+
+    CHECK( vectors[0].distance() == ULength(10, Length::Meters) );
+    CHECK( vectors[0].frontAzimuth() == UAngle(20, Angle::Degrees) );
+    CHECK( vectors[0].left() == ULength(1, Length::Meters) );
+    CHECK( vectors[0].down() == ULength(4, Length::Meters) );
+
+    CHECK( vectors[1].frontAzimuth() == UAngle(20, Angle::Degrees) );
+    CHECK( vectors[1].frontInclination() == UAngle(30, Angle::Degrees) );
+    CHECK( vectors[1].distance() == ULength(10, Length::Meters) );
+    CHECK( vectors[1].down() == ULength(1, Length::Meters) );
+    CHECK( vectors[1].up() == ULength(2, Length::Meters) );
+    CHECK( vectors[1].right() == ULength(3, Length::Meters) );
+    CHECK( vectors[1].left() == ULength(4, Length::Meters) );
+
+    CHECK( vectors[2].north() == ULength(1, Length::Meters) );
+    CHECK( vectors[2].rectUp() == ULength(2, Length::Meters) );
+    CHECK( vectors[2].east() == ULength(3, Length::Meters) );
+    CHECK( vectors[3].north() == ULength(1, Length::Meters) );
+    CHECK( vectors[3].east() == ULength(3, Length::Meters) );
+
+    CHECK( vectors[4].frontAzimuth() == UAngle(20, Angle::Degrees) );
+    CHECK( vectors[4].distance() == ULength(10, Length::Meters) );
+}
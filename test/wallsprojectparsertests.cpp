@@ -2,6 +2,7 @@
 
 //#include "tostrings.h"
 #include "../src/wallsprojectparser.h"
+#include "../src/wallssurveyparser.h"
 
 using namespace dewalls;
 
@@ -147,3 +148,76 @@ TEST_CASE( "WallsProjectParser handles paths correctly", "[WallsProjectParser, .
     CHECK( "/hdir" == absolutePath(entryAt(root, "a/h")) );
     CHECK( QString() == absolutePath(entryAt(root, "a/i")) );
 }
+
+TEST_CASE( "WallsSurveyParser can be set up from a project entry", "[WallsProjectParser]" ) {
+    WpjBookPtr book(new WpjBook(WpjBookPtr(), "Book"));
+    book->Name = Segment("BOOK");
+    book->Status = WpjEntry::NameDefinesSegmentBit | WpjEntry::DeriveDeclBit;
+    book->Options = Segment("feet");
+    book->Reference = GeoReferencePtr(new GeoReference);
+    book->Reference->latitude = UAngle(20.85, Angle::Degrees);
+    book->Reference->longitude = UAngle(-88.69, Angle::Degrees);
+
+    WpjEntryPtr survey(new WpjEntry(book, "Survey"));
+    survey->Name = Segment("SURVEY");
+    survey->Status = WpjEntry::NameDefinesSegmentBit;
+    survey->Options = Segment("decl=2");
+    book->Children << survey;
+
+    WallsSurveyParser parser;
+    parser.setProjectEntry(survey);
+
+    CHECK( parser.segment() == (QStringList() << "BOOK" << "SURVEY") );
+    CHECK( parser.rootSegment() == (QStringList() << "BOOK" << "SURVEY") );
+    CHECK( parser.units().dUnit() == Length::Feet );
+    CHECK( parser.units().decl() == UAngle(2, Angle::Degrees) );
+
+    CHECK( !parser.derivedDecl().isValid() );
+    parser.parseLine("#date 2021-03-04");
+    CHECK( parser.derivedDecl().isValid() );
+}
+
+TEST_CASE( "flattened project entries match the tree accessors", "[WallsProjectParser]" ) {
+    WallsProjectParser parser;
+    WpjBookPtr root = parser.parseFile(":/test/Kaua North Maze.wpj");
+    REQUIRE( !root.isNull() );
+
+    const QVector<WpjFlatEntry>& entries = parser.flatResult();
+    REQUIRE( !entries.isEmpty() );
+    CHECK( entries[0].Entry == root );
+    CHECK( entries[0].ParentIndex == -1 );
+
+    int surveys = 0;
+    for (int i = 0; i < entries.size(); i++) {
+        const WpjFlatEntry& flat = entries[i];
+        WpjEntryPtr entry = flat.Entry;
+        INFO( entry->Title.toStdString() );
+        if (i > 0) {
+            REQUIRE( flat.ParentIndex >= 0 );
+            REQUIRE( flat.ParentIndex < i );
+            CHECK( entries[flat.ParentIndex].Entry == WpjEntryPtr(entry->Parent.toStrongRef()) );
+            CHECK( flat.Depth == entries[flat.ParentIndex].Depth + 1 );
+        }
+        CHECK( flat.Dir == entry->dir().path() );
+        CHECK( flat.AbsolutePath == entry->absolutePath() );
+        CHECK( flat.SegmentPath == entry->segment() );
+        CHECK( flat.Options.size() == entry->allOptions().size() );
+        CHECK( flat.Reference == entry->reference() );
+        CHECK( flat.IsBook == entry->isBook() );
+        CHECK( flat.IsSurvey == entry->isSurvey() );
+        CHECK( flat.IsOther == entry->isOther() );
+        CHECK( flat.NameDefinesSegment == entry->nameDefinesSegment() );
+        CHECK( flat.ReviewUnits == entry->reviewUnits() );
+        CHECK( flat.DeriveDeclFromDate == entry->deriveDeclFromDate() );
+        CHECK( flat.GridRelative == entry->gridRelative() );
+        CHECK( flat.PreserveVertShotOrientation == entry->preserveVertShotOrientation() );
+        CHECK( flat.PreserveVertShotLength == entry->preserveVertShotLength() );
+        CHECK( flat.LaunchOptions == entry->launchOptions() );
+        CHECK( flat.DefaultViewAfterCompilation == entry->defaultViewAfterCompilation() );
+        if (flat.IsSurvey) {
+            surveys++;
+        }
+    }
+    CHECK( surveys > 0 );
+    CHECK( WallsProjectParser::flatten(WpjBookPtr()).isEmpty() );
+}